@@ -0,0 +1,459 @@
+#include "analysis/corpus.h"
+
+#include "output/json-writer.h"
+
+#include <algorithm>
+#include <utility>
+#include <cstring>
+
+namespace soren {
+
+static
+unsigned get_length_bucket(std::uint64_t length)
+{
+	unsigned result = 0;
+
+	while (length > 1 && result + 1 < CORPUS_LENGTH_BUCKET_COUNT)
+	{
+		length >>= 1;
+		result++;
+	}
+
+	return result;
+}
+
+static
+bool fits_bits(std::int32_t value, unsigned bits)
+{
+	const auto rbits = 32 - bits;
+	return ((value << rbits) >> rbits) == value;
+}
+
+void CorpusStats::add_cmb(const CmbInfo& cmb, GameKind game)
+{
+	fileCnt++;
+
+	if (game == GameKind::FE9)
+		fe9FileCnt++;
+	else
+		fe10FileCnt++;
+
+	for (auto& scene : cmb.scenes)
+	{
+		if (scene.rawScript.empty())
+			continue; // failed to decode
+
+		sceneCnt++;
+		insCnt += scene.rawScript.size();
+
+		const std::uint64_t length = scene.rawScript.size();
+
+		lengthBuckets[get_length_bucket(length)]++;
+		minLength = std::min(minLength, length);
+		maxLength = std::max(maxLength, length);
+
+		// n-grams don't cross scene boundaries
+		unsigned prev1 = CORPUS_OPCODE_COUNT, prev2 = CORPUS_OPCODE_COUNT;
+
+		for (auto& ins : scene.rawScript)
+		{
+			const unsigned op = ins.opcode;
+
+			opcodes[op]++;
+
+			if (prev1 != CORPUS_OPCODE_COUNT)
+				bigrams[prev1 * CORPUS_OPCODE_COUNT + op]++;
+
+			if (prev2 != CORPUS_OPCODE_COUNT)
+				trigrams[(prev2 << 16) | (prev1 << 8) | op]++;
+
+			prev2 = prev1;
+			prev1 = op;
+
+			const auto operandSize = ins.info().operandSize;
+
+			// jumps are excluded: their operand was made absolute
+			if ((operandSize == 2 || operandSize == 4) && !ins.is_jump())
+			{
+				auto& width = operandWidths[op];
+
+				width.count++;
+
+				if (fits_bits(ins.operand, 8))
+					width.fits8++;
+
+				if (fits_bits(ins.operand, 16))
+					width.fits16++;
+			}
+
+			if (op == BC_OPCODE_CALLEXT)
+			{
+				const char* name = cmb.try_get_cstr(static_cast<std::uint32_t>(ins.operand) >> 8);
+				callextNames[name ? name : "<bad string>"]++;
+			}
+		}
+	}
+}
+
+void CorpusStats::merge(const CorpusStats& other)
+{
+	fileCnt       += other.fileCnt;
+	failedFileCnt += other.failedFileCnt;
+	fe9FileCnt    += other.fe9FileCnt;
+	fe10FileCnt   += other.fe10FileCnt;
+
+	sceneCnt += other.sceneCnt;
+	insCnt   += other.insCnt;
+
+	for (unsigned i = 0; i < CORPUS_OPCODE_COUNT; ++i)
+	{
+		opcodes[i] += other.opcodes[i];
+
+		operandWidths[i].count  += other.operandWidths[i].count;
+		operandWidths[i].fits8  += other.operandWidths[i].fits8;
+		operandWidths[i].fits16 += other.operandWidths[i].fits16;
+	}
+
+	for (unsigned i = 0; i < bigrams.size(); ++i)
+		bigrams[i] += other.bigrams[i];
+
+	for (auto& trigram : other.trigrams)
+		trigrams[trigram.first] += trigram.second;
+
+	for (auto& name : other.callextNames)
+		callextNames[name.first] += name.second;
+
+	for (unsigned i = 0; i < CORPUS_LENGTH_BUCKET_COUNT; ++i)
+		lengthBuckets[i] += other.lengthBuckets[i];
+
+	minLength = std::min(minLength, other.minLength);
+	maxLength = std::max(maxLength, other.maxLength);
+}
+
+// "val8", "val16", ... for mnemonics shared between operand widths, the mnemonic otherwise
+static
+std::string get_opcode_label(unsigned opcode)
+{
+	const auto& info = gBcOpcodeInfo[opcode];
+
+	auto sameMnemonic = [&] (unsigned other)
+	{
+		return other < BC_OPCODE_COUNT && std::strcmp(gBcOpcodeInfo[other].mnemonic, info.mnemonic) == 0;
+	};
+
+	std::string result(info.mnemonic);
+
+	if ((opcode > 0 && sameMnemonic(opcode - 1)) || sameMnemonic(opcode + 1))
+		result.append(std::to_string(info.operandSize * 8));
+
+	return result;
+}
+
+template<typename Key>
+static
+std::vector<std::pair<Key, std::uint64_t>> get_top(const std::unordered_map<Key, std::uint64_t>& map, unsigned top)
+{
+	std::vector<std::pair<Key, std::uint64_t>> result(map.begin(), map.end());
+
+	// most frequent first, ties by key so that output is stable
+	std::sort(result.begin(), result.end(), [] (auto& a, auto& b)
+	{
+		return a.second != b.second ? a.second > b.second : a.first < b.first;
+	});
+
+	if (top != 0 && result.size() > top)
+		result.resize(top);
+
+	return result;
+}
+
+static
+std::vector<std::pair<std::uint32_t, std::uint64_t>> get_top_bigrams(const CorpusStats& stats, unsigned top)
+{
+	std::unordered_map<std::uint32_t, std::uint64_t> map;
+
+	for (unsigned i = 0; i < stats.bigrams.size(); ++i)
+	{
+		if (stats.bigrams[i] != 0)
+			map[((i / CORPUS_OPCODE_COUNT) << 8) | (i % CORPUS_OPCODE_COUNT)] = stats.bigrams[i];
+	}
+
+	return get_top(map, top);
+}
+
+// "a>b>c"
+static
+std::string get_ngram_label(std::uint32_t key, unsigned n)
+{
+	std::string result;
+
+	for (unsigned i = n; i-- > 0;)
+	{
+		result.append(get_opcode_label((key >> (8*i)) & 0xFF));
+
+		if (i != 0)
+			result.push_back('>');
+	}
+
+	return result;
+}
+
+static
+void write_csv_field(std::ostream& os, const std::string& str)
+{
+	// quoted only if needed
+	if (str.find_first_of(",\"\n") == std::string::npos)
+	{
+		os << str;
+		return;
+	}
+
+	os << '"';
+
+	for (auto c : str)
+	{
+		if (c == '"')
+			os << '"';
+
+		os << c;
+	}
+
+	os << '"';
+}
+
+static
+void write_csv_row(std::ostream& os, const char* section, const std::string& key, std::uint64_t value)
+{
+	os << section << ',';
+	write_csv_field(os, key);
+	os << ',' << value << '\n';
+}
+
+/*
+ * CSV layout: one "section,key,value" row per datum
+ *
+ * summary,<files|failedFiles|fe9Files|fe10Files|scenes|instructions|minLength|maxLength>,n
+ * opcode,<label>,n
+ * bigram,<label>><label>,n
+ * trigram,<label>><label>><label>,n
+ * width,<label>,n / width,<label>/fits8,n / width,<label>/fits16,n
+ * callext,<name>,n
+ * length,<from>-<to>,n (instruction count range, inclusive)
+ */
+
+static
+void write_corpus_csv(std::ostream& os, const CorpusStats& stats, unsigned top)
+{
+	os << "section,key,value\n";
+
+	write_csv_row(os, "summary", "files", stats.fileCnt);
+	write_csv_row(os, "summary", "failedFiles", stats.failedFileCnt);
+	write_csv_row(os, "summary", "fe9Files", stats.fe9FileCnt);
+	write_csv_row(os, "summary", "fe10Files", stats.fe10FileCnt);
+	write_csv_row(os, "summary", "scenes", stats.sceneCnt);
+	write_csv_row(os, "summary", "instructions", stats.insCnt);
+	write_csv_row(os, "summary", "minLength", stats.sceneCnt ? stats.minLength : 0);
+	write_csv_row(os, "summary", "maxLength", stats.maxLength);
+
+	for (unsigned i = 0; i < CORPUS_OPCODE_COUNT; ++i)
+	{
+		if (stats.opcodes[i] != 0)
+			write_csv_row(os, "opcode", get_opcode_label(i), stats.opcodes[i]);
+	}
+
+	for (auto& bigram : get_top_bigrams(stats, top))
+		write_csv_row(os, "bigram", get_ngram_label(bigram.first, 2), bigram.second);
+
+	for (auto& trigram : get_top(stats.trigrams, top))
+		write_csv_row(os, "trigram", get_ngram_label(trigram.first, 3), trigram.second);
+
+	for (unsigned i = 0; i < CORPUS_OPCODE_COUNT; ++i)
+	{
+		auto& width = stats.operandWidths[i];
+
+		if (width.count == 0)
+			continue;
+
+		const auto label = get_opcode_label(i);
+
+		write_csv_row(os, "width", label, width.count);
+		write_csv_row(os, "width", label + "/fits8", width.fits8);
+
+		if (gBcOpcodeInfo[i].operandSize > 2)
+			write_csv_row(os, "width", label + "/fits16", width.fits16);
+	}
+
+	for (auto& name : get_top(stats.callextNames, top))
+		write_csv_row(os, "callext", name.first, name.second);
+
+	for (unsigned i = 0; i < CORPUS_LENGTH_BUCKET_COUNT; ++i)
+	{
+		if (stats.lengthBuckets[i] == 0)
+			continue;
+
+		const std::uint64_t from = (i == 0) ? 0 : (1ull << i);
+		const std::uint64_t to = (2ull << i) - 1;
+
+		write_csv_row(os, "length", std::to_string(from) + "-" + std::to_string(to), stats.lengthBuckets[i]);
+	}
+}
+
+/*
+ * JSON layout:
+ *
+ * {
+ *   "files": n, "failedFiles": n, "fe9Files": n, "fe10Files": n, "scenes": n, "instructions": n,
+ *   "opcodes": [ { "opcode": 25, "label": "number8", "count": n }, ... ],
+ *   "bigrams": [ { "opcodes": [ a, b ], "label": "ref8>number8", "count": n }, ... ],
+ *   "trigrams": [ { "opcodes": [ a, b, c ], "label": "...", "count": n }, ... ],
+ *   "operandWidths": [ { "opcode": 26, "label": "number16", "count": n, "fits8": n, "fits16": n }, ... ],
+ *   "callext": [ { "name": "...", "count": n }, ... ],
+ *   "scriptLengths": { "min": n, "max": n, "mean": x, "buckets": [ { "from": 0, "to": 1, "count": n }, ... ] }
+ * }
+ */
+
+static
+void write_ngram_json(JsonWriter& json, std::uint32_t key, unsigned n, std::uint64_t count)
+{
+	json.begin_object();
+
+	json.key("opcodes");
+	json.begin_array();
+
+	for (unsigned i = n; i-- > 0;)
+		json.value(static_cast<std::uint32_t>((key >> (8*i)) & 0xFF));
+
+	json.end_array();
+
+	json.field("label", get_ngram_label(key, n));
+	json.field("count", count);
+	json.end_object();
+}
+
+static
+void write_corpus_json(std::ostream& os, const CorpusStats& stats, unsigned top)
+{
+	JsonWriter json(os);
+
+	json.begin_object();
+
+	json.field("files", stats.fileCnt);
+	json.field("failedFiles", stats.failedFileCnt);
+	json.field("fe9Files", stats.fe9FileCnt);
+	json.field("fe10Files", stats.fe10FileCnt);
+	json.field("scenes", stats.sceneCnt);
+	json.field("instructions", stats.insCnt);
+
+	json.key("opcodes");
+	json.begin_array();
+
+	for (unsigned i = 0; i < CORPUS_OPCODE_COUNT; ++i)
+	{
+		if (stats.opcodes[i] == 0)
+			continue;
+
+		json.begin_object();
+		json.field("opcode", static_cast<std::uint32_t>(i));
+		json.field("label", get_opcode_label(i));
+		json.field("count", stats.opcodes[i]);
+		json.end_object();
+	}
+
+	json.end_array();
+
+	json.key("bigrams");
+	json.begin_array();
+
+	for (auto& bigram : get_top_bigrams(stats, top))
+		write_ngram_json(json, bigram.first, 2, bigram.second);
+
+	json.end_array();
+
+	json.key("trigrams");
+	json.begin_array();
+
+	for (auto& trigram : get_top(stats.trigrams, top))
+		write_ngram_json(json, trigram.first, 3, trigram.second);
+
+	json.end_array();
+
+	json.key("operandWidths");
+	json.begin_array();
+
+	for (unsigned i = 0; i < CORPUS_OPCODE_COUNT; ++i)
+	{
+		auto& width = stats.operandWidths[i];
+
+		if (width.count == 0)
+			continue;
+
+		json.begin_object();
+		json.field("opcode", static_cast<std::uint32_t>(i));
+		json.field("label", get_opcode_label(i));
+		json.field("count", width.count);
+		json.field("fits8", width.fits8);
+		json.field("fits16", width.fits16);
+		json.end_object();
+	}
+
+	json.end_array();
+
+	json.key("callext");
+	json.begin_array();
+
+	for (auto& name : get_top(stats.callextNames, top))
+	{
+		json.begin_object();
+		json.field("name", name.first);
+		json.field("count", name.second);
+		json.end_object();
+	}
+
+	json.end_array();
+
+	json.key("scriptLengths");
+	json.begin_object();
+
+	json.field("min", stats.sceneCnt ? stats.minLength : 0);
+	json.field("max", stats.maxLength);
+	json.field("mean", stats.sceneCnt ? double(stats.insCnt) / stats.sceneCnt : 0.0);
+
+	json.key("buckets");
+	json.begin_array();
+
+	for (unsigned i = 0; i < CORPUS_LENGTH_BUCKET_COUNT; ++i)
+	{
+		if (stats.lengthBuckets[i] == 0)
+			continue;
+
+		json.begin_object();
+		json.field("from", (i == 0) ? std::uint64_t(0) : (std::uint64_t(1) << i));
+		json.field("to", (std::uint64_t(2) << i) - 1);
+		json.field("count", stats.lengthBuckets[i]);
+		json.end_object();
+	}
+
+	json.end_array();
+	json.end_object();
+
+	json.end_object();
+	json.newline();
+}
+
+void write_corpus_stats(std::ostream& os, const CorpusStats& stats, CorpusFormat format, unsigned top)
+{
+	switch (format)
+	{
+
+	case CorpusFormat::Csv:
+		write_corpus_csv(os, stats, top);
+		break;
+
+	case CorpusFormat::Json:
+		write_corpus_json(os, stats, top);
+		break;
+
+	} // switch (format)
+}
+
+} // namespace soren
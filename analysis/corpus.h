@@ -0,0 +1,68 @@
+#ifndef SOREN_ANALYSIS_CORPUS_INCLUDED
+#define SOREN_ANALYSIS_CORPUS_INCLUDED
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "core/soren-bytecode.h"
+#include "core/soren-cmb.h"
+
+namespace soren {
+
+// Bytecode statistics over many files (soren stats-corpus)
+// Each worker gathers into its own CorpusStats, those get merged once every worker is done
+
+enum
+{
+	CORPUS_OPCODE_COUNT = BC_OPCODE_FE10_COUNT,
+	CORPUS_LENGTH_BUCKET_COUNT = 32, // bucket i holds scripts of [2^i, 2^(i+1)) instructions (bucket 0 also holds empty ones)
+};
+
+struct OperandWidthStats
+{
+	std::uint64_t count { 0u };
+	std::uint64_t fits8 { 0u };  // value would round-trip through an 8-bit operand
+	std::uint64_t fits16 { 0u }; // value would round-trip through a 16-bit operand
+};
+
+struct CorpusStats
+{
+	void add_cmb(const CmbInfo& cmb, GameKind game);
+	void merge(const CorpusStats& other);
+
+	std::uint64_t fileCnt { 0u };
+	std::uint64_t failedFileCnt { 0u };
+	std::uint64_t fe9FileCnt { 0u };
+	std::uint64_t fe10FileCnt { 0u };
+
+	std::uint64_t sceneCnt { 0u };
+	std::uint64_t insCnt { 0u };
+
+	std::uint64_t opcodes[CORPUS_OPCODE_COUNT] {};
+	std::vector<std::uint64_t> bigrams = std::vector<std::uint64_t>(CORPUS_OPCODE_COUNT * CORPUS_OPCODE_COUNT); // [a * COUNT + b]
+	std::unordered_map<std::uint32_t, std::uint64_t> trigrams; // key is a << 16 | b << 8 | c
+
+	OperandWidthStats operandWidths[CORPUS_OPCODE_COUNT]; // only for opcodes with 16/32-bit operands
+
+	std::unordered_map<std::string, std::uint64_t> callextNames;
+
+	std::uint64_t lengthBuckets[CORPUS_LENGTH_BUCKET_COUNT] {};
+	std::uint64_t minLength { UINT64_MAX };
+	std::uint64_t maxLength { 0u };
+};
+
+enum class CorpusFormat
+{
+	Csv,
+	Json,
+};
+
+// top limits how many n-grams and callext names are written (most frequent first), 0 means all
+void write_corpus_stats(std::ostream& os, const CorpusStats& stats, CorpusFormat format, unsigned top);
+
+} // namespace soren
+
+#endif // SOREN_ANALYSIS_CORPUS_INCLUDED
@@ -0,0 +1,577 @@
+#include "analysis/diff.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <set>
+#include <iomanip>
+
+namespace soren {
+
+static constexpr std::uint64_t FNV_OFFSET = 0xCBF29CE484222325ull;
+static constexpr std::uint64_t FNV_PRIME  = 0x100000001B3ull;
+
+static
+std::uint64_t hash_string(const char* str)
+{
+	std::uint64_t result = FNV_OFFSET;
+
+	for (; *str; ++str)
+		result = (result ^ static_cast<unsigned char>(*str)) * FNV_PRIME;
+
+	return result;
+}
+
+static inline
+std::uint64_t hash_step(std::uint64_t hash, std::uint64_t value)
+{
+	// polynomial rolling hash, the multiplier is odd so nothing is lost mod 2^64
+	return hash * 0x9E3779B97F4A7C15ull + value + 1;
+}
+
+static
+std::uint8_t fold_opcode(std::uint8_t opcode)
+{
+	switch (opcode)
+	{
+
+	case BC_OPCODE_NUMBER16:
+	case BC_OPCODE_NUMBER32:
+		return BC_OPCODE_NUMBER8;
+
+	case BC_OPCODE_STRING16:
+	case BC_OPCODE_STRING32:
+		return BC_OPCODE_STRING8;
+
+	default:
+		return opcode;
+
+	} // switch (opcode)
+}
+
+bool operator == (const NormalizedIns& a, const NormalizedIns& b)
+{
+	return a.kind == b.kind && a.key == b.key;
+}
+
+bool operator != (const NormalizedIns& a, const NormalizedIns& b)
+{
+	return !(a == b);
+}
+
+std::vector<NormalizedIns> normalize_script(const CmbInfo& cmb, const SceneInfo& scene)
+{
+	std::vector<NormalizedIns> result;
+	result.reserve(scene.rawScript.size());
+
+	for (auto& ins : scene.rawScript)
+	{
+		NormalizedIns norm { ins.location, ins.opcode, fold_opcode(ins.opcode), static_cast<std::uint32_t>(ins.operand), nullptr };
+
+		switch (ins.opcode)
+		{
+
+		case BC_OPCODE_STRING8:
+		case BC_OPCODE_STRING16:
+		case BC_OPCODE_STRING32:
+			norm.str = cmb.try_get_cstr(ins.operand);
+
+			if (norm.str)
+				norm.key = hash_string(norm.str);
+
+			break;
+
+		case BC_OPCODE_CALLEXT:
+			norm.str = cmb.try_get_cstr(static_cast<std::uint32_t>(ins.operand) >> 8);
+
+			if (norm.str)
+				norm.key = hash_step(hash_string(norm.str), ins.operand & 0xFF);
+
+			break;
+
+		case BC_OPCODE_B:
+		case BC_OPCODE_BY:
+		case BC_OPCODE_BKY:
+		case BC_OPCODE_BN:
+		case BC_OPCODE_BKN:
+		{
+			// target instruction index (rawScript is sorted by location)
+			const auto it = std::lower_bound(scene.rawScript.begin(), scene.rawScript.end(), ins.operand, [] (const BcIns& ins, std::int32_t location)
+			{
+				return static_cast<std::int32_t>(ins.location) < location;
+			});
+
+			norm.key = it - scene.rawScript.begin();
+			break;
+		}
+
+		default:
+			break;
+
+		} // switch (ins.opcode)
+
+		result.push_back(norm);
+	}
+
+	return result;
+}
+
+std::uint64_t fingerprint_scene(const SceneInfo& scene, Span<const NormalizedIns> script)
+{
+	std::uint64_t result = FNV_OFFSET;
+
+	result = hash_step(result, scene.kind);
+	result = hash_step(result, scene.argCnt);
+	result = hash_step(result, scene.varnames.size());
+
+	// global scenes are known by name, so renaming one is a change
+	if (scene.isGlobal)
+		result = hash_step(result, hash_string(scene.name.c_str()));
+
+	for (auto param : scene.parameters)
+		result = hash_step(result, static_cast<std::uint32_t>(param));
+
+	for (auto& ins : script)
+		result = hash_step(hash_step(result, ins.kind), ins.key);
+
+	return result;
+}
+
+std::vector<InsEdit> diff_instructions(Span<const NormalizedIns> a, Span<const NormalizedIns> b)
+{
+	const int n = a.size(), m = b.size();
+
+	// trace[d] holds the furthest x reached on diagonals [-d-1, d+1] before step d (index k + d + 1)
+	std::vector<std::vector<int>> trace;
+
+	std::vector<int> v(2 * (n + m) + 3, 0);
+	const int offset = n + m + 1;
+
+	int finalD = 0;
+
+	for (int d = 0; d <= n + m; ++d)
+	{
+		trace.emplace_back(v.begin() + offset - d - 1, v.begin() + offset + d + 2);
+
+		bool done = false;
+
+		for (int k = -d; k <= d; k += 2)
+		{
+			int x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]))
+				? v[offset + k + 1]
+				: v[offset + k - 1] + 1;
+
+			int y = x - k;
+
+			while (x < n && y < m && a[x] == b[y])
+				x++, y++;
+
+			v[offset + k] = x;
+
+			if (x >= n && y >= m)
+			{
+				done = true;
+				break;
+			}
+		}
+
+		if (done)
+		{
+			finalD = d;
+			break;
+		}
+	}
+
+	// backtrack
+
+	std::vector<InsEdit> result;
+
+	int x = n, y = m;
+
+	for (int d = finalD; d >= 0; --d)
+	{
+		const auto& tv = trace[d];
+		auto at = [&] (int k) { return tv[k + d + 1]; };
+
+		const int k = x - y;
+
+		const int prevK = (d == 0)
+			? 0
+			: (k == -d || (k != d && at(k - 1) < at(k + 1))) ? k + 1 : k - 1;
+
+		const int prevX = (d == 0) ? 0 : at(prevK);
+		const int prevY = prevX - prevK;
+
+		while (x > prevX && y > prevY)
+		{
+			x--, y--;
+			result.push_back({ EditKind::Keep, unsigned(x), unsigned(y) });
+		}
+
+		if (d == 0)
+			break;
+
+		if (x == prevX)
+			result.push_back({ EditKind::Add, unsigned(x), unsigned(--y) });
+		else
+			result.push_back({ EditKind::Remove, unsigned(--x), unsigned(y) });
+	}
+
+	std::reverse(result.begin(), result.end());
+	return result;
+}
+
+bool CmbDiff::identical() const
+{
+	return removedStrings.empty() && addedStrings.empty() && std::all_of(scenes.begin(), scenes.end(), [] (auto& scene)
+	{
+		return scene.change == SceneChange::Unchanged;
+	});
+}
+
+static
+void collect_strings(const CmbInfo& cmb, std::set<std::string>& result)
+{
+	for (auto& scene : cmb.scenes)
+	{
+		for (auto& ins : scene.rawScript)
+		{
+			if (ins.opcode != BC_OPCODE_STRING8 && ins.opcode != BC_OPCODE_STRING16 && ins.opcode != BC_OPCODE_STRING32)
+				continue;
+
+			if (const char* str = cmb.try_get_cstr(ins.operand))
+				result.insert(str);
+		}
+	}
+}
+
+CmbDiff diff_cmb(const CmbInfo& a, const CmbInfo& b)
+{
+	CmbDiff result;
+
+	std::vector<std::uint64_t> hashA(a.scenes.size()), hashB(b.scenes.size());
+
+	for (unsigned i = 0; i < a.scenes.size(); ++i)
+		hashA[i] = fingerprint_scene(a.scenes[i], normalize_script(a, a.scenes[i]));
+
+	for (unsigned i = 0; i < b.scenes.size(); ++i)
+		hashB[i] = fingerprint_scene(b.scenes[i], normalize_script(b, b.scenes[i]));
+
+	std::vector<int> matchA(a.scenes.size(), -1), matchB(b.scenes.size(), -1);
+	std::vector<SceneChange> changeA(a.scenes.size(), SceneChange::Removed);
+
+	// 1. identical scenes, preferring the same index
+
+	std::unordered_map<std::uint64_t, std::vector<int>> byHash;
+
+	for (unsigned i = b.scenes.size(); i-- > 0;)
+		byHash[hashB[i]].push_back(i); // reverse order, so that popping from the back gives the lowest index
+
+	for (unsigned i = 0; i < a.scenes.size(); ++i)
+	{
+		if (i < b.scenes.size() && hashB[i] == hashA[i] && matchB[i] < 0)
+		{
+			matchA[i] = i, matchB[i] = i;
+			changeA[i] = SceneChange::Unchanged;
+		}
+	}
+
+	for (unsigned i = 0; i < a.scenes.size(); ++i)
+	{
+		if (matchA[i] >= 0)
+			continue;
+
+		auto it = byHash.find(hashA[i]);
+
+		if (it == byHash.end())
+			continue;
+
+		auto& candidates = it->second;
+
+		while (!candidates.empty() && matchB[candidates.back()] >= 0)
+			candidates.pop_back();
+
+		if (candidates.empty())
+			continue;
+
+		const int j = candidates.back();
+		candidates.pop_back();
+
+		matchA[i] = j, matchB[j] = i;
+		changeA[i] = SceneChange::Moved;
+	}
+
+	// 2. global scenes by name
+
+	std::unordered_map<std::string, int> byName;
+
+	for (unsigned j = 0; j < b.scenes.size(); ++j)
+	{
+		if (matchB[j] < 0 && b.scenes[j].isGlobal)
+			byName.emplace(b.scenes[j].name, j);
+	}
+
+	for (unsigned i = 0; i < a.scenes.size(); ++i)
+	{
+		if (matchA[i] >= 0 || !a.scenes[i].isGlobal)
+			continue;
+
+		auto it = byName.find(a.scenes[i].name);
+
+		if (it == byName.end() || matchB[it->second] >= 0)
+			continue;
+
+		matchA[i] = it->second, matchB[it->second] = i;
+		changeA[i] = SceneChange::Changed;
+	}
+
+	// 3. anonymous scenes in order, between the scenes matched so far
+
+	int anchor = -1; // new index of the last matched scene
+
+	for (unsigned i = 0; i < a.scenes.size(); ++i)
+	{
+		if (matchA[i] >= 0)
+		{
+			anchor = std::max(anchor, matchA[i]);
+			continue;
+		}
+
+		if (a.scenes[i].isGlobal)
+			continue;
+
+		unsigned j = anchor + 1;
+
+		while (j < b.scenes.size() && matchB[j] < 0 && b.scenes[j].isGlobal)
+			j++;
+
+		if (j >= b.scenes.size() || matchB[j] >= 0)
+			continue; // nothing left before the next matched scene
+
+		matchA[i] = j, matchB[j] = i;
+		changeA[i] = SceneChange::Changed;
+
+		anchor = j;
+	}
+
+	for (unsigned i = 0; i < a.scenes.size(); ++i)
+		result.scenes.push_back({ changeA[i], int(i), matchA[i] });
+
+	for (unsigned j = 0; j < b.scenes.size(); ++j)
+	{
+		if (matchB[j] < 0)
+			result.scenes.push_back({ SceneChange::Added, -1, int(j) });
+	}
+
+	// string literals
+
+	std::set<std::string> stringsA, stringsB;
+
+	collect_strings(a, stringsA);
+	collect_strings(b, stringsB);
+
+	std::set_difference(stringsA.begin(), stringsA.end(), stringsB.begin(), stringsB.end(), std::back_inserter(result.removedStrings));
+	std::set_difference(stringsB.begin(), stringsB.end(), stringsA.begin(), stringsA.end(), std::back_inserter(result.addedStrings));
+
+	return result;
+}
+
+static
+void write_quoted(std::ostream& os, const char* str)
+{
+	os << '"';
+
+	for (; *str; ++str)
+	{
+		if (*str == '"' || *str == '\\')
+			os << '\\';
+
+		os << *str;
+	}
+
+	os << '"';
+}
+
+static
+void write_normalized_ins(std::ostream& os, const NormalizedIns& ins, Span<const NormalizedIns> script)
+{
+	const auto& info = gBcOpcodeInfo[ins.opcode];
+
+	os << std::hex << std::setw(4) << std::setfill('0') << ins.location << std::dec << std::setfill(' ') << " " << info.mnemonic;
+
+	switch (ins.opcode)
+	{
+
+	case BC_OPCODE_STRING8:
+	case BC_OPCODE_STRING16:
+	case BC_OPCODE_STRING32:
+	case BC_OPCODE_CALLEXT:
+		os << " ";
+
+		if (ins.str)
+			write_quoted(os, ins.str);
+		else
+			os << "<bad string>";
+
+		break;
+
+	case BC_OPCODE_B:
+	case BC_OPCODE_BY:
+	case BC_OPCODE_BKY:
+	case BC_OPCODE_BN:
+	case BC_OPCODE_BKN:
+		os << " -> ";
+
+		if (ins.key < script.size())
+			os << std::hex << std::setw(4) << std::setfill('0') << script[ins.key].location << std::dec << std::setfill(' ');
+		else
+			os << "end";
+
+		break;
+
+	default:
+		if (info.operandSize > 0)
+			os << " " << static_cast<std::int32_t>(ins.key);
+
+		break;
+
+	} // switch (ins.opcode)
+}
+
+static
+void write_scene_name(std::ostream& os, const SceneInfo& scene)
+{
+	os << "scene " << scene.idx << " (" << scene.name << ")";
+}
+
+/*
+ * Output layout:
+ *
+ * changed scene 4 (EV_Foo) -> scene 4 (EV_Foo)
+ *   @@ -12 +12
+ *   - 0012 string "hello"
+ *   + 0012 string "hallo"
+ * moved scene 3 (Unknown_3) -> scene 5 (Unknown_5)
+ * removed scene 2 (Unknown_2)
+ * added scene 7 (Unknown_7)
+ * strings:
+ *   - "hello"
+ *   + "hallo"
+ * 10 unchanged, 1 moved, 1 changed, 1 removed, 1 added
+ */
+
+void write_cmb_diff(std::ostream& os, const CmbInfo& a, const CmbInfo& b, const CmbDiff& diff)
+{
+	unsigned counts[5] {};
+
+	for (auto& scene : diff.scenes)
+	{
+		counts[static_cast<int>(scene.change)]++;
+
+		switch (scene.change)
+		{
+
+		case SceneChange::Unchanged:
+			break;
+
+		case SceneChange::Moved:
+			os << "moved ";
+			write_scene_name(os, a.scenes[scene.oldIdx]);
+			os << " -> ";
+			write_scene_name(os, b.scenes[scene.newIdx]);
+			os << std::endl;
+			break;
+
+		case SceneChange::Removed:
+			os << "removed ";
+			write_scene_name(os, a.scenes[scene.oldIdx]);
+			os << std::endl;
+			break;
+
+		case SceneChange::Added:
+			os << "added ";
+			write_scene_name(os, b.scenes[scene.newIdx]);
+			os << std::endl;
+			break;
+
+		case SceneChange::Changed:
+		{
+			os << "changed ";
+			write_scene_name(os, a.scenes[scene.oldIdx]);
+			os << " -> ";
+			write_scene_name(os, b.scenes[scene.newIdx]);
+			os << std::endl;
+
+			const auto& sceneA = a.scenes[scene.oldIdx];
+			const auto& sceneB = b.scenes[scene.newIdx];
+
+			if (sceneA.kind != sceneB.kind || sceneA.argCnt != sceneB.argCnt || sceneA.varnames.size() != sceneB.varnames.size() || sceneA.parameters != sceneB.parameters)
+				os << "  signature differs" << std::endl;
+
+			const auto scriptA = normalize_script(a, sceneA);
+			const auto scriptB = normalize_script(b, sceneB);
+
+			const auto edits = diff_instructions(scriptA, scriptB);
+
+			bool inHunk = false;
+
+			for (auto& edit : edits)
+			{
+				if (edit.kind == EditKind::Keep)
+				{
+					inHunk = false;
+					continue;
+				}
+
+				if (!inHunk)
+				{
+					os << "  @@ -" << edit.oldIdx << " +" << edit.newIdx << std::endl;
+					inHunk = true;
+				}
+
+				if (edit.kind == EditKind::Remove)
+				{
+					os << "  - ";
+					write_normalized_ins(os, scriptA[edit.oldIdx], scriptA);
+				}
+				else
+				{
+					os << "  + ";
+					write_normalized_ins(os, scriptB[edit.newIdx], scriptB);
+				}
+
+				os << std::endl;
+			}
+
+			break;
+		}
+
+		} // switch (scene.change)
+	}
+
+	if (!diff.removedStrings.empty() || !diff.addedStrings.empty())
+	{
+		os << "strings:" << std::endl;
+
+		for (auto& str : diff.removedStrings)
+		{
+			os << "  - ";
+			write_quoted(os, str.c_str());
+			os << std::endl;
+		}
+
+		for (auto& str : diff.addedStrings)
+		{
+			os << "  + ";
+			write_quoted(os, str.c_str());
+			os << std::endl;
+		}
+	}
+
+	os << counts[static_cast<int>(SceneChange::Unchanged)] << " unchanged, "
+		<< counts[static_cast<int>(SceneChange::Moved)] << " moved, "
+		<< counts[static_cast<int>(SceneChange::Changed)] << " changed, "
+		<< counts[static_cast<int>(SceneChange::Removed)] << " removed, "
+		<< counts[static_cast<int>(SceneChange::Added)] << " added" << std::endl;
+}
+
+} // namespace soren
@@ -0,0 +1,86 @@
+#ifndef SOREN_ANALYSIS_DIFF_INCLUDED
+#define SOREN_ANALYSIS_DIFF_INCLUDED
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "core/types.h"
+#include "core/soren-cmb.h"
+
+namespace soren {
+
+// Structural comparison of two CMBs (soren diff)
+
+// Instruction made independent of the file layout:
+// string and callext operands are replaced by a hash of what they reference,
+// jump targets by instruction indices and number/string operand widths are folded
+struct NormalizedIns
+{
+	unsigned location;
+	std::uint8_t opcode;
+	std::uint8_t kind; // opcode with width variants folded, compared for equality
+	std::uint64_t key; // normalized operand, compared for equality
+	const char* str; // referenced string (string and callext only, nullptr if bad)
+};
+
+bool operator == (const NormalizedIns& a, const NormalizedIns& b);
+bool operator != (const NormalizedIns& a, const NormalizedIns& b);
+
+std::vector<NormalizedIns> normalize_script(const CmbInfo& cmb, const SceneInfo& scene);
+
+// Rolling hash over the normalized script (and scene signature), equal fingerprints mean equal scenes
+std::uint64_t fingerprint_scene(const SceneInfo& scene, Span<const NormalizedIns> script);
+
+enum class SceneChange
+{
+	Unchanged, // same fingerprint, same index
+	Moved,     // same fingerprint, different index
+	Changed,   // matched by name (or order), different fingerprint
+	Added,
+	Removed,
+};
+
+struct SceneDiff
+{
+	SceneChange change;
+	int oldIdx; // -1 when added
+	int newIdx; // -1 when removed
+};
+
+enum class EditKind
+{
+	Keep,
+	Remove,
+	Add,
+};
+
+struct InsEdit
+{
+	EditKind kind;
+	unsigned oldIdx;
+	unsigned newIdx;
+};
+
+// Myers' O(ND) diff, the result is in script order
+std::vector<InsEdit> diff_instructions(Span<const NormalizedIns> a, Span<const NormalizedIns> b);
+
+struct CmbDiff
+{
+	std::vector<SceneDiff> scenes; // in order of old index, then added scenes in order of new index
+	std::vector<std::string> removedStrings; // string literals only referenced by the old file
+	std::vector<std::string> addedStrings;   // string literals only referenced by the new file
+
+	bool identical() const;
+};
+
+// Aligns scenes by fingerprint, then by name (global scenes) or order (others), in linear time
+CmbDiff diff_cmb(const CmbInfo& a, const CmbInfo& b);
+
+// Instruction level differences are only computed (and written) for changed scenes
+void write_cmb_diff(std::ostream& os, const CmbInfo& a, const CmbInfo& b, const CmbDiff& diff);
+
+} // namespace soren
+
+#endif // SOREN_ANALYSIS_DIFF_INCLUDED
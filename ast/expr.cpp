@@ -0,0 +1,40 @@
+#include "ast/expr.h"
+#include "ast/traverse.h"
+
+namespace soren {
+
+Expr::~Expr()
+{
+	// Subtrees are detached onto a worklist first, so that every node is destroyed with no children left
+	// The worklist is per thread and kept (as walk stacks are), nodes destroyed from it don't use it themselves
+
+	if (children.empty())
+		return;
+
+	static thread_local std::vector<std::unique_ptr<Expr>> pending;
+	const auto base = pending.size();
+
+	for (auto& child : children)
+		pending.push_back(std::move(child));
+
+	while (pending.size() > base)
+	{
+		std::unique_ptr<Expr> node = std::move(pending.back());
+		pending.pop_back();
+
+		if (!node)
+			continue; // moved from
+
+		for (auto& child : node->children)
+			pending.push_back(std::move(child));
+
+		node->children.clear();
+	}
+}
+
+std::unique_ptr<Expr> Expr::make_unique_copy(const Expr& expr)
+{
+	return copy_expr(expr, [] () { return true; });
+}
+
+} // namespace soren
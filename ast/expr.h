@@ -1,7 +1,10 @@
 #ifndef SOREN_AST_EXPR_INCLUDED
 #define SOREN_AST_EXPR_INCLUDED
 
+#include <cstdint>
+
 #include <vector>
+#include <string>
 #include <memory>
 
 namespace soren {
@@ -63,6 +66,12 @@ struct Expr
 
 	std::vector<std::unique_ptr<Expr>> children;
 
+	Expr() = default;
+	Expr(Expr&&) = default;
+	Expr& operator = (Expr&&) = default;
+
+	~Expr();
+
 	static inline
 	std::unique_ptr<Expr> make_unique_intlit(std::int32_t value)
 	{
@@ -113,26 +122,16 @@ struct Expr
 		std::unique_ptr<Expr> result = std::make_unique<Expr>();
 
 		result->kind = kind;
+		result->children.reserve(2);
 		result->children.push_back(std::move(lexpr));
 		result->children.push_back(std::move(rexpr));
 
 		return result;
 	}
 
-	static inline
-	std::unique_ptr<Expr> make_unique_copy(const Expr& expr)
-	{
-		std::unique_ptr<Expr> result = std::make_unique<Expr>();
-
-		result->kind = expr.kind;
-		result->literal = expr.literal;
-		result->named = expr.named;
-
-		for (auto& child : expr.children)
-			result->children.push_back(make_unique_copy(*child));
-
-		return result;
-	}
+	// Deep copy (see ast/traverse.h, neither this nor destruction recurse)
+	static
+	std::unique_ptr<Expr> make_unique_copy(const Expr& expr);
 };
 
 } // namespace soren
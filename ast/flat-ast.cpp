@@ -0,0 +1,220 @@
+#include "ast/flat-ast.h"
+#include "ast/traverse.h"
+
+#include <cstring>
+#include <algorithm>
+
+namespace soren {
+
+constexpr SymbolTable::id_type SymbolTable::bad_id;
+
+SymbolTable::id_type SymbolTable::intern(const char* str, std::size_t len)
+{
+	return intern(str, len, hash_string(str, len));
+}
+
+SymbolTable::id_type SymbolTable::intern(const PoolString& str)
+{
+	if (str.id >= mPoolSymbols.size())
+		mPoolSymbols.resize(str.id + 1, { 0u, bad_id });
+
+	auto& slot = mPoolSymbols[str.id];
+
+	if (slot.first != mGeneration)
+		slot = { mGeneration, intern(str.str, str.length, str.hash) };
+
+	return slot.second;
+}
+
+SymbolTable::id_type SymbolTable::intern(const char* str, std::size_t len, std::uint32_t hash)
+{
+	if (2 * (mEntries.size() + 1) > mBuckets.size())
+		rehash(mBuckets.empty() ? 64 : 2 * mBuckets.size());
+
+	const auto mask = mBuckets.size() - 1;
+
+	for (auto bucket = hash & mask;; bucket = (bucket + 1) & mask)
+	{
+		const auto id = mBuckets[bucket];
+
+		if (id == bad_id)
+		{
+			mBuckets[bucket] = mEntries.size();
+			mEntries.push_back({ static_cast<std::uint32_t>(mChars.size()), static_cast<std::uint32_t>(len), hash });
+
+			mChars.insert(mChars.end(), str, str + len);
+			mChars.push_back(0);
+
+			return mEntries.size() - 1;
+		}
+
+		auto& entry = mEntries[id];
+
+		if (entry.hash == hash && entry.length == len && std::memcmp(mChars.data() + entry.offset, str, len) == 0)
+			return id;
+	}
+}
+
+void SymbolTable::clear()
+{
+	mChars.clear();
+	mEntries.clear();
+	std::fill(mBuckets.begin(), mBuckets.end(), bad_id);
+
+	if (++mGeneration == 0)
+	{
+		std::fill(mPoolSymbols.begin(), mPoolSymbols.end(), std::make_pair(0u, bad_id));
+		mGeneration = 1;
+	}
+}
+
+void SymbolTable::rehash(std::size_t bucketCnt)
+{
+	mBuckets.assign(bucketCnt, bad_id);
+
+	const auto mask = bucketCnt - 1;
+
+	for (id_type id = 0; id < mEntries.size(); ++id)
+	{
+		auto bucket = mEntries[id].hash & mask;
+
+		while (mBuckets[bucket] != bad_id)
+			bucket = (bucket + 1) & mask;
+
+		mBuckets[bucket] = id;
+	}
+}
+
+FlatAst::index_type FlatAst::append_expr(const Expr& expr)
+{
+	// children first, then their indices (contiguous) and finally the node itself
+	// indices of nodes appended but not yet linked to their parent wait on a stack
+
+	static thread_local std::vector<index_type> pending;
+	const auto base = pending.size();
+
+	for_each_postorder(TreeNodes {}, expr, [&] (const Expr& node)
+	{
+		index_type idx;
+
+		switch (node.kind)
+		{
+
+		case Expr::Kind::IntLiteral:
+			idx = add_leaf(node.kind, node.literal, SymbolTable::bad_id);
+			break;
+
+		case Expr::Kind::StrLiteral:
+		case Expr::Kind::Named:
+			idx = add_leaf(node.kind, 0, symbols.intern(node.named));
+			break;
+
+		default:
+		{
+			const auto childCnt = node.children.size();
+
+			const index_type firstChild = links.size();
+			links.insert(links.end(), pending.end() - childCnt, pending.end());
+			pending.resize(pending.size() - childCnt);
+
+			const auto symbol = (node.kind == Expr::Kind::Func)
+				? symbols.intern(node.named)
+				: SymbolTable::bad_id;
+
+			idx = add_node_linked(node.kind, symbol, firstChild, childCnt);
+			break;
+		}
+
+		} // switch (node.kind)
+
+		pending.push_back(idx);
+	});
+
+	const auto result = pending.back();
+	pending.resize(base);
+
+	return result;
+}
+
+FlatAst::index_type FlatAst::append_stmt(const Stmt& stmt)
+{
+	std::vector<index_type> children;
+	children.reserve(stmt.children.size());
+
+	for (auto& child : stmt.children)
+		children.push_back(append_expr(*child));
+
+	const index_type firstChild = links.size();
+	links.insert(links.end(), children.begin(), children.end());
+
+	const auto label = stmt.label.empty()
+		? SymbolTable::bad_id
+		: symbols.intern(stmt.label);
+
+	return add_statement(stmt.kind, label, firstChild, children.size());
+}
+
+std::unique_ptr<Expr> FlatAst::make_expr(index_type idx) const
+{
+	// same as Expr::make_unique_copy, from flat nodes
+
+	struct Builder
+	{
+		bool enter(const FlatExpr& flat, const FlatExpr*, unsigned)
+		{
+			auto node = std::make_unique<Expr>();
+
+			node->kind = flat.kind;
+			node->literal = flat.literal;
+
+			if (flat.symbol != SymbolTable::bad_id)
+				node->named.assign(ast.symbols.c_str(flat.symbol), ast.symbols.length(flat.symbol));
+
+			node->children.reserve(flat.childCnt);
+
+			Expr* raw = node.get();
+
+			if (path.size() == base)
+				result = std::move(node);
+			else
+				path.back()->children.push_back(std::move(node));
+
+			path.push_back(raw);
+			return true;
+		}
+
+		void between(const FlatExpr&, unsigned) {}
+		void leave(const FlatExpr&, const FlatExpr*, unsigned) { path.pop_back(); }
+
+		const FlatAst& ast;
+
+		std::vector<Expr*>& path;
+		const std::size_t base;
+
+		std::unique_ptr<Expr> result;
+	};
+
+	static thread_local std::vector<Expr*> path;
+
+	Builder builder { *this, path, path.size(), nullptr };
+	walk_expr(FlatNodes { *this }, exprs[idx], builder);
+
+	return std::move(builder.result);
+}
+
+Stmt FlatAst::make_stmt(index_type idx) const
+{
+	auto& flat = statements[idx];
+
+	Stmt result { flat.kind, {}, {} };
+
+	if (flat.label != SymbolTable::bad_id)
+		result.label.assign(symbols.c_str(flat.label), symbols.length(flat.label));
+
+	for (unsigned i = 0; i < flat.childCnt; ++i)
+		result.children.push_back(make_expr(links[flat.firstChild + i]));
+
+	return result;
+}
+
+} // namespace soren
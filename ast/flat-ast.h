@@ -0,0 +1,148 @@
+#ifndef SOREN_AST_FLAT_AST_INCLUDED
+#define SOREN_AST_FLAT_AST_INCLUDED
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <limits>
+
+#include "core/string-pool.h"
+
+#include "ast/expr.h"
+#include "ast/stmt.h"
+
+namespace soren {
+
+// Interned names, stored back to back (NUL-terminated) in a single buffer
+// Clearing keeps all storage around, so that a table can be reused without allocating
+
+struct SymbolTable
+{
+	using id_type = std::uint32_t;
+
+	static constexpr id_type bad_id = std::numeric_limits<id_type>::max();
+
+	id_type intern(const char* str, std::size_t len);
+	id_type intern(const char* str) { return intern(str, std::char_traits<char>::length(str)); }
+	id_type intern(const std::string& str) { return intern(str.data(), str.size()); }
+
+	// Same, for a string of an indexed pool: each pool string is only looked up the first time it is interned (since the
+	// table was last cleared), after that its pool id maps straight to its symbol
+	// Pool strings interned between two clears must all come from the same pool
+	id_type intern(const PoolString& str);
+
+	const char* c_str(id_type id) const { return mChars.data() + mEntries[id].offset; }
+	std::size_t length(id_type id) const { return mEntries[id].length; }
+
+	std::size_t size() const { return mEntries.size(); }
+
+	void clear();
+
+private:
+	struct Entry
+	{
+		std::uint32_t offset;
+		std::uint32_t length;
+		std::uint32_t hash;
+	};
+
+	id_type intern(const char* str, std::size_t len, std::uint32_t hash);
+
+	void rehash(std::size_t bucketCnt);
+
+	std::vector<char> mChars;
+	std::vector<Entry> mEntries;
+	std::vector<id_type> mBuckets; // open addressing, bad_id marks empty buckets
+
+	// by pool id: the generation it was interned in (slots of older ones are stale) and its symbol
+	std::vector<std::pair<std::uint32_t, id_type>> mPoolSymbols;
+	std::uint32_t mGeneration { 1u }; // bumped by clear
+};
+
+// Fixed-size nodes, children are referenced by index into FlatAst::links
+// Nodes are only ever appended, so children always come before their parents
+// Nodes are immutable once appended, which allows them to be shared (dup/deref don't copy)
+
+struct FlatExpr
+{
+	Expr::Kind kind;
+	std::uint32_t childCnt;
+	std::uint32_t firstChild; // index into links
+	std::int32_t literal; // IntLiteral
+	SymbolTable::id_type symbol; // StrLiteral/Named/Func
+};
+
+struct FlatStmt
+{
+	Stmt::Kind kind;
+	SymbolTable::id_type label;
+	std::uint32_t childCnt;
+	std::uint32_t firstChild; // index into links
+};
+
+struct FlatAst
+{
+	using index_type = std::uint32_t;
+
+	std::vector<FlatStmt> statements;
+	std::vector<FlatExpr> exprs;
+	std::vector<index_type> links; // expr indices
+	SymbolTable symbols;
+
+	index_type add_leaf(Expr::Kind kind, std::int32_t literal, SymbolTable::id_type symbol)
+	{
+		exprs.push_back({ kind, 0, 0, literal, symbol });
+		return exprs.size() - 1;
+	}
+
+	template<typename... Children>
+	index_type add_node(Expr::Kind kind, SymbolTable::id_type symbol, Children... children)
+	{
+		const index_type firstChild = links.size();
+		const index_type indices[] { children... };
+
+		links.insert(links.end(), std::begin(indices), std::end(indices));
+		exprs.push_back({ kind, sizeof...(children), firstChild, 0, symbol });
+
+		return exprs.size() - 1;
+	}
+
+	// children are expected to have been appended to links beforehand, starting at firstChild
+	index_type add_node_linked(Expr::Kind kind, SymbolTable::id_type symbol, std::uint32_t firstChild, std::uint32_t childCnt)
+	{
+		exprs.push_back({ kind, childCnt, firstChild, 0, symbol });
+		return exprs.size() - 1;
+	}
+
+	index_type add_statement(Stmt::Kind kind, SymbolTable::id_type label, std::uint32_t firstChild, std::uint32_t childCnt)
+	{
+		statements.push_back({ kind, label, childCnt, firstChild });
+		return statements.size() - 1;
+	}
+
+	const FlatExpr& child(const FlatExpr& expr, unsigned i) const { return exprs[links[expr.firstChild + i]]; }
+	const FlatExpr& child(const FlatStmt& stmt, unsigned i) const { return exprs[links[stmt.firstChild + i]]; }
+
+	const char* name(const FlatExpr& expr) const { return symbols.c_str(expr.symbol); }
+
+	void clear()
+	{
+		statements.clear();
+		exprs.clear();
+		links.clear();
+		symbols.clear();
+	}
+
+	// conversion from and to the pointer-based ast
+
+	index_type append_expr(const Expr& expr);
+	index_type append_stmt(const Stmt& stmt);
+
+	std::unique_ptr<Expr> make_expr(index_type idx) const;
+	Stmt make_stmt(index_type idx) const;
+};
+
+} // namespace soren
+
+#endif // SOREN_AST_FLAT_AST_INCLUDED
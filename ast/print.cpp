@@ -0,0 +1,383 @@
+#include "ast/print.h"
+#include "ast/traverse.h"
+
+namespace soren {
+
+static
+const char* get_binop_token(Expr::Kind kind)
+{
+	switch (kind)
+	{
+
+	case Expr::Kind::Add:        return " + ";
+	case Expr::Kind::Sub:        return " - ";
+	case Expr::Kind::Mul:        return " * ";
+	case Expr::Kind::Div:        return " / ";
+	case Expr::Kind::Mod:        return " % ";
+	case Expr::Kind::And:        return " & ";
+	case Expr::Kind::Or:         return " | ";
+	case Expr::Kind::Xor:        return " ^ ";
+	case Expr::Kind::Lsl:        return " << ";
+	case Expr::Kind::Lsr:        return " >> ";
+	case Expr::Kind::Eq:         return " == ";
+	case Expr::Kind::Ne:         return " != ";
+	case Expr::Kind::Lt:         return " <? ";
+	case Expr::Kind::Le:         return " <= ";
+	case Expr::Kind::Gt:         return " >? ";
+	case Expr::Kind::Ge:         return " >=? ";
+	case Expr::Kind::EqStr:      return " <=> ";
+	case Expr::Kind::NeStr:      return " <!> ";
+	case Expr::Kind::LogicalAnd: return " && ";
+	case Expr::Kind::LogicalOr:  return " || ";
+
+	default:
+		return nullptr;
+
+	} // switch (kind)
+}
+
+static
+const char* get_unop_token(Expr::Kind kind)
+{
+	switch (kind)
+	{
+
+	case Expr::Kind::Not:        return "!";
+	case Expr::Kind::Neg:        return "-";
+	case Expr::Kind::BitwiseNot: return "~";
+	case Expr::Kind::Addrof:     return "&";
+
+	default:
+		return nullptr;
+
+	} // switch (kind)
+}
+
+unsigned get_precedence(Expr::Kind kind)
+{
+	switch (kind)
+	{
+
+	case Expr::Kind::Assign:     return EXPR_PRECEDENCE_ASSIGN;
+	case Expr::Kind::LogicalOr:  return 2;
+	case Expr::Kind::LogicalAnd: return 3;
+	case Expr::Kind::Or:         return 4;
+	case Expr::Kind::Xor:        return 5;
+	case Expr::Kind::And:        return 6;
+
+	case Expr::Kind::Eq:
+	case Expr::Kind::Ne:
+	case Expr::Kind::EqStr:
+	case Expr::Kind::NeStr:
+		return 7;
+
+	case Expr::Kind::Lt:
+	case Expr::Kind::Le:
+	case Expr::Kind::Gt:
+	case Expr::Kind::Ge:
+		return 8;
+
+	case Expr::Kind::Lsl:
+	case Expr::Kind::Lsr:
+		return 9;
+
+	case Expr::Kind::Add:
+	case Expr::Kind::Sub:
+		return 10;
+
+	case Expr::Kind::Mul:
+	case Expr::Kind::Div:
+	case Expr::Kind::Mod:
+		return 11;
+
+	case Expr::Kind::Neg:
+	case Expr::Kind::Not:
+	case Expr::Kind::BitwiseNot:
+	case Expr::Kind::Addrof:
+		return EXPR_PRECEDENCE_UNARY;
+
+	default:
+		return EXPR_PRECEDENCE_PRIMARY;
+
+	} // switch (kind)
+}
+
+// Prints an expression as a walk_expr visitor, each node parenthesized if it binds looser than its place in its parent
+template<typename Nodes>
+struct ExprPrinter
+{
+	using node_type = typename Nodes::node_type;
+
+	// Precedence child idx of parent must have (at least) to be printed without parentheses
+	static
+	unsigned get_operand_precedence(const node_type& parent, unsigned idx, const node_type& child)
+	{
+		if (get_binop_token(parent.kind))
+			return get_precedence(parent.kind) + (idx == 0 ? 0 : 1);
+
+		// -(5) so that it isn't read back as the literal -5
+		if (parent.kind == Expr::Kind::Neg && child.kind == Expr::Kind::IntLiteral)
+			return EXPR_PRECEDENCE_PRIMARY + 1;
+
+		if (get_unop_token(parent.kind))
+			return EXPR_PRECEDENCE_UNARY;
+
+		return 0; // [], [] = and call arguments are delimited already
+	}
+
+	static
+	bool needs_parentheses(const node_type& expr, const node_type* parent, unsigned idx)
+	{
+		return parent && get_precedence(expr.kind) < get_operand_precedence(*parent, idx, expr);
+	}
+
+	bool enter(const node_type& expr, const node_type* parent, unsigned idx)
+	{
+		if (needs_parentheses(expr, parent, idx))
+			os << "(";
+
+		switch (expr.kind)
+		{
+
+		case Expr::Kind::IntLiteral:
+			os << std::dec << expr.literal;
+			return false;
+
+		case Expr::Kind::StrLiteral:
+			os << "\"" << nodes.name(expr) << "\"";
+			return false;
+
+		case Expr::Kind::Named:
+			os << nodes.name(expr);
+			return false;
+
+		case Expr::Kind::Deref:
+		case Expr::Kind::Assign:
+			os << "[";
+			return true;
+
+		case Expr::Kind::Func:
+			os << nodes.name(expr) << "(";
+			return true;
+
+		default:
+			if (get_binop_token(expr.kind))
+				return true;
+
+			if (auto token = get_unop_token(expr.kind))
+			{
+				os << token;
+				return true;
+			}
+
+			os << "<expr>";
+			return false;
+
+		} // switch (expr.kind)
+	}
+
+	void between(const node_type& expr, unsigned idx)
+	{
+		if (idx == 0)
+			return;
+
+		if (expr.kind == Expr::Kind::Assign)
+			os << "] = ";
+		else if (expr.kind == Expr::Kind::Func)
+			os << ", ";
+		else if (auto token = get_binop_token(expr.kind))
+			os << token;
+	}
+
+	void leave(const node_type& expr, const node_type* parent, unsigned idx)
+	{
+		if (expr.kind == Expr::Kind::Deref)
+			os << "]";
+		else if (expr.kind == Expr::Kind::Func)
+			os << ")";
+
+		if (needs_parentheses(expr, parent, idx))
+			os << ")";
+	}
+
+	std::ostream& os;
+	const Nodes& nodes;
+};
+
+template<typename Nodes>
+static
+std::ostream& print_expr(std::ostream& os, const Nodes& nodes, const typename Nodes::node_type& expr)
+{
+	ExprPrinter<Nodes> printer { os, nodes };
+	walk_expr(nodes, expr, printer);
+
+	return os;
+}
+
+template<typename Nodes, typename StmtNode>
+static
+std::ostream& print_stmt(std::ostream& os, const Nodes& nodes, const StmtNode& stmt)
+{
+	switch (stmt.kind)
+	{
+
+	case Stmt::Kind::Invalid:
+		return os << "<invalid statement>" << std::endl;
+
+	case Stmt::Kind::Push:
+		os << "push ";
+		print_expr(os, nodes, nodes.child(stmt, 0));
+		return os << ";";
+
+	case Stmt::Kind::Expr:
+		print_expr(os, nodes, nodes.child(stmt, 0));
+		return os << ";";
+
+	case Stmt::Kind::Return:
+		os << "return ";
+		print_expr(os, nodes, nodes.child(stmt, 0));
+		return os << ";";
+
+	case Stmt::Kind::Goto:
+		os << "goto ";
+		print_expr(os, nodes, nodes.child(stmt, 0));
+		return os << ";";
+
+	case Stmt::Kind::GotoIf:
+		os << "goto ";
+		print_expr(os, nodes, nodes.child(stmt, 0));
+		os << " if ";
+		print_expr(os, nodes, nodes.child(stmt, 1));
+		return os << ";";
+
+	case Stmt::Kind::Yield:
+		return os << "yield;";
+
+	case Stmt::Kind::If:
+		os << "if (";
+		print_expr(os, nodes, nodes.child(stmt, 0));
+		return os << ")";
+
+	case Stmt::Kind::Else:
+		return os << "else";
+
+	case Stmt::Kind::While:
+		os << "while (";
+		print_expr(os, nodes, nodes.child(stmt, 0));
+		return os << ")";
+
+	case Stmt::Kind::Break:
+		return os << "break;";
+
+	} // switch (stmt.kind)
+
+	return os;
+}
+
+std::ostream& operator << (std::ostream& os, const Expr& expr)
+{
+	return print_expr(os, TreeNodes {}, expr);
+}
+
+std::ostream& operator << (std::ostream& os, const Stmt& stmt)
+{
+	return print_stmt(os, TreeNodes {}, stmt);
+}
+
+std::ostream& print_block(std::ostream& os, const Ast& ast, unsigned depth)
+{
+	for (auto& stmt : ast)
+	{
+		if (!stmt.label.empty())
+			os << std::string(2*(depth-1), ' ') << stmt.label << ":" << std::endl;
+
+		const std::string indent(2*depth, ' ');
+
+		os << indent << stmt << std::endl;
+
+		if (stmt.childAst)
+		{
+			os << indent << "{" << std::endl;
+			print_block(os, *stmt.childAst, depth + 1);
+			os << indent << "}" << std::endl;
+		}
+	}
+
+	return os;
+}
+
+std::ostream& print_flat_expr(std::ostream& os, const FlatAst& ast, FlatAst::index_type idx)
+{
+	return print_expr(os, FlatNodes { ast }, ast.exprs[idx]);
+}
+
+std::ostream& print_flat_stmt(std::ostream& os, const FlatAst& ast, FlatAst::index_type idx)
+{
+	return print_stmt(os, FlatNodes { ast }, ast.statements[idx]);
+}
+
+const char* get_kind_name(Expr::Kind kind)
+{
+	switch (kind)
+	{
+
+	case Expr::Kind::Invalid:    return "invalid";
+	case Expr::Kind::IntLiteral: return "int";
+	case Expr::Kind::StrLiteral: return "str";
+	case Expr::Kind::Named:      return "named";
+	case Expr::Kind::Neg:        return "neg";
+	case Expr::Kind::Not:        return "not";
+	case Expr::Kind::BitwiseNot: return "mvn";
+	case Expr::Kind::Deref:      return "deref";
+	case Expr::Kind::Addrof:     return "addrof";
+	case Expr::Kind::Assign:     return "assign";
+	case Expr::Kind::Add:        return "add";
+	case Expr::Kind::Sub:        return "sub";
+	case Expr::Kind::Mul:        return "mul";
+	case Expr::Kind::Div:        return "div";
+	case Expr::Kind::Mod:        return "mod";
+	case Expr::Kind::Or:         return "orr";
+	case Expr::Kind::And:        return "and";
+	case Expr::Kind::Xor:        return "xor";
+	case Expr::Kind::Lsl:        return "lsl";
+	case Expr::Kind::Lsr:        return "lsr";
+	case Expr::Kind::Eq:         return "eq";
+	case Expr::Kind::Ne:         return "ne";
+	case Expr::Kind::Lt:         return "lt";
+	case Expr::Kind::Le:         return "le";
+	case Expr::Kind::Gt:         return "gt";
+	case Expr::Kind::Ge:         return "ge";
+	case Expr::Kind::EqStr:      return "eqstr";
+	case Expr::Kind::NeStr:      return "nestr";
+	case Expr::Kind::LogicalAnd: return "land";
+	case Expr::Kind::LogicalOr:  return "lorr";
+	case Expr::Kind::Func:       return "func";
+
+	} // switch (kind)
+
+	return "invalid";
+}
+
+const char* get_kind_name(Stmt::Kind kind)
+{
+	switch (kind)
+	{
+
+	case Stmt::Kind::Invalid: return "invalid";
+	case Stmt::Kind::Push:    return "push";
+	case Stmt::Kind::Expr:    return "expr";
+	case Stmt::Kind::Goto:    return "goto";
+	case Stmt::Kind::GotoIf:  return "gotoif";
+	case Stmt::Kind::Yield:   return "yield";
+	case Stmt::Kind::Return:  return "return";
+	case Stmt::Kind::If:      return "if";
+	case Stmt::Kind::Else:    return "else";
+	case Stmt::Kind::While:   return "while";
+	case Stmt::Kind::Break:   return "break";
+
+	} // switch (kind)
+
+	return "invalid";
+}
+
+} // namespace soren
@@ -0,0 +1,39 @@
+#ifndef SOREN_AST_PRINT_INCLUDED
+#define SOREN_AST_PRINT_INCLUDED
+
+#include <ostream>
+
+#include "ast/expr.h"
+#include "ast/stmt.h"
+#include "ast/flat-ast.h"
+
+namespace soren {
+
+std::ostream& operator << (std::ostream& os, const Expr& expr);
+std::ostream& operator << (std::ostream& os, const Stmt& stmt);
+
+// One statement per line, indented by depth, with nested bodies (and labels) of structured statements
+std::ostream& print_block(std::ostream& os, const Ast& ast, unsigned depth);
+
+// Same output as above, for nodes of a linearized ast
+std::ostream& print_flat_expr(std::ostream& os, const FlatAst& ast, FlatAst::index_type idx);
+std::ostream& print_flat_stmt(std::ostream& os, const FlatAst& ast, FlatAst::index_type idx);
+
+// Binding strength of an operator as printed (and parsed back by the compiler), higher binds tighter
+// Operands are parenthesized where needed, binary operators are left associative (but for assignment)
+enum
+{
+	EXPR_PRECEDENCE_ASSIGN = 1,
+	EXPR_PRECEDENCE_UNARY = 12,
+	EXPR_PRECEDENCE_PRIMARY = 13,
+};
+
+unsigned get_precedence(Expr::Kind kind);
+
+// Stable names for node kinds, used by structured output formats
+const char* get_kind_name(Expr::Kind kind);
+const char* get_kind_name(Stmt::Kind kind);
+
+} // namespace soren
+
+#endif // SOREN_AST_PRINT_INCLUDED
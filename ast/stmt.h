@@ -24,6 +24,12 @@ struct Stmt
 		GotoIf, // Two child exprs (first constant)
 		Yield, // No children
 		Return, // One child expr
+
+		// Structured control flow (see structure_scene), bodies are in childAst
+		If, // One child expr (condition)
+		Else, // No children, follows an If
+		While, // One child expr (condition)
+		Break, // No children
 	};
 
 	Kind kind { Kind::Invalid };
@@ -0,0 +1,222 @@
+#ifndef SOREN_AST_TRAVERSE_INCLUDED
+#define SOREN_AST_TRAVERSE_INCLUDED
+
+#include <vector>
+#include <memory>
+
+#include "ast/expr.h"
+#include "ast/stmt.h"
+#include "ast/flat-ast.h"
+
+namespace soren {
+
+// Expression tree traversal without recursion: depth is only bounded by memory, not by the call stack
+// (decompiled expressions can nest as deep as the script has pushes, left leaning chains of && and + especially)
+
+// Node accessors, so that the same traversal works for both ast representations
+
+struct TreeNodes
+{
+	using node_type = Expr;
+
+	const std::string& name(const Expr& expr) const { return expr.named; }
+	const Expr& child(const Expr& expr, unsigned i) const { return *expr.children[i]; }
+	const Expr& child(const Stmt& stmt, unsigned i) const { return *stmt.children[i]; }
+	unsigned child_count(const Expr& expr) const { return expr.children.size(); }
+};
+
+struct FlatNodes
+{
+	using node_type = FlatExpr;
+
+	const char* name(const FlatExpr& expr) const { return ast.name(expr); }
+	const FlatExpr& child(const FlatExpr& expr, unsigned i) const { return ast.child(expr, i); }
+	const FlatExpr& child(const FlatStmt& stmt, unsigned i) const { return ast.child(stmt, i); }
+	unsigned child_count(const FlatExpr& expr) const { return expr.childCnt; }
+
+	const FlatAst& ast;
+};
+
+/*
+ * walk_expr calls, for every node under (and including) root, in depth first order:
+ *
+ *   bool visitor.enter(node, parent, idx)  before its children (parent is null for root, idx is node's index in parent)
+ *                                           returning false skips the children (leave is still called)
+ *   void visitor.between(node, idx)        before each child idx
+ *   void visitor.leave(node, parent, idx)  after its children
+ *
+ * The explicit stack is per thread and kept between walks (so walks don't allocate once it has grown), visitors may
+ * start other walks from any of these.
+ */
+
+template<typename Node>
+struct WalkFrame
+{
+	const Node* node;
+	const Node* parent;
+	unsigned idx;
+	unsigned next; // next child to visit
+};
+
+template<typename Node>
+std::vector<WalkFrame<Node>>& get_walk_stack()
+{
+	static thread_local std::vector<WalkFrame<Node>> stack;
+	return stack;
+}
+
+template<typename Nodes, typename Visitor>
+void walk_expr(const Nodes& nodes, const typename Nodes::node_type& root, Visitor& visitor)
+{
+	using node_type = typename Nodes::node_type;
+
+	if (!visitor.enter(root, nullptr, 0))
+	{
+		visitor.leave(root, nullptr, 0);
+		return;
+	}
+
+	auto& stack = get_walk_stack<node_type>();
+
+	// frames below base belong to walks this one was started from
+	struct Unwind
+	{
+		~Unwind() { stack.resize(base); }
+
+		std::vector<WalkFrame<node_type>>& stack;
+		const std::size_t base;
+	} unwind { stack, stack.size() };
+
+	stack.push_back({ &root, nullptr, 0, 0 });
+
+	while (stack.size() > unwind.base)
+	{
+		auto& top = stack.back();
+		const node_type& node = *top.node;
+
+		if (top.next < nodes.child_count(node))
+		{
+			const unsigned i = top.next++;
+
+			visitor.between(node, i);
+
+			const node_type& child = nodes.child(node, i);
+
+			if (visitor.enter(child, &node, i))
+				stack.push_back({ &child, &node, i, 0 }); // top is invalidated from here on
+			else
+				visitor.leave(child, &node, i);
+
+			continue;
+		}
+
+		const auto frame = top;
+		stack.pop_back();
+
+		visitor.leave(*frame.node, frame.parent, frame.idx);
+	}
+}
+
+template<typename Visitor>
+void walk_expr(const Expr& root, Visitor& visitor)
+{
+	walk_expr(TreeNodes {}, root, visitor);
+}
+
+// fn(node) for every node, parents before their children
+template<typename Nodes, typename Fn>
+void for_each_preorder(const Nodes& nodes, const typename Nodes::node_type& root, Fn fn)
+{
+	using node_type = typename Nodes::node_type;
+
+	struct Visitor
+	{
+		bool enter(const node_type& node, const node_type*, unsigned) { fn(node); return true; }
+		void between(const node_type&, unsigned) {}
+		void leave(const node_type&, const node_type*, unsigned) {}
+
+		Fn& fn;
+	} visitor { fn };
+
+	walk_expr(nodes, root, visitor);
+}
+
+// fn(node) for every node, children before their parents
+template<typename Nodes, typename Fn>
+void for_each_postorder(const Nodes& nodes, const typename Nodes::node_type& root, Fn fn)
+{
+	using node_type = typename Nodes::node_type;
+
+	struct Visitor
+	{
+		bool enter(const node_type&, const node_type*, unsigned) { return true; }
+		void between(const node_type&, unsigned) {}
+		void leave(const node_type& node, const node_type*, unsigned) { fn(node); }
+
+		Fn& fn;
+	} visitor { fn };
+
+	walk_expr(nodes, root, visitor);
+}
+
+// Deep copy of root, calling tick() before copying each node (Expr::make_unique_copy copies without ticking)
+// Stops as soon as tick returns false: what was copied so far is freed and null is returned
+template<typename Tick>
+std::unique_ptr<Expr> copy_expr(const Expr& root, Tick tick)
+{
+	struct Copier
+	{
+		bool enter(const Expr& node, const Expr*, unsigned)
+		{
+			if (stopped || !tick())
+			{
+				// leave pops this one too
+				stopped = true;
+				path.push_back(nullptr);
+
+				return false;
+			}
+
+			auto copy = std::make_unique<Expr>();
+
+			copy->kind = node.kind;
+			copy->literal = node.literal;
+			copy->named = node.named;
+			copy->children.reserve(node.children.size());
+
+			Expr* raw = copy.get();
+
+			if (path.size() == base)
+				result = std::move(copy);
+			else
+				path.back()->children.push_back(std::move(copy));
+
+			path.push_back(raw);
+			return true;
+		}
+
+		void between(const Expr&, unsigned) {}
+		void leave(const Expr&, const Expr*, unsigned) { path.pop_back(); }
+
+		Tick& tick;
+		std::vector<Expr*>& path; // copies of the nodes being walked
+		const std::size_t base;
+
+		std::unique_ptr<Expr> result;
+		bool stopped;
+	};
+
+	static thread_local std::vector<Expr*> path;
+
+	Copier copier { tick, path, path.size(), nullptr, false };
+	walk_expr(root, copier);
+
+	if (copier.stopped)
+		return nullptr;
+
+	return std::move(copier.result);
+}
+
+} // namespace soren
+
+#endif // SOREN_AST_TRAVERSE_INCLUDED
@@ -0,0 +1,362 @@
+#include "capi/soren.h"
+
+#include <cstddef>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "core/diagnostics.h"
+#include "core/soren-bytecode.h"
+#include "core/soren-cmb.h"
+#include "decode/decode.h"
+#include "decode/detect.h"
+#include "decompile/decompile.h"
+#include "output/output.h"
+
+// The accessors hand out the library's own buffers, which only works as long as the C structs mirror their layout
+
+static_assert(sizeof(soren_ins) == sizeof(soren::BcIns), "soren_ins doesn't match BcIns");
+static_assert(offsetof(soren_ins, location) == offsetof(soren::BcIns, location), "soren_ins doesn't match BcIns");
+static_assert(offsetof(soren_ins, operand) == offsetof(soren::BcIns, operand), "soren_ins doesn't match BcIns");
+static_assert(offsetof(soren_ins, opcode) == offsetof(soren::BcIns, opcode), "soren_ins doesn't match BcIns");
+
+static_assert(sizeof(soren_expr) == sizeof(soren::FlatExpr), "soren_expr doesn't match FlatExpr");
+static_assert(offsetof(soren_expr, child_count) == offsetof(soren::FlatExpr, childCnt), "soren_expr doesn't match FlatExpr");
+static_assert(offsetof(soren_expr, first_child) == offsetof(soren::FlatExpr, firstChild), "soren_expr doesn't match FlatExpr");
+static_assert(offsetof(soren_expr, literal) == offsetof(soren::FlatExpr, literal), "soren_expr doesn't match FlatExpr");
+static_assert(offsetof(soren_expr, symbol) == offsetof(soren::FlatExpr, symbol), "soren_expr doesn't match FlatExpr");
+
+static_assert(sizeof(soren_stmt) == sizeof(soren::FlatStmt), "soren_stmt doesn't match FlatStmt");
+static_assert(offsetof(soren_stmt, label) == offsetof(soren::FlatStmt, label), "soren_stmt doesn't match FlatStmt");
+static_assert(offsetof(soren_stmt, child_count) == offsetof(soren::FlatStmt, childCnt), "soren_stmt doesn't match FlatStmt");
+static_assert(offsetof(soren_stmt, first_child) == offsetof(soren::FlatStmt, firstChild), "soren_stmt doesn't match FlatStmt");
+
+static_assert(sizeof(soren_slice) == sizeof(soren::FlatSlice), "soren_slice doesn't match FlatSlice");
+static_assert(offsetof(soren_slice, label) == offsetof(soren::FlatSlice, label), "soren_slice doesn't match FlatSlice");
+static_assert(offsetof(soren_slice, first_stmt) == offsetof(soren::FlatSlice, firstStmt), "soren_slice doesn't match FlatSlice");
+static_assert(offsetof(soren_slice, stmt_count) == offsetof(soren::FlatSlice, stmtCnt), "soren_slice doesn't match FlatSlice");
+
+static_assert(sizeof(soren::Expr::Kind) == sizeof(int32_t) && sizeof(soren::Stmt::Kind) == sizeof(int32_t), "kinds aren't 32-bit");
+static_assert(sizeof(int) == sizeof(int32_t), "scene parameters aren't 32-bit");
+
+static_assert(SOREN_NO_SYMBOL == soren::SymbolTable::bad_id, "SOREN_NO_SYMBOL doesn't match SymbolTable::bad_id");
+
+static_assert(int(soren::Expr::Kind::IntLiteral) == SOREN_EXPR_INT_LITERAL, "soren_expr_kind doesn't match Expr::Kind");
+static_assert(int(soren::Expr::Kind::Addrof) == SOREN_EXPR_ADDROF, "soren_expr_kind doesn't match Expr::Kind");
+static_assert(int(soren::Expr::Kind::Assign) == SOREN_EXPR_ASSIGN, "soren_expr_kind doesn't match Expr::Kind");
+static_assert(int(soren::Expr::Kind::NeStr) == SOREN_EXPR_NE_STR, "soren_expr_kind doesn't match Expr::Kind");
+static_assert(int(soren::Expr::Kind::Func) == SOREN_EXPR_FUNC, "soren_expr_kind doesn't match Expr::Kind");
+static_assert(int(soren::Stmt::Kind::Return) == SOREN_STMT_RETURN, "soren_stmt_kind doesn't match Stmt::Kind");
+
+static_assert(int(soren::GameKind::FE9) == SOREN_GAME_FE9 && int(soren::GameKind::FE10) == SOREN_GAME_FE10, "soren_game doesn't match GameKind");
+
+struct soren_cmb
+{
+	soren::CmbInfo cmb;
+	soren::GameKind game { soren::GameKind::FE10 };
+	soren::Diagnostics diags;
+	std::vector<soren::byte_type> data;
+};
+
+struct soren_ast
+{
+	soren::FlatSceneAst ast;
+	soren::Diagnostics diags;
+
+	// what was last decompiled, for rendering
+	const soren_cmb* cmb { nullptr };
+	const soren::SceneInfo* scene { nullptr };
+
+	std::ostringstream text;
+	std::string textStr;
+};
+
+namespace soren {
+
+// Runs fn, turning exceptions into status codes (nothing may unwind into C)
+template<typename Fn>
+static
+soren_status guard(Fn&& fn) noexcept
+{
+	try
+	{
+		return fn();
+	}
+	catch (const std::bad_alloc&)
+	{
+		return SOREN_ERROR_NO_MEMORY;
+	}
+	catch (...)
+	{
+		return SOREN_ERROR_INTERNAL;
+	}
+}
+
+static
+void fill_diagnostic(const Diagnostic& diag, soren_diagnostic& out)
+{
+	out.kind = static_cast<int32_t>(diag.kind);
+	out.offset = diag.offset;
+	out.scene = diag.scene;
+	out.message = get_error_message(diag.kind);
+}
+
+static
+soren_status decode_data(soren_cmb& handle, int32_t game)
+{
+	handle.game = game == SOREN_GAME_AUTO
+		? detect_game(handle.data).game
+		: static_cast<GameKind>(game);
+
+	return try_decode_cmb(handle.data, handle.game, handle.cmb, handle.diags)
+		? SOREN_OK
+		: SOREN_ERROR_DECODE;
+}
+
+static
+bool valid_game(int32_t game)
+{
+	return game == SOREN_GAME_AUTO || game == SOREN_GAME_FE9 || game == SOREN_GAME_FE10;
+}
+
+} // namespace soren
+
+using namespace soren;
+
+extern "C" {
+
+uint32_t soren_abi_version(void)
+{
+	return SOREN_ABI_VERSION;
+}
+
+const char* soren_opcode_mnemonic(uint8_t opcode)
+{
+	return opcode < BC_OPCODE_COUNT
+		? gBcOpcodeInfo[opcode].mnemonic
+		: nullptr;
+}
+
+uint32_t soren_opcode_operand_size(uint8_t opcode)
+{
+	return opcode < BC_OPCODE_COUNT
+		? gBcOpcodeInfo[opcode].operandSize
+		: 0u;
+}
+
+soren_cmb* soren_cmb_create(void)
+{
+	return new (std::nothrow) soren_cmb;
+}
+
+void soren_cmb_destroy(soren_cmb* cmb)
+{
+	delete cmb;
+}
+
+soren_status soren_cmb_decode(soren_cmb* cmb, const uint8_t* data, size_t size, int32_t game)
+{
+	if (!cmb || (!data && size != 0) || !valid_game(game))
+		return SOREN_ERROR_ARGUMENT;
+
+	return guard([&] ()
+	{
+		cmb->cmb = CmbInfo();
+		cmb->diags.clear();
+		cmb->data.assign(data, data + size);
+
+		return decode_data(*cmb, game);
+	});
+}
+
+soren_status soren_cmb_load_file(soren_cmb* cmb, const char* filename, int32_t game)
+{
+	if (!cmb || !filename || !valid_game(game))
+		return SOREN_ERROR_ARGUMENT;
+
+	return guard([&] ()
+	{
+		cmb->cmb = CmbInfo();
+		cmb->diags.clear();
+
+		if (!try_read_cmb_file(filename, cmb->data, cmb->diags))
+		{
+			cmb->data.clear();
+
+			// a decompression issue is still a decode issue
+			return cmb->diags.list.back().kind == ErrorKind::FileUnreadable
+				? SOREN_ERROR_FILE
+				: SOREN_ERROR_DECODE;
+		}
+
+		return decode_data(*cmb, game);
+	});
+}
+
+int32_t soren_cmb_game(const soren_cmb* cmb)
+{
+	return cmb ? static_cast<int32_t>(cmb->game) : SOREN_GAME_AUTO;
+}
+
+size_t soren_cmb_scene_count(const soren_cmb* cmb)
+{
+	return cmb ? cmb->cmb.scenes.size() : 0u;
+}
+
+soren_status soren_cmb_get_scene(const soren_cmb* cmb, size_t idx, soren_scene* out)
+{
+	if (!cmb || !out || idx >= cmb->cmb.scenes.size())
+		return SOREN_ERROR_ARGUMENT;
+
+	auto& scene = cmb->cmb.scenes[idx];
+
+	out->idx = scene.idx;
+	out->kind = scene.kind;
+	out->arg_count = scene.argCnt;
+	out->var_count = scene.varnames.size();
+	out->script_offset = scene.scriptOffset;
+	out->is_global = scene.isGlobal;
+
+	out->name = scene.name.c_str();
+	out->name_length = scene.name.size();
+
+	out->parameters = reinterpret_cast<const int32_t*>(scene.parameters.data());
+	out->parameter_count = scene.parameters.size();
+
+	out->instructions = reinterpret_cast<const soren_ins*>(scene.rawScript.data());
+	out->instruction_count = scene.rawScript.size();
+
+	return SOREN_OK;
+}
+
+const char* soren_cmb_string_pool(const soren_cmb* cmb, size_t* size)
+{
+	if (!cmb)
+		return nullptr;
+
+	if (size)
+		*size = cmb->cmb.stringPool.size();
+
+	return cmb->cmb.stringPool.data();
+}
+
+const char* soren_cmb_string(const soren_cmb* cmb, uint32_t offset)
+{
+	return cmb ? cmb->cmb.try_get_cstr(offset) : nullptr;
+}
+
+size_t soren_cmb_diagnostic_count(const soren_cmb* cmb)
+{
+	return cmb ? cmb->diags.size() : 0u;
+}
+
+soren_status soren_cmb_get_diagnostic(const soren_cmb* cmb, size_t idx, soren_diagnostic* out)
+{
+	if (!cmb || !out || idx >= cmb->diags.size())
+		return SOREN_ERROR_ARGUMENT;
+
+	fill_diagnostic(cmb->diags.list[idx], *out);
+	return SOREN_OK;
+}
+
+soren_ast* soren_ast_create(void)
+{
+	return new (std::nothrow) soren_ast;
+}
+
+void soren_ast_destroy(soren_ast* ast)
+{
+	delete ast;
+}
+
+soren_status soren_ast_decompile(soren_ast* ast, const soren_cmb* cmb, size_t scene_idx)
+{
+	if (!ast || !cmb || scene_idx >= cmb->cmb.scenes.size())
+		return SOREN_ERROR_ARGUMENT;
+
+	return guard([&] ()
+	{
+		auto& scene = cmb->cmb.scenes[scene_idx];
+
+		ast->diags.clear();
+		ast->cmb = cmb;
+		ast->scene = &scene;
+
+		return decompile_scene_flat(cmb->cmb, scene, ast->ast, ast->diags)
+			? SOREN_OK
+			: SOREN_ERROR_DECODE;
+	});
+}
+
+soren_status soren_ast_get_view(const soren_ast* ast, soren_ast_view* out)
+{
+	if (!ast || !out)
+		return SOREN_ERROR_ARGUMENT;
+
+	auto& flat = ast->ast;
+
+	out->slices = reinterpret_cast<const soren_slice*>(flat.slices.data());
+	out->slice_count = flat.slices.size();
+
+	out->statements = reinterpret_cast<const soren_stmt*>(flat.ast.statements.data());
+	out->stmt_count = flat.ast.statements.size();
+
+	out->exprs = reinterpret_cast<const soren_expr*>(flat.ast.exprs.data());
+	out->expr_count = flat.ast.exprs.size();
+
+	out->links = flat.ast.links.data();
+	out->link_count = flat.ast.links.size();
+
+	return SOREN_OK;
+}
+
+const char* soren_ast_symbol(const soren_ast* ast, uint32_t id, size_t* length)
+{
+	if (!ast || id >= ast->ast.ast.symbols.size())
+		return nullptr;
+
+	if (length)
+		*length = ast->ast.ast.symbols.length(id);
+
+	return ast->ast.ast.symbols.c_str(id);
+}
+
+size_t soren_ast_diagnostic_count(const soren_ast* ast)
+{
+	return ast ? ast->diags.size() : 0u;
+}
+
+soren_status soren_ast_get_diagnostic(const soren_ast* ast, size_t idx, soren_diagnostic* out)
+{
+	if (!ast || !out || idx >= ast->diags.size())
+		return SOREN_ERROR_ARGUMENT;
+
+	fill_diagnostic(ast->diags.list[idx], *out);
+	return SOREN_OK;
+}
+
+soren_status soren_ast_render_text(soren_ast* ast, const char** text, size_t* length)
+{
+	if (!ast || !ast->scene || !text)
+		return SOREN_ERROR_ARGUMENT;
+
+	return guard([&] ()
+	{
+		ast->text.str(std::string());
+		ast->text.clear();
+
+		make_text_writer(ast->text)->write_flat_scene(ast->cmb->cmb, *ast->scene, ast->ast);
+
+		ast->textStr = ast->text.str();
+
+		*text = ast->textStr.c_str();
+
+		if (length)
+			*length = ast->textStr.size();
+
+		return SOREN_OK;
+	});
+}
+
+} // extern "C"
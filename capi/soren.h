@@ -0,0 +1,243 @@
+#ifndef SOREN_CAPI_SOREN_INCLUDED
+#define SOREN_CAPI_SOREN_INCLUDED
+
+/*
+ * libsoren: C interface to the CMB decoder, slicer and statement builder
+ *
+ * Everything goes through two opaque handles:
+ * - soren_cmb holds one decoded file (scene table, instructions, string pool)
+ * - soren_ast holds one decompiled scene, as flat arrays (see ast/flat-ast.h)
+ *
+ * Accessors never allocate: they return pointers (and lengths) straight into the buffers held by a handle.
+ * Those pointers stay valid until the handle is destroyed or decodes/decompiles something else.
+ *
+ * Handles are independent from each other, and nothing is shared between them: separate handles can be used from
+ * separate threads concurrently. A single handle must not be modified (decode, decompile, render) while in use
+ * from another thread; const accessors may be called concurrently. A soren_ast reads from the soren_cmb it was
+ * decompiled from, so that one must outlive it and not be modified while it is decompiling or rendering.
+ *
+ * Functions never throw nor abort on malformed input: issues are reported as diagnostics and whatever could be
+ * decoded is still available.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#	if defined(SOREN_BUILDING_LIBRARY)
+#		define SOREN_API __declspec(dllexport)
+#	else
+#		define SOREN_API __declspec(dllimport)
+#	endif
+#else
+#	define SOREN_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever a declaration below changes incompatibly */
+#define SOREN_ABI_VERSION 1
+
+typedef struct soren_cmb soren_cmb;
+typedef struct soren_ast soren_ast;
+
+typedef enum soren_status
+{
+	SOREN_OK = 0,
+	SOREN_ERROR_ARGUMENT = 1, /* null handle, index out of range... */
+	SOREN_ERROR_FILE = 2,     /* file unreadable */
+	SOREN_ERROR_DECODE = 3,   /* malformed input, see diagnostics (results are still available) */
+	SOREN_ERROR_NO_MEMORY = 4,
+	SOREN_ERROR_INTERNAL = 5,
+} soren_status;
+
+typedef enum soren_game
+{
+	SOREN_GAME_AUTO = -1, /* input only: detect from the bytecode */
+	SOREN_GAME_FE9 = 0,
+	SOREN_GAME_FE10 = 1,
+} soren_game;
+
+/* Same layout as the decoder's own instructions, so that they can be handed out as is */
+typedef struct soren_ins
+{
+	uint32_t location; /* offset within the script */
+	int32_t operand;   /* jump operands are absolute (within the script) */
+	uint8_t opcode;
+} soren_ins;
+
+typedef struct soren_scene
+{
+	uint32_t idx;
+	uint32_t kind;
+	uint32_t arg_count;
+	uint32_t var_count;
+	uint32_t script_offset; /* file offset of the script */
+	int32_t is_global;
+
+	const char* name; /* NUL-terminated, empty for non-global scenes */
+	size_t name_length;
+
+	const int32_t* parameters;
+	size_t parameter_count;
+
+	const soren_ins* instructions; /* empty if the scene failed to decode */
+	size_t instruction_count;
+} soren_scene;
+
+typedef struct soren_diagnostic
+{
+	int32_t kind;
+	uint32_t offset; /* file offset */
+	int32_t scene;   /* scene index, or -1 */
+	const char* message; /* static string */
+} soren_diagnostic;
+
+/* Flat ast nodes, children are referenced through soren_ast_view::links (see ast/flat-ast.h) */
+
+typedef enum soren_expr_kind
+{
+	SOREN_EXPR_INVALID,
+	SOREN_EXPR_INT_LITERAL,
+	SOREN_EXPR_STR_LITERAL,
+	SOREN_EXPR_NAMED,
+	SOREN_EXPR_NEG,
+	SOREN_EXPR_NOT,
+	SOREN_EXPR_BITWISE_NOT,
+	SOREN_EXPR_DEREF,
+	SOREN_EXPR_ADDROF,
+	SOREN_EXPR_ASSIGN,
+	SOREN_EXPR_ADD,
+	SOREN_EXPR_SUB,
+	SOREN_EXPR_MUL,
+	SOREN_EXPR_DIV,
+	SOREN_EXPR_MOD,
+	SOREN_EXPR_OR,
+	SOREN_EXPR_AND,
+	SOREN_EXPR_XOR,
+	SOREN_EXPR_LSL,
+	SOREN_EXPR_LSR,
+	SOREN_EXPR_EQ,
+	SOREN_EXPR_NE,
+	SOREN_EXPR_LT,
+	SOREN_EXPR_LE,
+	SOREN_EXPR_GT,
+	SOREN_EXPR_GE,
+	SOREN_EXPR_EQ_STR,
+	SOREN_EXPR_NE_STR,
+	SOREN_EXPR_LOGICAL_AND,
+	SOREN_EXPR_LOGICAL_OR,
+	SOREN_EXPR_FUNC,
+} soren_expr_kind;
+
+typedef enum soren_stmt_kind
+{
+	SOREN_STMT_INVALID,
+	SOREN_STMT_PUSH,
+	SOREN_STMT_EXPR,
+	SOREN_STMT_GOTO,
+	SOREN_STMT_GOTO_IF,
+	SOREN_STMT_YIELD,
+	SOREN_STMT_RETURN,
+} soren_stmt_kind;
+
+#define SOREN_NO_SYMBOL UINT32_MAX
+
+typedef struct soren_expr
+{
+	int32_t kind; /* soren_expr_kind */
+	uint32_t child_count;
+	uint32_t first_child; /* index into links */
+	int32_t literal; /* int literals */
+	uint32_t symbol; /* string literals, names and functions */
+} soren_expr;
+
+typedef struct soren_stmt
+{
+	int32_t kind; /* soren_stmt_kind */
+	uint32_t label; /* symbol, or SOREN_NO_SYMBOL */
+	uint32_t child_count;
+	uint32_t first_child; /* index into links */
+} soren_stmt;
+
+typedef struct soren_slice
+{
+	uint32_t offset; /* offset of the first instruction within the script */
+	uint32_t label; /* symbol, or SOREN_NO_SYMBOL */
+	uint32_t first_stmt;
+	uint32_t stmt_count;
+} soren_slice;
+
+typedef struct soren_ast_view
+{
+	const soren_slice* slices;
+	size_t slice_count;
+
+	const soren_stmt* statements;
+	size_t stmt_count;
+
+	const soren_expr* exprs;
+	size_t expr_count;
+
+	const uint32_t* links; /* expr indices */
+	size_t link_count;
+} soren_ast_view;
+
+SOREN_API uint32_t soren_abi_version(void);
+
+/* Opcodes */
+
+SOREN_API const char* soren_opcode_mnemonic(uint8_t opcode); /* NULL if not an opcode */
+SOREN_API uint32_t soren_opcode_operand_size(uint8_t opcode);
+
+/* Decoded files */
+
+SOREN_API soren_cmb* soren_cmb_create(void);
+SOREN_API void soren_cmb_destroy(soren_cmb* cmb);
+
+/* data is copied from, it doesn't need to outlive the call */
+SOREN_API soren_status soren_cmb_decode(soren_cmb* cmb, const uint8_t* data, size_t size, int32_t game);
+
+/* LZ10/LZ11 compressed files are decompressed first */
+SOREN_API soren_status soren_cmb_load_file(soren_cmb* cmb, const char* filename, int32_t game);
+
+SOREN_API int32_t soren_cmb_game(const soren_cmb* cmb);
+
+SOREN_API size_t soren_cmb_scene_count(const soren_cmb* cmb);
+SOREN_API soren_status soren_cmb_get_scene(const soren_cmb* cmb, size_t idx, soren_scene* out);
+
+SOREN_API const char* soren_cmb_string_pool(const soren_cmb* cmb, size_t* size);
+
+/* NULL if offset isn't the start of a NUL-terminated string within the pool */
+SOREN_API const char* soren_cmb_string(const soren_cmb* cmb, uint32_t offset);
+
+SOREN_API size_t soren_cmb_diagnostic_count(const soren_cmb* cmb);
+SOREN_API soren_status soren_cmb_get_diagnostic(const soren_cmb* cmb, size_t idx, soren_diagnostic* out);
+
+/* Decompiled scenes */
+
+SOREN_API soren_ast* soren_ast_create(void);
+SOREN_API void soren_ast_destroy(soren_ast* ast);
+
+/* Slices the scene and builds its statements, storage is reused from one call to the next */
+SOREN_API soren_status soren_ast_decompile(soren_ast* ast, const soren_cmb* cmb, size_t scene_idx);
+
+SOREN_API soren_status soren_ast_get_view(const soren_ast* ast, soren_ast_view* out);
+
+/* NULL if id isn't a symbol */
+SOREN_API const char* soren_ast_symbol(const soren_ast* ast, uint32_t id, size_t* length);
+
+SOREN_API size_t soren_ast_diagnostic_count(const soren_ast* ast);
+SOREN_API soren_status soren_ast_get_diagnostic(const soren_ast* ast, size_t idx, soren_diagnostic* out);
+
+/* Renders the last decompiled scene as in the text dump, the text is held by the handle
+ * The soren_cmb it was decompiled from must not have decoded anything else since */
+SOREN_API soren_status soren_ast_render_text(soren_ast* ast, const char** text, size_t* length);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* SOREN_CAPI_SOREN_INCLUDED */
@@ -0,0 +1,616 @@
+#include "cli/commands.h"
+
+#include "core/io.h"
+#include "core/diagnostics.h"
+#include "core/stats.h"
+#include "core/sjis.h"
+#include "decode/lz.h"
+#include "decode/decode.h"
+#include "decode/archive.h"
+#include "decompile/decompile.h"
+#include "compile/compile.h"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+namespace soren {
+
+// soren bench <suite> [--iterations=N] <dir or file>...
+// Suites:
+//   lz: decompression throughput (of decompressed bytes) of every compressed input
+//   compile: compilation throughput (of source bytes) of text dumps, parsing alone and through to the encoded CMB
+//   decompile: scenes per second through the decompile pipeline (to tree and flat asts) with one DecompileScratch, and
+//              heap allocations per scene once it is warm; fails if flat asts still allocate (tree asts allocate their
+//              nodes and aren't checked), exits with 3 if stats are compiled out as nothing can be checked then
+//   sjis: Shift-JIS to UTF-8 conversion throughput (of Shift-JIS bytes) of the string pool of every input, converted
+//         once per distinct string as --sjis does
+//   adversarial: (takes no input) time to decompile crafted scenes with and without a DecompileBudget; fails if any
+//                budgeted run takes more than 10 ms past its deadline
+
+struct BenchOptions
+{
+	unsigned iterations { 20u };
+	std::vector<std::string> files;
+};
+
+static
+double get_mb_per_s(std::uint64_t bytes, std::chrono::steady_clock::duration duration)
+{
+	const double seconds = std::chrono::duration<double>(duration).count();
+	return seconds > 0.0 ? (bytes / (1024.0 * 1024.0)) / seconds : 0.0;
+}
+
+static
+int bench_lz(const BenchOptions& options)
+{
+	std::vector<byte_type> compressed, result;
+	Diagnostics diags;
+
+	std::uint64_t totalBytes = 0;
+	std::chrono::steady_clock::duration totalTime {};
+
+	std::cout << std::fixed << std::setprecision(2);
+
+	for (auto& filename : options.files)
+	{
+		if (!read_entire_file(filename.c_str(), compressed))
+		{
+			std::cerr << filename << ": error: " << get_error_message(ErrorKind::FileUnreadable) << std::endl;
+			continue;
+		}
+
+		const auto kind = detect_lz(compressed);
+
+		if (kind == LzKind::None)
+			continue; // nothing to measure
+
+		// warm up (and check that it decompresses at all)
+		diags.clear();
+
+		if (!try_lz_decompress(compressed, result, diags))
+		{
+			std::cerr << filename << ": error: " << diags.list.front() << std::endl;
+			continue;
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+
+		for (unsigned i = 0; i < options.iterations; ++i)
+			try_lz_decompress(compressed, result, diags);
+
+		const auto time = std::chrono::steady_clock::now() - start;
+		const std::uint64_t bytes = std::uint64_t(result.size()) * options.iterations;
+
+		totalBytes += bytes;
+		totalTime += time;
+
+		std::cout << filename << "\t" << (kind == LzKind::Lz10 ? "lz10" : "lz11")
+			<< "\t" << compressed.size() << " -> " << result.size()
+			<< "\t" << get_mb_per_s(bytes, time) << " MB/s" << std::endl;
+	}
+
+	std::cout << "total\t" << get_mb_per_s(totalBytes, totalTime) << " MB/s" << std::endl;
+
+	return 0;
+}
+
+static
+int bench_compile(const BenchOptions& options)
+{
+	std::uint64_t totalBytes = 0;
+	std::chrono::steady_clock::duration totalParseTime {}, totalTime {};
+
+	std::cout << std::fixed << std::setprecision(2);
+
+	for (auto& filename : options.files)
+	{
+		MappedFile file;
+
+		if (!file.open(filename.c_str()))
+		{
+			std::cerr << filename << ": error: " << get_error_message(ErrorKind::FileUnreadable) << std::endl;
+			continue;
+		}
+
+		const Span<const char> source(reinterpret_cast<const char*>(file.data()), file.size());
+
+		SourceScript script;
+		CmbInfo cmb;
+		std::vector<byte_type> data;
+		Diagnostics diags;
+
+		// warm up (and check that it compiles at all)
+		if (!parse_source(source, script, diags) || !generate_cmb(script, GameKind::FE10, cmb, diags))
+		{
+			std::cerr << filename << ": error: " << get_error_message(diags.list.front().kind) << std::endl;
+			continue;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (unsigned i = 0; i < options.iterations; ++i)
+			parse_source(source, script, diags);
+
+		const auto parseTime = std::chrono::steady_clock::now() - start;
+
+		start = std::chrono::steady_clock::now();
+
+		for (unsigned i = 0; i < options.iterations; ++i)
+		{
+			parse_source(source, script, diags);
+			generate_cmb(script, GameKind::FE10, cmb, diags);
+			encode_cmb(cmb, GameKind::FE10, data);
+		}
+
+		const auto time = std::chrono::steady_clock::now() - start;
+		const std::uint64_t bytes = std::uint64_t(source.size()) * options.iterations;
+
+		totalBytes += bytes;
+		totalParseTime += parseTime;
+		totalTime += time;
+
+		std::cout << filename << "\t" << source.size() << " -> " << data.size()
+			<< "\tparse " << get_mb_per_s(bytes, parseTime) << " MB/s"
+			<< "\tcompile " << get_mb_per_s(bytes, time) << " MB/s" << std::endl;
+	}
+
+	std::cout << "total\tparse " << get_mb_per_s(totalBytes, totalParseTime) << " MB/s"
+		<< "\tcompile " << get_mb_per_s(totalBytes, totalTime) << " MB/s" << std::endl;
+
+	return 0;
+}
+
+// Heap allocations made so far (on any thread), 0 if stats are compiled out
+static
+std::uint64_t get_allocation_count()
+{
+	std::uint64_t result = 0;
+
+#if SOREN_ENABLE_STATS
+	for (unsigned i = 0; i < static_cast<unsigned>(StatsPhase::Count); ++i)
+		result += get_phase_totals(static_cast<StatsPhase>(i)).allocations;
+#endif
+
+	return result;
+}
+
+static
+int bench_decompile(const BenchOptions& options)
+{
+#if SOREN_ENABLE_STATS
+	enable_stats();
+#else
+	std::cerr << "note: stats are compiled out, allocations aren't counted (nor checked)" << std::endl;
+#endif
+
+	CmbInput input;
+	CmbInfo cmb;
+	Diagnostics diags;
+
+	SceneAst ast;
+	FlatSceneAst flatAst;
+	DecompileScratch scratch;
+
+	std::uint64_t totalScenes = 0;
+	std::chrono::steady_clock::duration totalTime[2] {};
+	std::uint64_t totalAllocations[2] {};
+
+	std::cout << std::fixed << std::setprecision(2);
+
+	for (auto& filename : options.files)
+	{
+		diags.clear();
+
+		if (!try_load_cmb_input(filename.c_str(), input, diags) || (!try_decode_cmb(input.data, get_input_game(input).game, cmb, diags) && cmb.scenes.empty()))
+		{
+			std::cerr << filename << ": error: " << diags.list.front() << std::endl;
+			continue;
+		}
+
+		auto run = [&] (bool flat)
+		{
+			for (auto& scene : cmb.scenes)
+			{
+				if (scene.rawScript.empty())
+					continue;
+
+				diags.clear();
+
+				if (flat)
+					decompile_scene_flat(cmb, scene, flatAst, scratch, diags);
+				else
+					try_decompile_scene(cmb, scene, ast, scratch, diags);
+			}
+		};
+
+		std::cout << filename << "\t" << cmb.scenes.size() << " scenes";
+
+		for (unsigned flat = 0; flat < 2; ++flat)
+		{
+			run(flat); // warm up
+
+			const auto allocations = get_allocation_count();
+			const auto start = std::chrono::steady_clock::now();
+
+			for (unsigned i = 0; i < options.iterations; ++i)
+				run(flat);
+
+			const auto time = std::chrono::steady_clock::now() - start;
+			const auto made = get_allocation_count() - allocations;
+			const std::uint64_t scenes = std::uint64_t(cmb.scenes.size()) * options.iterations;
+
+			totalTime[flat] += time;
+			totalAllocations[flat] += made;
+
+			const double seconds = std::chrono::duration<double>(time).count();
+
+			std::cout << "\t" << (flat ? "flat " : "tree ") << (seconds > 0.0 ? scenes / seconds : 0.0) << " scenes/s";
+
+			if (SOREN_ENABLE_STATS)
+				std::cout << ", " << (scenes ? double(made) / scenes : 0.0) << " allocs/scene";
+		}
+
+		std::cout << std::endl;
+
+		totalScenes += std::uint64_t(cmb.scenes.size()) * options.iterations;
+	}
+
+	std::cout << "total";
+
+	for (unsigned flat = 0; flat < 2; ++flat)
+	{
+		const double seconds = std::chrono::duration<double>(totalTime[flat]).count();
+
+		std::cout << "\t" << (flat ? "flat " : "tree ") << (seconds > 0.0 ? totalScenes / seconds : 0.0) << " scenes/s";
+
+		if (SOREN_ENABLE_STATS)
+			std::cout << ", " << totalAllocations[flat] << " allocs";
+	}
+
+	std::cout << std::endl;
+
+#if SOREN_ENABLE_STATS
+	// only flat asts are meant not to allocate, tree ast nodes are heap allocated
+	const bool flatPasses = totalAllocations[1] == 0;
+
+	std::cout << "tree\tunchecked (" << totalAllocations[0] << " allocations, for its nodes)" << std::endl;
+	std::cout << "flat\t" << (flatPasses ? "pass" : "fail") << std::endl;
+
+	return flatPasses ? 0 : 2;
+#else
+	std::cout << "tree\tskipped\nflat\tskipped" << std::endl;
+
+	return 3;
+#endif
+}
+
+// Crafted scenes, each made to blow up one part of the pipeline
+
+struct AdversarialScene
+{
+	const char* name;
+	bool bounded; // whether running it without a budget finishes (in reasonable time)
+	SceneInfo scene;
+};
+
+// Appends an instruction right after the last one
+static
+void add_instruction(SceneInfo& scene, std::uint8_t opcode, std::int32_t operand = 0)
+{
+	const auto& script = scene.rawScript;
+	const unsigned location = script.empty() ? 0 : script.back().location + 1 + script.back().info().operandSize;
+
+	scene.rawScript.push_back({ location, operand, opcode });
+}
+
+static
+std::vector<AdversarialScene> make_adversarial_scenes()
+{
+	std::vector<AdversarialScene> result;
+
+	auto add_scene = [&] (const char* name, bool bounded) -> SceneInfo&
+	{
+		result.push_back({ name, bounded, SceneInfo() });
+
+		auto& scene = result.back().scene;
+
+		scene.idx = result.size() - 1;
+		scene.scriptOffset = 0x1000 * result.size();
+		scene.varnames.push_back("var_0");
+
+		return scene;
+	};
+
+	{
+		// each dup + add doubles the expression: 2^48 nodes
+		SceneInfo& scene = add_scene("dup-chain", false);
+
+		add_instruction(scene, BC_OPCODE_VAL8, 0);
+
+		for (unsigned i = 0; i < 48; ++i)
+		{
+			add_instruction(scene, BC_OPCODE_DUP);
+			add_instruction(scene, BC_OPCODE_ADD);
+		}
+
+		add_instruction(scene, BC_OPCODE_DISC);
+		add_instruction(scene, BC_OPCODE_RETN);
+	}
+
+	{
+		// each deref copies everything pushed so far: quadratic nodes
+		SceneInfo& scene = add_scene("deref-chain", true);
+
+		add_instruction(scene, BC_OPCODE_VAL8, 0);
+
+		for (unsigned i = 0; i < 4000; ++i)
+			add_instruction(scene, BC_OPCODE_DEREF);
+
+		add_instruction(scene, BC_OPCODE_RETN);
+	}
+
+	{
+		// every bkn jumps to the end of the slice: quadratic bk conversion
+		SceneInfo& scene = add_scene("bk-chain", true);
+
+		const unsigned count = 20000;
+
+		// number8, then count times bkn (3 bytes) + number8 (2 bytes)
+		const unsigned end = 2 + count * 5;
+
+		add_instruction(scene, BC_OPCODE_NUMBER8, 1);
+
+		for (unsigned i = 0; i < count; ++i)
+		{
+			add_instruction(scene, BC_OPCODE_BKN, end);
+			add_instruction(scene, BC_OPCODE_NUMBER8, 1);
+		}
+
+		add_instruction(scene, BC_OPCODE_DISC);
+		add_instruction(scene, BC_OPCODE_RETN);
+	}
+
+	{
+		// jumps to ever earlier targets: many slices, labels found in reverse order
+		SceneInfo& scene = add_scene("backward-jumps", true);
+
+		const unsigned count = 100000;
+
+		// yield (1 byte) + b (3 bytes)
+		for (unsigned i = 0; i < count; ++i)
+		{
+			add_instruction(scene, BC_OPCODE_YIELD);
+			add_instruction(scene, BC_OPCODE_B, (count - 1 - i) * 4);
+		}
+
+		add_instruction(scene, BC_OPCODE_RETN);
+	}
+
+	{
+		// one very deep expression
+		SceneInfo& scene = add_scene("deep-expression", true);
+
+		add_instruction(scene, BC_OPCODE_NUMBER8, 1);
+
+		for (unsigned i = 0; i < 1000000; ++i)
+			add_instruction(scene, BC_OPCODE_NEG);
+
+		add_instruction(scene, BC_OPCODE_DISC);
+		add_instruction(scene, BC_OPCODE_RETN);
+	}
+
+	return result;
+}
+
+static
+int bench_adversarial(const BenchOptions& options)
+{
+	auto adversarial = make_adversarial_scenes();
+
+	CmbInfo cmb;
+	cmb.stringPool.push_back('\0');
+
+	for (auto& entry : adversarial)
+		cmb.scenes.push_back(std::move(entry.scene));
+
+	index_cmb_strings(cmb);
+
+	DecompileBudget budget;
+
+	budget.instructions = 1000000;
+	budget.slices = 10000;
+	budget.nodes = 1000000;
+	budget.depth = 10000;
+	budget.sceneMs = 50;
+
+	SceneAst ast;
+	FlatSceneAst flatAst;
+	DecompileScratch scratch;
+	Diagnostics diags;
+
+	bool ok = true;
+
+	std::cout << std::fixed << std::setprecision(2);
+
+	// returns the slowest of the runs, in ms
+	auto run = [&] (const SceneInfo& scene, bool flat, unsigned iterations)
+	{
+		double result = 0.0;
+
+		for (unsigned i = 0; i < iterations; ++i)
+		{
+			diags.clear();
+			scratch.meter.start_file();
+
+			const auto start = std::chrono::steady_clock::now();
+
+			if (flat)
+				decompile_scene_flat(cmb, scene, flatAst, scratch, diags);
+			else
+				try_decompile_scene(cmb, scene, ast, scratch, diags);
+
+			result = std::max(result, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+
+		return result;
+	};
+
+	for (unsigned i = 0; i < cmb.scenes.size(); ++i)
+	{
+		auto& scene = cmb.scenes[i];
+
+		std::cout << adversarial[i].name << "\t" << scene.rawScript.size() << " instructions";
+
+		for (unsigned flat = 0; flat < 2; ++flat)
+		{
+			std::cout << "\t" << (flat ? "flat " : "tree ");
+
+			// budgeted runs warm up first, not to time what is left of earlier runs (their ast, and the allocator
+			// tidying up after them)
+
+			if (adversarial[i].bounded)
+			{
+				scratch.meter.budget = budget;
+				run(scene, flat, 1);
+
+				scratch.meter.budget = DecompileBudget();
+				std::cout << run(scene, flat, 1) << " ms unbudgeted, ";
+			}
+			else
+			{
+				std::cout << "unbounded, ";
+			}
+
+			scratch.meter.budget = budget;
+			run(scene, flat, 1);
+
+			const auto ms = run(scene, flat, options.iterations);
+
+			std::cout << ms << " ms budgeted (" << (diags.empty() ? "ok" : get_error_message(diags.list.front().kind)) << ")";
+
+			// the deadline is read every 1024 ticks and leaves time to free what was made, by an estimate
+			if (ms > budget.sceneMs + 10.0)
+				ok = false;
+		}
+
+		std::cout << std::endl;
+	}
+
+	return ok ? 0 : 2;
+}
+
+static
+int bench_sjis(const BenchOptions& options)
+{
+	CmbInput input;
+	CmbInfo cmb;
+	Diagnostics diags;
+
+	std::uint64_t totalBytes = 0;
+	std::chrono::steady_clock::duration totalTime {};
+
+	std::cout << std::fixed << std::setprecision(2);
+
+	for (auto& filename : options.files)
+	{
+		diags.clear();
+
+		if (!try_load_cmb_input(filename.c_str(), input, diags) || (!try_decode_cmb(input.data, get_input_game(input).game, cmb, diags) && cmb.scenes.empty()))
+		{
+			std::cerr << filename << ": error: " << diags.list.front() << std::endl;
+			continue;
+		}
+
+		// what gets converted: each distinct string once
+
+		std::uint64_t poolBytes = 0;
+		std::uint64_t asciiBytes = 0;
+
+		for (std::uint32_t id = 0; id < cmb.stringIndex.id_count(); ++id)
+		{
+			const auto str = cmb.stringIndex.get_by_id(cmb.stringPool.data(), id);
+
+			poolBytes += str.length;
+			asciiBytes += std::count_if(str.str, str.str + str.length, [] (char c) { return (c & 0x80) == 0; });
+		}
+
+		// warm up
+		const auto badCnt = cmb.stringIndex.convert(cmb.stringPool.data(), sjis_to_utf8);
+
+		const auto start = std::chrono::steady_clock::now();
+
+		for (unsigned i = 0; i < options.iterations; ++i)
+			cmb.stringIndex.convert(cmb.stringPool.data(), sjis_to_utf8);
+
+		const auto time = std::chrono::steady_clock::now() - start;
+		const std::uint64_t bytes = poolBytes * options.iterations;
+
+		totalBytes += bytes;
+		totalTime += time;
+
+		std::cout << filename << "\t" << cmb.stringIndex.size() << " strings, " << cmb.stringIndex.id_count() << " distinct"
+			<< "\t" << poolBytes << " bytes (" << (poolBytes ? 100.0 * asciiBytes / poolBytes : 100.0) << "% ascii)"
+			<< "\t" << get_mb_per_s(bytes, time) << " MB/s";
+
+		if (badCnt != 0)
+			std::cout << "\t" << badCnt << " not shift-jis";
+
+		std::cout << std::endl;
+	}
+
+	std::cout << "total\t" << get_mb_per_s(totalBytes, totalTime) << " MB/s" << std::endl;
+
+	return 0;
+}
+
+int run_bench(int argc, char** argv)
+{
+	if (argc < 1)
+		return 1;
+
+	const char* suite = argv[0];
+
+	BenchOptions options;
+	std::vector<const char*> paths;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (parse_unsigned_option(argv[i], "--iterations=", options.iterations))
+			continue;
+		else if (argv[i][0] == '-')
+			return 1;
+		else
+			paths.push_back(argv[i]);
+	}
+
+	if (options.iterations == 0)
+		return 1;
+
+	if (std::strcmp(suite, "adversarial") == 0)
+		return paths.empty() ? bench_adversarial(options) : 1;
+
+	if (paths.empty())
+		return 1;
+
+	if (!collect_input_files(paths, options.files))
+		return 2;
+
+	if (std::strcmp(suite, "lz") == 0)
+		return bench_lz(options);
+
+	if (std::strcmp(suite, "compile") == 0)
+		return bench_compile(options);
+
+	if (std::strcmp(suite, "decompile") == 0)
+		return bench_decompile(options);
+
+	if (std::strcmp(suite, "sjis") == 0)
+		return bench_sjis(options);
+
+	return 1;
+}
+
+} // namespace soren
@@ -0,0 +1,116 @@
+#include "cli/commands.h"
+
+#include "core/io.h"
+#include "core/diagnostics.h"
+#include "decode/decode.h"
+#include "decode/lz.h"
+#include "decode/detect.h"
+#include "decode/archive.h"
+
+#include <iostream>
+
+namespace soren {
+
+// soren --check [--jobs=N] [--game=fe9|fe10] <path/to/script.cmb>...
+// Runs check_cmb over every file in parallel, then prints one status line per file (in the order given):
+//   name, tab, "ok" | "invalid" | "unreadable"
+// with every issue found reported to stderr. Files are mapped, not read (archive members are views into their archive)
+
+enum class CheckStatus
+{
+	Ok,
+	Invalid,
+	Unreadable,
+};
+
+static
+const char* get_check_status_name(CheckStatus status)
+{
+	switch (status)
+	{
+
+	case CheckStatus::Ok:         return "ok";
+	case CheckStatus::Invalid:    return "invalid";
+	case CheckStatus::Unreadable: return "unreadable";
+
+	} // switch (status)
+
+	return "";
+}
+
+struct CheckedFile
+{
+	CheckStatus status { CheckStatus::Ok };
+	Diagnostics diags;
+};
+
+static
+void check_file(const char* filename, bool autoGame, GameKind game, CheckedFile& result)
+{
+	CmbInput input;
+	MappedFile file;
+
+	if (is_archive_member(filename))
+	{
+		if (!try_load_cmb_input(filename, input, result.diags))
+		{
+			result.status = CheckStatus::Unreadable;
+			return;
+		}
+	}
+	else
+	{
+		if (!file.open(filename))
+		{
+			result.diags.report(ErrorKind::FileUnreadable, 0);
+			result.status = CheckStatus::Unreadable;
+			return;
+		}
+
+		input.data = Span<const byte_type>(file.data(), file.size());
+
+		if (detect_lz(input.data) != LzKind::None)
+		{
+			if (!try_lz_decompress(input.data, input.owned, result.diags))
+			{
+				result.status = CheckStatus::Unreadable;
+				return;
+			}
+
+			input.data = input.owned;
+		}
+	}
+
+	if (!check_cmb(input.data, autoGame ? get_input_game(input).game : game, result.diags))
+		result.status = CheckStatus::Invalid;
+}
+
+int run_check(const std::vector<const char*>& filenames, unsigned jobs, bool autoGame, GameKind game)
+{
+	std::vector<CheckedFile> results(filenames.size());
+
+	run_parallel(jobs, filenames.size(), [&] (std::size_t i)
+	{
+		check_file(filenames[i], autoGame, game, results[i]);
+	});
+
+	std::size_t okCnt = 0;
+
+	for (std::size_t i = 0; i < filenames.size(); ++i)
+	{
+		for (auto& diag : results[i].diags.list)
+			std::cerr << filenames[i] << ": error: " << diag << "\n";
+
+		std::cout << filenames[i] << "\t" << get_check_status_name(results[i].status) << "\n";
+
+		if (results[i].status == CheckStatus::Ok)
+			okCnt++;
+	}
+
+	std::cout.flush();
+	std::cerr << okCnt << "/" << filenames.size() << " files valid" << std::endl;
+
+	return (okCnt == filenames.size()) ? 0 : 2;
+}
+
+} // namespace soren
@@ -0,0 +1,76 @@
+#ifndef SOREN_CLI_COMMANDS_INCLUDED
+#define SOREN_CLI_COMMANDS_INCLUDED
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+#include "core/soren-bytecode.h"
+
+namespace soren {
+
+// Subcommands (soren <command> ...), argv starts after the command name
+// Each returns the process exit code
+
+int run_stats_corpus(int argc, char** argv);
+int run_bench(int argc, char** argv);
+int run_diff(int argc, char** argv);
+int run_daemon(int argc, char** argv);
+int run_compile(int argc, char** argv);
+int run_pack(int argc, char** argv);
+int run_strings(int argc, char** argv);
+int run_symbols(int argc, char** argv);
+
+// soren --check (main.cpp parses its options), filenames are files or archive members
+int run_check(const std::vector<const char*>& filenames, unsigned jobs, bool autoGame, GameKind game);
+
+// Expands directories (recursively, *.cmb only) and archives (*.spak, into "archive:member" names, see decode/archive.h)
+// and keeps other paths as is. Returns false (after reporting it) if a directory or archive couldn't be listed
+bool collect_input_files(const std::vector<const char*>& paths, std::vector<std::string>& result);
+
+// Parses the N in "--name=N"
+bool parse_unsigned_option(const char* arg, const char* prefix, unsigned& result);
+
+// Same, but N is a byte size that may end with k, m or g (powers of 1024)
+bool parse_size_option(const char* arg, const char* prefix, std::size_t& result);
+
+// Runs work(i) for every i in [0, count) over jobs threads (the calling thread being one of them)
+template<typename Work>
+void run_parallel(unsigned jobs, std::size_t count, Work work)
+{
+	if (jobs == 0)
+		jobs = 1;
+
+	if (jobs > count)
+		jobs = count ? count : 1;
+
+	std::atomic<std::size_t> next { 0u };
+
+	auto worker = [&] ()
+	{
+		for (;;)
+		{
+			const auto i = next.fetch_add(1, std::memory_order_relaxed);
+
+			if (i >= count)
+				break;
+
+			work(i);
+		}
+	};
+
+	std::vector<std::thread> workers;
+
+	for (unsigned i = 1; i < jobs; ++i)
+		workers.emplace_back(worker);
+
+	worker();
+
+	for (auto& thread : workers)
+		thread.join();
+}
+
+} // namespace soren
+
+#endif // SOREN_CLI_COMMANDS_INCLUDED
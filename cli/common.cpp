@@ -0,0 +1,94 @@
+#include "cli/commands.h"
+
+#include "core/io.h"
+#include "decode/archive.h"
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+namespace soren {
+
+bool collect_input_files(const std::vector<const char*>& paths, std::vector<std::string>& result)
+{
+	for (auto path : paths)
+	{
+		if (is_archive_path(path))
+		{
+			if (!list_archive_members(path, result))
+			{
+				std::cerr << path << ": error: couldn't open archive" << std::endl;
+				return false;
+			}
+
+			continue;
+		}
+
+		if (!is_directory(path))
+		{
+			result.emplace_back(path);
+			continue;
+		}
+
+		if (!list_files(path, ".cmb", result))
+		{
+			std::cerr << path << ": error: couldn't list directory" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool parse_unsigned_option(const char* arg, const char* prefix, unsigned& result)
+{
+	const auto prefixLen = std::strlen(prefix);
+
+	if (std::strncmp(arg, prefix, prefixLen) != 0)
+		return false;
+
+	char* end = nullptr;
+	const auto value = std::strtoul(arg + prefixLen, &end, 10);
+
+	if (end == arg + prefixLen || *end != '\0')
+		return false;
+
+	result = value;
+	return true;
+}
+
+bool parse_size_option(const char* arg, const char* prefix, std::size_t& result)
+{
+	const auto prefixLen = std::strlen(prefix);
+
+	if (std::strncmp(arg, prefix, prefixLen) != 0)
+		return false;
+
+	char* end = nullptr;
+	const auto value = std::strtoull(arg + prefixLen, &end, 10);
+
+	if (end == arg + prefixLen)
+		return false;
+
+	unsigned shift = 0;
+
+	switch (*end)
+	{
+
+	case 'k': case 'K': shift = 10; end++; break;
+	case 'm': case 'M': shift = 20; end++; break;
+	case 'g': case 'G': shift = 30; end++; break;
+
+	default:
+		break;
+
+	} // switch (*end)
+
+	if (*end != '\0')
+		return false;
+
+	result = value << shift;
+	return true;
+}
+
+} // namespace soren
@@ -0,0 +1,93 @@
+#include "cli/commands.h"
+
+#include "core/io.h"
+#include "core/diagnostics.h"
+#include "compile/compile.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+namespace soren {
+
+// soren compile [--game=fe9|fe10] [--output=PATH] <source.txt>
+// Compiles a text dump (as written by soren) back to a CMB file, written to PATH (default: source name + ".cmb")
+// Errors are reported as file:line:column, nothing is written if there were any
+
+static
+void report_source_diagnostics(const char* filename, Span<const char> source, const Diagnostics& diags)
+{
+	for (auto& diag : diags.list)
+	{
+		const auto location = get_source_location(source, diag.offset);
+
+		std::cerr << filename << ":" << location.line << ":" << location.column
+			<< ": error: " << get_error_message(diag.kind) << std::endl;
+	}
+}
+
+int run_compile(int argc, char** argv)
+{
+	GameKind game = GameKind::FE10;
+	const char* input = nullptr;
+	std::string output;
+
+	for (int i = 0; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--game=fe9") == 0)
+			game = GameKind::FE9;
+		else if (std::strcmp(argv[i], "--game=fe10") == 0)
+			game = GameKind::FE10;
+		else if (std::strncmp(argv[i], "--output=", 9) == 0)
+			output = argv[i] + 9;
+		else if (argv[i][0] == '-' || input != nullptr)
+			return 1;
+		else
+			input = argv[i];
+	}
+
+	if (input == nullptr)
+		return 1;
+
+	if (output.empty())
+		output = std::string(input) + ".cmb";
+
+	MappedFile file;
+
+	if (!file.open(input))
+	{
+		std::cerr << input << ": error: " << get_error_message(ErrorKind::FileUnreadable) << std::endl;
+		return 2;
+	}
+
+	const Span<const char> source(reinterpret_cast<const char*>(file.data()), file.size());
+
+	SourceScript script;
+	CmbInfo cmb;
+	Diagnostics diags;
+
+	if (parse_source(source, script, diags))
+		generate_cmb(script, game, cmb, diags);
+
+	if (!diags.empty())
+	{
+		report_source_diagnostics(input, source, diags);
+		return 2;
+	}
+
+	std::vector<byte_type> data;
+	encode_cmb(cmb, game, data);
+
+	std::ofstream out(output, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+	if (!out)
+	{
+		std::cerr << output << ": error: couldn't write file" << std::endl;
+		return 2;
+	}
+
+	return 0;
+}
+
+} // namespace soren
@@ -0,0 +1,871 @@
+#include "cli/commands.h"
+#include "cli/json-reader.h"
+
+#include "core/diagnostics.h"
+#include "core/soren-bytecode.h"
+#include "decode/decode.h"
+#include "decode/decode-common.h"
+#include "decode/detect.h"
+#include "decode/archive.h"
+#include "decompile/decompile.h"
+#include "output/output.h"
+#include "output/json-writer.h"
+
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <unordered_map>
+
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace soren {
+
+// soren daemon [--socket=PATH] <files/dirs>
+// Loads every file once, then answers newline-delimited JSON requests from memory, one response line per request line
+// Requests are read from stdin (responses to stdout) unless --socket is given
+//
+// Request:  {"id": <any>, "cmd": "<command>", ...arguments}
+// Response: {"id": <same>, "ok": true, "result": ...} or {"id": <same>, "ok": false, "error": "<message>"}
+//
+// Commands:
+//   files                              loaded files
+//   scenes  file                       scene table of a file
+//   dump    file, scene|name           text dump of one scene
+//   refs    target[, file][, limit]    calls, callexts and string literals referencing target
+//   decode  file, offset[, size][, game]  instructions in a raw file range
+//   stats                              per command latency percentiles (microseconds)
+//   quit
+//
+// Before a request touches a file its mtime and size are checked, a file that changed is read again
+// and only re-decoded if its content hash differs
+
+enum
+{
+	DAEMON_LINE_LIMIT = 0x100000, // longer request lines are rejected
+	DAEMON_LATENCY_WINDOW = 4096, // percentiles are over this many most recent samples (per command)
+	DAEMON_REFS_DEFAULT_LIMIT = 1000,
+	DAEMON_DECODE_DEFAULT_SIZE = 0x40,
+	DAEMON_DECODE_SIZE_LIMIT = 0x10000,
+};
+
+// request cmd values, latencies are logged per command and under "invalid" for anything else
+static const char* const DAEMON_COMMANDS[] = { "files", "scenes", "dump", "refs", "decode", "stats", "quit" };
+
+enum class RefKind
+{
+	Call,
+	CallExt,
+	String,
+};
+
+static
+const char* get_ref_kind_name(RefKind kind)
+{
+	switch (kind)
+	{
+
+	case RefKind::Call:    return "call";
+	case RefKind::CallExt: return "callext";
+	case RefKind::String:  return "string";
+
+	} // switch (kind)
+
+	return "unknown";
+}
+
+struct RefSite
+{
+	RefKind kind;
+	unsigned scene;
+	unsigned offset; // file offset of the instruction
+};
+
+struct CorpusFile
+{
+	std::string path;
+
+	bool present { false };
+	std::int64_t mtimeNs { 0 };
+	std::uint64_t size { 0u };
+	std::uint64_t hash { 0u };
+	unsigned decodeCnt { 0u };
+
+	std::vector<byte_type> data;
+	GameKind game { GameKind::FE10 };
+	CmbInfo cmb;
+	Diagnostics diags;
+
+	// name referenced => where
+	std::unordered_map<std::string, std::vector<RefSite>> refs;
+};
+
+static
+void index_refs(CorpusFile& file)
+{
+	file.refs.clear();
+
+	auto& cmb = file.cmb;
+
+	for (auto& scene : cmb.scenes)
+	{
+		for (auto& ins : scene.rawScript)
+		{
+			const char* name = nullptr;
+			RefKind kind = RefKind::String;
+
+			switch (ins.opcode)
+			{
+
+			case BC_OPCODE_STRING8:
+			case BC_OPCODE_STRING16:
+			case BC_OPCODE_STRING32:
+				name = cmb.try_get_cstr(ins.operand);
+				kind = RefKind::String;
+				break;
+
+			case BC_OPCODE_CALLEXT:
+				name = cmb.try_get_cstr(unsigned(ins.operand) >> 8);
+				kind = RefKind::CallExt;
+				break;
+
+			case BC_OPCODE_CALL:
+				if (unsigned(ins.operand) < cmb.scenes.size() && cmb.scenes[ins.operand].isGlobal)
+					name = cmb.scenes[ins.operand].name.c_str();
+
+				kind = RefKind::Call;
+				break;
+
+			} // switch (ins.opcode)
+
+			if (name)
+				file.refs[name].push_back({ kind, scene.idx, scene.scriptOffset + ins.location });
+		}
+	}
+}
+
+// Brings file up to date with what is on disk, returns false if it can't be read (anymore)
+// Archive members are stat'ed through their archive, which is read only once
+static
+bool refresh_file(CorpusFile& file)
+{
+	struct stat st;
+
+	if (::stat(get_input_file_path(file.path.c_str()).c_str(), &st) != 0)
+	{
+		file.present = false;
+		return false;
+	}
+
+	const std::int64_t mtimeNs = std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+	if (file.present && mtimeNs == file.mtimeNs && std::uint64_t(st.st_size) == file.size)
+		return true;
+
+	CmbInput input;
+	Diagnostics diags;
+
+	if (!try_load_cmb_input(file.path.c_str(), input, diags))
+	{
+		file.present = false;
+		return false;
+	}
+
+	const auto hash = hash_archive_member(input.data);
+
+	file.mtimeNs = mtimeNs;
+	file.size = st.st_size;
+
+	// touched but unchanged
+	if (file.present && hash == file.hash)
+		return true;
+
+	file.present = true;
+	file.hash = hash;
+	file.data.assign(input.data.begin(), input.data.end());
+
+	file.game = get_input_game(input).game;
+	file.cmb = CmbInfo();
+	file.diags = std::move(diags);
+
+	try_decode_cmb(file.data, file.game, file.cmb, file.diags);
+	index_refs(file);
+
+	file.decodeCnt++;
+
+	return true;
+}
+
+struct LatencyLog
+{
+	void add(std::uint64_t ns)
+	{
+		if (samples.size() < DAEMON_LATENCY_WINDOW)
+			samples.push_back(ns);
+		else
+			samples[count % DAEMON_LATENCY_WINDOW] = ns;
+
+		count++;
+	}
+
+	std::uint64_t count { 0u };
+	std::vector<std::uint64_t> samples;
+};
+
+class Daemon
+{
+public:
+	bool load(const std::vector<std::string>& paths)
+	{
+		mFiles.resize(paths.size());
+
+		for (std::size_t i = 0; i < paths.size(); ++i)
+		{
+			mFiles[i].path = paths[i];
+			mByPath[paths[i]] = i;
+
+			if (!refresh_file(mFiles[i]))
+				std::cerr << paths[i] << ": error: " << get_error_message(ErrorKind::FileUnreadable) << std::endl;
+		}
+
+		return true;
+	}
+
+	std::size_t scene_count() const
+	{
+		std::size_t result = 0;
+
+		for (auto& file : mFiles)
+			result += file.cmb.scenes.size();
+
+		return result;
+	}
+
+	bool quitting() const { return mQuit; }
+
+	// Answers one request line into response (without the trailing newline)
+	void handle(const char* begin, const char* end, std::string& response)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		mResponse.str(std::string());
+		mResponse.clear();
+
+		JsonWriter writer(mResponse);
+
+		JsonValue request;
+		const char* command = "invalid";
+
+		writer.begin_object();
+
+		if (!parse_json(begin, end, request) || request.kind != JsonValue::Kind::Object)
+		{
+			writer.key("id");
+			writer.null();
+			writer.field("ok", false);
+			writer.field("error", "malformed request");
+		}
+		else
+		{
+			writer.key("id");
+			write_id(writer, request.get("id"));
+
+			auto cmd = request.get("cmd");
+
+			// unknown commands share one latency log, so that requests can't grow the map
+			if (cmd && cmd->is_string())
+			{
+				for (auto known : DAEMON_COMMANDS)
+				{
+					if (cmd->string == known)
+						command = known;
+				}
+			}
+
+			// the result is built separately, so that errors found half way through don't leave a partial result
+			mResult.str(std::string());
+			mResult.clear();
+
+			try
+			{
+				JsonWriter result(mResult);
+				dispatch(command, request, result);
+
+				writer.field("ok", true);
+				writer.key("result");
+				mResponse << mResult.str();
+			}
+			catch (const std::runtime_error& e)
+			{
+				writer.field("ok", false);
+				writer.field("error", e.what());
+			}
+		}
+
+		writer.end_object();
+
+		response = mResponse.str();
+
+		const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		mLatencies[command].add(ns);
+	}
+
+private:
+	static
+	void write_id(JsonWriter& writer, const JsonValue* id)
+	{
+		if (id && id->is_string())
+			writer.value(id->string);
+		else if (id && id->is_number() && id->number == double(std::int64_t(id->number)))
+			writer.value(std::int64_t(id->number));
+		else if (id && id->is_number())
+			writer.value(id->number);
+		else
+			writer.null();
+	}
+
+	static
+	const std::string& get_string(const JsonValue& request, const char* name)
+	{
+		auto value = request.get(name);
+
+		if (!value || !value->is_string())
+			throw std::runtime_error("missing or non-string argument");
+
+		return value->string;
+	}
+
+	static
+	bool try_get_unsigned(const JsonValue& request, const char* name, unsigned& result)
+	{
+		auto value = request.get(name);
+
+		if (!value)
+			return false;
+
+		if (!value->is_number() || value->number != std::trunc(value->number))
+			throw std::runtime_error("non-integer argument");
+
+		if (value->number < 0 || value->number > 0xFFFFFFFFu)
+			throw std::runtime_error("argument out of range");
+
+		result = unsigned(value->number);
+		return true;
+	}
+
+	CorpusFile& get_file(const JsonValue& request)
+	{
+		auto it = mByPath.find(get_string(request, "file"));
+
+		if (it == mByPath.end())
+			throw std::runtime_error("file not in corpus");
+
+		auto& file = mFiles[it->second];
+
+		if (!refresh_file(file))
+			throw std::runtime_error("file unreadable");
+
+		return file;
+	}
+
+	void dispatch(const std::string& command, const JsonValue& request, JsonWriter& writer)
+	{
+		if (command == "files")
+			cmd_files(writer);
+		else if (command == "scenes")
+			cmd_scenes(request, writer);
+		else if (command == "dump")
+			cmd_dump(request, writer);
+		else if (command == "refs")
+			cmd_refs(request, writer);
+		else if (command == "decode")
+			cmd_decode(request, writer);
+		else if (command == "stats")
+			cmd_stats(writer);
+		else if (command == "quit")
+			mQuit = true, writer.value(true);
+		else
+			throw std::runtime_error("unknown command");
+	}
+
+	void cmd_files(JsonWriter& writer)
+	{
+		writer.begin_array();
+
+		for (auto& file : mFiles)
+		{
+			refresh_file(file);
+
+			writer.begin_object();
+			writer.field("file", file.path);
+			writer.field("present", file.present);
+
+			if (file.present)
+			{
+				writer.field("game", get_game_name(file.game));
+				writer.field("bytes", std::uint64_t(file.data.size()));
+				writer.field("scenes", std::uint64_t(file.cmb.scenes.size()));
+				writer.field("issues", std::uint64_t(file.diags.size()));
+				writer.field("decodes", file.decodeCnt);
+			}
+
+			writer.end_object();
+		}
+
+		writer.end_array();
+	}
+
+	void cmd_scenes(const JsonValue& request, JsonWriter& writer)
+	{
+		auto& file = get_file(request);
+
+		writer.begin_array();
+
+		for (auto& scene : file.cmb.scenes)
+		{
+			writer.begin_object();
+			writer.field("idx", scene.idx);
+
+			if (scene.isGlobal)
+				writer.field("name", scene.name);
+
+			writer.field("kind", scene.kind);
+			writer.field("args", scene.argCnt);
+			writer.field("offset", scene.scriptOffset);
+			writer.field("instructions", std::uint64_t(scene.rawScript.size()));
+			writer.end_object();
+		}
+
+		writer.end_array();
+	}
+
+	void cmd_dump(const JsonValue& request, JsonWriter& writer)
+	{
+		auto& file = get_file(request);
+		const SceneInfo* scene = nullptr;
+
+		unsigned idx;
+
+		if (try_get_unsigned(request, "scene", idx))
+		{
+			if (idx < file.cmb.scenes.size())
+				scene = &file.cmb.scenes[idx];
+		}
+		else
+		{
+			auto& name = get_string(request, "name");
+
+			for (auto& candidate : file.cmb.scenes)
+			{
+				if (candidate.isGlobal && candidate.name == name)
+				{
+					scene = &candidate;
+					break;
+				}
+			}
+		}
+
+		if (!scene || scene->rawScript.empty())
+			throw std::runtime_error("no such scene");
+
+		Diagnostics diags;
+		try_decompile_scene(file.cmb, *scene, mAst, mScratch, diags);
+
+		mText.str(std::string());
+		mText.clear();
+
+		make_text_writer(mText)->write_scene(file.cmb, *scene, mAst);
+
+		writer.begin_object();
+		writer.field("text", mText.str());
+		writer.field("issues", std::uint64_t(diags.size()));
+		writer.end_object();
+	}
+
+	void cmd_refs(const JsonValue& request, JsonWriter& writer)
+	{
+		auto& target = get_string(request, "target");
+
+		unsigned limit = DAEMON_REFS_DEFAULT_LIMIT;
+		try_get_unsigned(request, "limit", limit);
+
+		auto write_file_refs = [&] (CorpusFile& file)
+		{
+			auto it = file.refs.find(target);
+
+			if (it == file.refs.end())
+				return;
+
+			for (auto& site : it->second)
+			{
+				if (limit == 0)
+					return;
+
+				limit--;
+
+				writer.begin_object();
+				writer.field("file", file.path);
+				writer.field("scene", site.scene);
+				writer.field("offset", site.offset);
+				writer.field("kind", get_ref_kind_name(site.kind));
+				writer.end_object();
+			}
+		};
+
+		if (request.get("file"))
+		{
+			auto& file = get_file(request);
+
+			writer.begin_array();
+			write_file_refs(file);
+			writer.end_array();
+
+			return;
+		}
+
+		writer.begin_array();
+
+		for (auto& file : mFiles)
+		{
+			if (refresh_file(file))
+				write_file_refs(file);
+		}
+
+		writer.end_array();
+	}
+
+	void cmd_decode(const JsonValue& request, JsonWriter& writer)
+	{
+		auto& file = get_file(request);
+
+		unsigned offset = 0, size = DAEMON_DECODE_DEFAULT_SIZE;
+
+		if (!try_get_unsigned(request, "offset", offset))
+			throw std::runtime_error("missing offset");
+
+		try_get_unsigned(request, "size", size);
+
+		if (offset > file.data.size())
+			throw std::runtime_error("offset out of file");
+
+		size = std::min<unsigned>({ size, unsigned(file.data.size() - offset), DAEMON_DECODE_SIZE_LIMIT });
+
+		auto game = file.game;
+
+		if (auto gameArg = request.get("game"))
+		{
+			if (gameArg->is_string() && gameArg->string == "fe9")
+				game = GameKind::FE9;
+			else if (gameArg->is_string() && gameArg->string == "fe10")
+				game = GameKind::FE10;
+			else
+				throw std::runtime_error("bad game");
+		}
+
+		const Span<const byte_type> range(file.data.data() + offset, size);
+
+		writer.begin_object();
+		writer.field("game", get_game_name(game));
+		writer.key("instructions");
+		writer.begin_array();
+
+		const char* error = nullptr;
+		unsigned i = 0;
+
+		BcIns ins;
+
+		while (i < range.size())
+		{
+			const auto status = decode_instruction(range, i, game, ins);
+
+			if (status != InsStatus::Ok)
+			{
+				error = get_error_message(status == InsStatus::InvalidOpcode
+					? ErrorKind::InvalidOpcode
+					: ErrorKind::OperandOutOfBounds);
+
+				break;
+			}
+
+			writer.begin_object();
+			writer.field("offset", offset + ins.location);
+			writer.field("opcode", std::uint32_t(ins.opcode));
+			writer.field("mnemonic", ins.info().mnemonic);
+
+			if (ins.is_jump())
+				writer.field("operand", std::int64_t(offset) + ins.operand);
+			else if (ins.info().operandSize > 0)
+				writer.field("operand", ins.operand);
+
+			if (ins.opcode == BC_OPCODE_STRING8 || ins.opcode == BC_OPCODE_STRING16 || ins.opcode == BC_OPCODE_STRING32)
+			{
+				if (auto str = file.cmb.try_get_cstr(ins.operand))
+					writer.field("string", str);
+			}
+			else if (ins.opcode == BC_OPCODE_CALLEXT)
+			{
+				if (auto str = file.cmb.try_get_cstr(unsigned(ins.operand) >> 8))
+					writer.field("string", str);
+			}
+
+			writer.end_object();
+		}
+
+		writer.end_array();
+
+		if (error)
+		{
+			writer.field("error", error);
+			writer.field("errorOffset", offset + ins.location);
+		}
+
+		writer.end_object();
+	}
+
+	void cmd_stats(JsonWriter& writer)
+	{
+		writer.begin_object();
+
+		for (auto& entry : mLatencies)
+		{
+			auto sorted = entry.second.samples;
+			std::sort(sorted.begin(), sorted.end());
+
+			auto percentile = [&] (unsigned pct)
+			{
+				if (sorted.empty())
+					return 0.0;
+
+				return sorted[(sorted.size() - 1) * pct / 100] / 1000.0;
+			};
+
+			writer.key(entry.first.c_str());
+			writer.begin_object();
+			writer.field("count", entry.second.count);
+			writer.field("p50", percentile(50));
+			writer.field("p90", percentile(90));
+			writer.field("p99", percentile(99));
+			writer.field("max", percentile(100));
+			writer.end_object();
+		}
+
+		writer.end_object();
+	}
+
+	std::vector<CorpusFile> mFiles;
+	std::unordered_map<std::string, std::size_t> mByPath;
+
+	std::unordered_map<std::string, LatencyLog> mLatencies;
+
+	// reused between requests
+	std::ostringstream mResponse, mResult, mText;
+	SceneAst mAst;
+	DecompileScratch mScratch;
+
+	bool mQuit { false };
+};
+
+static
+int serve_stdio(Daemon& daemon)
+{
+	std::ios::sync_with_stdio(false);
+
+	std::string line, response;
+
+	while (!daemon.quitting() && std::getline(std::cin, line))
+	{
+		if (line.empty())
+			continue;
+
+		if (line.size() > DAEMON_LINE_LIMIT)
+			line.clear(); // answered as malformed
+
+		daemon.handle(line.data(), line.data() + line.size(), response);
+
+		std::cout << response << '\n';
+		std::cout.flush();
+	}
+
+	return 0;
+}
+
+static
+bool send_all(int fd, const char* data, std::size_t size)
+{
+	while (size > 0)
+	{
+		const auto sent = ::send(fd, data, size, MSG_NOSIGNAL);
+
+		if (sent < 0 && errno == EINTR)
+			continue;
+
+		if (sent <= 0)
+			return false;
+
+		data += sent;
+		size -= sent;
+	}
+
+	return true;
+}
+
+// Serves any number of clients, one request at a time (requests are short, so nobody waits for long)
+static
+int serve_socket(Daemon& daemon, const char* path)
+{
+	sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if (std::strlen(path) >= sizeof(addr.sun_path))
+	{
+		std::cerr << path << ": socket path too long" << std::endl;
+		return 2;
+	}
+
+	std::strcpy(addr.sun_path, path);
+
+	const int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+	// a stale socket from an earlier run would make bind fail
+	::unlink(path);
+
+	if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listenFd, 16) != 0)
+	{
+		std::cerr << path << ": " << std::strerror(errno) << std::endl;
+		return 2;
+	}
+
+	struct Client
+	{
+		int fd;
+		std::string input;
+	};
+
+	std::vector<Client> clients;
+	std::vector<pollfd> fds;
+
+	std::string response;
+	char buf[0x10000];
+
+	while (!daemon.quitting())
+	{
+		fds.clear();
+		fds.push_back({ listenFd, POLLIN, 0 });
+
+		for (auto& client : clients)
+			fds.push_back({ client.fd, POLLIN, 0 });
+
+		if (::poll(fds.data(), fds.size(), -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		if (fds[0].revents & POLLIN)
+		{
+			const int fd = ::accept(listenFd, nullptr, nullptr);
+
+			if (fd >= 0)
+				clients.push_back({ fd, std::string() });
+		}
+
+		// fds[i+1] is clients[i], clients accepted just now are past the end of fds
+		for (std::size_t i = fds.size() - 1; i > 0 && !daemon.quitting(); --i)
+		{
+			if (fds[i].revents == 0)
+				continue;
+
+			auto& client = clients[i - 1];
+			bool drop = true;
+
+			const auto got = (fds[i].revents & (POLLIN | POLLHUP)) ? ::read(client.fd, buf, sizeof(buf)) : -1;
+
+			if (got > 0)
+			{
+				drop = false;
+				client.input.append(buf, got);
+
+				std::size_t begin = 0, end;
+
+				while (!drop && (end = client.input.find('\n', begin)) != std::string::npos)
+				{
+					if (end > begin)
+					{
+						daemon.handle(client.input.data() + begin, client.input.data() + end, response);
+						response += '\n';
+
+						drop = !send_all(client.fd, response.data(), response.size());
+					}
+
+					begin = end + 1;
+				}
+
+				client.input.erase(0, begin);
+
+				if (client.input.size() > DAEMON_LINE_LIMIT)
+					drop = true;
+			}
+
+			if (drop)
+			{
+				::close(client.fd);
+				clients.erase(clients.begin() + (i - 1));
+			}
+		}
+	}
+
+	for (auto& client : clients)
+		::close(client.fd);
+
+	::close(listenFd);
+	::unlink(path);
+
+	return 0;
+}
+
+int run_daemon(int argc, char** argv)
+{
+	const char* socketPath = nullptr;
+	std::vector<const char*> paths;
+
+	for (int i = 0; i < argc; ++i)
+	{
+		if (std::strncmp(argv[i], "--socket=", 9) == 0 && argv[i][9] != '\0')
+			socketPath = argv[i] + 9;
+		else if (argv[i][0] == '-')
+			return 1;
+		else
+			paths.push_back(argv[i]);
+	}
+
+	std::vector<std::string> files;
+
+	if (paths.empty() || !collect_input_files(paths, files))
+		return 1;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	Daemon daemon;
+	daemon.load(files);
+
+	const auto loadMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+	std::cerr << "daemon: " << files.size() << " files, " << daemon.scene_count() << " scenes loaded in " << loadMs << " ms" << std::endl;
+
+	return socketPath
+		? serve_socket(daemon, socketPath)
+		: serve_stdio(daemon);
+}
+
+} // namespace soren
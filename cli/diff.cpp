@@ -0,0 +1,52 @@
+#include "cli/commands.h"
+
+#include "core/diagnostics.h"
+#include "decode/decode.h"
+#include "decode/detect.h"
+#include "decode/archive.h"
+#include "analysis/diff.h"
+
+#include <iostream>
+#include <cstring>
+
+namespace soren {
+
+// soren diff <old.cmb> <new.cmb>
+// Exit code follows diff(1): 0 if identical, 1 if different, 2 on trouble
+
+static
+bool load_cmb(const char* filename, CmbInfo& result)
+{
+	CmbInput input;
+	Diagnostics diags;
+
+	if (try_load_cmb_input(filename, input, diags))
+		try_decode_cmb(input.data, get_input_game(input).game, result, diags);
+
+	for (auto& diag : diags.list)
+		std::cerr << filename << ": error: " << diag << std::endl;
+
+	return !result.scenes.empty() || diags.empty();
+}
+
+int run_diff(int argc, char** argv)
+{
+	if (argc != 2)
+		return 2;
+
+	CmbInfo a, b;
+
+	if (!load_cmb(argv[0], a) || !load_cmb(argv[1], b))
+		return 2;
+
+	const auto diff = diff_cmb(a, b);
+
+	std::cout << "--- " << argv[0] << std::endl;
+	std::cout << "+++ " << argv[1] << std::endl;
+
+	write_cmb_diff(std::cout, a, b, diff);
+
+	return diff.identical() ? 0 : 1;
+}
+
+} // namespace soren
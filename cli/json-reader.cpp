@@ -0,0 +1,317 @@
+#include "cli/json-reader.h"
+
+#include <cstring>
+#include <cstdlib>
+
+namespace soren {
+
+const JsonValue* JsonValue::get(const char* name) const
+{
+	if (kind != Kind::Object)
+		return nullptr;
+
+	for (auto& member : object)
+	{
+		if (member.first == name)
+			return &member.second;
+	}
+
+	return nullptr;
+}
+
+class JsonParser
+{
+public:
+	JsonParser(const char* begin, const char* end)
+		: mIt(begin), mEnd(end) {}
+
+	bool parse_document(JsonValue& result)
+	{
+		if (!parse_value(result, 0))
+			return false;
+
+		skip_space();
+		return mIt == mEnd;
+	}
+
+private:
+	void skip_space()
+	{
+		while (mIt != mEnd && (*mIt == ' ' || *mIt == '\t' || *mIt == '\n' || *mIt == '\r'))
+			++mIt;
+	}
+
+	bool consume(char chr)
+	{
+		skip_space();
+
+		if (mIt == mEnd || *mIt != chr)
+			return false;
+
+		++mIt;
+		return true;
+	}
+
+	bool consume_word(const char* word)
+	{
+		const auto len = std::strlen(word);
+
+		if (std::size_t(mEnd - mIt) < len || std::memcmp(mIt, word, len) != 0)
+			return false;
+
+		mIt += len;
+		return true;
+	}
+
+	bool parse_value(JsonValue& result, unsigned depth)
+	{
+		if (depth >= JSON_DEPTH_LIMIT)
+			return false;
+
+		skip_space();
+
+		if (mIt == mEnd)
+			return false;
+
+		switch (*mIt)
+		{
+
+		case '{':
+			result.kind = JsonValue::Kind::Object;
+			return parse_object(result, depth);
+
+		case '[':
+			result.kind = JsonValue::Kind::Array;
+			return parse_array(result, depth);
+
+		case '"':
+			result.kind = JsonValue::Kind::String;
+			return parse_string(result.string);
+
+		case 't':
+			result.kind = JsonValue::Kind::Bool;
+			result.boolean = true;
+			return consume_word("true");
+
+		case 'f':
+			result.kind = JsonValue::Kind::Bool;
+			result.boolean = false;
+			return consume_word("false");
+
+		case 'n':
+			result.kind = JsonValue::Kind::Null;
+			return consume_word("null");
+
+		default:
+			result.kind = JsonValue::Kind::Number;
+			return parse_number(result.number);
+
+		} // switch (*mIt)
+	}
+
+	bool parse_object(JsonValue& result, unsigned depth)
+	{
+		++mIt; // '{'
+
+		if (consume('}'))
+			return true;
+
+		do
+		{
+			result.object.emplace_back();
+			auto& member = result.object.back();
+
+			skip_space();
+
+			if (mIt == mEnd || *mIt != '"' || !parse_string(member.first))
+				return false;
+
+			if (!consume(':') || !parse_value(member.second, depth + 1))
+				return false;
+		}
+		while (consume(','));
+
+		return consume('}');
+	}
+
+	bool parse_array(JsonValue& result, unsigned depth)
+	{
+		++mIt; // '['
+
+		if (consume(']'))
+			return true;
+
+		do
+		{
+			result.array.emplace_back();
+
+			if (!parse_value(result.array.back(), depth + 1))
+				return false;
+		}
+		while (consume(','));
+
+		return consume(']');
+	}
+
+	bool parse_number(double& result)
+	{
+		// strtod is more lenient than JSON (hex, inf, ...), so check the first character at least
+		if (*mIt != '-' && (*mIt < '0' || *mIt > '9'))
+			return false;
+
+		// the input isn't null terminated, numbers are short enough to be copied out
+		char buf[64];
+		std::size_t len = 0;
+
+		while (mIt + len != mEnd && len < sizeof(buf) - 1 && std::strchr("+-.0123456789eE", mIt[len]) && mIt[len] != '\0')
+			++len;
+
+		std::memcpy(buf, mIt, len);
+		buf[len] = '\0';
+
+		char* numEnd = nullptr;
+		result = std::strtod(buf, &numEnd);
+
+		if (numEnd != buf + len)
+			return false;
+
+		mIt += len;
+		return true;
+	}
+
+	static
+	int hex_digit(char chr)
+	{
+		if (chr >= '0' && chr <= '9') return chr - '0';
+		if (chr >= 'a' && chr <= 'f') return chr - 'a' + 10;
+		if (chr >= 'A' && chr <= 'F') return chr - 'A' + 10;
+
+		return -1;
+	}
+
+	bool parse_hex4(unsigned& result)
+	{
+		if (mEnd - mIt < 4)
+			return false;
+
+		result = 0;
+
+		for (unsigned i = 0; i < 4; ++i)
+		{
+			const int digit = hex_digit(*mIt++);
+
+			if (digit < 0)
+				return false;
+
+			result = (result << 4) | digit;
+		}
+
+		return true;
+	}
+
+	static
+	void append_utf8(std::string& result, unsigned cp)
+	{
+		if (cp < 0x80)
+		{
+			result += char(cp);
+		}
+		else if (cp < 0x800)
+		{
+			result += char(0xC0 | (cp >> 6));
+			result += char(0x80 | (cp & 0x3F));
+		}
+		else if (cp < 0x10000)
+		{
+			result += char(0xE0 | (cp >> 12));
+			result += char(0x80 | ((cp >> 6) & 0x3F));
+			result += char(0x80 | (cp & 0x3F));
+		}
+		else
+		{
+			result += char(0xF0 | (cp >> 18));
+			result += char(0x80 | ((cp >> 12) & 0x3F));
+			result += char(0x80 | ((cp >> 6) & 0x3F));
+			result += char(0x80 | (cp & 0x3F));
+		}
+	}
+
+	bool parse_string(std::string& result)
+	{
+		++mIt; // '"'
+
+		while (mIt != mEnd)
+		{
+			const char chr = *mIt++;
+
+			if (chr == '"')
+				return true;
+
+			if (static_cast<unsigned char>(chr) < 0x20)
+				return false;
+
+			if (chr != '\\')
+			{
+				result += chr;
+				continue;
+			}
+
+			if (mIt == mEnd)
+				return false;
+
+			switch (*mIt++)
+			{
+
+			case '"':  result += '"'; break;
+			case '\\': result += '\\'; break;
+			case '/':  result += '/'; break;
+			case 'b':  result += '\b'; break;
+			case 'f':  result += '\f'; break;
+			case 'n':  result += '\n'; break;
+			case 'r':  result += '\r'; break;
+			case 't':  result += '\t'; break;
+
+			case 'u':
+			{
+				unsigned cp;
+
+				if (!parse_hex4(cp))
+					return false;
+
+				// surrogate pair
+				if (cp >= 0xD800 && cp < 0xDC00)
+				{
+					unsigned low;
+
+					if (!consume_word("\\u") || !parse_hex4(low) || low < 0xDC00 || low >= 0xE000)
+						return false;
+
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+				}
+
+				append_utf8(result, cp);
+				break;
+			}
+
+			default:
+				return false;
+
+			} // switch (*mIt++)
+		}
+
+		return false; // unterminated
+	}
+
+	const char* mIt;
+	const char* mEnd;
+};
+
+bool parse_json(const char* begin, const char* end, JsonValue& result)
+{
+	result = JsonValue();
+
+	JsonParser parser(begin, end);
+	return parser.parse_document(result);
+}
+
+} // namespace soren
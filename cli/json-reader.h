@@ -0,0 +1,52 @@
+#ifndef SOREN_CLI_JSON_READER_INCLUDED
+#define SOREN_CLI_JSON_READER_INCLUDED
+
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace soren {
+
+// Minimal JSON reader, for small request documents (see cli/daemon.cpp)
+// Everything is parsed into a tree; \u escapes are decoded to UTF-8
+
+struct JsonValue
+{
+	enum class Kind
+	{
+		Null,
+		Bool,
+		Number,
+		String,
+		Array,
+		Object,
+	};
+
+	// nullptr if this isn't an object or has no such member
+	const JsonValue* get(const char* name) const;
+
+	bool is_string() const { return kind == Kind::String; }
+	bool is_number() const { return kind == Kind::Number; }
+
+	Kind kind { Kind::Null };
+
+	bool boolean { false };
+	double number { 0.0 };
+	std::string string;
+
+	std::vector<JsonValue> array;
+	std::vector<std::pair<std::string, JsonValue>> object;
+};
+
+// Parses exactly one value spanning [begin, end) (surrounding whitespace allowed)
+// Returns false on any syntax error, or if nesting is deeper than JSON_DEPTH_LIMIT
+bool parse_json(const char* begin, const char* end, JsonValue& result);
+
+enum
+{
+	JSON_DEPTH_LIMIT = 64,
+};
+
+} // namespace soren
+
+#endif // SOREN_CLI_JSON_READER_INCLUDED
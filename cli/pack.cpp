@@ -0,0 +1,142 @@
+#include "cli/commands.h"
+
+#include "core/io.h"
+#include "core/diagnostics.h"
+#include "decode/lz.h"
+#include "decode/detect.h"
+#include "decode/archive.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+namespace soren {
+
+// soren pack --output=PATH <dir or file>...
+// Packs CMB files into one archive (see decode/archive.h), which every mode then takes in place of the files
+// Files found in a directory are named relative to it, other files are named as given; names must be distinct
+
+struct PackFile
+{
+	std::string path;
+	std::string name;
+	std::vector<byte_type> data;
+};
+
+static
+bool collect_pack_files(const char* path, std::vector<PackFile>& result)
+{
+	if (!is_directory(path))
+	{
+		result.push_back({ path, path, {} });
+		return true;
+	}
+
+	std::vector<std::string> files;
+
+	if (!list_files(path, ".cmb", files))
+	{
+		std::cerr << path << ": error: couldn't list directory" << std::endl;
+		return false;
+	}
+
+	const auto pathLen = std::strlen(path);
+	const auto prefixLen = (pathLen > 0 && path[pathLen - 1] == '/') ? pathLen : pathLen + 1;
+
+	for (auto& file : files)
+		result.push_back({ file, file.substr(prefixLen), {} });
+
+	return true;
+}
+
+int run_pack(int argc, char** argv)
+{
+	std::string output;
+	std::vector<const char*> paths;
+
+	for (int i = 0; i < argc; ++i)
+	{
+		if (std::strncmp(argv[i], "--output=", 9) == 0)
+			output = argv[i] + 9;
+		else if (argv[i][0] == '-')
+			return 1;
+		else
+			paths.push_back(argv[i]);
+	}
+
+	if (paths.empty() || output.empty())
+		return 1;
+
+	std::vector<PackFile> files;
+
+	for (auto path : paths)
+	{
+		if (!collect_pack_files(path, files))
+			return 2;
+	}
+
+	// write_archive would refuse duplicate names too, but here they can be reported by path
+	std::sort(files.begin(), files.end(), [] (const PackFile& a, const PackFile& b)
+	{
+		return a.name < b.name;
+	});
+
+	for (std::size_t i = 1; i < files.size(); ++i)
+	{
+		if (files[i].name == files[i - 1].name)
+		{
+			std::cerr << files[i].path << ": error: member name '" << files[i].name << "' is also used by "
+				<< files[i - 1].path << std::endl;
+
+			return 2;
+		}
+	}
+
+	std::vector<ArchiveInput> inputs;
+	inputs.reserve(files.size());
+
+	std::vector<byte_type> decompressed;
+
+	for (auto& file : files)
+	{
+		if (!read_entire_file(file.path.c_str(), file.data))
+		{
+			std::cerr << file.path << ": error: " << get_error_message(ErrorKind::FileUnreadable) << std::endl;
+			return 2;
+		}
+
+		// members are stored as they are, detection looks at what they decompress to
+		Span<const byte_type> data = file.data;
+		Diagnostics diags;
+
+		if (detect_lz(data) != LzKind::None)
+		{
+			if (!try_lz_decompress(data, decompressed, diags))
+			{
+				for (auto& diag : diags.list)
+					std::cerr << file.path << ": error: " << diag << std::endl;
+
+				return 2;
+			}
+
+			data = decompressed;
+		}
+
+		inputs.push_back({ file.name, file.data, detect_game(data) });
+	}
+
+	std::ofstream out(output, std::ios::binary);
+
+	if (!write_archive(out, std::move(inputs)) || !out.flush())
+	{
+		std::cerr << output << ": error: couldn't write archive" << std::endl;
+		return 2;
+	}
+
+	std::cerr << output << ": " << files.size() << " members" << std::endl;
+
+	return 0;
+}
+
+} // namespace soren
@@ -0,0 +1,112 @@
+#include "cli/commands.h"
+
+#include "core/diagnostics.h"
+#include "decode/decode.h"
+#include "decode/detect.h"
+#include "decode/archive.h"
+#include "analysis/corpus.h"
+
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <cstring>
+
+namespace soren {
+
+// soren stats-corpus [--format=csv|json] [--jobs=N] [--top=N] <dir or file>...
+
+static
+void gather_worker(const std::vector<std::string>& files, std::atomic<std::size_t>& next, CorpusStats& result)
+{
+	CmbInput input;
+	CmbInfo cmb;
+	Diagnostics diags;
+
+	for (;;)
+	{
+		const auto i = next.fetch_add(1, std::memory_order_relaxed);
+
+		if (i >= files.size())
+			break;
+
+		diags.clear();
+
+		if (!try_load_cmb_input(files[i].c_str(), input, diags))
+		{
+			result.failedFileCnt++;
+			continue;
+		}
+
+		const auto game = get_input_game(input).game;
+
+		if (!try_decode_cmb(input.data, game, cmb, diags) && cmb.scenes.empty())
+		{
+			result.failedFileCnt++;
+			continue;
+		}
+
+		result.add_cmb(cmb, game);
+	}
+}
+
+int run_stats_corpus(int argc, char** argv)
+{
+	CorpusFormat format = CorpusFormat::Csv;
+	unsigned jobs = std::thread::hardware_concurrency();
+	unsigned top = 50;
+
+	std::vector<const char*> paths;
+
+	for (int i = 0; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--format=csv") == 0)
+			format = CorpusFormat::Csv;
+		else if (std::strcmp(argv[i], "--format=json") == 0)
+			format = CorpusFormat::Json;
+		else if (parse_unsigned_option(argv[i], "--jobs=", jobs))
+			continue;
+		else if (parse_unsigned_option(argv[i], "--top=", top))
+			continue;
+		else if (argv[i][0] == '-')
+			return 1;
+		else
+			paths.push_back(argv[i]);
+	}
+
+	if (paths.empty())
+		return 1;
+
+	std::vector<std::string> files;
+
+	if (!collect_input_files(paths, files))
+		return 2;
+
+	if (jobs == 0)
+		jobs = 1;
+
+	if (jobs > files.size())
+		jobs = files.size() ? files.size() : 1;
+
+	// every worker has its own counters, nothing is shared but the index of the next file
+	std::vector<CorpusStats> perWorker(jobs);
+	std::vector<std::thread> workers;
+
+	std::atomic<std::size_t> next { 0u };
+
+	for (unsigned i = 1; i < jobs; ++i)
+		workers.emplace_back(gather_worker, std::cref(files), std::ref(next), std::ref(perWorker[i]));
+
+	gather_worker(files, next, perWorker[0]);
+
+	for (auto& worker : workers)
+		worker.join();
+
+	for (unsigned i = 1; i < jobs; ++i)
+		perWorker[0].merge(perWorker[i]);
+
+	write_corpus_stats(std::cout, perWorker[0], format, top);
+
+	return perWorker[0].failedFileCnt == 0 ? 0 : 2;
+}
+
+} // namespace soren
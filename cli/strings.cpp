@@ -0,0 +1,409 @@
+#include "cli/commands.h"
+
+#include "core/io.h"
+#include "core/diagnostics.h"
+#include "decode/decode.h"
+#include "decode/lz.h"
+#include "decode/detect.h"
+#include "decode/archive.h"
+#include "compile/compile.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <map>
+#include <set>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+namespace soren {
+
+// soren strings export [--jobs=N] <dir or file>...
+// soren strings import [--jobs=N] [--dry-run] <table.tsv>
+//
+// The table is tab separated, one row per string pushed by a STRING instruction (in reachable code):
+//   file, pool offset, xrefs (scene:file offset of every instruction pushing it, comma separated), text
+// Text is written as it is in the pool (no re-encoding), with \, tab, newline and carriage return escaped as
+// \\, \t, \n and \r. Import rewrites the files named by the table in place, with the text of every row it has.
+
+static const char sTableHeader[] = "file\toffset\txrefs\ttext";
+
+static
+void write_escaped(std::ostream& out, const char* str)
+{
+	for (; *str != '\0'; ++str)
+	{
+		switch (*str)
+		{
+
+		case '\\': out << "\\\\"; break;
+		case '\t': out << "\\t"; break;
+		case '\n': out << "\\n"; break;
+		case '\r': out << "\\r"; break;
+		default: out.put(*str); break;
+
+		} // switch (*str)
+	}
+}
+
+// Returns false on an unknown escape
+static
+bool unescape(const char* begin, const char* end, std::string& result)
+{
+	result.clear();
+
+	for (const char* it = begin; it != end; ++it)
+	{
+		if (*it != '\\')
+		{
+			result.push_back(*it);
+			continue;
+		}
+
+		if (++it == end)
+			return false;
+
+		switch (*it)
+		{
+
+		case '\\': result.push_back('\\'); break;
+		case 't': result.push_back('\t'); break;
+		case 'n': result.push_back('\n'); break;
+		case 'r': result.push_back('\r'); break;
+		default: return false;
+
+		} // switch (*it)
+	}
+
+	return true;
+}
+
+// Export
+
+struct ExportedFile
+{
+	std::string table; // rows
+	std::string errors;
+};
+
+static
+void export_strings(const std::string& file, ExportedFile& result)
+{
+	CmbInput input;
+	CmbInfo cmb;
+	Diagnostics diags;
+
+	std::ostringstream errors;
+
+	if (!try_load_cmb_input(file.c_str(), input, diags) || !try_decode_cmb(input.data, get_input_game(input).game, cmb, diags))
+	{
+		for (auto& diag : diags.list)
+			errors << file << ": error: " << diag << std::endl;
+
+		result.errors = errors.str();
+		return;
+	}
+
+	// offset -> (scene, file offset) of every instruction pushing it, in order
+	std::map<unsigned, std::vector<std::pair<unsigned, unsigned>>> xrefs;
+
+	for (auto& scene : cmb.scenes)
+	{
+		for (auto& ins : scene.rawScript)
+		{
+			if (ins.opcode == BC_OPCODE_STRING8 || ins.opcode == BC_OPCODE_STRING16 || ins.opcode == BC_OPCODE_STRING32)
+				xrefs[ins.operand].push_back({ scene.idx, scene.scriptOffset + ins.location });
+		}
+	}
+
+	std::ostringstream out;
+
+	for (auto& entry : xrefs)
+	{
+		const char* str = cmb.try_get_cstr(entry.first);
+
+		if (str == nullptr)
+		{
+			errors << file << ": error: " << Diagnostic { ErrorKind::BadStringOffset, entry.second[0].second, static_cast<int>(entry.second[0].first) } << std::endl;
+			continue;
+		}
+
+		out << file << "\t0x" << std::hex << entry.first << "\t";
+
+		for (std::size_t i = 0; i < entry.second.size(); ++i)
+			out << (i ? "," : "") << std::dec << entry.second[i].first << ":0x" << std::hex << entry.second[i].second;
+
+		out << "\t" << std::dec;
+		write_escaped(out, str);
+		out << "\n";
+	}
+
+	result.table = out.str();
+	result.errors = errors.str();
+}
+
+static
+int run_strings_export(unsigned jobs, const std::vector<const char*>& paths)
+{
+	std::vector<std::string> files;
+
+	if (!collect_input_files(paths, files))
+		return 2;
+
+	std::vector<ExportedFile> results(files.size());
+
+	run_parallel(jobs, files.size(), [&] (std::size_t i)
+	{
+		export_strings(files[i], results[i]);
+	});
+
+	bool ok = true;
+
+	std::cout << sTableHeader << "\n";
+
+	for (auto& result : results)
+	{
+		std::cout << result.table;
+		std::cerr << result.errors;
+
+		ok = ok && result.errors.empty();
+	}
+
+	std::cout.flush();
+
+	return ok ? 0 : 2;
+}
+
+// Import
+
+struct ImportedFile
+{
+	std::string path;
+	std::vector<StringEdit> edits;
+
+	Diagnostics diags;
+	bool compressed { false };
+	bool unwritable { false };
+};
+
+static
+void import_strings(ImportedFile& file, bool dryRun)
+{
+	std::vector<byte_type> raw, data;
+
+	if (!read_entire_file(file.path.c_str(), raw))
+	{
+		file.diags.report(ErrorKind::FileUnreadable, 0);
+		return;
+	}
+
+	Span<const byte_type> input = raw;
+
+	if (detect_lz(input) != LzKind::None)
+	{
+		if (!try_lz_decompress(input, data, file.diags))
+			return;
+
+		file.compressed = true;
+		input = data;
+	}
+
+	std::vector<byte_type> result;
+
+	if (!try_rewrite_strings(input, detect_game(input).game, file.edits, result, file.diags))
+		return;
+
+	if (dryRun)
+		return;
+
+	// written next to it then renamed over it, so that a failed write leaves the original
+	const std::string temp = file.path + ".tmp";
+
+	std::ofstream out(temp, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(result.data()), result.size());
+	out.close();
+
+	if (!out || std::rename(temp.c_str(), file.path.c_str()) != 0)
+	{
+		std::remove(temp.c_str());
+		file.unwritable = true;
+	}
+}
+
+static
+int run_strings_import(unsigned jobs, bool dryRun, const char* tablePath)
+{
+	std::vector<byte_type> table;
+
+	if (!read_entire_file(tablePath, table))
+	{
+		std::cerr << tablePath << ": error: " << get_error_message(ErrorKind::FileUnreadable) << std::endl;
+		return 2;
+	}
+
+	// Rows, grouped by file (in the order files first appear)
+
+	std::vector<ImportedFile> files;
+	std::map<std::string, std::size_t> fileIndices;
+	std::set<std::string> members; // archive members met (reported once each)
+
+	const char* it = reinterpret_cast<const char*>(table.data());
+	const char* const end = it + table.size();
+
+	bool ok = true;
+
+	for (unsigned line = 1; it != end; ++line)
+	{
+		const char* lineEnd = static_cast<const char*>(std::memchr(it, '\n', end - it));
+
+		if (lineEnd == nullptr)
+			lineEnd = end;
+
+		const char* next = (lineEnd == end) ? end : lineEnd + 1;
+
+		if (lineEnd != it && lineEnd[-1] == '\r')
+			--lineEnd;
+
+		// file, offset, xrefs (ignored), text
+		const char* fields[4] = {};
+		const char* fieldEnds[4] = {};
+
+		unsigned fieldCnt = 0;
+
+		for (const char* field = it; fieldCnt < 4;)
+		{
+			const char* tab = (fieldCnt < 3)
+				? static_cast<const char*>(std::memchr(field, '\t', lineEnd - field))
+				: nullptr;
+
+			fields[fieldCnt] = field;
+			fieldEnds[fieldCnt] = (tab != nullptr) ? tab : lineEnd;
+			fieldCnt++;
+
+			if (tab == nullptr)
+				break;
+
+			field = tab + 1;
+		}
+
+		const std::string row(it, lineEnd);
+		it = next;
+
+		if (row.empty() || (line == 1 && row == sTableHeader))
+			continue;
+
+		StringEdit edit;
+
+		// fields are only read from whole rows
+		std::string offset;
+		char* offsetEnd = nullptr;
+
+		if (fieldCnt == 4)
+		{
+			offset.assign(fields[1], fieldEnds[1]);
+			edit.offset = std::strtoul(offset.c_str(), &offsetEnd, 0);
+		}
+
+		if (fieldCnt != 4 || offset.empty() || *offsetEnd != '\0' || !unescape(fields[3], fieldEnds[3], edit.text))
+		{
+			std::cerr << tablePath << ":" << line << ": error: malformed row" << std::endl;
+			ok = false;
+			continue;
+		}
+
+		const std::string path(fields[0], fieldEnds[0]);
+
+		if (is_archive_member(path.c_str()))
+		{
+			if (members.insert(path).second)
+				std::cerr << tablePath << ":" << line << ": error: " << path << " is an archive member, those can't be rewritten" << std::endl;
+
+			ok = false;
+			continue;
+		}
+
+		auto found = fileIndices.find(path);
+
+		if (found == fileIndices.end())
+		{
+			found = fileIndices.emplace(path, files.size()).first;
+
+			files.emplace_back();
+			files.back().path = path;
+		}
+
+		files[found->second].edits.push_back(std::move(edit));
+	}
+
+	if (!ok)
+		return 2;
+
+	run_parallel(jobs, files.size(), [&] (std::size_t i)
+	{
+		import_strings(files[i], dryRun);
+	});
+
+	std::size_t rewrittenCnt = 0;
+
+	for (auto& file : files)
+	{
+		for (auto& diag : file.diags.list)
+			std::cerr << file.path << ": error: " << diag << std::endl;
+
+		if (file.unwritable)
+			std::cerr << file.path << ": error: couldn't write file" << std::endl;
+
+		if (!file.diags.empty() || file.unwritable)
+		{
+			ok = false;
+			continue;
+		}
+
+		if (file.compressed)
+			std::cerr << file.path << ": note: was LZ compressed, written back uncompressed" << std::endl;
+
+		rewrittenCnt++;
+	}
+
+	std::cerr << rewrittenCnt << " of " << files.size() << " files " << (dryRun ? "would be rewritten" : "rewritten") << std::endl;
+
+	return ok ? 0 : 2;
+}
+
+int run_strings(int argc, char** argv)
+{
+	if (argc < 1)
+		return 1;
+
+	const bool isExport = std::strcmp(argv[0], "export") == 0;
+	const bool isImport = std::strcmp(argv[0], "import") == 0;
+
+	if (!isExport && !isImport)
+		return 1;
+
+	unsigned jobs = std::thread::hardware_concurrency();
+	bool dryRun = false;
+
+	std::vector<const char*> paths;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (parse_unsigned_option(argv[i], "--jobs=", jobs))
+			continue;
+		else if (isImport && std::strcmp(argv[i], "--dry-run") == 0)
+			dryRun = true;
+		else if (argv[i][0] == '-')
+			return 1;
+		else
+			paths.push_back(argv[i]);
+	}
+
+	if (isExport)
+		return paths.empty() ? 1 : run_strings_export(jobs, paths);
+
+	return (paths.size() != 1) ? 1 : run_strings_import(jobs, dryRun, paths[0]);
+}
+
+} // namespace soren
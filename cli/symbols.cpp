@@ -0,0 +1,211 @@
+#include "cli/commands.h"
+
+#include "core/io.h"
+#include "core/diagnostics.h"
+#include "decode/archive.h"
+#include "decode/symbols.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+namespace soren {
+
+// soren symbols build --output=PATH <symbols.tsv>...
+// soren symbols hash <dir or file>...
+//
+// Symbol sources are tab separated, one symbol per line (empty lines and lines starting with # are skipped):
+//   game (fe9|fe10), file (* or the 64-bit hash printed by soren symbols hash), scene, slot, name
+// scene is - for globals, slot is - for scene names (see decode/symbols.h)
+
+static
+bool parse_symbol_index(const std::string& field, std::uint32_t& result)
+{
+	if (field == "-")
+	{
+		result = SYMBOL_NONE;
+		return true;
+	}
+
+	char* end = nullptr;
+	const auto value = std::strtoul(field.c_str(), &end, 10);
+
+	if (field.empty() || *end != '\0' || value >= SYMBOL_NONE)
+		return false;
+
+	result = value;
+	return true;
+}
+
+static
+bool parse_symbol_line(const std::string& line, SymbolInput& result)
+{
+	std::string fields[5];
+	std::size_t begin = 0;
+
+	for (unsigned i = 0; i < 5; ++i)
+	{
+		const auto tab = (i < 4) ? line.find('\t', begin) : std::string::npos;
+
+		if (i < 4 && tab == std::string::npos)
+			return false;
+
+		fields[i] = line.substr(begin, tab - begin);
+		begin = tab + 1;
+	}
+
+	if (fields[0] == "fe9")
+		result.key.game = GameKind::FE9;
+	else if (fields[0] == "fe10")
+		result.key.game = GameKind::FE10;
+	else
+		return false;
+
+	if (fields[1] == "*")
+	{
+		result.key.file = SYMBOL_ANY_FILE;
+	}
+	else
+	{
+		char* end = nullptr;
+		result.key.file = std::strtoull(fields[1].c_str(), &end, 16);
+
+		if (fields[1].empty() || *end != '\0' || result.key.file == SYMBOL_ANY_FILE)
+			return false;
+	}
+
+	if (!parse_symbol_index(fields[2], result.key.scene) || !parse_symbol_index(fields[3], result.key.slot))
+		return false;
+
+	if (result.key.scene == SYMBOL_NONE && result.key.slot == SYMBOL_NONE)
+		return false;
+
+	result.name = std::move(fields[4]);
+
+	return !result.name.empty();
+}
+
+static
+int run_symbols_build(const std::string& output, const std::vector<const char*>& paths)
+{
+	std::vector<SymbolInput> inputs;
+
+	for (auto path : paths)
+	{
+		std::ifstream in(path, std::ios::binary);
+
+		if (!in)
+		{
+			std::cerr << path << ": error: " << get_error_message(ErrorKind::FileUnreadable) << std::endl;
+			return 2;
+		}
+
+		std::string line;
+
+		for (unsigned lineNum = 1; std::getline(in, line); ++lineNum)
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			if (line.empty() || line[0] == '#')
+				continue;
+
+			SymbolInput input;
+
+			if (!parse_symbol_line(line, input))
+			{
+				std::cerr << path << ":" << lineNum << ": error: malformed symbol" << std::endl;
+				return 2;
+			}
+
+			inputs.push_back(std::move(input));
+		}
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+
+	std::ofstream out(output, std::ios::binary);
+
+	if (!write_symbol_db(out, inputs) || !out.flush())
+	{
+		std::cerr << output << ": error: couldn't write symbol database (are some symbols defined twice?)" << std::endl;
+		return 2;
+	}
+
+	const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+	std::cerr << output << ": " << inputs.size() << " symbols (" << ms << " ms)" << std::endl;
+
+	return 0;
+}
+
+static
+int run_symbols_hash(const std::vector<const char*>& paths)
+{
+	std::vector<std::string> files;
+
+	if (!collect_input_files(paths, files))
+		return 2;
+
+	bool ok = true;
+
+	CmbInput input;
+	Diagnostics diags;
+
+	for (auto& file : files)
+	{
+		diags.clear();
+
+		if (!try_load_cmb_input(file.c_str(), input, diags))
+		{
+			for (auto& diag : diags.list)
+				std::cerr << file << ": error: " << diag << std::endl;
+
+			ok = false;
+			continue;
+		}
+
+		std::cout << std::hex << std::setw(16) << std::setfill('0') << hash_symbol_file(input.data) << std::dec
+			<< "\t" << file << "\n";
+	}
+
+	return ok ? 0 : 2;
+}
+
+int run_symbols(int argc, char** argv)
+{
+	if (argc < 1)
+		return 1;
+
+	const bool isBuild = std::strcmp(argv[0], "build") == 0;
+	const bool isHash = std::strcmp(argv[0], "hash") == 0;
+
+	if (!isBuild && !isHash)
+		return 1;
+
+	std::string output;
+	std::vector<const char*> paths;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (isBuild && std::strncmp(argv[i], "--output=", 9) == 0)
+			output = argv[i] + 9;
+		else if (argv[i][0] == '-')
+			return 1;
+		else
+			paths.push_back(argv[i]);
+	}
+
+	if (paths.empty())
+		return 1;
+
+	if (isHash)
+		return run_symbols_hash(paths);
+
+	return output.empty() ? 1 : run_symbols_build(output, paths);
+}
+
+} // namespace soren
@@ -0,0 +1,592 @@
+#include "compile/compile.h"
+
+#include "decode/decode-common.h"
+
+#include <cstring>
+
+namespace soren {
+
+// Inverse of the statement builder (see decompile/stack-machine.h): each expression pattern it produces is compiled
+// back to the instructions it came from, so that dumping a compiled script gives back its source
+
+enum : std::uint32_t
+{
+	NO_INDEX = 0xFFFFFFFFu,
+};
+
+// Thrown while compiling a scene, reported at the scene
+struct CompileError
+{
+	ErrorKind kind;
+};
+
+static
+bool get_binop_opcode(Expr::Kind kind, std::uint8_t& result)
+{
+	switch (kind)
+	{
+
+	case Expr::Kind::Assign: result = BC_OPCODE_STORE; return true;
+	case Expr::Kind::Add:    result = BC_OPCODE_ADD; return true;
+	case Expr::Kind::Sub:    result = BC_OPCODE_SUB; return true;
+	case Expr::Kind::Mul:    result = BC_OPCODE_MUL; return true;
+	case Expr::Kind::Div:    result = BC_OPCODE_DIV; return true;
+	case Expr::Kind::Mod:    result = BC_OPCODE_MOD; return true;
+	case Expr::Kind::Or:     result = BC_OPCODE_ORR; return true;
+	case Expr::Kind::And:    result = BC_OPCODE_AND; return true;
+	case Expr::Kind::Xor:    result = BC_OPCODE_XOR; return true;
+	case Expr::Kind::Lsl:    result = BC_OPCODE_LSL; return true;
+	case Expr::Kind::Lsr:    result = BC_OPCODE_LSR; return true;
+	case Expr::Kind::Eq:     result = BC_OPCODE_EQ; return true;
+	case Expr::Kind::Ne:     result = BC_OPCODE_NE; return true;
+	case Expr::Kind::Lt:     result = BC_OPCODE_LT; return true;
+	case Expr::Kind::Le:     result = BC_OPCODE_LE; return true;
+	case Expr::Kind::Gt:     result = BC_OPCODE_GT; return true;
+	case Expr::Kind::Ge:     result = BC_OPCODE_GE; return true;
+	case Expr::Kind::EqStr:  result = BC_OPCODE_EQSTR; return true;
+	case Expr::Kind::NeStr:  result = BC_OPCODE_NESTR; return true;
+
+	default:
+		return false;
+
+	} // switch (kind)
+}
+
+// Names resolve through tables indexed by symbol id, filled once per script
+
+class ScriptCompiler
+{
+public:
+	ScriptCompiler(const SourceScript& source, GameKind game, CmbInfo& result)
+		: mSource(source), mAst(source.ast), mGame(game), mResult(result)
+	{
+		const auto symbolCnt = mAst.symbols.size();
+
+		mSceneOf.assign(symbolCnt, NO_INDEX);
+		mGlobalOf.assign(symbolCnt, NO_INDEX);
+		mPoolOffsetOf.assign(symbolCnt, NO_INDEX);
+		mLabelOf.assign(symbolCnt, NO_INDEX);
+
+		for (unsigned i = 0; i < source.globals.size(); ++i)
+			mGlobalOf[source.globals[i]] = i;
+	}
+
+	// returns false if the name is already taken
+	bool add_scene(unsigned idx)
+	{
+		auto& sceneIdx = mSceneOf[mSource.scenes[idx].name];
+
+		if (sceneIdx != NO_INDEX)
+			return false;
+
+		sceneIdx = idx;
+		return true;
+	}
+
+	// throws CompileError
+	void compile(const SourceScene& source, SceneInfo& scene)
+	{
+		mScene = &source;
+		mScript = &scene.rawScript;
+		mLocation = 0;
+		mVarAmt = source.argCnt;
+		mJumps.clear();
+		mLastPush = NO_INDEX;
+
+		const Span<const SourceLabel> labels(mSource.labels.data() + source.firstLabel, source.labelCnt);
+
+		for (auto& label : labels)
+			mLabelOf[label.name] = label.stmt;
+
+		// labels are per scene, the table is cleared on the way out (even when throwing)
+		struct LabelReset
+		{
+			~LabelReset()
+			{
+				for (auto& label : labels)
+					table[label.name] = NO_INDEX;
+			}
+
+			Span<const SourceLabel> labels;
+			std::vector<std::uint32_t>& table;
+		} labelReset { labels, mLabelOf };
+
+		mStmtLocations.resize(source.stmtCnt + 1);
+
+		for (unsigned i = 0; i < source.stmtCnt; ++i)
+		{
+			mStmtLocations[i] = mLocation;
+			compile_stmt(mAst.statements[source.firstStmt + i]);
+		}
+
+		mStmtLocations[source.stmtCnt] = mLocation;
+
+		// the script needs to end past the last jump target for the decoder to find its end
+
+		bool jumpsToEnd = false;
+
+		for (auto& jump : mJumps)
+		{
+			if (mLabelOf[jump.second] == NO_INDEX)
+				throw CompileError { ErrorKind::UnknownLabel };
+
+			if (mLabelOf[jump.second] == source.stmtCnt)
+				jumpsToEnd = true;
+		}
+
+		if (mScript->empty() || !mScript->back().is_end() || jumpsToEnd)
+			compile_return(NO_INDEX);
+
+		for (auto& jump : mJumps)
+		{
+			auto& ins = (*mScript)[jump.first];
+			const unsigned target = mStmtLocations[mLabelOf[jump.second]];
+
+			// encoded relative to the operand (see decode_instruction)
+			const std::int32_t relative = std::int32_t(target) - std::int32_t(ins.location + 1);
+
+			if (relative < -0x8000 || relative > 0x7FFF)
+				throw CompileError { ErrorKind::OperandTooLarge };
+
+			ins.operand = target;
+		}
+
+		make_varnames(source.argCnt, mVarAmt, scene.varnames);
+	}
+
+private:
+	using index_type = FlatAst::index_type;
+
+	const FlatExpr& child(const FlatExpr& expr, unsigned i) const { return mAst.child(expr, i); }
+	index_type child_index(const FlatExpr& expr, unsigned i) const { return mAst.links[expr.firstChild + i]; }
+
+	bool is_named(const FlatExpr& expr, const char* name) const
+	{
+		return std::strlen(name) == mAst.symbols.length(expr.symbol) && std::strcmp(mAst.symbols.c_str(expr.symbol), name) == 0;
+	}
+
+	bool same_expr(index_type a, index_type b) const
+	{
+		if (a == b)
+			return true;
+
+		auto& ea = mAst.exprs[a];
+		auto& eb = mAst.exprs[b];
+
+		if (ea.kind != eb.kind || ea.literal != eb.literal || ea.symbol != eb.symbol || ea.childCnt != eb.childCnt)
+			return false;
+
+		for (unsigned i = 0; i < ea.childCnt; ++i)
+			if (!same_expr(child_index(ea, i), child_index(eb, i)))
+				return false;
+
+		return true;
+	}
+
+	unsigned intern_string(SymbolTable::id_type symbol)
+	{
+		auto& offset = mPoolOffsetOf[symbol];
+
+		if (offset == NO_INDEX)
+		{
+			auto& pool = mResult.stringPool;
+			const char* str = mAst.symbols.c_str(symbol);
+
+			offset = pool.size();
+			pool.insert(pool.end(), str, str + mAst.symbols.length(symbol) + 1);
+		}
+
+		return offset;
+	}
+
+	void emit(std::uint8_t opcode, std::int32_t operand = 0)
+	{
+		mScript->push_back(BcIns { mLocation, operand, opcode });
+
+		mLocation += 1 + gBcOpcodeInfo[opcode].operandSize;
+
+		if (mGame == GameKind::FE10 && opcode == BC_OPCODE_CALL && operand >= 0x80)
+			mLocation += 1;
+	}
+
+	// operands are sign extended, opcodes for each width follow each other
+	void emit_sized(std::uint8_t opcode8, std::int32_t operand, bool allow32)
+	{
+		if (operand >= -0x80 && operand < 0x80)
+			return emit(opcode8, operand);
+
+		if (operand >= -0x8000 && operand < 0x8000)
+			return emit(opcode8 + 1, operand);
+
+		if (!allow32)
+			throw CompileError { ErrorKind::OperandTooLarge };
+
+		emit(opcode8 + 2, operand);
+	}
+
+	// returns false if name isn't a local: arguments by position, then var_N
+	bool find_local(SymbolTable::id_type name, unsigned& result)
+	{
+		for (unsigned i = 0; i < mScene->argCnt; ++i)
+		{
+			if (mSource.args[mScene->firstArg + i] == name)
+			{
+				result = i;
+				return true;
+			}
+		}
+
+		const char* str = mAst.symbols.c_str(name);
+		const auto len = mAst.symbols.length(name);
+
+		if (len <= 4 || std::strncmp(str, "var_", 4) != 0)
+			return false;
+
+		unsigned idx = 0;
+
+		for (unsigned i = 4; i < len; ++i)
+		{
+			if (str[i] < '0' || str[i] > '9' || idx > 0xFFFF)
+				return false;
+
+			idx = idx * 10 + (str[i] - '0');
+		}
+
+		if (idx < mScene->argCnt)
+			return false;
+
+		mVarAmt = std::max(mVarAmt, idx + 1);
+
+		result = idx;
+		return true;
+	}
+
+	// global opcodes come 12 opcodes after their local equivalent (val => gval, ...)
+	void emit_variable(const FlatExpr& named, std::uint8_t localOpcode8)
+	{
+		if (named.kind != Expr::Kind::Named)
+			throw CompileError { ErrorKind::UnsupportedExpression };
+
+		unsigned idx;
+
+		if (find_local(named.symbol, idx))
+			return emit_sized(localOpcode8, idx, false);
+
+		if (mGlobalOf[named.symbol] == NO_INDEX)
+			throw CompileError { ErrorKind::UnknownName };
+
+		emit_sized(localOpcode8 + (BC_OPCODE_GVAL8 - BC_OPCODE_VAL8), mGlobalOf[named.symbol], false);
+	}
+
+	bool is_variable_ref(const FlatExpr& expr) const
+	{
+		return expr.kind == Expr::Kind::Addrof && child(expr, 0).kind == Expr::Kind::Named;
+	}
+
+	void compile_expr(index_type idx)
+	{
+		auto& expr = mAst.exprs[idx];
+		std::uint8_t opcode;
+
+		switch (expr.kind)
+		{
+
+		case Expr::Kind::IntLiteral:
+			emit_sized(BC_OPCODE_NUMBER8, expr.literal, true);
+			break;
+
+		case Expr::Kind::StrLiteral:
+			emit_sized(BC_OPCODE_STRING8, intern_string(expr.symbol), true);
+			break;
+
+		case Expr::Kind::Named:
+			emit_variable(expr, BC_OPCODE_VAL8);
+			break;
+
+		case Expr::Kind::Addrof:
+			// &v => ref v
+			emit_variable(child(expr, 0), BC_OPCODE_REF8);
+			break;
+
+		case Expr::Kind::Deref:
+		{
+			auto& address = child(expr, 0);
+
+			if (is_variable_ref(address))
+			{
+				// [&v] => val v
+				emit_variable(child(address, 0), BC_OPCODE_VAL8);
+			}
+			else if (address.kind == Expr::Kind::Add && is_variable_ref(child(address, 0)))
+			{
+				// [&v + a] => a; valx v
+				compile_expr(child_index(address, 1));
+				emit_variable(child(child(address, 0), 0), BC_OPCODE_VALX8);
+			}
+			else if (mLastPush != NO_INDEX && mScript->size() == mLastPushEnd && same_expr(mLastPush, child_index(expr, 0)))
+			{
+				// deref keeps its operand: push a; [a] => a; deref
+				emit(BC_OPCODE_DEREF);
+			}
+			else
+			{
+				throw CompileError { ErrorKind::UnsupportedExpression };
+			}
+
+			break;
+		}
+
+		case Expr::Kind::Add:
+			if (is_variable_ref(child(expr, 0)))
+			{
+				// &v + a => a; refx v
+				compile_expr(child_index(expr, 1));
+				emit_variable(child(child(expr, 0), 0), BC_OPCODE_REFX8);
+				break;
+			}
+
+			compile_expr(child_index(expr, 0));
+			compile_expr(child_index(expr, 1));
+			emit(BC_OPCODE_ADD);
+			break;
+
+		case Expr::Kind::Neg:
+			compile_expr(child_index(expr, 0));
+			emit(BC_OPCODE_NEG);
+			break;
+
+		case Expr::Kind::Not:
+			compile_expr(child_index(expr, 0));
+			emit(BC_OPCODE_NOT);
+			break;
+
+		case Expr::Kind::BitwiseNot:
+			compile_expr(child_index(expr, 0));
+			emit(BC_OPCODE_MVN);
+			break;
+
+		case Expr::Kind::LogicalAnd:
+		case Expr::Kind::LogicalOr:
+		{
+			// a && b => a; bkn end; b; end:
+			compile_expr(child_index(expr, 0));
+
+			const auto jumpIdx = mScript->size();
+			emit(expr.kind == Expr::Kind::LogicalAnd ? BC_OPCODE_BKN : BC_OPCODE_BKY);
+
+			compile_expr(child_index(expr, 1));
+
+			(*mScript)[jumpIdx].operand = mLocation;
+			break;
+		}
+
+		case Expr::Kind::Func:
+			compile_call(expr);
+			break;
+
+		default:
+			if (!get_binop_opcode(expr.kind, opcode))
+				throw CompileError { ErrorKind::UnsupportedExpression };
+
+			compile_expr(child_index(expr, 0));
+			compile_expr(child_index(expr, 1));
+			emit(opcode);
+			break;
+
+		} // switch (expr.kind)
+	}
+
+	void compile_call(const FlatExpr& expr)
+	{
+		for (unsigned i = 0; i < expr.childCnt; ++i)
+			compile_expr(child_index(expr, i));
+
+		const auto sceneIdx = mSceneOf[expr.symbol];
+
+		if (sceneIdx != NO_INDEX)
+		{
+			if (expr.childCnt != mSource.scenes[sceneIdx].argCnt)
+				throw CompileError { ErrorKind::ArgumentCountMismatch };
+
+			if (sceneIdx > (mGame == GameKind::FE10 ? 0x7FFFu : 0xFFu))
+				throw CompileError { ErrorKind::OperandTooLarge };
+
+			return emit(BC_OPCODE_CALL, sceneIdx);
+		}
+
+		// __printf only ever is a statement of its own (see compile_stmt)
+		if (is_named(expr, "__printf"))
+			throw CompileError { ErrorKind::UnsupportedExpression };
+
+		const unsigned nameOffset = intern_string(expr.symbol);
+
+		if (nameOffset > 0xFFFF || expr.childCnt > 0xFF)
+			throw CompileError { ErrorKind::OperandTooLarge };
+
+		emit(BC_OPCODE_CALLEXT, (nameOffset << 8) | expr.childCnt);
+	}
+
+	// NO_INDEX for an implicit return 0
+	void compile_return(index_type idx)
+	{
+		const bool literal = idx == NO_INDEX || mAst.exprs[idx].kind == Expr::Kind::IntLiteral;
+		const std::int32_t value = idx == NO_INDEX ? 0 : mAst.exprs[idx].literal;
+
+		if (mGame == GameKind::FE10 && literal && (value == 0 || value == 1))
+			return emit(value == 0 ? BC_OPCODE_RETN : BC_OPCODE_RETY);
+
+		if (idx == NO_INDEX)
+			emit(BC_OPCODE_NUMBER8, 0);
+		else
+			compile_expr(idx);
+
+		emit(BC_OPCODE_RETURN);
+	}
+
+	void compile_stmt(const FlatStmt& stmt)
+	{
+		const auto first = stmt.childCnt > 0 ? mAst.links[stmt.firstChild] : NO_INDEX;
+
+		switch (stmt.kind)
+		{
+
+		case Stmt::Kind::Push:
+			compile_expr(first);
+			break;
+
+		case Stmt::Kind::Expr:
+		{
+			auto& expr = mAst.exprs[first];
+
+			if (expr.kind == Expr::Kind::Func && mSceneOf[expr.symbol] == NO_INDEX && is_named(expr, "__printf"))
+			{
+				// __printf(...); => ...; printf
+				for (unsigned i = 0; i < expr.childCnt; ++i)
+					compile_expr(child_index(expr, i));
+
+				if (expr.childCnt > 0x7F)
+					throw CompileError { ErrorKind::OperandTooLarge };
+
+				emit(BC_OPCODE_PRINTF, expr.childCnt);
+			}
+			else if (expr.kind == Expr::Kind::Assign && mGame == GameKind::FE10)
+			{
+				// [a] = b; => a; b; assign
+				compile_expr(child_index(expr, 0));
+				compile_expr(child_index(expr, 1));
+				emit(BC_OPCODE_ASSIGN);
+			}
+			else
+			{
+				compile_expr(first);
+				emit(BC_OPCODE_DISC);
+			}
+
+			break;
+		}
+
+		case Stmt::Kind::Goto:
+			mJumps.emplace_back(mScript->size(), mAst.exprs[first].symbol);
+			emit(BC_OPCODE_B);
+			break;
+
+		case Stmt::Kind::GotoIf:
+		{
+			const auto truth = mAst.links[stmt.firstChild + 1];
+			const bool negated = mAst.exprs[truth].kind == Expr::Kind::Not;
+
+			compile_expr(negated ? child_index(mAst.exprs[truth], 0) : truth);
+
+			mJumps.emplace_back(mScript->size(), mAst.exprs[first].symbol);
+			emit(negated ? BC_OPCODE_BN : BC_OPCODE_BY);
+
+			break;
+		}
+
+		case Stmt::Kind::Yield:
+			emit(BC_OPCODE_YIELD);
+			break;
+
+		case Stmt::Kind::Return:
+			compile_return(first);
+			break;
+
+		default:
+			throw CompileError { ErrorKind::UnsupportedExpression };
+
+		} // switch (stmt.kind)
+
+		mLastPush = stmt.kind == Stmt::Kind::Push ? first : NO_INDEX;
+		mLastPushEnd = mScript->size();
+	}
+
+	const SourceScript& mSource;
+	const FlatAst& mAst;
+	GameKind mGame;
+	CmbInfo& mResult;
+
+	// by symbol id
+	std::vector<std::uint32_t> mSceneOf;
+	std::vector<std::uint32_t> mGlobalOf;
+	std::vector<std::uint32_t> mPoolOffsetOf;
+	std::vector<std::uint32_t> mLabelOf; // statement index, for the scene being compiled
+
+	const SourceScene* mScene { nullptr };
+	std::vector<BcIns>* mScript { nullptr };
+	unsigned mLocation { 0u };
+	unsigned mVarAmt { 0u };
+
+	std::vector<unsigned> mStmtLocations;
+	std::vector<std::pair<std::size_t, SymbolTable::id_type>> mJumps; // instruction index => label
+
+	// the last push statement, if nothing was emitted since (a deref may then refer to it)
+	index_type mLastPush { NO_INDEX };
+	std::size_t mLastPushEnd { 0u };
+};
+
+bool generate_cmb(const SourceScript& source, GameKind game, CmbInfo& result, Diagnostics& diags)
+{
+	const auto diagCnt = diags.size();
+
+	result = CmbInfo();
+
+	result.globalNames.reserve(source.globals.size());
+
+	for (auto global : source.globals)
+		result.globalNames.emplace_back(source.ast.symbols.c_str(global), source.ast.symbols.length(global));
+
+	ScriptCompiler compiler(source, game, result);
+
+	for (unsigned i = 0; i < source.scenes.size(); ++i)
+		if (!compiler.add_scene(i))
+			diags.report(ErrorKind::DuplicateName, source.scenes[i].offset, i);
+
+	result.scenes.resize(source.scenes.size());
+
+	for (unsigned i = 0; i < source.scenes.size(); ++i)
+	{
+		auto& sourceScene = source.scenes[i];
+		auto& scene = result.scenes[i];
+
+		scene.idx = i;
+		scene.name.assign(source.ast.symbols.c_str(sourceScene.name), source.ast.symbols.length(sourceScene.name));
+		scene.argCnt = sourceScene.argCnt;
+		scene.isGlobal = sourceScene.isGlobal;
+
+		try
+		{
+			compiler.compile(sourceScene, scene);
+		}
+		catch (const CompileError& error)
+		{
+			diags.report(error.kind, sourceScene.offset, i);
+
+			scene.rawScript.clear();
+			make_varnames(scene.argCnt, scene.argCnt, scene.varnames);
+		}
+	}
+
+	return diags.size() == diagCnt;
+}
+
+} // namespace soren
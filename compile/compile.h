@@ -0,0 +1,94 @@
+#ifndef SOREN_COMPILE_INCLUDED
+#define SOREN_COMPILE_INCLUDED
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+#include "core/types.h"
+#include "core/diagnostics.h"
+#include "core/soren-bytecode.h"
+#include "core/soren-cmb.h"
+
+#include "ast/flat-ast.h"
+
+namespace soren {
+
+// Compiler for the text dump language (soren compile): source => SourceScript => CmbInfo => CMB file
+// Diagnostics offsets are byte offsets within the source (see get_source_location)
+
+// Everything is held in flat arrays (statements and expressions in a single FlatAst), so that parsing into a
+// SourceScript it already parsed into reuses its storage instead of allocating
+
+struct SourceLabel
+{
+	std::uint32_t stmt; // index (within the scene) of the statement following it, stmtCnt for labels at the very end
+	SymbolTable::id_type name;
+};
+
+struct SourceScene
+{
+	SymbolTable::id_type name;
+	bool isGlobal;
+
+	std::uint32_t firstArg, argCnt; // into SourceScript::args
+	std::uint32_t firstStmt, stmtCnt; // into SourceScript::ast.statements
+	std::uint32_t firstLabel, labelCnt; // into SourceScript::labels
+
+	unsigned offset; // source offset of the EVENT keyword
+};
+
+struct SourceScript
+{
+	void clear()
+	{
+		ast.clear();
+		globals.clear();
+		scenes.clear();
+		args.clear();
+		labels.clear();
+	}
+
+	FlatAst ast; // goto statements have the label name as first child (Named)
+	std::vector<SymbolTable::id_type> globals;
+	std::vector<SourceScene> scenes;
+	std::vector<SymbolTable::id_type> args;
+	std::vector<SourceLabel> labels;
+};
+
+// Parses everything it can, reporting every syntax error (a scene with errors is skipped, parsing resumes after it)
+bool parse_source(Span<const char> source, SourceScript& result, Diagnostics& diags);
+
+// Generates bytecode (with resolved jumps) and the string pool
+// Scene indices follow the order of definition; scene kinds and parameters aren't part of the source, they are left as 0/none
+bool generate_cmb(const SourceScript& source, GameKind game, CmbInfo& result, Diagnostics& diags);
+
+// Lays out a CMB file: header, event table, scene records, scripts and string pool
+// Expects a CmbInfo as made by generate_cmb (or decoded), instructions are encoded back from their decoded form
+void encode_cmb(const CmbInfo& cmb, GameKind game, std::vector<byte_type>& result);
+
+// A translated string: the pool offset it was exported from (as pushed by STRING instructions) and its new text
+struct StringEdit
+{
+	unsigned offset;
+	std::string text;
+};
+
+// Rebuilds the string pool of a CMB file with edits applied, rewriting only STRING operands (widened to a bigger
+// STRING opcode when an offset no longer fits, moving jumps over them) and copying everything else as it is
+// Nothing is written unless the whole file decodes, and every edit is for a string pushed somewhere in it
+bool try_rewrite_strings(Span<const byte_type> data, GameKind game, const std::vector<StringEdit>& edits,
+	std::vector<byte_type>& result, Diagnostics& diags);
+
+// 1-based line and column of a source offset
+struct SourceLocation
+{
+	unsigned line;
+	unsigned column;
+};
+
+SourceLocation get_source_location(Span<const char> source, unsigned offset);
+
+} // namespace soren
+
+#endif // SOREN_COMPILE_INCLUDED
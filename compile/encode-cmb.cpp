@@ -0,0 +1,212 @@
+#include "compile/compile.h"
+
+#include "decode/decode-common.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace soren {
+
+/*
+ * Layout written:
+ *
+ * 0x00 header: "cmb\0", zeros, globalAmt at 0x22, offStrings at 0x24, offEvents at 0x28
+ * 0x2C event table: u32 scene record offsets, 0 terminated
+ *      scene records (4-aligned): offName, offScript, kind, argAmt, paramAmt, idx, varAmt, u16 parameters
+ *      scripts, one after the other
+ *      string pool, last (offStrings > offEvents, so that the pool extends to the end of the file)
+ *
+ * The rest of the header isn't understood and is left as zeros, the decoder doesn't read it.
+ */
+
+static
+void put_u16_le(std::vector<byte_type>& out, std::size_t offset, unsigned value)
+{
+	out[offset + 0] = value & 0xFF;
+	out[offset + 1] = (value >> 8) & 0xFF;
+}
+
+static
+void put_u32_le(std::vector<byte_type>& out, std::size_t offset, unsigned value)
+{
+	put_u16_le(out, offset + 0, value & 0xFFFF);
+	put_u16_le(out, offset + 2, value >> 16);
+}
+
+static
+void append_be(std::vector<byte_type>& out, std::uint32_t value, unsigned size)
+{
+	for (unsigned i = size; i > 0; --i)
+		out.push_back((value >> (8*(i-1))) & 0xFF);
+}
+
+static
+void encode_script(const std::vector<BcIns>& script, GameKind game, std::vector<byte_type>& out)
+{
+	if (script.empty())
+	{
+		// scenes that failed to decode or compile are kept as a lone return 0, so that indices stay meaningful
+
+		if (game == GameKind::FE10)
+		{
+			out.push_back(BC_OPCODE_RETN);
+		}
+		else
+		{
+			out.push_back(BC_OPCODE_NUMBER8);
+			out.push_back(0);
+			out.push_back(BC_OPCODE_RETURN);
+		}
+
+		return;
+	}
+
+	for (auto& ins : script)
+	{
+		out.push_back(ins.opcode);
+
+		const unsigned size = ins.info().operandSize;
+
+		if (size == 0)
+			continue;
+
+		if (ins.is_jump())
+		{
+			// relative to the operand
+			append_be(out, ins.operand - (ins.location + 1), size);
+		}
+		else if (game == GameKind::FE10 && ins.opcode == BC_OPCODE_CALL && ins.operand >= 0x80)
+		{
+			append_be(out, 0x8000 | ins.operand, 2);
+		}
+		else
+		{
+			append_be(out, ins.operand, size);
+		}
+	}
+}
+
+// Orders scene indices by name, against a NUL-terminated pool string
+struct NameLess
+{
+	bool operator () (unsigned sceneIdx, const char* str) const { return std::strcmp(cmb.scenes[sceneIdx].name.c_str(), str) < 0; }
+	bool operator () (const char* str, unsigned sceneIdx) const { return std::strcmp(str, cmb.scenes[sceneIdx].name.c_str()) < 0; }
+
+	const CmbInfo& cmb;
+};
+
+void encode_cmb(const CmbInfo& cmb, GameKind game, std::vector<byte_type>& result)
+{
+	result.assign(CMB_HEADER_SIZE, 0);
+
+	result[0] = 'c';
+	result[1] = 'm';
+	result[2] = 'b';
+
+	put_u16_le(result, 0x22, cmb.globalNames.size());
+
+	// Global scene names are looked up within the pool, and appended to it if they aren't there
+
+	std::vector<char> pool(cmb.stringPool);
+
+	// the decoder expects the pool to start within the file
+	if (pool.empty())
+		pool.push_back(0);
+
+	// names to look for, by name
+	std::vector<unsigned> wanted;
+
+	for (unsigned i = 0; i < cmb.scenes.size(); ++i)
+		if (cmb.scenes[i].isGlobal)
+			wanted.push_back(i);
+
+	std::sort(wanted.begin(), wanted.end(), [&] (unsigned a, unsigned b)
+	{
+		return std::strcmp(cmb.scenes[a].name.c_str(), cmb.scenes[b].name.c_str()) < 0;
+	});
+
+	std::vector<unsigned> nameOffsets(cmb.scenes.size(), 0xFFFFFFFFu);
+
+	for (unsigned offset = 0; offset < pool.size() && !wanted.empty();)
+	{
+		const char* str = pool.data() + offset;
+		const auto end = std::find(pool.begin() + offset, pool.end(), 0);
+
+		if (end == pool.end())
+			break; // unterminated
+
+		const auto range = std::equal_range(wanted.begin(), wanted.end(), str, NameLess { cmb });
+
+		for (auto it = range.first; it != range.second; ++it)
+			if (nameOffsets[*it] == 0xFFFFFFFFu)
+				nameOffsets[*it] = offset;
+
+		offset = (end - pool.begin()) + 1;
+	}
+
+	for (auto i : wanted)
+	{
+		if (nameOffsets[i] != 0xFFFFFFFFu)
+			continue;
+
+		auto& name = cmb.scenes[i].name;
+
+		nameOffsets[i] = pool.size();
+
+		pool.insert(pool.end(), name.begin(), name.end());
+		pool.push_back(0);
+	}
+
+	// Event table
+
+	const unsigned offEvents = result.size();
+	result.resize(result.size() + 4*(cmb.scenes.size() + 1), 0);
+
+	// Scene records
+
+	std::vector<unsigned> recordOffsets(cmb.scenes.size());
+
+	for (unsigned i = 0; i < cmb.scenes.size(); ++i)
+	{
+		auto& scene = cmb.scenes[i];
+
+		const unsigned offRecord = result.size();
+		recordOffsets[i] = offRecord;
+
+		put_u32_le(result, offEvents + 4*i, offRecord);
+
+		result.resize(offRecord + ((CMB_SCENE_RECORD_SIZE + 2*scene.parameters.size() + 3) & ~3u), 0);
+
+		result[offRecord + 0x0C] = scene.kind;
+		result[offRecord + 0x0D] = scene.argCnt;
+		result[offRecord + 0x0E] = scene.parameters.size();
+
+		put_u16_le(result, offRecord + 0x10, i);
+		put_u16_le(result, offRecord + 0x12, scene.varnames.size());
+
+		for (unsigned j = 0; j < scene.parameters.size(); ++j)
+			put_u16_le(result, offRecord + CMB_SCENE_RECORD_SIZE + 2*j, scene.parameters[j]);
+	}
+
+	// Scripts
+
+	for (unsigned i = 0; i < cmb.scenes.size(); ++i)
+	{
+		put_u32_le(result, recordOffsets[i] + 0x04, result.size());
+		encode_script(cmb.scenes[i].rawScript, game, result);
+	}
+
+	// String pool
+
+	const unsigned offStrings = result.size();
+	result.insert(result.end(), pool.begin(), pool.end());
+
+	for (unsigned i = 0; i < cmb.scenes.size(); ++i)
+		if (cmb.scenes[i].isGlobal)
+			put_u32_le(result, recordOffsets[i] + 0x00, offStrings + nameOffsets[i]);
+
+	put_u32_le(result, 0x24, offStrings);
+	put_u32_le(result, 0x28, offEvents);
+}
+
+} // namespace soren
@@ -0,0 +1,171 @@
+#include "compile/lexer.h"
+
+namespace soren {
+
+enum : std::uint8_t
+{
+	CHAR_SPACE = 1,
+	CHAR_IDENT_START = 2,
+	CHAR_IDENT = 4, // includes digits
+	CHAR_DIGIT = 8,
+};
+
+struct CharClassTable
+{
+	constexpr CharClassTable()
+		: classes()
+	{
+		classes[int(' ')] = CHAR_SPACE;
+		classes[int('\t')] = CHAR_SPACE;
+		classes[int('\n')] = CHAR_SPACE;
+		classes[int('\r')] = CHAR_SPACE;
+
+		for (int c = 'a'; c <= 'z'; ++c)
+			classes[c] = CHAR_IDENT_START | CHAR_IDENT;
+
+		for (int c = 'A'; c <= 'Z'; ++c)
+			classes[c] = CHAR_IDENT_START | CHAR_IDENT;
+
+		classes[int('_')] = CHAR_IDENT_START | CHAR_IDENT;
+
+		for (int c = '0'; c <= '9'; ++c)
+			classes[c] = CHAR_IDENT | CHAR_DIGIT;
+	}
+
+	std::uint8_t classes[0x100];
+};
+
+static constexpr CharClassTable sCharClasses;
+
+static inline
+bool has_class(char chr, std::uint8_t cls)
+{
+	return (sCharClasses.classes[static_cast<unsigned char>(chr)] & cls) != 0;
+}
+
+Token Lexer::next()
+{
+	const char* const src = mSource.data();
+	const std::uint32_t size = mSource.size();
+
+	// whitespace and // comments
+	for (;;)
+	{
+		while (mPos < size && has_class(src[mPos], CHAR_SPACE))
+			++mPos;
+
+		if (mPos + 1 < size && src[mPos] == '/' && src[mPos + 1] == '/')
+		{
+			while (mPos < size && src[mPos] != '\n')
+				++mPos;
+
+			continue;
+		}
+
+		break;
+	}
+
+	const std::uint32_t begin = mPos;
+
+	if (mPos >= size)
+		return make(TokenKind::End, begin, begin);
+
+	const char chr = src[mPos++];
+
+	if (has_class(chr, CHAR_IDENT_START))
+	{
+		while (mPos < size && has_class(src[mPos], CHAR_IDENT))
+			++mPos;
+
+		return make(TokenKind::Identifier, begin, mPos);
+	}
+
+	if (has_class(chr, CHAR_DIGIT))
+	{
+		while (mPos < size && has_class(src[mPos], CHAR_IDENT))
+			++mPos; // letters are included so that 0x10 and 12abc are one (number) token, checked by the parser
+
+		return make(TokenKind::Number, begin, mPos);
+	}
+
+	// true if the upcoming characters are str (which are then consumed)
+	auto accept = [&] (const char* str)
+	{
+		const auto len = std::strlen(str);
+
+		if (size - mPos < len || std::memcmp(src + mPos, str, len) != 0)
+			return false;
+
+		mPos += len;
+		return true;
+	};
+
+	switch (chr)
+	{
+
+	case '"':
+	{
+		const void* quote = std::memchr(src + mPos, '"', size - mPos);
+
+		if (quote == nullptr)
+		{
+			mPos = size; // the rest of the source is the string
+			return make(TokenKind::Error, begin, begin);
+		}
+
+		const std::uint32_t end = static_cast<const char*>(quote) - src;
+		mPos = end + 1;
+
+		return make(TokenKind::String, begin + 1, end);
+	}
+
+	case '(': return make(TokenKind::LParen, begin, mPos);
+	case ')': return make(TokenKind::RParen, begin, mPos);
+	case '{': return make(TokenKind::LBrace, begin, mPos);
+	case '}': return make(TokenKind::RBrace, begin, mPos);
+	case '[': return make(TokenKind::LBracket, begin, mPos);
+	case ']': return make(TokenKind::RBracket, begin, mPos);
+	case ',': return make(TokenKind::Comma, begin, mPos);
+	case ';': return make(TokenKind::Semicolon, begin, mPos);
+	case ':': return make(TokenKind::Colon, begin, mPos);
+	case '+': return make(TokenKind::Plus, begin, mPos);
+	case '-': return make(TokenKind::Minus, begin, mPos);
+	case '*': return make(TokenKind::Star, begin, mPos);
+	case '/': return make(TokenKind::Slash, begin, mPos);
+	case '%': return make(TokenKind::Percent, begin, mPos);
+	case '^': return make(TokenKind::Caret, begin, mPos);
+	case '~': return make(TokenKind::Tilde, begin, mPos);
+
+	case '=':
+		return make(accept("=") ? TokenKind::Eq : TokenKind::Assign, begin, mPos);
+
+	case '!':
+		return make(accept("=") ? TokenKind::Ne : TokenKind::Bang, begin, mPos);
+
+	case '|':
+		return make(accept("|") ? TokenKind::LogicalOr : TokenKind::Pipe, begin, mPos);
+
+	case '&':
+		return make(accept("&") ? TokenKind::LogicalAnd : TokenKind::Amp, begin, mPos);
+
+	case '<':
+		if (accept("=>")) return make(TokenKind::EqStr, begin, mPos);
+		if (accept("!>")) return make(TokenKind::NeStr, begin, mPos);
+		if (accept("=")) return make(TokenKind::Le, begin, mPos);
+		if (accept("?")) return make(TokenKind::Lt, begin, mPos);
+		if (accept("<")) return make(TokenKind::Lsl, begin, mPos);
+		break;
+
+	case '>':
+		if (accept("=?")) return make(TokenKind::Ge, begin, mPos);
+		if (accept("?")) return make(TokenKind::Gt, begin, mPos);
+		if (accept(">")) return make(TokenKind::Lsr, begin, mPos);
+		break;
+
+	} // switch (chr)
+
+	// lexing resumes past the offending character
+	return make(TokenKind::Error, begin, begin);
+}
+
+} // namespace soren
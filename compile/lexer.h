@@ -0,0 +1,73 @@
+#ifndef SOREN_COMPILE_LEXER_INCLUDED
+#define SOREN_COMPILE_LEXER_INCLUDED
+
+#include <cstdint>
+#include <cstring>
+
+#include "core/types.h"
+
+namespace soren {
+
+enum class TokenKind
+{
+	End,
+	Error, // unexpected character or unterminated string, at offset
+
+	Identifier,
+	Number,
+	String, // text excludes the quotes
+
+	LParen, RParen,
+	LBrace, RBrace,
+	LBracket, RBracket,
+	Comma, Semicolon, Colon,
+
+	Assign, // =
+
+	Plus, Minus, Star, Slash, Percent,
+	Pipe, Amp, Caret, Bang, Tilde,
+	Lsl, Lsr, // << >>
+	Eq, Ne, // == !=
+	Lt, Le, Gt, Ge, // <? <= >? >=?
+	EqStr, NeStr, // <=> <!>
+	LogicalAnd, LogicalOr, // && ||
+};
+
+// Tokens point into the source, nothing is copied
+
+struct Token
+{
+	bool is(TokenKind other) const { return kind == other; }
+
+	bool is_word(const char* word) const
+	{
+		return kind == TokenKind::Identifier && std::strlen(word) == length && std::memcmp(word, text, length) == 0;
+	}
+
+	TokenKind kind;
+	const char* text;
+	std::uint32_t length;
+	std::uint32_t offset; // within the source
+};
+
+class Lexer
+{
+public:
+	explicit Lexer(Span<const char> source)
+		: mSource(source) {}
+
+	Token next();
+
+private:
+	Token make(TokenKind kind, std::uint32_t begin, std::uint32_t end) const
+	{
+		return Token { kind, mSource.data() + begin, end - begin, begin };
+	}
+
+	Span<const char> mSource;
+	std::uint32_t mPos { 0u };
+};
+
+} // namespace soren
+
+#endif // SOREN_COMPILE_LEXER_INCLUDED
@@ -0,0 +1,531 @@
+#include "compile/compile.h"
+#include "compile/lexer.h"
+
+#include "ast/print.h"
+
+namespace soren {
+
+/*
+ * Grammar (what the text writer emits, see output/write-text.cpp):
+ *
+ * script    := { "VARIABLE" name ";" | event }
+ * event     := "EVENT" name "(" [ name { "," name } ] ")" [ "global" ] "{" { label | statement } "}"
+ * label     := name ":"
+ * statement := "push" expr ";" | "return" expr ";" | "goto" name [ "if" expr ] ";" | "yield" ";" | expr ";"
+ * expr      := binary operators by precedence (see get_precedence), over
+ * unary     := ( "!" | "-" | "~" | "&" ) unary | primary
+ * primary   := number | string | name [ "(" [ expr { "," expr } ] ")" ] | "[" expr "]" [ "=" expr ] | "(" expr ")"
+ */
+
+enum
+{
+	PARSE_DEPTH_LIMIT = 256, // expression nesting, deeper is reported instead of overflowing the stack
+};
+
+// Thrown on the first error within a scene, after reporting it; parsing resumes at the next top-level keyword
+struct SyntaxError {};
+
+static
+bool get_binop_kind(TokenKind token, Expr::Kind& result)
+{
+	switch (token)
+	{
+
+	case TokenKind::Plus:       result = Expr::Kind::Add; return true;
+	case TokenKind::Minus:      result = Expr::Kind::Sub; return true;
+	case TokenKind::Star:       result = Expr::Kind::Mul; return true;
+	case TokenKind::Slash:      result = Expr::Kind::Div; return true;
+	case TokenKind::Percent:    result = Expr::Kind::Mod; return true;
+	case TokenKind::Pipe:       result = Expr::Kind::Or; return true;
+	case TokenKind::Amp:        result = Expr::Kind::And; return true;
+	case TokenKind::Caret:      result = Expr::Kind::Xor; return true;
+	case TokenKind::Lsl:        result = Expr::Kind::Lsl; return true;
+	case TokenKind::Lsr:        result = Expr::Kind::Lsr; return true;
+	case TokenKind::Eq:         result = Expr::Kind::Eq; return true;
+	case TokenKind::Ne:         result = Expr::Kind::Ne; return true;
+	case TokenKind::Lt:         result = Expr::Kind::Lt; return true;
+	case TokenKind::Le:         result = Expr::Kind::Le; return true;
+	case TokenKind::Gt:         result = Expr::Kind::Gt; return true;
+	case TokenKind::Ge:         result = Expr::Kind::Ge; return true;
+	case TokenKind::EqStr:      result = Expr::Kind::EqStr; return true;
+	case TokenKind::NeStr:      result = Expr::Kind::NeStr; return true;
+	case TokenKind::LogicalAnd: result = Expr::Kind::LogicalAnd; return true;
+	case TokenKind::LogicalOr:  result = Expr::Kind::LogicalOr; return true;
+
+	default:
+		return false;
+
+	} // switch (token)
+}
+
+static
+bool get_unop_kind(TokenKind token, Expr::Kind& result)
+{
+	switch (token)
+	{
+
+	case TokenKind::Bang:  result = Expr::Kind::Not; return true;
+	case TokenKind::Minus: result = Expr::Kind::Neg; return true;
+	case TokenKind::Tilde: result = Expr::Kind::BitwiseNot; return true;
+	case TokenKind::Amp:   result = Expr::Kind::Addrof; return true;
+
+	default:
+		return false;
+
+	} // switch (token)
+}
+
+class Parser
+{
+public:
+	Parser(Span<const char> source, SourceScript& result, Diagnostics& diags)
+		: mSource(source), mLexer(source), mResult(result), mAst(result.ast), mDiags(diags)
+	{
+		mNext = mLexer.next();
+		advance();
+	}
+
+	void parse()
+	{
+		while (!mToken.is(TokenKind::End))
+		{
+			try
+			{
+				if (mToken.is_word("VARIABLE"))
+				{
+					advance();
+
+					const auto offset = mToken.offset;
+					const auto name = expect_name();
+
+					expect(TokenKind::Semicolon);
+
+					for (auto global : mResult.globals)
+						if (global == name)
+							fail(ErrorKind::DuplicateName, offset);
+
+					mResult.globals.push_back(name);
+				}
+				else if (mToken.is_word("EVENT"))
+				{
+					parse_event();
+				}
+				else
+				{
+					fail();
+				}
+			}
+			catch (const SyntaxError&)
+			{
+				mDepth = 0;
+				mArgs.clear();
+
+				// resume at the next top-level keyword
+				while (!mToken.is(TokenKind::End) && !mToken.is_word("EVENT") && !mToken.is_word("VARIABLE"))
+					advance();
+			}
+		}
+	}
+
+private:
+	using index_type = FlatAst::index_type;
+
+	void advance()
+	{
+		mToken = mNext;
+
+		if (!mNext.is(TokenKind::End))
+			mNext = mLexer.next();
+	}
+
+	[[noreturn]]
+	void fail(ErrorKind kind, unsigned offset)
+	{
+		mDiags.report(kind, offset);
+		throw SyntaxError {};
+	}
+
+	// reports the current token as unexpected
+	[[noreturn]]
+	void fail()
+	{
+		if (!mToken.is(TokenKind::Error))
+			fail(ErrorKind::UnexpectedToken, mToken.offset);
+
+		fail(mSource[mToken.offset] == '"'
+			? ErrorKind::UnterminatedString
+			: ErrorKind::UnexpectedCharacter, mToken.offset);
+	}
+
+	void expect(TokenKind kind)
+	{
+		if (!mToken.is(kind))
+			fail();
+
+		advance();
+	}
+
+	SymbolTable::id_type expect_name()
+	{
+		if (!mToken.is(TokenKind::Identifier))
+			fail();
+
+		const auto result = mAst.symbols.intern(mToken.text, mToken.length);
+		advance();
+
+		return result;
+	}
+
+	void parse_event()
+	{
+		SourceScene scene;
+
+		scene.offset = mToken.offset;
+		scene.firstArg = mResult.args.size();
+		scene.firstStmt = mAst.statements.size();
+		scene.firstLabel = mResult.labels.size();
+
+		// a scene with errors is dropped entirely
+		const auto exprCnt = mAst.exprs.size();
+		const auto linkCnt = mAst.links.size();
+
+		try
+		{
+			advance(); // EVENT
+
+			scene.name = expect_name();
+
+			expect(TokenKind::LParen);
+
+			if (!mToken.is(TokenKind::RParen))
+			{
+				mResult.args.push_back(expect_name());
+
+				while (mToken.is(TokenKind::Comma))
+				{
+					advance();
+					mResult.args.push_back(expect_name());
+				}
+			}
+
+			expect(TokenKind::RParen);
+
+			scene.isGlobal = mToken.is_word("global");
+
+			if (scene.isGlobal)
+				advance();
+
+			expect(TokenKind::LBrace);
+
+			while (!mToken.is(TokenKind::RBrace))
+			{
+				if (mToken.is(TokenKind::Identifier) && mNext.is(TokenKind::Colon))
+				{
+					const auto offset = mToken.offset;
+					const auto label = expect_name();
+
+					for (auto i = scene.firstLabel; i < mResult.labels.size(); ++i)
+						if (mResult.labels[i].name == label)
+							fail(ErrorKind::DuplicateLabel, offset);
+
+					mResult.labels.push_back({ std::uint32_t(mAst.statements.size() - scene.firstStmt), label });
+
+					advance(); // :
+					continue;
+				}
+
+				parse_statement();
+			}
+
+			advance(); // }
+		}
+		catch (const SyntaxError&)
+		{
+			mResult.args.resize(scene.firstArg);
+			mResult.labels.resize(scene.firstLabel);
+			mAst.statements.resize(scene.firstStmt);
+			mAst.exprs.resize(exprCnt);
+			mAst.links.resize(linkCnt);
+
+			throw;
+		}
+
+		scene.argCnt = mResult.args.size() - scene.firstArg;
+		scene.stmtCnt = mAst.statements.size() - scene.firstStmt;
+		scene.labelCnt = mResult.labels.size() - scene.firstLabel;
+
+		mResult.scenes.push_back(scene);
+	}
+
+	void parse_statement()
+	{
+		auto kind = Stmt::Kind::Expr;
+		index_type children[2];
+		unsigned childCnt = 1;
+
+		if (mToken.is_word("push"))
+		{
+			advance();
+			kind = Stmt::Kind::Push;
+			children[0] = parse_expr();
+		}
+		else if (mToken.is_word("return"))
+		{
+			advance();
+			kind = Stmt::Kind::Return;
+			children[0] = parse_expr();
+		}
+		else if (mToken.is_word("yield"))
+		{
+			advance();
+			kind = Stmt::Kind::Yield;
+			childCnt = 0;
+		}
+		else if (mToken.is_word("goto"))
+		{
+			advance();
+
+			kind = Stmt::Kind::Goto;
+			children[0] = mAst.add_leaf(Expr::Kind::Named, 0, expect_name());
+
+			if (mToken.is_word("if"))
+			{
+				advance();
+
+				kind = Stmt::Kind::GotoIf;
+				children[1] = parse_expr();
+				childCnt = 2;
+			}
+		}
+		else
+		{
+			children[0] = parse_expr();
+		}
+
+		expect(TokenKind::Semicolon);
+
+		const std::uint32_t firstChild = mAst.links.size();
+		mAst.links.insert(mAst.links.end(), children, children + childCnt);
+
+		mAst.add_statement(kind, SymbolTable::bad_id, firstChild, childCnt);
+	}
+
+	index_type parse_expr(unsigned minPrecedence = EXPR_PRECEDENCE_ASSIGN)
+	{
+		DepthGuard guard(*this);
+
+		auto result = parse_unary();
+
+		Expr::Kind kind;
+
+		while (get_binop_kind(mToken.kind, kind) && get_precedence(kind) >= minPrecedence)
+		{
+			advance();
+
+			// left associative: the right operand only takes tighter operators
+			const auto rexpr = parse_expr(get_precedence(kind) + 1);
+			result = mAst.add_node(kind, SymbolTable::bad_id, result, rexpr);
+		}
+
+		return result;
+	}
+
+	index_type parse_unary()
+	{
+		Expr::Kind kind;
+
+		if (!get_unop_kind(mToken.kind, kind))
+			return parse_primary();
+
+		// -5 is a literal (the printer writes a negated literal as -(5))
+		if (mToken.is(TokenKind::Minus) && mNext.is(TokenKind::Number))
+		{
+			advance();
+			return mAst.add_leaf(Expr::Kind::IntLiteral, parse_number(true), SymbolTable::bad_id);
+		}
+
+		DepthGuard guard(*this);
+
+		advance();
+		return mAst.add_node(kind, SymbolTable::bad_id, parse_unary());
+	}
+
+	index_type parse_primary()
+	{
+		switch (mToken.kind)
+		{
+
+		case TokenKind::Number:
+			return mAst.add_leaf(Expr::Kind::IntLiteral, parse_number(false), SymbolTable::bad_id);
+
+		case TokenKind::String:
+		{
+			const auto result = mAst.add_leaf(Expr::Kind::StrLiteral, 0, mAst.symbols.intern(mToken.text, mToken.length));
+			advance();
+
+			return result;
+		}
+
+		case TokenKind::Identifier:
+		{
+			const auto name = expect_name();
+
+			if (!mToken.is(TokenKind::LParen))
+				return mAst.add_leaf(Expr::Kind::Named, 0, name);
+
+			advance();
+
+			// arguments may append links of their own, so they are only linked once all are parsed
+			const auto firstArg = mArgs.size();
+
+			if (!mToken.is(TokenKind::RParen))
+			{
+				mArgs.push_back(parse_expr());
+
+				while (mToken.is(TokenKind::Comma))
+				{
+					advance();
+					mArgs.push_back(parse_expr());
+				}
+			}
+
+			expect(TokenKind::RParen);
+
+			const std::uint32_t firstChild = mAst.links.size();
+			mAst.links.insert(mAst.links.end(), mArgs.begin() + firstArg, mArgs.end());
+
+			const std::uint32_t argCnt = mArgs.size() - firstArg;
+			mArgs.resize(firstArg);
+
+			return mAst.add_node_linked(Expr::Kind::Func, name, firstChild, argCnt);
+		}
+
+		case TokenKind::LBracket:
+		{
+			advance();
+
+			const auto address = parse_expr();
+			expect(TokenKind::RBracket);
+
+			if (!mToken.is(TokenKind::Assign))
+				return mAst.add_node(Expr::Kind::Deref, SymbolTable::bad_id, address);
+
+			advance();
+
+			// assignment is right associative
+			const auto value = parse_expr(EXPR_PRECEDENCE_ASSIGN);
+			return mAst.add_node(Expr::Kind::Assign, SymbolTable::bad_id, address, value);
+		}
+
+		case TokenKind::LParen:
+		{
+			advance();
+
+			const auto result = parse_expr();
+			expect(TokenKind::RParen);
+
+			return result;
+		}
+
+		default:
+			fail();
+
+		} // switch (mToken.kind)
+	}
+
+	// decimal or 0x hexadecimal, anything that fits 32 bits (wrapping to negative past INT32_MAX)
+	std::int32_t parse_number(bool negative)
+	{
+		const char* it = mToken.text;
+		const char* const end = mToken.text + mToken.length;
+
+		const unsigned base = (mToken.length > 2 && it[0] == '0' && (it[1] == 'x' || it[1] == 'X')) ? 16 : 10;
+
+		if (base == 16)
+			it += 2;
+
+		std::uint64_t value = 0;
+
+		for (; it != end; ++it)
+		{
+			unsigned digit;
+
+			if (*it >= '0' && *it <= '9')
+				digit = *it - '0';
+			else if (base == 16 && *it >= 'a' && *it <= 'f')
+				digit = *it - 'a' + 10;
+			else if (base == 16 && *it >= 'A' && *it <= 'F')
+				digit = *it - 'A' + 10;
+			else
+				fail();
+
+			value = value * base + digit;
+
+			if (value > 0xFFFFFFFFu)
+				fail(ErrorKind::OperandTooLarge, mToken.offset);
+		}
+
+		if (negative && value > 0x80000000u)
+			fail(ErrorKind::OperandTooLarge, mToken.offset);
+
+		advance();
+
+		const auto bits = static_cast<std::uint32_t>(negative ? 0u - value : value);
+		return static_cast<std::int32_t>(bits);
+	}
+
+	struct DepthGuard
+	{
+		explicit DepthGuard(Parser& parser)
+			: mParser(parser)
+		{
+			if (++mParser.mDepth > PARSE_DEPTH_LIMIT)
+				mParser.fail(ErrorKind::UnsupportedExpression, mParser.mToken.offset);
+		}
+
+		~DepthGuard() { --mParser.mDepth; }
+
+		Parser& mParser;
+	};
+
+	Span<const char> mSource;
+	Lexer mLexer;
+	SourceScript& mResult;
+	FlatAst& mAst;
+	Diagnostics& mDiags;
+
+	Token mToken;
+	Token mNext;
+
+	std::vector<index_type> mArgs; // call arguments being parsed, of all nested calls
+	unsigned mDepth { 0u };
+};
+
+bool parse_source(Span<const char> source, SourceScript& result, Diagnostics& diags)
+{
+	const auto diagCnt = diags.size();
+
+	result.clear();
+
+	Parser parser(source, result, diags);
+	parser.parse();
+
+	return diags.size() == diagCnt;
+}
+
+SourceLocation get_source_location(Span<const char> source, unsigned offset)
+{
+	SourceLocation result { 1, 1 };
+
+	for (unsigned i = 0; i < offset && i < source.size(); ++i)
+	{
+		if (source[i] == '\n')
+			result.line++, result.column = 1;
+		else
+			result.column++;
+	}
+
+	return result;
+}
+
+} // namespace soren
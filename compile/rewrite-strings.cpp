@@ -0,0 +1,344 @@
+#include "compile/compile.h"
+
+#include "decode/decode.h"
+#include "decode/decode-common.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace soren {
+
+/*
+ * The file is laid out again the way encode_cmb lays it out (header, event table, scene records, scripts, pool last),
+ * but every piece is copied from the original bytes: the header (past what is patched), records (offName and offScript
+ * patched) and scripts. Only STRING and CALLEXT operands are rewritten, and jumps where a STRING instruction had to be
+ * widened moved their target. Unreachable bytes within a script are copied along, bytes past the last reachable instruction
+ * (padding) and between structures are not.
+ *
+ * New pool: CALLEXT names first (their offset is a 16-bit operand), then scene names, then STRING strings.
+ * Identical strings are only stored once.
+ */
+
+static
+void put_u32_le(std::vector<byte_type>& out, std::size_t offset, unsigned value)
+{
+	for (unsigned i = 0; i < 4; ++i)
+		out[offset + i] = (value >> (8*i)) & 0xFF;
+}
+
+static
+void put_be(byte_type* out, std::uint32_t value, unsigned size)
+{
+	for (unsigned i = size; i > 0; --i)
+		*out++ = (value >> (8*(i-1))) & 0xFF;
+}
+
+static
+bool is_string_opcode(unsigned opcode)
+{
+	return opcode == BC_OPCODE_STRING8 || opcode == BC_OPCODE_STRING16 || opcode == BC_OPCODE_STRING32;
+}
+
+// Smallest string operand size that holds offset (operands are sign extended)
+static
+unsigned get_string_operand_size(unsigned offset)
+{
+	return (offset <= 0x7F) ? 1 : (offset <= 0x7FFF) ? 2 : 4;
+}
+
+static
+unsigned get_string_opcode(unsigned operandSize)
+{
+	return (operandSize == 1) ? BC_OPCODE_STRING8 : (operandSize == 2) ? BC_OPCODE_STRING16 : BC_OPCODE_STRING32;
+}
+
+class PoolBuilder
+{
+public:
+	unsigned add(const char* str)
+	{
+		auto it = mOffsets.find(str);
+
+		if (it != mOffsets.end())
+			return it->second;
+
+		const unsigned offset = pool.size();
+
+		pool.insert(pool.end(), str, str + std::strlen(str) + 1);
+		mOffsets.emplace(str, offset);
+
+		return offset;
+	}
+
+	std::vector<char> pool;
+
+private:
+	std::unordered_map<std::string, unsigned> mOffsets;
+};
+
+// CALLEXT operands are the name offset (16 bits) followed by the argument count (8 bits)
+static
+std::uint32_t get_callext_operand(std::unordered_map<unsigned, unsigned>& nameRemap, const BcIns& ins)
+{
+	const auto operand = static_cast<std::uint32_t>(ins.operand);
+	return (nameRemap[operand >> 8] << 8) | (operand & 0xFF);
+}
+
+// New location of an original script offset, given the (location, growth) of every widened instruction before it
+static
+unsigned get_new_location(const std::vector<std::pair<unsigned, unsigned>>& shifts, unsigned location)
+{
+	const auto it = std::lower_bound(shifts.begin(), shifts.end(), location, [] (const std::pair<unsigned, unsigned>& shift, unsigned loc)
+	{
+		return shift.first < loc;
+	});
+
+	return (it == shifts.begin()) ? location : location + std::prev(it)->second;
+}
+
+bool try_rewrite_strings(Span<const byte_type> data, GameKind game, const std::vector<StringEdit>& edits,
+	std::vector<byte_type>& result, Diagnostics& diags)
+{
+	const auto diagCnt = diags.size();
+
+	CmbInfo cmb;
+
+	// broken scenes would be lost, nothing is rewritten unless everything decodes
+	if (!try_decode_cmb(data, game, cmb, diags))
+		return false;
+
+	const auto header = read_cmb_header(data);
+
+	// Edits, by original offset
+
+	std::unordered_map<unsigned, const std::string*> edited;
+
+	for (auto& edit : edits)
+		edited[edit.offset] = &edit.text;
+
+	// New pool
+
+	PoolBuilder builder;
+
+	// original offset -> new offset, names and strings apart (a CALLEXT name may be pushed as a string too)
+	std::unordered_map<unsigned, unsigned> nameRemap, stringRemap;
+
+	auto remap_string = [&] (std::unordered_map<unsigned, unsigned>& remap, unsigned offset, bool editable,
+		const SceneInfo& scene, const BcIns& ins)
+	{
+		if (remap.count(offset))
+			return;
+
+		const char* str = cmb.try_get_cstr(offset);
+
+		if (str == nullptr)
+		{
+			diags.report(ErrorKind::BadStringOffset, scene.scriptOffset + ins.location, scene.idx);
+			return;
+		}
+
+		const auto it = editable ? edited.find(offset) : edited.end();
+
+		remap[offset] = builder.add((it != edited.end()) ? it->second->c_str() : str);
+	};
+
+	for (auto& scene : cmb.scenes)
+	{
+		for (auto& ins : scene.rawScript)
+		{
+			if (ins.opcode == BC_OPCODE_CALLEXT)
+				remap_string(nameRemap, static_cast<std::uint32_t>(ins.operand) >> 8, false, scene, ins);
+		}
+	}
+
+	std::vector<unsigned> nameOffsets(cmb.scenes.size(), 0);
+
+	for (auto& scene : cmb.scenes)
+	{
+		if (scene.isGlobal)
+			nameOffsets[scene.idx] = builder.add(scene.name.c_str());
+	}
+
+	for (auto& scene : cmb.scenes)
+	{
+		for (auto& ins : scene.rawScript)
+		{
+			if (is_string_opcode(ins.opcode))
+				remap_string(stringRemap, ins.operand, true, scene, ins);
+		}
+	}
+
+	// edits of strings that aren't pushed anywhere (table for another version of the file, or CALLEXT names)
+	for (auto& edit : edits)
+	{
+		if (!stringRemap.count(edit.offset))
+			diags.report(ErrorKind::BadStringOffset, header.offStrings + edit.offset);
+	}
+
+	if (diags.size() != diagCnt)
+		return false;
+
+	for (auto& scene : cmb.scenes)
+	{
+		for (auto& ins : scene.rawScript)
+		{
+			if (ins.opcode == BC_OPCODE_CALLEXT && nameRemap[static_cast<std::uint32_t>(ins.operand) >> 8] > 0xFFFF)
+			{
+				diags.report(ErrorKind::OperandTooLarge, scene.scriptOffset + ins.location, scene.idx);
+				return false;
+			}
+		}
+	}
+
+	if (builder.pool.empty())
+		builder.pool.push_back(0); // the decoder expects the pool to start within the file
+
+	// Header and event table
+
+	result.assign(data.begin(), data.begin() + CMB_HEADER_SIZE);
+
+	const unsigned offEvents = result.size();
+	result.resize(result.size() + 4*(cmb.scenes.size() + 1), 0);
+
+	// Scene records, as they were
+
+	std::vector<unsigned> recordOffsets(cmb.scenes.size());
+
+	for (auto& scene : cmb.scenes)
+	{
+		const auto offEvent = decode_int_le(data.subspan(header.offEvents + 4*scene.idx, 4));
+		const unsigned recordSize = CMB_SCENE_RECORD_SIZE + 2*scene.parameters.size();
+
+		const unsigned offRecord = result.size();
+		recordOffsets[scene.idx] = offRecord;
+
+		put_u32_le(result, offEvents + 4*scene.idx, offRecord);
+
+		result.insert(result.end(), data.begin() + offEvent, data.begin() + offEvent + recordSize);
+		result.resize((result.size() + 3) & ~3u, 0);
+	}
+
+	// Scripts
+
+	std::vector<std::pair<unsigned, unsigned>> shifts;
+
+	for (auto& scene : cmb.scenes)
+	{
+		const auto script = data.subspan(scene.scriptOffset, data.size() - scene.scriptOffset);
+
+		// extent and growth of the script
+		unsigned extent = 0, growth = 0;
+		shifts.clear();
+
+		for (auto& ins : scene.rawScript)
+		{
+			unsigned next = ins.location;
+			BcIns decoded;
+
+			decode_instruction(script, next, game, decoded);
+			extent = std::max(extent, next);
+
+			if (is_string_opcode(ins.opcode))
+			{
+				const unsigned size = ins.info().operandSize;
+				const unsigned newSize = get_string_operand_size(stringRemap[ins.operand]);
+
+				if (newSize > size)
+				{
+					growth += newSize - size;
+					shifts.push_back({ ins.location, growth });
+				}
+			}
+		}
+
+		const unsigned offScript = result.size();
+		put_u32_le(result, recordOffsets[scene.idx] + 0x04, offScript);
+
+		if (growth == 0)
+		{
+			// same layout: copy it all and patch the operands
+			result.insert(result.end(), script.begin(), script.begin() + extent);
+
+			for (auto& ins : scene.rawScript)
+			{
+				if (is_string_opcode(ins.opcode))
+					put_be(result.data() + offScript + ins.location + 1, stringRemap[ins.operand], ins.info().operandSize);
+				else if (ins.opcode == BC_OPCODE_CALLEXT)
+					put_be(result.data() + offScript + ins.location + 1, get_callext_operand(nameRemap, ins), 3);
+			}
+
+			continue;
+		}
+
+		// copy it over instruction by instruction, widening strings and moving jumps
+		unsigned copied = 0;
+
+		for (auto& ins : scene.rawScript)
+		{
+			unsigned next = ins.location;
+			BcIns decoded;
+
+			decode_instruction(script, next, game, decoded);
+
+			// unreachable bytes before it, as they were
+			result.insert(result.end(), script.begin() + copied, script.begin() + ins.location);
+			copied = next;
+
+			if (is_string_opcode(ins.opcode))
+			{
+				const unsigned offset = stringRemap[ins.operand];
+				const unsigned size = std::max(ins.info().operandSize, get_string_operand_size(offset));
+
+				result.push_back(get_string_opcode(size));
+				result.resize(result.size() + size);
+
+				put_be(result.data() + result.size() - size, offset, size);
+			}
+			else if (ins.opcode == BC_OPCODE_CALLEXT)
+			{
+				result.push_back(ins.opcode);
+				result.resize(result.size() + 3);
+
+				put_be(result.data() + result.size() - 3, get_callext_operand(nameRemap, ins), 3);
+			}
+			else if (ins.is_jump())
+			{
+				const int rel = static_cast<int>(get_new_location(shifts, ins.operand))
+					- static_cast<int>(get_new_location(shifts, ins.location) + 1);
+
+				if (rel < -0x8000 || rel > 0x7FFF)
+				{
+					diags.report(ErrorKind::OperandTooLarge, scene.scriptOffset + ins.location, scene.idx);
+					return false;
+				}
+
+				result.push_back(ins.opcode);
+				result.resize(result.size() + 2);
+
+				put_be(result.data() + result.size() - 2, rel, 2);
+			}
+			else
+			{
+				result.insert(result.end(), script.begin() + ins.location, script.begin() + next);
+			}
+		}
+	}
+
+	// String pool
+
+	const unsigned offStrings = result.size();
+	result.insert(result.end(), builder.pool.begin(), builder.pool.end());
+
+	for (auto& scene : cmb.scenes)
+	{
+		put_u32_le(result, recordOffsets[scene.idx] + 0x00, scene.isGlobal ? offStrings + nameOffsets[scene.idx] : 0);
+	}
+
+	put_u32_le(result, 0x24, offStrings);
+	put_u32_le(result, 0x28, offEvents);
+
+	return true;
+}
+
+} // namespace soren
@@ -0,0 +1,546 @@
+#include "core/bulk-read.h"
+#include "core/io.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#if SOREN_HAVE_IO_URING
+#include <linux/io_uring.h>
+
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+namespace soren {
+
+const char* get_backend_name(BulkBackend backend)
+{
+	switch (backend)
+	{
+
+	case BulkBackend::IoUring: return "io_uring";
+	case BulkBackend::Threads: return "threads";
+
+	} // switch (backend)
+
+	return "unknown";
+}
+
+struct BulkReader::Engine
+{
+	virtual ~Engine() = default;
+
+	virtual bool next(BulkFile& file) = 0;
+	virtual BulkBackend backend() const = 0;
+};
+
+/*
+ * Both engines keep a window of inFlight consecutive files being read, starting at the next one to hand out.
+ * File i lives in slot i % inFlight until it is handed out, which is what lets the window move forward.
+ */
+
+struct BulkSlot
+{
+	bool ready { false };
+	bool ok { false };
+	std::vector<byte_type> data;
+};
+
+// Plain reads from a pool of threads
+
+struct ThreadEngine : public BulkReader::Engine
+{
+	ThreadEngine(const std::vector<std::string>& paths, unsigned inFlight)
+		: mPaths(paths), mSlots(inFlight)
+	{
+		const unsigned threadCnt = std::max(1u, std::min<unsigned>({ inFlight, std::thread::hardware_concurrency(), unsigned(paths.size()) }));
+
+		for (unsigned i = 0; i < threadCnt; ++i)
+			mThreads.emplace_back([this] () { run(); });
+	}
+
+	~ThreadEngine() override
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStop = true;
+		}
+
+		mCondition.notify_all();
+
+		for (auto& thread : mThreads)
+			thread.join();
+	}
+
+	void run()
+	{
+		std::vector<byte_type> data;
+
+		for (;;)
+		{
+			std::size_t idx;
+
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+
+				mCondition.wait(lock, [&] ()
+				{
+					return mStop || mNextToRead >= mPaths.size() || mNextToRead < mNextToHand + mSlots.size();
+				});
+
+				if (mStop || mNextToRead >= mPaths.size())
+					return;
+
+				idx = mNextToRead++;
+			}
+
+			const bool ok = read_entire_file(mPaths[idx].c_str(), data);
+
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+
+				auto& slot = mSlots[idx % mSlots.size()];
+
+				slot.ok = ok;
+				slot.data.swap(data);
+				slot.ready = true;
+			}
+
+			mCondition.notify_all();
+			data.clear();
+		}
+	}
+
+	bool next(BulkFile& file) override
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+
+		if (mNextToHand >= mPaths.size())
+			return false;
+
+		auto& slot = mSlots[mNextToHand % mSlots.size()];
+
+		mCondition.wait(lock, [&] () { return slot.ready; });
+
+		file.index = mNextToHand++;
+		file.ok = slot.ok;
+		file.data.swap(slot.data);
+
+		slot.ready = false;
+		slot.data.clear();
+
+		lock.unlock();
+		mCondition.notify_all();
+
+		return true;
+	}
+
+	BulkBackend backend() const override { return BulkBackend::Threads; }
+
+	const std::vector<std::string>& mPaths;
+
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	std::vector<BulkSlot> mSlots;
+	std::size_t mNextToRead { 0u };
+	std::size_t mNextToHand { 0u };
+	bool mStop { false };
+
+	std::vector<std::thread> mThreads;
+};
+
+#if SOREN_HAVE_IO_URING
+
+/*
+ * io_uring, through raw syscalls (no liburing). Each file goes through:
+ *
+ *   openat + statx (submitted together) -> read (repeated until the whole size is read) -> close
+ *
+ * Every step of every file in flight is submitted in one io_uring_enter, which also waits for the next completion.
+ * A file whose steps fail for any reason is read again synchronously, so that errors (or ops the kernel lacks)
+ * are handled the same way as everywhere else.
+ */
+
+enum : unsigned
+{
+	URING_OP_OPEN,
+	URING_OP_STAT,
+	URING_OP_READ,
+	URING_OP_CLOSE,
+
+	URING_OP_BITS = 2,
+};
+
+struct UringSlot : public BulkSlot
+{
+	int fd { -1 };
+	unsigned pending { 0u }; // submitted ops not completed yet
+	bool failed { false };
+	bool statDone { false };
+	std::size_t readSize { 0u };
+	struct statx stat;
+};
+
+struct UringEngine : public BulkReader::Engine
+{
+	UringEngine(const std::vector<std::string>& paths, unsigned inFlight)
+		: mPaths(paths), mSlots(inFlight) {}
+
+	~UringEngine() override
+	{
+		// wait for whatever is still running (it writes to our buffers)
+		while (std::any_of(mSlots.begin(), mSlots.end(), [] (const UringSlot& slot) { return slot.pending != 0; }))
+		{
+			if (!submit_and_wait())
+				break;
+		}
+
+		for (auto& slot : mSlots)
+			if (slot.fd >= 0)
+				::close(slot.fd);
+
+		if (mSqRing != MAP_FAILED)
+			munmap(mSqRing, mSqRingSize);
+
+		if (mCqRing != MAP_FAILED && mCqRing != mSqRing)
+			munmap(mCqRing, mCqRingSize);
+
+		if (mSqes != MAP_FAILED)
+			munmap(mSqes, mSqesSize);
+
+		if (mRingFd >= 0)
+			::close(mRingFd);
+	}
+
+	// Returns false if io_uring isn't available
+	bool setup()
+	{
+		unsigned entries = 1;
+
+		while (entries < 2 * mSlots.size() && entries < 4096)
+			entries *= 2;
+
+		io_uring_params params {};
+
+		mRingFd = syscall(__NR_io_uring_setup, entries, &params);
+
+		if (mRingFd < 0)
+			return false;
+
+		mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+			mSqRingSize = mCqRingSize = std::max(mSqRingSize, mCqRingSize);
+
+		mSqRing = mmap(nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQ_RING);
+
+		if (mSqRing == MAP_FAILED)
+			return false;
+
+		mCqRing = (params.features & IORING_FEAT_SINGLE_MMAP)
+			? mSqRing
+			: mmap(nullptr, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_CQ_RING);
+
+		if (mCqRing == MAP_FAILED)
+			return false;
+
+		mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		mSqes = mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQES);
+
+		if (mSqes == MAP_FAILED)
+			return false;
+
+		auto sq = static_cast<char*>(mSqRing);
+		auto cq = static_cast<char*>(mCqRing);
+
+		mSqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		mSqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		mSqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+		mCqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		mCqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		mCqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		mCqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+		return true;
+	}
+
+	io_uring_sqe& get_sqe(std::size_t idx, unsigned op)
+	{
+		const unsigned tail = *mSqTail + mUnsubmitted;
+		auto& sqe = static_cast<io_uring_sqe*>(mSqes)[tail & mSqMask];
+
+		std::memset(&sqe, 0, sizeof(sqe));
+		sqe.user_data = (std::uint64_t(idx) << URING_OP_BITS) | op;
+
+		mSqArray[tail & mSqMask] = tail & mSqMask;
+		mUnsubmitted++;
+
+		get_slot(idx).pending++;
+
+		return sqe;
+	}
+
+	UringSlot& get_slot(std::size_t idx)
+	{
+		return mSlots[idx % mSlots.size()];
+	}
+
+	void start(std::size_t idx)
+	{
+		auto& open = get_sqe(idx, URING_OP_OPEN);
+		open.opcode = IORING_OP_OPENAT;
+		open.fd = AT_FDCWD;
+		open.addr = reinterpret_cast<std::uintptr_t>(mPaths[idx].c_str());
+		open.open_flags = O_RDONLY | O_CLOEXEC;
+
+		auto& stat = get_sqe(idx, URING_OP_STAT);
+		stat.opcode = IORING_OP_STATX;
+		stat.fd = AT_FDCWD;
+		stat.addr = reinterpret_cast<std::uintptr_t>(mPaths[idx].c_str());
+		stat.len = STATX_SIZE;
+		stat.off = reinterpret_cast<std::uintptr_t>(&get_slot(idx).stat);
+	}
+
+	void submit_read(std::size_t idx)
+	{
+		auto& slot = get_slot(idx);
+
+		auto& read = get_sqe(idx, URING_OP_READ);
+		read.opcode = IORING_OP_READ;
+		read.fd = slot.fd;
+		read.addr = reinterpret_cast<std::uintptr_t>(slot.data.data() + slot.readSize);
+		read.len = std::min<std::size_t>(slot.data.size() - slot.readSize, 0x40000000u);
+		read.off = slot.readSize;
+	}
+
+	void submit_close(std::size_t idx)
+	{
+		auto& slot = get_slot(idx);
+
+		auto& close = get_sqe(idx, URING_OP_CLOSE);
+		close.opcode = IORING_OP_CLOSE;
+		close.fd = slot.fd;
+
+		slot.fd = -1;
+	}
+
+	// What comes after a step of file idx completed
+	void advance(std::size_t idx, unsigned op, int res)
+	{
+		auto& slot = get_slot(idx);
+
+		slot.pending--;
+
+		switch (op)
+		{
+
+		case URING_OP_OPEN:
+			if (res >= 0)
+				slot.fd = res;
+			else
+				slot.failed = true;
+
+			break;
+
+		case URING_OP_STAT:
+			if (res >= 0)
+				slot.statDone = true;
+			else
+				slot.failed = true;
+
+			break;
+
+		case URING_OP_READ:
+			if (res < 0)
+				slot.failed = true;
+			else if (res == 0)
+				slot.data.resize(slot.readSize); // shrunk since
+			else
+				slot.readSize += res;
+
+			break;
+
+		case URING_OP_CLOSE:
+			break;
+
+		} // switch (op)
+
+		if (slot.pending != 0)
+			return;
+
+		if (!slot.failed && op != URING_OP_CLOSE)
+		{
+			if (op != URING_OP_READ)
+				slot.data.resize(slot.stat.stx_size);
+
+			if (slot.readSize < slot.data.size())
+			{
+				submit_read(idx);
+				return;
+			}
+		}
+
+		if (slot.fd >= 0)
+		{
+			submit_close(idx);
+			return;
+		}
+
+		if (slot.failed)
+		{
+			// for the same result (and same errors) as elsewhere
+			slot.ok = read_entire_file(mPaths[idx].c_str(), slot.data);
+		}
+		else
+		{
+			slot.ok = true;
+		}
+
+		slot.ready = true;
+	}
+
+	// Returns false if io_uring_enter failed
+	bool submit_and_wait()
+	{
+		__atomic_store_n(mSqTail, *mSqTail + mUnsubmitted, __ATOMIC_RELEASE);
+
+		const unsigned toSubmit = mUnsubmitted;
+		mUnsubmitted = 0;
+
+		for (;;)
+		{
+			const int result = syscall(__NR_io_uring_enter, mRingFd, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+			if (result >= 0)
+				break;
+
+			if (errno != EINTR)
+				return false;
+		}
+
+		unsigned head = *mCqHead;
+		const unsigned tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+
+		for (; head != tail; ++head)
+		{
+			const auto& cqe = mCqes[head & mCqMask];
+			advance(cqe.user_data >> URING_OP_BITS, cqe.user_data & ((1u << URING_OP_BITS) - 1), cqe.res);
+		}
+
+		__atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+
+		return true;
+	}
+
+	bool next(BulkFile& file) override
+	{
+		if (mNextToHand >= mPaths.size())
+			return false;
+
+		for (;;)
+		{
+			// at most two ops per file are ever outstanding, entries is at least twice the slot count
+			while (mNextToStart < mPaths.size() && mNextToStart < mNextToHand + mSlots.size())
+				start(mNextToStart++);
+
+			auto& slot = get_slot(mNextToHand);
+
+			if (slot.ready)
+				break;
+
+			if (!submit_and_wait())
+			{
+				// shouldn't happen: finish this file synchronously, the next ones will fail the same way
+				while (slot.pending != 0 && submit_and_wait()) {}
+
+				slot.ok = read_entire_file(mPaths[mNextToHand].c_str(), slot.data);
+				slot.ready = true;
+
+				break;
+			}
+		}
+
+		auto& slot = get_slot(mNextToHand);
+
+		file.index = mNextToHand++;
+		file.ok = slot.ok;
+		file.data.swap(slot.data);
+
+		slot = UringSlot();
+
+		return true;
+	}
+
+	BulkBackend backend() const override { return BulkBackend::IoUring; }
+
+	const std::vector<std::string>& mPaths;
+	std::vector<UringSlot> mSlots;
+	std::size_t mNextToStart { 0u };
+	std::size_t mNextToHand { 0u };
+
+	int mRingFd { -1 };
+
+	void* mSqRing { MAP_FAILED };
+	void* mCqRing { MAP_FAILED };
+	void* mSqes { MAP_FAILED };
+	std::size_t mSqRingSize { 0u };
+	std::size_t mCqRingSize { 0u };
+	std::size_t mSqesSize { 0u };
+
+	unsigned* mSqTail { nullptr };
+	unsigned* mSqArray { nullptr };
+	unsigned mSqMask { 0u };
+	unsigned mUnsubmitted { 0u };
+
+	unsigned* mCqHead { nullptr };
+	unsigned* mCqTail { nullptr };
+	unsigned mCqMask { 0u };
+	io_uring_cqe* mCqes { nullptr };
+};
+
+#endif // SOREN_HAVE_IO_URING
+
+BulkReader::BulkReader(const std::vector<std::string>& paths, unsigned inFlight, bool allowIoUring)
+{
+	// the io_uring queue is sized from this (two entries per file), and is capped at 4096 entries
+	inFlight = std::min(std::max(1u, inFlight), 2048u);
+
+#if SOREN_HAVE_IO_URING
+	if (allowIoUring)
+	{
+		auto engine = std::make_unique<UringEngine>(paths, inFlight);
+
+		if (engine->setup())
+			mEngine = std::move(engine);
+	}
+#else
+	(void) allowIoUring;
+#endif
+
+	if (!mEngine)
+		mEngine = std::make_unique<ThreadEngine>(paths, inFlight);
+}
+
+BulkReader::~BulkReader() = default;
+
+bool BulkReader::next(BulkFile& file)
+{
+	return mEngine->next(file);
+}
+
+BulkBackend BulkReader::backend() const
+{
+	return mEngine->backend();
+}
+
+} // namespace soren
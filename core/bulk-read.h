@@ -0,0 +1,55 @@
+#ifndef SOREN_CORE_BULK_READ_INCLUDED
+#define SOREN_CORE_BULK_READ_INCLUDED
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "core/types.h"
+
+namespace soren {
+
+// Reads many whole files ahead of whoever processes them, with up to inFlight files being read at once
+// Where the kernel has it, the open, statx, read and close calls of every file in flight are submitted in batches
+// through io_uring; otherwise (or if told not to) a pool of reader threads does plain reads instead
+// Files are handed out in the order they were given, each as soon as it is read
+
+enum class BulkBackend
+{
+	IoUring,
+	Threads,
+};
+
+const char* get_backend_name(BulkBackend backend);
+
+struct BulkFile
+{
+	std::size_t index { 0u }; // in the paths given to the reader
+	bool ok { false }; // false if the file couldn't be read
+	std::vector<byte_type> data;
+};
+
+class BulkReader
+{
+public:
+	BulkReader(const std::vector<std::string>& paths, unsigned inFlight, bool allowIoUring = true);
+	~BulkReader();
+
+	BulkReader(const BulkReader&) = delete;
+	BulkReader& operator = (const BulkReader&) = delete;
+
+	// Blocks until the next file is read, returns false once every file was handed out
+	bool next(BulkFile& file);
+
+	BulkBackend backend() const;
+
+	// Same interface for both backends (see bulk-read.cpp)
+	struct Engine;
+
+private:
+	std::unique_ptr<Engine> mEngine;
+};
+
+} // namespace soren
+
+#endif // SOREN_CORE_BULK_READ_INCLUDED
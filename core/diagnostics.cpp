@@ -0,0 +1,79 @@
+#include "core/diagnostics.h"
+
+#include <iomanip>
+
+namespace soren {
+
+const char* get_error_message(ErrorKind kind)
+{
+	switch (kind)
+	{
+
+	case ErrorKind::None:                       return "no error";
+
+	case ErrorKind::FileUnreadable:             return "couldn't open file for binary read";
+	case ErrorKind::CompressedTruncated:        return "compressed data ends before the decompressed size is reached";
+	case ErrorKind::CompressedBadReference:     return "compressed data references bytes before the start of the output";
+	case ErrorKind::MemoryCapExceeded:          return "skipped, processing this would exceed the memory cap";
+
+	case ErrorKind::FileTooSmall:               return "this is not a valid CMB file (too small)";
+	case ErrorKind::StringPoolOutOfBounds:      return "string pool past the end of the file";
+	case ErrorKind::EventTableOutOfBounds:      return "event offset array past the end of the file";
+	case ErrorKind::EventTableUnterminated:     return "event offset array unterminated by the end of the file";
+	case ErrorKind::TooManyGlobals:             return "global variable amount is past the suspicion limit";
+	case ErrorKind::SceneOutOfBounds:           return "scene information goes past the end of the file";
+	case ErrorKind::SceneParametersOutOfBounds: return "scene information parameters go past the end of the file";
+	case ErrorKind::SceneNameOutOfBounds:       return "scene name string reaches past the end of the file";
+	case ErrorKind::SceneIndexMismatch:         return "scene information is invalid (index doesn't match)";
+	case ErrorKind::TooManyParameters:          return "scene parameter amount is past the suspicion limit";
+	case ErrorKind::TooManyVariables:           return "scene variable amount is past the suspicion limit";
+	case ErrorKind::TooManyArguments:           return "scene argument amount is past the variable amount";
+
+	case ErrorKind::ScriptOutOfBounds:          return "script starts past the end of the file";
+	case ErrorKind::InvalidOpcode:              return "invalid opcode";
+	case ErrorKind::OperandOutOfBounds:         return "reached end of script when expecting operand";
+	case ErrorKind::ScriptUnterminated:         return "reached the next structure (or end of file) without reaching end of script";
+	case ErrorKind::BadJumpTarget:              return "jump target outside of the script or within another instruction";
+
+	case ErrorKind::ExpectedPush:               return "instruction expects pushed values";
+	case ErrorKind::UnsupportedOpcode:          return "unsupported opcode";
+	case ErrorKind::BadVariableIndex:           return "variable index out of range";
+	case ErrorKind::BadGlobalIndex:             return "global variable index out of range";
+	case ErrorKind::BadSceneIndex:              return "called scene index out of range";
+	case ErrorKind::BadStringOffset:            return "bad string pool offset";
+
+	case ErrorKind::InstructionBudgetExceeded:  return "scene skipped, it has more instructions than the budget allows";
+	case ErrorKind::MoveBudgetExceeded:         return "scene skipped, its bkn/bky chains move more instructions than the budget allows";
+	case ErrorKind::SliceBudgetExceeded:        return "scene skipped, it has more slices than the budget allows";
+	case ErrorKind::NodeBudgetExceeded:         return "scene skipped, it builds more expression nodes than the budget allows";
+	case ErrorKind::DepthBudgetExceeded:        return "scene skipped, it nests expressions deeper than the budget allows";
+	case ErrorKind::SceneDeadlineExceeded:      return "scene skipped, it took longer than the scene time budget";
+	case ErrorKind::FileDeadlineExceeded:       return "scene skipped, the file took longer than its time budget";
+
+	case ErrorKind::UnexpectedCharacter:        return "unexpected character";
+	case ErrorKind::UnterminatedString:         return "unterminated string literal";
+	case ErrorKind::UnexpectedToken:            return "syntax error";
+	case ErrorKind::UnknownName:                return "unknown variable name";
+	case ErrorKind::UnknownLabel:               return "unknown label";
+	case ErrorKind::DuplicateLabel:             return "label defined twice";
+	case ErrorKind::DuplicateName:              return "name defined twice";
+	case ErrorKind::ArgumentCountMismatch:      return "wrong amount of arguments to event";
+	case ErrorKind::UnsupportedExpression:      return "expression has no bytecode equivalent";
+	case ErrorKind::OperandTooLarge:            return "operand too large for its instruction";
+
+	} // switch (kind)
+
+	return "unknown error";
+}
+
+std::ostream& operator << (std::ostream& os, const Diagnostic& diag)
+{
+	os << get_error_message(diag.kind) << " (at 0x" << std::hex << diag.offset << std::dec;
+
+	if (diag.scene >= 0)
+		os << ", in scene " << diag.scene;
+
+	return os << ")";
+}
+
+} // namespace soren
@@ -0,0 +1,100 @@
+#ifndef SOREN_CORE_DIAGNOSTICS_INCLUDED
+#define SOREN_CORE_DIAGNOSTICS_INCLUDED
+
+#include <vector>
+#include <ostream>
+
+namespace soren {
+
+enum class ErrorKind
+{
+	None,
+
+	// Input
+	FileUnreadable,
+	CompressedTruncated,
+	CompressedBadReference,
+	MemoryCapExceeded,
+
+	// CMB structure
+	FileTooSmall,
+	StringPoolOutOfBounds,
+	EventTableOutOfBounds,
+	EventTableUnterminated,
+	TooManyGlobals,
+	SceneOutOfBounds,
+	SceneParametersOutOfBounds,
+	SceneNameOutOfBounds,
+	SceneIndexMismatch,
+	TooManyParameters,
+	TooManyVariables,
+	TooManyArguments,
+
+	// Bytecode
+	ScriptOutOfBounds,
+	InvalidOpcode,
+	OperandOutOfBounds,
+	ScriptUnterminated,
+	BadJumpTarget,
+
+	// Statement building
+	ExpectedPush,
+	UnsupportedOpcode,
+	BadVariableIndex,
+	BadGlobalIndex,
+	BadSceneIndex,
+	BadStringOffset,
+
+	// Decompile budget (see DecompileBudget)
+	InstructionBudgetExceeded,
+	MoveBudgetExceeded,
+	SliceBudgetExceeded,
+	NodeBudgetExceeded,
+	DepthBudgetExceeded,
+	SceneDeadlineExceeded,
+	FileDeadlineExceeded,
+
+	// Compilation (offsets are source offsets)
+	UnexpectedCharacter,
+	UnterminatedString,
+	UnexpectedToken,
+	UnknownName,
+	UnknownLabel,
+	DuplicateLabel,
+	DuplicateName,
+	ArgumentCountMismatch,
+	UnsupportedExpression,
+	OperandTooLarge,
+};
+
+const char* get_error_message(ErrorKind kind);
+
+struct Diagnostic
+{
+	ErrorKind kind;
+	unsigned offset; // file offset
+	int scene; // scene index, or -1 when not within a scene
+};
+
+std::ostream& operator << (std::ostream& os, const Diagnostic& diag);
+
+// Collects every issue found instead of stopping at the first one
+
+struct Diagnostics
+{
+	void report(ErrorKind kind, unsigned offset, int scene = -1)
+	{
+		list.push_back({ kind, offset, scene });
+	}
+
+	bool empty() const { return list.empty(); }
+	std::size_t size() const { return list.size(); }
+
+	void clear() { list.clear(); }
+
+	std::vector<Diagnostic> list;
+};
+
+} // namespace soren
+
+#endif // SOREN_CORE_DIAGNOSTICS_INCLUDED
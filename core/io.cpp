@@ -0,0 +1,227 @@
+#include "core/io.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+
+// TODO (C++17): std::filesystem
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace soren {
+
+bool read_entire_file(const char* filename, std::vector<byte_type>& result)
+{
+	std::ifstream in(filename, std::ios::binary | std::ios::ate);
+
+	if (!in.is_open())
+		return false;
+
+	const auto size = in.tellg();
+
+	if (size < 0)
+		return false;
+
+	result.resize(size);
+
+	in.seekg(0, std::ios::beg);
+	in.read(reinterpret_cast<std::ifstream::char_type*>(result.data()), size);
+
+	return static_cast<bool>(in);
+}
+
+bool is_directory(const char* path)
+{
+	struct stat st;
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool FileWindow::open(const char* filename)
+{
+	mFile.close();
+	mFile.clear();
+
+	mSize = 0;
+	mBufferOffset = 0;
+	mBufferSize = 0;
+
+	mFile.open(filename, std::ios::binary | std::ios::ate);
+
+	if (!mFile.is_open())
+		return false;
+
+	const auto size = mFile.tellg();
+
+	if (size < 0)
+		return false;
+
+	mSize = size;
+	return true;
+}
+
+bool FileWindow::read(std::size_t offset, std::size_t size, void* out)
+{
+	if (offset > mSize || size > mSize - offset)
+		return false;
+
+	if (offset >= mBufferOffset && offset + size <= mBufferOffset + mBufferSize)
+	{
+		std::memcpy(out, mBuffer.data() + (offset - mBufferOffset), size);
+		return true;
+	}
+
+	if (size >= mBuffer.size())
+	{
+		mFile.clear();
+		mFile.seekg(offset, std::ios::beg);
+		mFile.read(reinterpret_cast<std::ifstream::char_type*>(out), size);
+
+		return static_cast<bool>(mFile);
+	}
+
+	// refill the window, starting at offset
+
+	mBufferOffset = offset;
+	mBufferSize = std::min(mBuffer.size(), mSize - offset);
+
+	mFile.clear();
+	mFile.seekg(offset, std::ios::beg);
+	mFile.read(reinterpret_cast<std::ifstream::char_type*>(mBuffer.data()), mBufferSize);
+
+	if (!mFile)
+	{
+		mBufferSize = 0;
+		return false;
+	}
+
+	std::memcpy(out, mBuffer.data(), size);
+	return true;
+}
+
+bool MappedFile::open(const char* filename)
+{
+	close();
+
+	const int fd = ::open(filename, O_RDONLY);
+
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	mSize = st.st_size;
+
+	// empty files can't be mapped, but there is nothing to read either
+	if (mSize == 0)
+	{
+		::close(fd);
+		return true;
+	}
+
+	void* mapping = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (mapping != MAP_FAILED)
+	{
+		mData = static_cast<const byte_type*>(mapping);
+		mMapped = true;
+
+		return true;
+	}
+
+	if (!read_entire_file(filename, mFallback))
+	{
+		mSize = 0;
+		return false;
+	}
+
+	mData = mFallback.data();
+	mSize = mFallback.size();
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mMapped)
+		munmap(const_cast<byte_type*>(mData), mSize);
+
+	mData = nullptr;
+	mSize = 0;
+	mMapped = false;
+
+	mFallback.clear();
+}
+
+static
+bool ends_with_nocase(const char* str, const char* suffix)
+{
+	const auto len = std::strlen(str);
+	const auto suffixLen = std::strlen(suffix);
+
+	if (suffixLen > len)
+		return false;
+
+	return std::equal(suffix, suffix + suffixLen, str + len - suffixLen, [] (char a, char b)
+	{
+		return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+	});
+}
+
+static
+bool list_files_impl(const std::string& path, const char* extension, std::vector<std::string>& result)
+{
+	DIR* dir = opendir(path.c_str());
+
+	if (dir == nullptr)
+		return false;
+
+	while (const dirent* entry = readdir(dir))
+	{
+		if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0)
+			continue;
+
+		std::string fullPath(path);
+
+		if (fullPath.empty() || fullPath.back() != '/')
+			fullPath.push_back('/');
+
+		fullPath.append(entry->d_name);
+
+		struct stat st;
+
+		if (stat(fullPath.c_str(), &st) != 0)
+			continue;
+
+		if (S_ISDIR(st.st_mode))
+			list_files_impl(fullPath, extension, result); // unreadable subdirectories are skipped
+		else if (S_ISREG(st.st_mode) && ends_with_nocase(entry->d_name, extension))
+			result.push_back(std::move(fullPath));
+	}
+
+	closedir(dir);
+	return true;
+}
+
+bool list_files(const char* path, const char* extension, std::vector<std::string>& result)
+{
+	const auto first = result.size();
+
+	if (!list_files_impl(path, extension, result))
+		return false;
+
+	std::sort(result.begin() + first, result.end());
+	return true;
+}
+
+} // namespace soren
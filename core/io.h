@@ -0,0 +1,74 @@
+#ifndef SOREN_CORE_IO_INCLUDED
+#define SOREN_CORE_IO_INCLUDED
+
+#include <vector>
+#include <string>
+#include <fstream>
+
+#include "core/types.h"
+
+namespace soren {
+
+// Returns false if the file couldn't be read
+bool read_entire_file(const char* filename, std::vector<byte_type>& result);
+
+bool is_directory(const char* path);
+
+// Recursively appends paths of regular files under path whose name ends with extension (case insensitive), sorted
+// Returns false if path couldn't be listed
+bool list_files(const char* path, const char* extension, std::vector<std::string>& result);
+
+// Reads arbitrary ranges of a file through a fixed size buffer, for when the whole file shouldn't be loaded
+// Small reads near each other are served from the buffer, reads at least as large as it go straight to the file
+
+class FileWindow
+{
+public:
+	explicit FileWindow(std::size_t windowSize)
+		: mBuffer(windowSize) {}
+
+	bool open(const char* filename);
+
+	std::size_t size() const { return mSize; }
+	std::size_t window_size() const { return mBuffer.size(); }
+
+	// Returns false if [offset, offset+size) isn't within the file
+	bool read(std::size_t offset, std::size_t size, void* out);
+
+private:
+	std::ifstream mFile;
+	std::size_t mSize { 0u };
+
+	std::vector<byte_type> mBuffer;
+	std::size_t mBufferOffset { 0u };
+	std::size_t mBufferSize { 0u }; // how much of mBuffer holds file data
+};
+
+// Read-only view of an entire file, memory mapped where possible (read into memory otherwise)
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+
+	bool open(const char* filename);
+	void close();
+
+	const byte_type* data() const { return mData; }
+	std::size_t size() const { return mSize; }
+
+private:
+	const byte_type* mData { nullptr };
+	std::size_t mSize { 0u };
+
+	bool mMapped { false };
+	std::vector<byte_type> mFallback;
+};
+
+} // namespace soren
+
+#endif // SOREN_CORE_IO_INCLUDED
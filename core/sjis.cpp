@@ -0,0 +1,137 @@
+#include "core/sjis.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace soren {
+
+static
+int get_lead_index(unsigned byte)
+{
+	if (byte >= 0x81 && byte <= 0x9F)
+		return byte - 0x81;
+
+	if (byte >= 0xE0 && byte <= 0xFC)
+		return byte - 0xE0 + 31;
+
+	return -1;
+}
+
+static
+int get_trail_index(unsigned byte)
+{
+	if (byte >= 0x40 && byte <= 0x7E)
+		return byte - 0x40;
+
+	if (byte >= 0x80 && byte <= 0xFC)
+		return byte - 0x80 + 63;
+
+	return -1;
+}
+
+static
+char* put_utf8(char* out, unsigned codepoint)
+{
+	if (codepoint < 0x80)
+	{
+		*out++ = static_cast<char>(codepoint);
+	}
+	else if (codepoint < 0x800)
+	{
+		*out++ = static_cast<char>(0xC0 | (codepoint >> 6));
+		*out++ = static_cast<char>(0x80 | (codepoint & 0x3F));
+	}
+	else
+	{
+		*out++ = static_cast<char>(0xE0 | (codepoint >> 12));
+		*out++ = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+		*out++ = static_cast<char>(0x80 | (codepoint & 0x3F));
+	}
+
+	return out;
+}
+
+bool sjis_to_utf8(const char* str, std::size_t len, std::vector<char>& result)
+{
+	const auto start = result.size();
+
+	// at most 3 bytes out per byte in (half-width katakana)
+	result.resize(start + 3 * len);
+
+	auto in = reinterpret_cast<const unsigned char*>(str);
+	const auto end = in + len;
+
+	char* out = result.data() + start;
+	bool valid = true;
+
+	while (in != end)
+	{
+		if (*in < 0x80)
+		{
+#if defined(__SSE2__)
+			while (end - in >= 16)
+			{
+				const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+				const unsigned mask = _mm_movemask_epi8(chunk);
+
+				if (mask != 0)
+				{
+					const unsigned run = __builtin_ctz(mask);
+
+					std::memcpy(out, in, run);
+					in += run;
+					out += run;
+
+					break;
+				}
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out), chunk);
+				in += 16;
+				out += 16;
+			}
+#endif
+
+			while (in != end && *in < 0x80)
+				*out++ = static_cast<char>(*in++);
+
+			continue;
+		}
+
+		const unsigned lead = *in++;
+
+		if (lead >= 0xA1 && lead <= 0xDF)
+		{
+			// half-width katakana
+			out = put_utf8(out, 0xFF61 + (lead - 0xA1));
+			continue;
+		}
+
+		const int row = get_lead_index(lead);
+		const int column = (row >= 0 && in != end) ? get_trail_index(*in) : -1;
+
+		unsigned codepoint = 0;
+
+		if (column >= 0)
+		{
+			// an unmapped pair is one bad character, a lead byte without a trail byte leaves the next byte be
+			codepoint = SJIS_DOUBLE_TABLE[row * SJIS_TRAIL_COUNT + column];
+			++in;
+		}
+
+		if (codepoint == 0)
+		{
+			codepoint = 0xFFFD;
+			valid = false;
+		}
+
+		out = put_utf8(out, codepoint);
+	}
+
+	result.resize(out - result.data());
+	return valid;
+}
+
+} // namespace soren
@@ -0,0 +1,27 @@
+#ifndef SOREN_CORE_SJIS_INCLUDED
+#define SOREN_CORE_SJIS_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace soren {
+
+// Shift-JIS (as Windows code page 932, which is what the JP releases store their text as) to UTF-8
+
+enum : unsigned
+{
+	SJIS_LEAD_COUNT = 60, // 81-9F, E0-FC
+	SJIS_TRAIL_COUNT = 188, // 40-7E, 80-FC
+};
+
+// Code points of double byte characters, by lead and trail byte (0 if there is none, see sjis-table.cpp)
+extern const std::uint16_t SJIS_DOUBLE_TABLE[SJIS_LEAD_COUNT * SJIS_TRAIL_COUNT];
+
+// Appends the UTF-8 of str to result, returns false if some of it wasn't Shift-JIS (each bad character is U+FFFD)
+// ASCII runs are copied 16 bytes at a time
+bool sjis_to_utf8(const char* str, std::size_t len, std::vector<char>& result);
+
+} // namespace soren
+
+#endif // SOREN_CORE_SJIS_INCLUDED
@@ -2,11 +2,13 @@
 #define SOREN_CORE_CMB_INCLUDED
 
 #include <stdexcept>
+#include <cstring>
 
 #include <vector>
 #include <string>
 
 #include "core/soren-bytecode.h"
+#include "core/string-pool.h"
 
 namespace soren {
 
@@ -18,6 +20,13 @@ enum
 	CMB_SCENE_KIND_TURN6    = 6,
 };
 
+// [begin, end) byte range, relative to the start of a script
+struct ScriptRange
+{
+	unsigned begin;
+	unsigned end;
+};
+
 struct SceneInfo
 {
 	unsigned idx { 0u };
@@ -31,6 +40,8 @@ struct SceneInfo
 	std::vector<std::string> varnames;
 
 	std::vector<BcIns> rawScript;
+	unsigned scriptOffset { 0u }; // file offset of the script, rawScript locations are relative to it
+	std::vector<ScriptRange> unreachable; // bytes between reachable instructions that no path from the entry decodes
 
 	bool isGlobal { false };
 };
@@ -45,8 +56,27 @@ struct CmbInfo
 		return stringPool.data() + offset;
 	}
 
+	// nullptr if offset is out of the pool or the string is unterminated
+	const char* try_get_cstr(unsigned offset) const noexcept
+	{
+		if (offset >= stringPool.size())
+			return nullptr;
+
+		if (std::memchr(stringPool.data() + offset, 0, stringPool.size() - offset) == nullptr)
+			return nullptr;
+
+		return stringPool.data() + offset;
+	}
+
+	// The string at offset, from stringIndex (str is nullptr if it isn't a string scripts reference, or unterminated)
+	PoolString find_string(unsigned offset) const
+	{
+		return stringIndex.find(stringPool.data(), offset);
+	}
+
 	std::vector<SceneInfo> scenes;
 	std::vector<char> stringPool;
+	StringPoolIndex stringIndex; // built by decoding (see index_cmb_strings)
 
 	std::vector<std::string> globalNames; // TODO: this may not be what it is, investigate
 };
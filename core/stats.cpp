@@ -0,0 +1,209 @@
+#include "core/stats.h"
+
+namespace soren {
+
+const char* get_phase_name(StatsPhase phase)
+{
+	switch (phase)
+	{
+
+	case StatsPhase::Other:        return "other";
+	case StatsPhase::Read:         return "read";
+	case StatsPhase::Decode:       return "decode";
+	case StatsPhase::Slice:        return "slice";
+	case StatsPhase::BkConversion: return "bk";
+	case StatsPhase::Statements:   return "statements";
+	case StatsPhase::Structure:    return "structure";
+	case StatsPhase::Print:        return "print";
+
+	case StatsPhase::Count:
+		break;
+
+	} // switch (phase)
+
+	return "unknown";
+}
+
+const char* get_counter_name(StatsCounter counter)
+{
+	switch (counter)
+	{
+
+	case StatsCounter::Bytes:        return "bytes";
+	case StatsCounter::Instructions: return "instructions";
+	case StatsCounter::Slices:       return "slices";
+	case StatsCounter::Statements:   return "statements";
+	case StatsCounter::ExprNodes:    return "exprNodes";
+
+	case StatsCounter::Count:
+		break;
+
+	} // switch (counter)
+
+	return "unknown";
+}
+
+} // namespace soren
+
+#if SOREN_ENABLE_STATS
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
+#include <new>
+
+namespace soren {
+
+enum
+{
+	PHASE_COUNT = static_cast<int>(StatsPhase::Count),
+	COUNTER_COUNT = static_cast<int>(StatsCounter::Count),
+};
+
+struct AtomicPhaseTotals
+{
+	std::atomic<std::uint64_t> wallNs;
+	std::atomic<std::uint64_t> cpuNs;
+	std::atomic<std::uint64_t> calls;
+	std::atomic<std::uint64_t> allocations;
+	std::atomic<std::uint64_t> allocatedBytes;
+};
+
+// zero-initialized (static storage), so usable from operator new before any constructor runs
+static AtomicPhaseTotals sPhases[PHASE_COUNT];
+static std::atomic<std::uint64_t> sCounters[COUNTER_COUNT];
+static std::atomic<bool> sEnabled;
+
+static thread_local StatsPhase tCurrentPhase = StatsPhase::Other;
+
+static
+std::uint64_t get_wall_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static
+std::uint64_t get_cpu_ns()
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return std::uint64_t(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+#else
+	return std::uint64_t(std::clock()) * (1000000000u / CLOCKS_PER_SEC);
+#endif
+}
+
+void enable_stats()
+{
+	sEnabled.store(true, std::memory_order_relaxed);
+}
+
+bool stats_enabled()
+{
+	return sEnabled.load(std::memory_order_relaxed);
+}
+
+void add_stats_count(StatsCounter counter, std::uint64_t amount)
+{
+	sCounters[static_cast<int>(counter)].fetch_add(amount, std::memory_order_relaxed);
+}
+
+StatsPhaseTotals get_phase_totals(StatsPhase phase)
+{
+	auto& totals = sPhases[static_cast<int>(phase)];
+
+	return StatsPhaseTotals
+	{
+		totals.wallNs.load(std::memory_order_relaxed),
+		totals.cpuNs.load(std::memory_order_relaxed),
+		totals.calls.load(std::memory_order_relaxed),
+		totals.allocations.load(std::memory_order_relaxed),
+		totals.allocatedBytes.load(std::memory_order_relaxed),
+	};
+}
+
+std::uint64_t get_counter_total(StatsCounter counter)
+{
+	return sCounters[static_cast<int>(counter)].load(std::memory_order_relaxed);
+}
+
+StatsPhaseScope::StatsPhaseScope(StatsPhase phase)
+	: mPhase(phase), mPrevious(tCurrentPhase), mActive(stats_enabled()), mWallStart(0), mCpuStart(0)
+{
+	if (!mActive)
+		return;
+
+	tCurrentPhase = phase;
+
+	mWallStart = get_wall_ns();
+	mCpuStart = get_cpu_ns();
+}
+
+StatsPhaseScope::~StatsPhaseScope()
+{
+	if (!mActive)
+		return;
+
+	auto& totals = sPhases[static_cast<int>(mPhase)];
+
+	totals.wallNs.fetch_add(get_wall_ns() - mWallStart, std::memory_order_relaxed);
+	totals.cpuNs.fetch_add(get_cpu_ns() - mCpuStart, std::memory_order_relaxed);
+	totals.calls.fetch_add(1, std::memory_order_relaxed);
+
+	tCurrentPhase = mPrevious;
+}
+
+static inline
+void account_allocation(std::size_t size)
+{
+	if (!sEnabled.load(std::memory_order_relaxed))
+		return;
+
+	auto& totals = sPhases[static_cast<int>(tCurrentPhase)];
+
+	totals.allocations.fetch_add(1, std::memory_order_relaxed);
+	totals.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+} // namespace soren
+
+// Counting allocator hook: every global allocation goes through here
+
+void* operator new (std::size_t size)
+{
+	soren::account_allocation(size);
+
+	if (void* result = std::malloc(size == 0 ? 1 : size))
+		return result;
+
+	throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size)
+{
+	return operator new (size);
+}
+
+void* operator new (std::size_t size, const std::nothrow_t&) noexcept
+{
+	soren::account_allocation(size);
+	return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[] (std::size_t size, const std::nothrow_t& tag) noexcept
+{
+	return operator new (size, tag);
+}
+
+void operator delete (void* ptr) noexcept { std::free(ptr); }
+void operator delete[] (void* ptr) noexcept { std::free(ptr); }
+void operator delete (void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[] (void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete (void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[] (void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+
+#endif // SOREN_ENABLE_STATS
@@ -0,0 +1,98 @@
+#ifndef SOREN_CORE_STATS_INCLUDED
+#define SOREN_CORE_STATS_INCLUDED
+
+// Per-phase performance counters (--stats)
+// Building with SOREN_ENABLE_STATS=0 compiles all of this out: the macros below expand to nothing
+
+#include <cstdint>
+#include <cstddef>
+
+#ifndef SOREN_ENABLE_STATS
+#define SOREN_ENABLE_STATS 1
+#endif
+
+namespace soren {
+
+enum class StatsPhase
+{
+	Other, // outside of any phase scope
+	Read,
+	Decode,
+	Slice,
+	BkConversion,
+	Statements,
+	Structure,
+	Print,
+
+	Count,
+};
+
+enum class StatsCounter
+{
+	Bytes,
+	Instructions,
+	Slices,
+	Statements,
+	ExprNodes,
+
+	Count,
+};
+
+struct StatsPhaseTotals
+{
+	std::uint64_t wallNs;
+	std::uint64_t cpuNs;
+	std::uint64_t calls;
+	std::uint64_t allocations;
+	std::uint64_t allocatedBytes;
+};
+
+const char* get_phase_name(StatsPhase phase);
+const char* get_counter_name(StatsCounter counter);
+
+#if SOREN_ENABLE_STATS
+
+// Nothing is recorded until this is called
+void enable_stats();
+bool stats_enabled();
+
+void add_stats_count(StatsCounter counter, std::uint64_t amount);
+
+StatsPhaseTotals get_phase_totals(StatsPhase phase);
+std::uint64_t get_counter_total(StatsCounter counter);
+
+// Times the enclosing scope, allocations made within it (on this thread) are accounted to its phase
+struct StatsPhaseScope
+{
+	explicit StatsPhaseScope(StatsPhase phase);
+	~StatsPhaseScope();
+
+	StatsPhaseScope(const StatsPhaseScope&) = delete;
+	StatsPhaseScope& operator = (const StatsPhaseScope&) = delete;
+
+private:
+	StatsPhase mPhase;
+	StatsPhase mPrevious;
+	bool mActive;
+	std::uint64_t mWallStart;
+	std::uint64_t mCpuStart;
+};
+
+#define SOREN_STATS_CONCAT_IMPL(a, b) a ## b
+#define SOREN_STATS_CONCAT(a, b) SOREN_STATS_CONCAT_IMPL(a, b)
+
+#define SOREN_STATS_PHASE(phase) ::soren::StatsPhaseScope SOREN_STATS_CONCAT(sorenStatsScope, __LINE__) (::soren::StatsPhase::phase)
+#define SOREN_STATS_ADD(counter, amount) do { if (::soren::stats_enabled()) ::soren::add_stats_count(::soren::StatsCounter::counter, (amount)); } while (false)
+#define SOREN_STATS_ONLY(...) __VA_ARGS__
+
+#else // SOREN_ENABLE_STATS
+
+#define SOREN_STATS_PHASE(phase) do {} while (false)
+#define SOREN_STATS_ADD(counter, amount) do {} while (false)
+#define SOREN_STATS_ONLY(...)
+
+#endif // SOREN_ENABLE_STATS
+
+} // namespace soren
+
+#endif // SOREN_CORE_STATS_INCLUDED
@@ -0,0 +1,171 @@
+#include "core/string-pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace soren {
+
+void find_nuls(Span<const char> data, std::vector<std::uint32_t>& result)
+{
+	result.clear();
+
+	const char* const begin = data.data();
+	std::size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 16 <= data.size(); i += 16)
+	{
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin + i));
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero));
+
+		while (mask != 0)
+		{
+			result.push_back(i + __builtin_ctz(mask));
+			mask &= mask - 1;
+		}
+	}
+#endif
+
+	while (i < data.size())
+	{
+		const auto nul = static_cast<const char*>(std::memchr(begin + i, 0, data.size() - i));
+
+		if (nul == nullptr)
+			break;
+
+		result.push_back(nul - begin);
+		i = nul - begin + 1;
+	}
+}
+
+void StringPoolIndex::clear()
+{
+	mEntries.clear();
+	mFirstById.clear();
+	mTexts.clear();
+	mTextChars.clear();
+	mIdCnt = 0;
+}
+
+std::size_t StringPoolIndex::convert(const char* pool, Converter converter)
+{
+	std::size_t failCnt = 0;
+
+	mTexts.clear();
+	mTextChars.clear();
+
+	for (std::uint32_t id = 0; id < mIdCnt; ++id)
+	{
+		auto& entry = mEntries[mFirstById[id]];
+		const std::uint32_t start = mTextChars.size();
+
+		if (!converter(pool + entry.offset, entry.length, mTextChars))
+			++failCnt;
+
+		const std::uint32_t length = mTextChars.size() - start;
+
+		mTexts.push_back({ start, length, hash_string(mTextChars.data() + start, length) });
+		mTextChars.push_back('\0');
+	}
+
+	return failCnt;
+}
+
+void StringPoolIndex::build(Span<const char> pool, Span<const std::uint32_t> referenced)
+{
+	clear();
+
+	static thread_local std::vector<std::uint32_t> nuls;
+	find_nuls(pool, nuls);
+
+	// strings starting the pool or following a NUL
+
+	std::uint32_t start = 0;
+
+	for (auto nul : nuls)
+	{
+		mEntries.push_back({ start, nul - start, 0u, 0u });
+		start = nul + 1;
+	}
+
+	// strings starting within another one
+
+	const auto startCnt = mEntries.size();
+
+	for (auto offset : referenced)
+	{
+		if (nuls.empty() || offset > nuls.back())
+			continue; // out of the pool, or unterminated
+
+		if (offset == 0 || pool[offset - 1] == 0)
+			continue; // indexed above
+
+		const auto nul = *std::lower_bound(nuls.begin(), nuls.end(), offset);
+		mEntries.push_back({ offset, nul - offset, 0u, 0u });
+	}
+
+	if (mEntries.size() != startCnt)
+	{
+		auto by_offset = [] (const Entry& a, const Entry& b) { return a.offset < b.offset; };
+		auto same_offset = [] (const Entry& a, const Entry& b) { return a.offset == b.offset; };
+
+		const auto middle = mEntries.begin() + startCnt;
+
+		std::sort(middle, mEntries.end(), by_offset);
+		mEntries.erase(std::unique(middle, mEntries.end(), same_offset), mEntries.end());
+
+		std::inplace_merge(mEntries.begin(), mEntries.begin() + startCnt, mEntries.end(), by_offset);
+	}
+
+	// ids, by text (open addressing over entry indices)
+
+	static thread_local std::vector<std::uint32_t> buckets;
+
+	std::size_t bucketCnt = 16;
+
+	while (bucketCnt < 2 * mEntries.size())
+		bucketCnt *= 2;
+
+	const std::uint32_t none = 0xFFFFFFFFu;
+	const auto mask = bucketCnt - 1;
+
+	buckets.assign(bucketCnt, none);
+
+	for (std::uint32_t i = 0; i < mEntries.size(); ++i)
+	{
+		auto& entry = mEntries[i];
+		const char* str = pool.data() + entry.offset;
+
+		entry.hash = hash_string(str, entry.length);
+
+		for (auto bucket = entry.hash & mask;; bucket = (bucket + 1) & mask)
+		{
+			if (buckets[bucket] == none)
+			{
+				buckets[bucket] = i;
+
+				entry.id = mIdCnt++;
+				mFirstById.push_back(i);
+
+				break;
+			}
+
+			auto& other = mEntries[buckets[bucket]];
+
+			if (other.hash == entry.hash && other.length == entry.length
+				&& std::memcmp(pool.data() + other.offset, str, entry.length) == 0)
+			{
+				entry.id = other.id;
+				break;
+			}
+		}
+	}
+}
+
+} // namespace soren
@@ -0,0 +1,120 @@
+#ifndef SOREN_CORE_STRING_POOL_INCLUDED
+#define SOREN_CORE_STRING_POOL_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "core/types.h"
+
+namespace soren {
+
+// FNV-1a (what SymbolTable hashes names with)
+inline std::uint32_t hash_string(const char* str, std::size_t len)
+{
+	std::uint32_t hash = 2166136261u;
+
+	for (std::size_t i = 0; i < len; ++i)
+		hash = (hash ^ static_cast<unsigned char>(str[i])) * 16777619u;
+
+	return hash;
+}
+
+// One string of an indexed pool, str is nullptr if there is none at the offset looked up
+struct PoolString
+{
+	const char* str;
+	std::uint32_t length;
+	std::uint32_t id; // same for every string of the pool with the same text, below StringPoolIndex::id_count()
+	std::uint32_t hash; // hash_string of the text
+};
+
+// Every string of a pool (NUL-terminated strings back to back) that a script can reference, indexed once per file so
+// that nothing past decoding needs to measure or hash pool strings again: the ones starting the pool or following a
+// NUL, and those starting within another string (scripts may reference suffixes) given when building
+// NULs are searched for 16 bytes at a time, bytes past the last one are an unterminated string and left out
+// Only offsets are kept: lookups take the pool (which may have moved since, as long as it is the same bytes)
+// Strings can be converted (to another encoding), once per id: lookups then return the converted text instead
+
+class StringPoolIndex
+{
+public:
+	void build(Span<const char> pool, Span<const std::uint32_t> referenced = Span<const std::uint32_t>());
+
+	void clear();
+
+	// Appends the converted text of str to result, returns false if it couldn't all be converted
+	using Converter = bool (*)(const char* str, std::size_t len, std::vector<char>& result);
+
+	// Converts every string (lasts until the next build or clear), returns how many couldn't all be converted
+	std::size_t convert(const char* pool, Converter converter);
+
+	// The (terminated) string at offset, if it was indexed
+	PoolString find(const char* pool, std::uint32_t offset) const
+	{
+		std::size_t left = 0;
+		std::size_t right = mEntries.size();
+
+		while (left < right)
+		{
+			const std::size_t mid = (left + right) / 2;
+
+			if (mEntries[mid].offset < offset)
+				left = mid + 1;
+			else
+				right = mid;
+		}
+
+		if (left == mEntries.size() || mEntries[left].offset != offset)
+			return { nullptr, 0u, 0u, 0u };
+
+		return make_string(pool, mEntries[left]);
+	}
+
+	std::size_t size() const { return mEntries.size(); }
+	std::uint32_t id_count() const { return mIdCnt; }
+
+	// The first string indexed with each id, in id order
+	PoolString get_by_id(const char* pool, std::uint32_t id) const
+	{
+		return make_string(pool, mEntries[mFirstById[id]]);
+	}
+
+private:
+	struct Entry
+	{
+		std::uint32_t offset;
+		std::uint32_t length;
+		std::uint32_t id;
+		std::uint32_t hash;
+	};
+
+	struct Text
+	{
+		std::uint32_t offset; // in mTextChars
+		std::uint32_t length;
+		std::uint32_t hash;
+	};
+
+	PoolString make_string(const char* pool, const Entry& entry) const
+	{
+		if (mTexts.empty())
+			return { pool + entry.offset, entry.length, entry.id, entry.hash };
+
+		auto& text = mTexts[entry.id];
+		return { mTextChars.data() + text.offset, text.length, entry.id, text.hash };
+	}
+
+	std::vector<Entry> mEntries; // by offset
+	std::vector<std::uint32_t> mFirstById; // entry indices
+	std::vector<Text> mTexts; // converted text by id, empty unless converted
+	std::vector<char> mTextChars; // NUL-terminated
+	std::uint32_t mIdCnt { 0u };
+};
+
+// Offsets of every NUL of data, in order (into result, cleared first)
+void find_nuls(Span<const char> data, std::vector<std::uint32_t>& result);
+
+} // namespace soren
+
+#endif // SOREN_CORE_STRING_POOL_INCLUDED
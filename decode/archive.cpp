@@ -0,0 +1,396 @@
+#include "decode/archive.h"
+#include "decode/decode.h"
+#include "decode/lz.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace soren {
+
+/*
+ * Archive layout (all little endian):
+ *
+ * 0x00 header: "SPAK", u32 version, u32 entryCnt, u32 reserved (0), u64 namesOffset, u64 namesSize
+ * 0x20 index:  entryCnt entries of 0x20 bytes, sorted by name (bytewise):
+ *              u64 offset, u64 size, u64 hash, u32 nameOffset (within names), u16 nameLength, u8 game, u8 confidence
+ *      names:  NUL terminated member names
+ *      data:   member bytes, as they were given (LZ compressed members stay compressed), each aligned to 0x40
+ *
+ * hash is FNV-1a 64 over the member bytes, game and confidence are the values of GameKind and DetectConfidence
+ * as detect_game reported them for the (decompressed) member.
+ */
+
+enum : std::uint32_t
+{
+	ARCHIVE_VERSION = 1,
+
+	ARCHIVE_HEADER_SIZE = 0x20,
+	ARCHIVE_ENTRY_SIZE = 0x20,
+	ARCHIVE_ALIGNMENT = 0x40,
+};
+
+static const char sArchiveMagic[4] { 'S', 'P', 'A', 'K' };
+
+static
+std::uint64_t read_le(const byte_type* data, unsigned size)
+{
+	std::uint64_t result = 0;
+
+	for (unsigned i = size; i > 0; --i)
+		result = (result << 8) | data[i - 1];
+
+	return result;
+}
+
+static
+void write_le(std::ostream& out, std::uint64_t value, unsigned size)
+{
+	for (unsigned i = 0; i < size; ++i)
+		out.put(static_cast<char>((value >> (8*i)) & 0xFF));
+}
+
+static
+void write_padding(std::ostream& out, std::uint64_t& offset, std::uint64_t alignment)
+{
+	while (offset % alignment != 0)
+	{
+		out.put(0);
+		offset++;
+	}
+}
+
+std::uint64_t hash_archive_member(Span<const byte_type> data)
+{
+	// FNV-1a
+	std::uint64_t result = 0xCBF29CE484222325ull;
+
+	for (auto byte : data)
+		result = (result ^ byte) * 0x100000001B3ull;
+
+	return result;
+}
+
+bool CmbArchive::open(const char* filename)
+{
+	mEntryCnt = 0;
+
+	if (!mFile.open(filename))
+		return false;
+
+	const byte_type* data = mFile.data();
+	const std::uint64_t fileSize = mFile.size();
+
+	if (fileSize < ARCHIVE_HEADER_SIZE || std::memcmp(data, sArchiveMagic, 4) != 0 || read_le(data + 4, 4) != ARCHIVE_VERSION)
+		return false;
+
+	const std::uint64_t entryCnt = read_le(data + 0x08, 4);
+	const std::uint64_t namesOffset = read_le(data + 0x10, 8);
+	const std::uint64_t namesSize = read_le(data + 0x18, 8);
+
+	if (ARCHIVE_HEADER_SIZE + entryCnt * ARCHIVE_ENTRY_SIZE > fileSize || namesOffset > fileSize || namesSize > fileSize - namesOffset)
+		return false;
+
+	// every entry is checked once here, so that accessors don't have to
+
+	const byte_type* previousName = nullptr;
+	std::size_t previousLength = 0;
+
+	for (std::uint64_t i = 0; i < entryCnt; ++i)
+	{
+		const byte_type* entry = data + ARCHIVE_HEADER_SIZE + i * ARCHIVE_ENTRY_SIZE;
+
+		const auto offset = read_le(entry + 0x00, 8);
+		const auto size = read_le(entry + 0x08, 8);
+		const auto nameOffset = read_le(entry + 0x18, 4);
+		const auto nameLength = read_le(entry + 0x1C, 2);
+
+		if (offset > fileSize || size > fileSize - offset)
+			return false;
+
+		if (nameOffset + nameLength >= namesSize || data[namesOffset + nameOffset + nameLength] != 0)
+			return false;
+
+		const byte_type* name = data + namesOffset + nameOffset;
+
+		if (previousName != nullptr)
+		{
+			const int cmp = std::memcmp(previousName, name, std::min<std::size_t>(previousLength, nameLength));
+
+			if (cmp > 0 || (cmp == 0 && previousLength >= nameLength))
+				return false; // unsorted or duplicate
+		}
+
+		previousName = name;
+		previousLength = nameLength;
+	}
+
+	mEntryCnt = entryCnt;
+	return true;
+}
+
+ArchiveEntry CmbArchive::entry(std::size_t idx) const
+{
+	const byte_type* data = mFile.data();
+	const byte_type* entry = data + ARCHIVE_HEADER_SIZE + idx * ARCHIVE_ENTRY_SIZE;
+
+	const auto namesOffset = read_le(data + 0x10, 8);
+
+	ArchiveEntry result;
+
+	result.name = reinterpret_cast<const char*>(data + namesOffset + read_le(entry + 0x18, 4));
+	result.nameLength = read_le(entry + 0x1C, 2);
+	result.data = Span<const byte_type>(data + read_le(entry + 0x00, 8), read_le(entry + 0x08, 8));
+	result.hash = read_le(entry + 0x10, 8);
+	result.detection.game = static_cast<GameKind>(entry[0x1E]);
+	result.detection.confidence = static_cast<DetectConfidence>(entry[0x1F]);
+
+	return result;
+}
+
+std::size_t CmbArchive::find(const char* name, std::size_t nameLength) const
+{
+	std::size_t lo = 0, hi = mEntryCnt;
+
+	while (lo < hi)
+	{
+		const std::size_t mid = lo + (hi - lo) / 2;
+		const auto entry = this->entry(mid);
+
+		int cmp = std::memcmp(entry.name, name, std::min(entry.nameLength, nameLength));
+
+		if (cmp == 0)
+			cmp = (entry.nameLength < nameLength) ? -1 : (entry.nameLength > nameLength) ? 1 : 0;
+
+		if (cmp == 0)
+			return mid;
+
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return npos;
+}
+
+bool write_archive(std::ostream& out, std::vector<ArchiveInput> inputs)
+{
+	std::sort(inputs.begin(), inputs.end(), [] (const ArchiveInput& a, const ArchiveInput& b)
+	{
+		return a.name < b.name; // std::string compares bytewise (as char_traits<char>::compare is memcmp)
+	});
+
+	if (inputs.size() > 0xFFFFFFFFu)
+		return false;
+
+	for (std::size_t i = 0; i < inputs.size(); ++i)
+	{
+		if (inputs[i].name.size() > 0xFFFF || (i > 0 && inputs[i].name == inputs[i - 1].name))
+			return false;
+	}
+
+	// Layout
+
+	std::uint64_t namesSize = 0;
+
+	for (auto& input : inputs)
+		namesSize += input.name.size() + 1;
+
+	const std::uint64_t namesOffset = ARCHIVE_HEADER_SIZE + inputs.size() * ARCHIVE_ENTRY_SIZE;
+
+	if (namesSize > 0xFFFFFFFFu)
+		return false;
+
+	std::vector<std::uint64_t> offsets(inputs.size());
+	std::uint64_t offset = namesOffset + namesSize;
+
+	for (std::size_t i = 0; i < inputs.size(); ++i)
+	{
+		offset = (offset + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+		offsets[i] = offset;
+		offset += inputs[i].data.size();
+	}
+
+	// Header and index
+
+	out.write(sArchiveMagic, 4);
+	write_le(out, ARCHIVE_VERSION, 4);
+	write_le(out, inputs.size(), 4);
+	write_le(out, 0, 4);
+	write_le(out, namesOffset, 8);
+	write_le(out, namesSize, 8);
+
+	std::uint64_t nameOffset = 0;
+
+	for (std::size_t i = 0; i < inputs.size(); ++i)
+	{
+		auto& input = inputs[i];
+
+		write_le(out, offsets[i], 8);
+		write_le(out, input.data.size(), 8);
+		write_le(out, hash_archive_member(input.data), 8);
+		write_le(out, nameOffset, 4);
+		write_le(out, input.name.size(), 2);
+		write_le(out, static_cast<unsigned>(input.detection.game), 1);
+		write_le(out, static_cast<unsigned>(input.detection.confidence), 1);
+
+		nameOffset += input.name.size() + 1;
+	}
+
+	for (auto& input : inputs)
+		out.write(input.name.c_str(), input.name.size() + 1);
+
+	// Data
+
+	std::uint64_t position = namesOffset + namesSize;
+
+	for (auto& input : inputs)
+	{
+		write_padding(out, position, ARCHIVE_ALIGNMENT);
+
+		out.write(reinterpret_cast<const char*>(input.data.data()), input.data.size());
+		position += input.data.size();
+	}
+
+	return bool(out);
+}
+
+// Input names
+
+static const char sArchiveExtension[] = ".spak";
+
+// Position of the ':' separating archive and member names, or npos
+static
+std::size_t find_member_separator(const char* name)
+{
+	const char* found = std::strstr(name, ".spak:");
+
+	return (found == nullptr)
+		? std::string::npos
+		: (found - name) + (sizeof(sArchiveExtension) - 1);
+}
+
+bool is_archive_path(const char* path)
+{
+	const auto len = std::strlen(path);
+	const auto extLen = sizeof(sArchiveExtension) - 1;
+
+	return len >= extLen && std::strcmp(path + len - extLen, sArchiveExtension) == 0;
+}
+
+bool is_archive_member(const char* name)
+{
+	return find_member_separator(name) != std::string::npos;
+}
+
+std::string get_input_file_path(const char* name)
+{
+	const auto separator = find_member_separator(name);
+
+	return (separator == std::string::npos)
+		? std::string(name)
+		: std::string(name, separator);
+}
+
+// Archives opened so far (they stay open, their members are handed out as views into them)
+static
+const CmbArchive* get_archive(const std::string& path)
+{
+	static std::mutex sMutex;
+	static std::map<std::string, std::unique_ptr<CmbArchive>> sArchives;
+
+	std::lock_guard<std::mutex> lock(sMutex);
+
+	auto& archive = sArchives[path];
+
+	if (!archive)
+	{
+		archive = std::make_unique<CmbArchive>();
+
+		if (!archive->open(path.c_str()))
+		{
+			archive.reset();
+			return nullptr;
+		}
+	}
+
+	return archive.get();
+}
+
+bool list_archive_members(const char* path, std::vector<std::string>& result)
+{
+	const auto archive = get_archive(path);
+
+	if (archive == nullptr)
+		return false;
+
+	for (std::size_t i = 0; i < archive->size(); ++i)
+	{
+		const auto entry = archive->entry(i);
+
+		result.emplace_back(path);
+		result.back().push_back(':');
+		result.back().append(entry.name, entry.nameLength);
+	}
+
+	return true;
+}
+
+bool try_load_cmb_input(const char* name, CmbInput& input, Diagnostics& diags)
+{
+	input.owned.clear();
+	input.hasDetection = false;
+
+	const auto separator = find_member_separator(name);
+
+	if (separator == std::string::npos)
+	{
+		const bool ok = try_read_cmb_file(name, input.owned, diags);
+		input.data = input.owned;
+
+		return ok;
+	}
+
+	const auto archive = get_archive(std::string(name, separator));
+	const char* member = name + separator + 1;
+
+	const auto idx = (archive != nullptr)
+		? archive->find(member, std::strlen(member))
+		: CmbArchive::npos;
+
+	if (idx == CmbArchive::npos)
+	{
+		input.data = Span<const byte_type>();
+		diags.report(ErrorKind::FileUnreadable, 0);
+
+		return false;
+	}
+
+	const auto entry = archive->entry(idx);
+
+	input.hasDetection = true;
+	input.detection = entry.detection;
+
+	if (detect_lz(entry.data) == LzKind::None)
+	{
+		input.data = entry.data;
+		return true;
+	}
+
+	const bool ok = try_lz_decompress(entry.data, input.owned, diags);
+	input.data = input.owned;
+
+	return ok;
+}
+
+GameDetection get_input_game(const CmbInput& input)
+{
+	return input.hasDetection
+		? input.detection
+		: detect_game(input.data);
+}
+
+} // namespace soren
@@ -0,0 +1,92 @@
+#ifndef SOREN_DECODE_ARCHIVE_INCLUDED
+#define SOREN_DECODE_ARCHIVE_INCLUDED
+
+#include <cstdint>
+
+#include <vector>
+#include <string>
+#include <ostream>
+
+#include "core/types.h"
+#include "core/io.h"
+#include "core/diagnostics.h"
+#include "decode/detect.h"
+
+namespace soren {
+
+// soren pack archives: many CMB files in one, with a sorted index (see archive.cpp for the layout)
+// Members are addressed as "path/to/scripts.spak:member/name.cmb", an archive path alone stands for all its members
+
+struct ArchiveEntry
+{
+	const char* name; // NUL terminated
+	std::size_t nameLength;
+	Span<const byte_type> data; // as stored (may be LZ compressed)
+	std::uint64_t hash; // FNV-1a 64 of data
+	GameDetection detection; // of the (decompressed) member, offset is left as 0
+};
+
+// Read-only view of an archive, every member is a view into one mapping of the file
+class CmbArchive
+{
+public:
+	static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+	// Returns false if the file can't be read or isn't a well-formed archive
+	bool open(const char* filename);
+
+	std::size_t size() const { return mEntryCnt; }
+	ArchiveEntry entry(std::size_t idx) const;
+
+	// Binary search over the index, npos if there is no such member
+	std::size_t find(const char* name, std::size_t nameLength) const;
+
+private:
+	MappedFile mFile;
+	std::size_t mEntryCnt { 0u };
+};
+
+struct ArchiveInput
+{
+	std::string name;
+	Span<const byte_type> data;
+	GameDetection detection;
+};
+
+// FNV-1a 64, as stored in the index
+std::uint64_t hash_archive_member(Span<const byte_type> data);
+
+// Writes an archive of inputs (which must have distinct names, in any order), returns false if they don't fit the format
+bool write_archive(std::ostream& out, std::vector<ArchiveInput> inputs);
+
+// Input names
+
+// True for "*.spak" (an archive) or "*.spak:member" (one of its members)
+bool is_archive_path(const char* path);
+bool is_archive_member(const char* name);
+
+// The file a name reads from: the archive for members, name itself otherwise
+std::string get_input_file_path(const char* name);
+
+// Appends every member of an archive as "path:member", in index order, returns false if it can't be opened
+bool list_archive_members(const char* path, std::vector<std::string>& result);
+
+// A CMB to decode: a view into an archive (members that aren't compressed are never copied), or owned bytes
+struct CmbInput
+{
+	Span<const byte_type> data;
+	std::vector<byte_type> owned; // data points here if it doesn't point into an archive
+
+	bool hasDetection { false }; // archive members come with their game already detected
+	GameDetection detection;
+};
+
+// Reads (and decompresses) a file or archive member, archives are opened once (per process) and kept open
+bool try_load_cmb_input(const char* name, CmbInput& input, Diagnostics& diags);
+
+// The game detected for input, using the archive's if there is one
+GameDetection get_input_game(const CmbInput& input);
+
+} // namespace soren
+
+#endif // SOREN_DECODE_ARCHIVE_INCLUDED
@@ -0,0 +1,176 @@
+#include "decode/decode.h"
+#include "decode/decode-common.h"
+
+#include <algorithm>
+
+namespace soren {
+
+/*
+ * The checks try_decode_cmb and make_statements make, without keeping anything: names aren't read (only checked to be
+ * terminated), string operands are checked against the last NUL of the pool instead of being scanned, and scripts are
+ * disassembled into buffers that are kept for the next call (per thread), so that checking doesn't allocate once warm.
+ */
+
+struct CheckedScene
+{
+	unsigned idx;
+	unsigned offScript;
+	unsigned varAmt;
+};
+
+bool check_cmb(Span<const byte_type> data, GameKind game, Diagnostics& diags)
+{
+	const auto diagCnt = diags.size();
+
+	if (data.size() < CMB_HEADER_SIZE)
+	{
+		diags.report(ErrorKind::FileTooSmall, 0);
+		return false;
+	}
+
+	const auto header = read_cmb_header(data);
+
+	if (!check_cmb_header(header, data.size(), diags))
+		return false;
+
+	// strings start anywhere before the last NUL of the pool
+	const auto poolBegin = data.begin() + header.offStrings;
+	const auto poolEnd = (header.offStrings > header.offEvents) ? data.end() : data.begin() + header.offEvents;
+
+	const auto lastNul = std::find(std::make_reverse_iterator(poolEnd), std::make_reverse_iterator(poolBegin), 0);
+	const std::size_t poolLimit = lastNul.base() - poolBegin; // offsets below this are terminated strings
+
+	auto is_string = [&] (std::uint32_t offset)
+	{
+		return offset < poolLimit;
+	};
+
+	// Scene records
+
+	static thread_local std::vector<unsigned> boundaries;
+	static thread_local std::vector<CheckedScene> scenes;
+
+	boundaries.assign({ header.offStrings, header.offEvents });
+	scenes.clear();
+
+	unsigned sceneCnt = 0;
+
+	for (unsigned i = 0;; ++i)
+	{
+		if (header.offEvents + i*4 + 4 > data.size())
+		{
+			diags.report(ErrorKind::EventTableUnterminated, header.offEvents + i*4);
+			break;
+		}
+
+		const auto offEvent = decode_int_le(data.subspan(header.offEvents + 4*i, 4));
+
+		if (offEvent == 0)
+			break;
+
+		sceneCnt++;
+
+		if (offEvent + CMB_SCENE_RECORD_SIZE > data.size())
+		{
+			diags.report(ErrorKind::SceneOutOfBounds, header.offEvents + 4*i, i);
+			continue;
+		}
+
+		boundaries.push_back(offEvent);
+
+		const auto record = read_scene_record(data.subspan(offEvent, CMB_SCENE_RECORD_SIZE));
+
+		if (!check_scene_record(record, offEvent, i, data.size(), diags))
+			continue;
+
+		boundaries.push_back(record.offScript);
+
+		if (record.offName != 0 && std::find(data.begin() + record.offName, data.end(), 0) == data.end())
+		{
+			diags.report(ErrorKind::SceneNameOutOfBounds, record.offName, i);
+			continue;
+		}
+
+		scenes.push_back({ i, record.offScript, record.varAmt });
+	}
+
+	// Scripts, each only up to the next structure in the file
+
+	static thread_local std::vector<BcIns> script;
+	static thread_local std::vector<ScriptRange> unreachable;
+
+	std::sort(boundaries.begin(), boundaries.end());
+
+	for (auto& scene : scenes)
+	{
+		const auto it = std::upper_bound(boundaries.begin(), boundaries.end(), scene.offScript);
+		const unsigned scriptEnd = (it != boundaries.end() && *it < data.size()) ? *it : data.size();
+
+		const int i = scene.idx;
+
+		if (!try_decode_script(data.subspan(scene.offScript, scriptEnd - scene.offScript), game, scene.offScript, i,
+			script, unreachable, diags))
+			continue;
+
+		// operand checks, as make_statements does them (the first issue fails the scene)
+
+		for (auto& ins : script)
+		{
+			const auto operand = static_cast<std::uint32_t>(ins.operand);
+			ErrorKind error = ErrorKind::None;
+
+			switch (ins.opcode)
+			{
+
+			case BC_OPCODE_VAL8: case BC_OPCODE_VAL16:
+			case BC_OPCODE_VALX8: case BC_OPCODE_VALX16:
+			case BC_OPCODE_REF8: case BC_OPCODE_REF16:
+			case BC_OPCODE_REFX8: case BC_OPCODE_REFX16:
+				if (operand >= scene.varAmt)
+					error = ErrorKind::BadVariableIndex;
+
+				break;
+
+			case BC_OPCODE_GVAL8: case BC_OPCODE_GVAL16:
+			case BC_OPCODE_GVALX8: case BC_OPCODE_GVALX16:
+			case BC_OPCODE_GREF8: case BC_OPCODE_GREF16:
+			case BC_OPCODE_GREFX8: case BC_OPCODE_GREFX16:
+				if (operand >= header.globalAmt)
+					error = ErrorKind::BadGlobalIndex;
+
+				break;
+
+			case BC_OPCODE_STRING8:
+			case BC_OPCODE_STRING16:
+			case BC_OPCODE_STRING32:
+				if (!is_string(operand))
+					error = ErrorKind::BadStringOffset;
+
+				break;
+
+			case BC_OPCODE_CALL:
+				if (operand >= sceneCnt)
+					error = ErrorKind::BadSceneIndex;
+
+				break;
+
+			case BC_OPCODE_CALLEXT:
+				if (!is_string(operand >> 8))
+					error = ErrorKind::BadStringOffset;
+
+				break;
+
+			} // switch (ins.opcode)
+
+			if (error != ErrorKind::None)
+			{
+				diags.report(error, scene.offScript + ins.location, i);
+				break;
+			}
+		}
+	}
+
+	return diags.size() == diagCnt;
+}
+
+} // namespace soren
@@ -0,0 +1,176 @@
+#ifndef SOREN_DECODE_COMMON_INCLUDED
+#define SOREN_DECODE_COMMON_INCLUDED
+
+// Helpers shared by the decoders, not part of the public decode interface
+
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <string>
+#include <vector>
+
+#include "core/types.h"
+#include "core/diagnostics.h"
+#include "core/soren-bytecode.h"
+
+namespace soren {
+
+enum
+{
+	GLOBAL_AMT_SUSPICION_LIMIT = 1000,
+	LOCALS_AMT_SUSPICION_LIMIT = 1000,
+	PARAMS_AMT_SUSPICION_LIMIT = 20,
+};
+
+template<typename IteratorType, typename ResultType = std::uint32_t>
+inline
+ResultType decode_int_le(IteratorType begin, IteratorType end)
+{
+	static_assert(std::is_convertible<typename std::iterator_traits<IteratorType>::value_type, byte_type>::value, "decode_le: expected byte (u8) iterators");
+
+	ResultType result = 0;
+	unsigned i = 0;
+
+	while (begin != end)
+		result = result + (*begin++ << (8*i++));
+
+	return result;
+}
+
+template<typename IteratorType, typename ResultType = std::uint32_t>
+inline
+ResultType decode_int_be(IteratorType begin, IteratorType end)
+{
+	static_assert(std::is_convertible<typename std::iterator_traits<IteratorType>::value_type, byte_type>::value, "decode_le: expected byte (u8) iterators");
+
+	ResultType result = 0;
+
+	while (begin != end)
+		result = *begin++ + (result << 8);
+
+	return result;
+}
+
+template<typename ResultType = std::uint32_t>
+inline
+ResultType decode_int_le(Span<const byte_type> span)
+{
+	return decode_int_le<decltype(span.begin()), ResultType>(span.begin(), span.end());
+}
+
+template<typename ResultType = std::uint32_t>
+inline
+ResultType decode_int_be(Span<const byte_type> span)
+{
+	return decode_int_be<decltype(span.begin()), ResultType>(span.begin(), span.end());
+}
+
+template<typename IntType = std::int32_t>
+inline
+IntType sign_extend(IntType value, unsigned bits)
+{
+	static_assert(std::is_signed<IntType>::value, "Result of sign_extend should be signed");
+
+	const auto rbits = (sizeof(IntType)*8 - bits);
+
+	return (value << rbits) >> rbits;
+}
+
+enum class InsStatus
+{
+	Ok,
+	InvalidOpcode,
+	OperandOutOfBounds,
+};
+
+// Decodes the instruction at data[i], advancing i past it
+// Jump operands are made absolute (relative to the start of data)
+
+inline
+InsStatus decode_instruction(Span<const byte_type> data, unsigned& i, GameKind game, BcIns& ins)
+{
+	ins = BcIns { i, 0, 0 };
+	ins.opcode = data[i++];
+
+	if (!ins.valid(game))
+		return InsStatus::InvalidOpcode;
+
+	if (ins.info().operandSize > 0)
+	{
+		if (i + ins.info().operandSize > data.size())
+			return InsStatus::OperandOutOfBounds;
+
+		ins.operand = decode_int_be(
+			data.begin() + i,
+			data.begin() + i + ins.info().operandSize);
+
+		// call operands are indices and string offsets, those are not signed
+		if (ins.opcode != BC_OPCODE_CALL && ins.opcode != BC_OPCODE_CALLEXT)
+			ins.operand = sign_extend(ins.operand, ins.info().operandSize*8);
+
+		i += ins.info().operandSize;
+
+		if ((game == GameKind::FE10) && (ins.opcode == BC_OPCODE_CALL))
+		{
+			// in FE10 only, call(37) has a variable length operand
+			// if the first byte of the operand is >= 0x80
+			// the operand will be 2 bytes be, with the top bit removed
+
+			if (ins.operand & 0x80)
+			{
+				if (i >= data.size())
+					return InsStatus::OperandOutOfBounds;
+
+				ins.operand = ((ins.operand & 0x7F) << 8) + data[i++];
+			}
+		}
+	}
+
+	if (ins.is_jump())
+		ins.operand = i + ins.operand - ins.info().operandSize;
+
+	return InsStatus::Ok;
+}
+
+// CMB structure pieces, shared by try_decode_cmb and the streaming reader (implemented in read-cmb.cpp)
+// The check functions report issues with their file offset and return false if there were any
+
+enum
+{
+	CMB_HEADER_SIZE = 0x2C,
+	CMB_SCENE_RECORD_SIZE = 0x14, // followed by the parameters (u16 each)
+};
+
+struct CmbHeader
+{
+	unsigned globalAmt;
+	unsigned offStrings;
+	unsigned offEvents;
+};
+
+struct SceneRecord
+{
+	unsigned offName;
+	unsigned offScript;
+	unsigned kind;
+	unsigned argAmt;
+	unsigned paramAmt;
+	unsigned idx;
+	unsigned varAmt;
+};
+
+// header is the first CMB_HEADER_SIZE bytes of the file
+CmbHeader read_cmb_header(Span<const byte_type> header);
+bool check_cmb_header(const CmbHeader& header, std::size_t fileSize, Diagnostics& diags);
+
+void make_global_names(unsigned globalAmt, std::vector<std::string>& result);
+
+// record is the CMB_SCENE_RECORD_SIZE bytes at offEvent
+SceneRecord read_scene_record(Span<const byte_type> record);
+bool check_scene_record(const SceneRecord& record, unsigned offEvent, unsigned sceneIdx, std::size_t fileSize, Diagnostics& diags);
+
+void make_varnames(unsigned argAmt, unsigned varAmt, std::vector<std::string>& result);
+
+} // namespace soren
+
+#endif // SOREN_DECODE_COMMON_INCLUDED
@@ -3,14 +3,44 @@
 
 #include <cstdint>
 
+#include <vector>
+
 #include "core/types.h"
+#include "core/diagnostics.h"
 #include "core/soren-cmb.h"
 
 namespace soren {
 
 using byte_type = std::uint8_t;
 
+// These throw std::runtime_error on the first issue found
 CmbInfo decode_cmb(Span<const byte_type> data, GameKind game);
+std::vector<BcIns> decode_script(Span<const byte_type> data, GameKind game);
+
+// Exception-free variants, these report every issue found to diags and return false if there were any
+// try_decode_cmb keeps going past broken scenes, those are left with an empty rawScript
+
+bool try_decode_cmb(Span<const byte_type> data, GameKind game, CmbInfo& result, Diagnostics& diags);
+
+// baseOffset is the file offset of data, used for diagnostics only
+// Disassembles what is reachable from the start of data (which should end where the script's bytes do)
+// result is sorted by location, unreachable gets the byte ranges skipped over between reachable instructions
+bool try_decode_script(Span<const byte_type> data, GameKind game, unsigned baseOffset, int sceneIdx,
+	std::vector<BcIns>& result, std::vector<ScriptRange>& unreachable, Diagnostics& diags);
+
+// (Re)builds cmb.stringIndex for the strings its scripts reference, try_decode_cmb (and CmbStream) do this already
+void index_cmb_strings(CmbInfo& cmb);
+
+// Structural checks only (header, event table, scene records, reachable bytecode and the operand checks
+// make_statements makes), reporting what try_decode_cmb and decompiling would, without building anything
+// Doesn't allocate once warm (buffers are kept per thread)
+bool check_cmb(Span<const byte_type> data, GameKind game, Diagnostics& diags);
+
+// Reads a CMB file, decompressing it first if it is LZ10/LZ11 compressed (see decode/lz.h)
+bool try_read_cmb_file(const char* filename, std::vector<byte_type>& result, Diagnostics& diags);
+
+// Same, for file contents read some other way: decompresses data in place if needed
+bool try_decompress_cmb_data(std::vector<byte_type>& data, Diagnostics& diags);
 
 } // namespace soren
 
@@ -0,0 +1,161 @@
+#include "decode/detect.h"
+#include "decode/decode-common.h"
+
+#include <algorithm>
+
+namespace soren {
+
+struct ScanResult
+{
+	bool ok;
+	bool divergent; // saw an instruction that decodes differently in the other game
+	bool badCall; // saw a call to an event index that doesn't exist
+	unsigned offset; // where the scan failed or diverged first (relative to the script)
+};
+
+static
+ScanResult scan_script(Span<const byte_type> data, GameKind game, unsigned sceneCnt)
+{
+	ScanResult result { false, false, false, 0 };
+
+	unsigned i = 0, lastJump = 0;
+
+	while (i < data.size())
+	{
+		BcIns ins;
+
+		if (decode_instruction(data, i, game, ins) != InsStatus::Ok)
+		{
+			if (!result.divergent)
+				result.offset = ins.location;
+
+			return result;
+		}
+
+		// the FE10-only opcodes would be invalid in FE9, and so is a long call
+		// in FE9, the same bytes would be a call with an operand >= 0x80 (followed by garbage)
+
+		const bool divergent = (ins.opcode >= BC_OPCODE_FE9_COUNT && ins.opcode < BC_OPCODE_FE10_COUNT)
+			|| (ins.opcode == BC_OPCODE_CALL && (game == GameKind::FE10 ? (i - ins.location) == 3 : (ins.operand & 0x80) != 0));
+
+		if (divergent && !result.divergent)
+		{
+			result.divergent = true;
+			result.offset = ins.location;
+		}
+
+		if (ins.opcode == BC_OPCODE_CALL && static_cast<std::uint32_t>(ins.operand) >= sceneCnt)
+			result.badCall = true;
+
+		if (ins.is_jump())
+			lastJump = std::max(lastJump, (unsigned) ins.operand);
+
+		if (ins.is_end() && i > lastJump)
+		{
+			result.ok = true;
+			return result;
+		}
+	}
+
+	return result;
+}
+
+bool detect_game_step(Span<const byte_type> script, unsigned scriptOffset, unsigned sceneCnt, GameDetection& result)
+{
+	const auto fe9 = scan_script(script, GameKind::FE9, sceneCnt);
+	const auto fe10 = scan_script(script, GameKind::FE10, sceneCnt);
+
+	if (!fe9.divergent && !fe10.divergent)
+		return false; // same instructions either way
+
+	if (fe9.ok != fe10.ok)
+	{
+		result.game = fe10.ok ? GameKind::FE10 : GameKind::FE9;
+		result.confidence = DetectConfidence::High;
+		result.offset = scriptOffset + (fe10.ok ? fe9.offset : fe10.offset);
+
+		return true;
+	}
+
+	if (fe9.ok && fe9.badCall != fe10.badCall)
+	{
+		result.game = fe9.badCall ? GameKind::FE10 : GameKind::FE9;
+		result.confidence = DetectConfidence::Medium;
+		result.offset = scriptOffset + (fe9.badCall ? fe9.offset : fe10.offset);
+
+		return true;
+	}
+
+	// both broken or both plausible, keep looking
+	return false;
+}
+
+GameDetection detect_game(Span<const byte_type> data)
+{
+	GameDetection result;
+
+	if (data.size() < 0x2C)
+		return result;
+
+	const auto offEvents = decode_int_le(data.subspan(0x28, 4));
+
+	if (offEvents >= data.size())
+		return result;
+
+	// count scenes first, call targets are checked against it
+
+	unsigned sceneCnt = 0;
+
+	while (offEvents + 4*sceneCnt + 4 <= data.size() && decode_int_le(data.subspan(offEvents + 4*sceneCnt, 4)) != 0)
+		sceneCnt++;
+
+	result.confidence = DetectConfidence::Low;
+
+	for (unsigned i = 0; i < sceneCnt; ++i)
+	{
+		const auto offEvent = decode_int_le(data.subspan(offEvents + 4*i, 4));
+
+		if (offEvent + 0x14 > data.size())
+			continue;
+
+		const auto offScript = decode_int_le(data.subspan(offEvent + 0x04, 4));
+
+		if (offScript >= data.size())
+			continue;
+
+		if (detect_game_step(data.subspan(offScript), offScript, sceneCnt, result))
+			return result;
+	}
+
+	return result;
+}
+
+const char* get_game_name(GameKind game)
+{
+	switch (game)
+	{
+
+	case GameKind::FE9:  return "fe9";
+	case GameKind::FE10: return "fe10";
+
+	} // switch (game)
+
+	return "unknown";
+}
+
+const char* get_confidence_name(DetectConfidence confidence)
+{
+	switch (confidence)
+	{
+
+	case DetectConfidence::None:   return "none";
+	case DetectConfidence::Low:    return "low";
+	case DetectConfidence::Medium: return "medium";
+	case DetectConfidence::High:   return "high";
+
+	} // switch (confidence)
+
+	return "unknown";
+}
+
+} // namespace soren
@@ -0,0 +1,37 @@
+#ifndef SOREN_DECODE_DETECT_INCLUDED
+#define SOREN_DECODE_DETECT_INCLUDED
+
+#include "core/types.h"
+#include "core/soren-bytecode.h"
+
+namespace soren {
+
+enum class DetectConfidence
+{
+	None, // not even a readable CMB, game is only a default
+	Low,  // every script decodes the same way under both games, game is only a default
+	Medium, // both decode, but only one gives plausible call targets
+	High, // only one game decodes
+};
+
+struct GameDetection
+{
+	GameKind game { GameKind::FE10 };
+	DetectConfidence confidence { DetectConfidence::None };
+	unsigned offset { 0u }; // file offset of the instruction that settled it (if any)
+};
+
+// Cheap pre-scan: walks the scene table and speculatively decodes scene scripts under both opcode sets
+// Stops at the first scene that decodes differently, nothing is allocated
+GameDetection detect_game(Span<const byte_type> data);
+
+// One scene's worth of detect_game, for readers that only see one script at a time
+// result should start with Low confidence; returns true once detection is settled (result is then final)
+bool detect_game_step(Span<const byte_type> script, unsigned scriptOffset, unsigned sceneCnt, GameDetection& result);
+
+const char* get_game_name(GameKind game);
+const char* get_confidence_name(DetectConfidence confidence);
+
+} // namespace soren
+
+#endif // SOREN_DECODE_DETECT_INCLUDED
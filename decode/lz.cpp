@@ -0,0 +1,205 @@
+#include "decode/lz.h"
+#include "decode/decode-common.h"
+
+#include <cstring>
+
+namespace soren {
+
+enum
+{
+	LZ_KIND_LZ10 = 0x10,
+	LZ_KIND_LZ11 = 0x11,
+
+	// sanity limit on the decompressed size, so that a bogus header doesn't make us allocate gigabytes
+	LZ_SIZE_SUSPICION_LIMIT = 0x4000000,
+};
+
+struct LzHeader
+{
+	LzKind kind;
+	unsigned size;
+	unsigned dataOffset;
+};
+
+static
+LzHeader read_lz_header(Span<const byte_type> data)
+{
+	LzHeader result { LzKind::None, 0, 0 };
+
+	if (data.size() < 4)
+		return result;
+
+	// raw CMBs begin with "cmb"
+	if (data[0] != LZ_KIND_LZ10 && data[0] != LZ_KIND_LZ11)
+		return result;
+
+	unsigned size = decode_int_le(data.subspan(1, 3));
+	unsigned dataOffset = 4;
+
+	if (size == 0)
+	{
+		if (data.size() < 8)
+			return result;
+
+		size = decode_int_le(data.subspan(4, 4));
+		dataOffset = 8;
+	}
+
+	if (size == 0 || size > LZ_SIZE_SUSPICION_LIMIT)
+		return result;
+
+	result.kind = (data[0] == LZ_KIND_LZ10) ? LzKind::Lz10 : LzKind::Lz11;
+	result.size = size;
+	result.dataOffset = dataOffset;
+
+	return result;
+}
+
+LzKind detect_lz(Span<const byte_type> data)
+{
+	return read_lz_header(data).kind;
+}
+
+// Copies len bytes from disp bytes back, source and destination may overlap
+static inline
+void copy_back_reference(byte_type* out, unsigned disp, unsigned len)
+{
+	const byte_type* src = out - disp;
+
+	if (disp >= len)
+	{
+		std::memcpy(out, src, len);
+		return;
+	}
+
+	// overlapping: the output repeats the disp byte long pattern starting at src
+	// each chunk is copied from src, and is as long as all of the pattern written so far, so it never overlaps itself
+	// (that keeps every chunk start a multiple of disp away from src)
+
+	unsigned done = 0;
+
+	while (done < len)
+	{
+		const unsigned available = disp + done;
+		const unsigned chunk = (available < len - done) ? available : len - done;
+
+		std::memcpy(out + done, src, chunk);
+		done += chunk;
+	}
+}
+
+bool try_lz_decompress(Span<const byte_type> data, std::vector<byte_type>& result, Diagnostics& diags)
+{
+	const auto header = read_lz_header(data);
+
+	result.clear();
+
+	if (header.kind == LzKind::None)
+	{
+		result.assign(data.begin(), data.end());
+		return true;
+	}
+
+	result.resize(header.size);
+
+	byte_type* const outBegin = result.data();
+	byte_type* const outEnd = outBegin + result.size();
+	byte_type* out = outBegin;
+
+	unsigned i = header.dataOffset;
+
+	auto truncated = [&] ()
+	{
+		diags.report(ErrorKind::CompressedTruncated, i);
+		result.resize(out - outBegin);
+		return false;
+	};
+
+	while (out < outEnd)
+	{
+		if (i >= data.size())
+			return truncated();
+
+		unsigned flags = data[i++];
+
+		for (unsigned bit = 0; bit < 8 && out < outEnd; ++bit, flags <<= 1)
+		{
+			if (i >= data.size())
+				return truncated();
+
+			if ((flags & 0x80) == 0)
+			{
+				*out++ = data[i++];
+				continue;
+			}
+
+			const unsigned refOffset = i;
+			unsigned len, disp;
+
+			if (header.kind == LzKind::Lz10)
+			{
+				if (i + 2 > data.size())
+					return truncated();
+
+				len = (data[i] >> 4) + 3;
+				disp = (((data[i] & 0xF) << 8) | data[i+1]) + 1;
+				i += 2;
+			}
+			else
+			{
+				switch (data[i] >> 4)
+				{
+
+				case 0:
+					if (i + 3 > data.size())
+						return truncated();
+
+					len = (((data[i] & 0xF) << 4) | (data[i+1] >> 4)) + 0x11;
+					disp = (((data[i+1] & 0xF) << 8) | data[i+2]) + 1;
+					i += 3;
+
+					break;
+
+				case 1:
+					if (i + 4 > data.size())
+						return truncated();
+
+					len = (((data[i] & 0xF) << 12) | (data[i+1] << 4) | (data[i+2] >> 4)) + 0x111;
+					disp = (((data[i+2] & 0xF) << 8) | data[i+3]) + 1;
+					i += 4;
+
+					break;
+
+				default:
+					if (i + 2 > data.size())
+						return truncated();
+
+					len = (data[i] >> 4) + 1;
+					disp = (((data[i] & 0xF) << 8) | data[i+1]) + 1;
+					i += 2;
+
+					break;
+
+				} // switch (data[i] >> 4)
+			}
+
+			if (disp > static_cast<unsigned>(out - outBegin))
+			{
+				diags.report(ErrorKind::CompressedBadReference, refOffset);
+				result.resize(out - outBegin);
+				return false;
+			}
+
+			// the last reference may run past the declared size, it is cut short
+			if (len > static_cast<unsigned>(outEnd - out))
+				len = outEnd - out;
+
+			copy_back_reference(out, disp, len);
+			out += len;
+		}
+	}
+
+	return true;
+}
+
+} // namespace soren
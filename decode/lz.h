@@ -0,0 +1,30 @@
+#ifndef SOREN_DECODE_LZ_INCLUDED
+#define SOREN_DECODE_LZ_INCLUDED
+
+#include <vector>
+
+#include "core/types.h"
+#include "core/diagnostics.h"
+
+namespace soren {
+
+// Nintendo LZ77 variants, as found on disc: a 1 byte kind (0x10 or 0x11) and a 24 bit le decompressed size
+// (when that is 0, the actual size follows as 32 bit le)
+
+enum class LzKind
+{
+	None, // not compressed (or not that we know of)
+	Lz10,
+	Lz11,
+};
+
+// Only looks at the header, raw CMBs are never taken for compressed data
+LzKind detect_lz(Span<const byte_type> data);
+
+// Decompresses data into result (resized to the size from the header)
+// Diagnostic offsets are within the compressed data
+bool try_lz_decompress(Span<const byte_type> data, std::vector<byte_type>& result, Diagnostics& diags);
+
+} // namespace soren
+
+#endif // SOREN_DECODE_LZ_INCLUDED
@@ -1,166 +1,277 @@
 
 #include "decode/decode.h"
+#include "decode/decode-common.h"
+
+#include "core/stats.h"
+
+#include <algorithm>
 
 namespace soren {
 
-enum
+/*
+ * Scripts are disassembled by following control flow from their entry (offset 0): each run of instructions goes on
+ * until a return or an unconditional jump, and the targets of every jump met are queued as runs of their own.
+ * data only spans up to the next structure in the file, so nothing past the script is ever decoded.
+ * Bytes skipped over between reachable instructions (dead code, padding) are recorded as unreachable ranges.
+ */
+
+enum : std::uint8_t
 {
-	GLOBAL_AMT_SUSPICION_LIMIT = 1000,
-	LOCALS_AMT_SUSPICION_LIMIT = 1000,
-	PARAMS_AMT_SUSPICION_LIMIT = 20,
+	SCRIPT_BYTE_UNVISITED,
+	SCRIPT_BYTE_INS_START,
+	SCRIPT_BYTE_INS_REST,
 };
 
-template<typename IteratorType, typename ResultType = std::uint32_t>
-static inline
-ResultType decode_int_le(IteratorType begin, IteratorType end)
+bool try_decode_script(Span<const byte_type> data, GameKind game, unsigned baseOffset, int sceneIdx,
+	std::vector<BcIns>& result, std::vector<ScriptRange>& unreachable, Diagnostics& diags)
 {
-	static_assert(std::is_convertible<typename std::iterator_traits<IteratorType>::value_type, byte_type>::value, "decode_le: expected byte (u8) iterators");
+	result.clear();
+	unreachable.clear();
 
-	ResultType result = 0;
-	unsigned i = 0;
+	// reused between calls (scripts are mostly small, and there are many of them)
+	static thread_local std::vector<std::uint8_t> visited;
+	static thread_local std::vector<unsigned> worklist;
 
-	while (begin != end)
-		result = result + (*begin++ << (8*i++));
+	visited.assign(data.size(), SCRIPT_BYTE_UNVISITED);
+	worklist.assign(1, 0u);
 
-	return result;
-}
+	bool sorted = true;
+	unsigned extent = 0;
 
-template<typename IteratorType, typename ResultType = std::uint32_t>
-static inline
-ResultType decode_int_be(IteratorType begin, IteratorType end)
-{
-	static_assert(std::is_convertible<typename std::iterator_traits<IteratorType>::value_type, byte_type>::value, "decode_le: expected byte (u8) iterators");
+	while (!worklist.empty())
+	{
+		unsigned i = worklist.back();
+		worklist.pop_back();
+
+		for (;;)
+		{
+			if (i >= data.size())
+			{
+				diags.report(ErrorKind::ScriptUnterminated, baseOffset + i, sceneIdx);
+				return false;
+			}
 
-	ResultType result = 0;
+			if (visited[i] == SCRIPT_BYTE_INS_START)
+				break; // joined an already decoded run
 
-	while (begin != end)
-		result = *begin++ + (result << 8);
+			if (visited[i] == SCRIPT_BYTE_INS_REST)
+			{
+				diags.report(ErrorKind::BadJumpTarget, baseOffset + i, sceneIdx);
+				return false;
+			}
 
-	return result;
+			BcIns ins;
+
+			switch (decode_instruction(data, i, game, ins))
+			{
+
+			case InsStatus::Ok:
+				break;
+
+			case InsStatus::InvalidOpcode:
+				diags.report(ErrorKind::InvalidOpcode, baseOffset + ins.location, sceneIdx);
+				return false;
+
+			case InsStatus::OperandOutOfBounds:
+				diags.report(ErrorKind::OperandOutOfBounds, baseOffset + ins.location, sceneIdx);
+				return false;
+
+			} // switch (decode_instruction(...))
+
+			visited[ins.location] = SCRIPT_BYTE_INS_START;
+
+			for (unsigned j = ins.location + 1; j < i; ++j)
+			{
+				if (visited[j] != SCRIPT_BYTE_UNVISITED)
+				{
+					// overlaps an instruction decoded from another run
+					diags.report(ErrorKind::BadJumpTarget, baseOffset + ins.location, sceneIdx);
+					return false;
+				}
+
+				visited[j] = SCRIPT_BYTE_INS_REST;
+			}
+
+			if (!result.empty() && ins.location < result.back().location)
+				sorted = false;
+
+			extent = std::max(extent, i);
+			result.push_back(ins);
+
+			if (ins.is_jump())
+			{
+				if (ins.operand < 0 || static_cast<unsigned>(ins.operand) >= data.size())
+				{
+					diags.report(ErrorKind::BadJumpTarget, baseOffset + ins.location, sceneIdx);
+					return false;
+				}
+
+				if (visited[ins.operand] == SCRIPT_BYTE_UNVISITED)
+					worklist.push_back(ins.operand);
+			}
+
+			if (ins.is_end() || ins.opcode == BC_OPCODE_B)
+				break;
+		}
+	}
+
+	if (!sorted)
+	{
+		std::sort(result.begin(), result.end(), [] (const BcIns& a, const BcIns& b)
+		{
+			return a.location < b.location;
+		});
+	}
+
+	for (unsigned i = 0; i < extent;)
+	{
+		if (visited[i] != SCRIPT_BYTE_UNVISITED)
+		{
+			++i;
+			continue;
+		}
+
+		const unsigned begin = i;
+
+		while (i < extent && visited[i] == SCRIPT_BYTE_UNVISITED)
+			++i;
+
+		unreachable.push_back({ begin, i });
+	}
+
+	return true;
 }
 
-template<typename ResultType = std::uint32_t>
-static inline
-ResultType decode_int_le(Span<const byte_type> span)
+std::vector<BcIns> decode_script(Span<const byte_type> data, GameKind game)
 {
-	return decode_int_le<decltype(span.begin()), ResultType>(span.begin(), span.end());
+	std::vector<BcIns> result;
+	std::vector<ScriptRange> unreachable;
+	Diagnostics diags;
+
+	if (!try_decode_script(data, game, 0, -1, result, unreachable, diags))
+		throw std::runtime_error(get_error_message(diags.list.front().kind));
+
+	return result;
 }
 
-template<typename ResultType = std::uint32_t>
-static inline
-ResultType decode_int_be(Span<const byte_type> span)
+CmbHeader read_cmb_header(Span<const byte_type> header)
 {
-	return decode_int_be<decltype(span.begin()), ResultType>(span.begin(), span.end());
+	return CmbHeader
+	{
+		decode_int_le(header.subspan(0x22, 2)),
+		decode_int_le(header.subspan(0x24, 4)),
+		decode_int_le(header.subspan(0x28, 4)),
+	};
 }
 
-template<typename IntType = std::int32_t>
-static inline
-IntType sign_extend(IntType value, unsigned bits)
+bool check_cmb_header(const CmbHeader& header, std::size_t fileSize, Diagnostics& diags)
 {
-	static_assert(std::is_signed<IntType>::value, "Result of sign_extend should be signed");
+	const auto diagCnt = diags.size();
+
+	if (header.offStrings >= fileSize)
+		diags.report(ErrorKind::StringPoolOutOfBounds, 0x24);
 
-	const auto rbits = (sizeof(IntType)*8 - bits);
+	if (header.offEvents >= fileSize)
+		diags.report(ErrorKind::EventTableOutOfBounds, 0x28);
 
-	return (value << rbits) >> rbits;
+	if (header.globalAmt > GLOBAL_AMT_SUSPICION_LIMIT)
+		diags.report(ErrorKind::TooManyGlobals, 0x22);
+
+	return diags.size() == diagCnt;
 }
 
-std::vector<BcIns> decode_script(Span<const byte_type> data, GameKind game)
+void make_global_names(unsigned globalAmt, std::vector<std::string>& result)
 {
-	std::vector<BcIns> result;
+	result.resize(globalAmt);
 
-	unsigned i = 0, lastJump = 0;
-	bool ended = false;
-
-	while (!ended && i < data.size())
+	for (unsigned i = 0; i < globalAmt; ++i)
 	{
-		BcIns ins { i, 0, 0 };
-		ins.opcode = data[i++];
-
-		if (!ins.valid(game))
-			throw std::runtime_error("Invalid opcode."); // TODO: better error
-
-		if (ins.info().operandSize > 0)
+		result[i] = [&] ()
 		{
-			if (i + ins.info().operandSize > data.size())
-				throw std::runtime_error("Reached end of script when expecting operand."); // TODO: better error
-
-			ins.operand = decode_int_be(
-				data.begin() + i,
-				data.begin() + i + ins.info().operandSize);
+			// TODO: less hacky way of doing this
+			std::string r("gvar_");
+			r.append(std::to_string(i));
 
-			ins.operand = sign_extend(ins.operand, ins.info().operandSize*8);
+			return r;
+		} ();
+	}
+}
 
-			i += ins.info().operandSize;
+SceneRecord read_scene_record(Span<const byte_type> record)
+{
+	return SceneRecord
+	{
+		decode_int_le(record.subspan(0x00, 4)),
+		decode_int_le(record.subspan(0x04, 4)),
+		decode_int_le(record.subspan(0x0C, 1)),
+		decode_int_le(record.subspan(0x0D, 1)),
+		decode_int_le(record.subspan(0x0E, 1)),
+		decode_int_le(record.subspan(0x10, 2)),
+		decode_int_le(record.subspan(0x12, 2)),
+	};
+}
 
-			if ((game == GameKind::FE10) && (ins.opcode == BC_OPCODE_CALL))
-			{
-				// in FE10 only, call(37) has a variable length operand
-				// if the first byte of the operand is >= 0x80
-				// the operand will be 2 bytes be, with the top bit removed
+bool check_scene_record(const SceneRecord& record, unsigned offEvent, unsigned sceneIdx, std::size_t fileSize, Diagnostics& diags)
+{
+	const auto diagCnt = diags.size();
+	const int i = sceneIdx;
 
-				if (ins.operand & 0x80)
-				{
-					if (i >= data.size())
-						throw std::runtime_error("Reached end of script when expecting operand."); // TODO: better error
+	if (record.paramAmt > PARAMS_AMT_SUSPICION_LIMIT)
+		diags.report(ErrorKind::TooManyParameters, offEvent + 0x0E, i);
 
-					ins.operand = ((ins.operand & 0x7F) << 8) + data[i++];
-				}
-			}
-		}
+	if (record.varAmt > LOCALS_AMT_SUSPICION_LIMIT)
+		diags.report(ErrorKind::TooManyVariables, offEvent + 0x12, i);
 
-		switch (ins.opcode)
-		{
+	if (record.argAmt > record.varAmt)
+		diags.report(ErrorKind::TooManyArguments, offEvent + 0x0D, i);
 
-		case BC_OPCODE_B:
-		case BC_OPCODE_BY:
-		case BC_OPCODE_BKY:
-		case BC_OPCODE_BN:
-		case BC_OPCODE_BKN:
-			ins.operand = i + ins.operand - ins.info().operandSize;
-			lastJump = std::max(lastJump, (unsigned) ins.operand);
+	if (offEvent + CMB_SCENE_RECORD_SIZE + 2*record.paramAmt > fileSize)
+		diags.report(ErrorKind::SceneParametersOutOfBounds, offEvent + 0x14, i);
 
-			break;
+	if (record.idx != sceneIdx)
+		diags.report(ErrorKind::SceneIndexMismatch, offEvent + 0x10, i);
 
-		case BC_OPCODE_RETURN:
-		case BC_OPCODE_RETN:
-		case BC_OPCODE_RETY:
-			if (i > lastJump)
-				ended = true;
+	if (record.offName != 0 && record.offName >= fileSize)
+		diags.report(ErrorKind::SceneNameOutOfBounds, offEvent + 0x00, i);
 
-			break;
+	if (record.offScript >= fileSize)
+		diags.report(ErrorKind::ScriptOutOfBounds, offEvent + 0x04, i);
 
-		} // switch (ins.opcode)
+	return diags.size() == diagCnt;
+}
 
-		result.push_back(ins);
-	}
+void make_varnames(unsigned argAmt, unsigned varAmt, std::vector<std::string>& result)
+{
+	result.resize(varAmt);
 
-	if (result.empty() || !result.back().is_end())
-		throw std::runtime_error("Reached end of file without reached end of script.");
+	for (unsigned i = 0; i < argAmt; ++i)
+		result[i] = [&] () { std::string r("arg_"); r.append(std::to_string(i)); return r; } (); // TODO: better string formatting
 
-	return result;
+	for (unsigned i = argAmt; i < varAmt; ++i)
+		result[i] = [&] () { std::string r("var_"); r.append(std::to_string(i)); return r; } (); // TODO: better string formatting
 }
 
-CmbInfo decode_cmb(Span<const byte_type> data, GameKind game)
+bool try_decode_cmb(Span<const byte_type> data, GameKind game, CmbInfo& result, Diagnostics& diags)
 {
-	CmbInfo result;
+	const auto diagCnt = diags.size();
 
-	if (data.size() < 0x2C)
-		throw std::runtime_error("This is not a valid CMB file! (too small)"); // TODO: better error
+	result = CmbInfo();
 
-	// 1. Read cmb information
+	if (data.size() < CMB_HEADER_SIZE)
+	{
+		diags.report(ErrorKind::FileTooSmall, 0);
+		return false;
+	}
 
-	const auto globalAmt  = decode_int_le(data.subspan(0x22, 2));
-	const auto offStrings = decode_int_le(data.subspan(0x24, 4));
-	const auto offEvents  = decode_int_le(data.subspan(0x28, 4));
+	// 1. Read cmb information
 
-	if (offStrings >= data.size())
-		throw std::runtime_error("String pool past the end of the file!"); // TODO: better error
+	const auto header = read_cmb_header(data);
 
-	if (offEvents >= data.size())
-		throw std::runtime_error("Event offset array past the end of the file!"); // TODO: better error
+	if (!check_cmb_header(header, data.size(), diags))
+		return false;
 
-	if (globalAmt > GLOBAL_AMT_SUSPICION_LIMIT)
-		throw std::runtime_error("CMB global variable amount is past the suspicion limit!"); // TODO: better error
+	const auto offStrings = header.offStrings;
+	const auto offEvents  = header.offEvents;
 
 	// String pool
 	result.stringPool.assign(
@@ -170,117 +281,139 @@ CmbInfo decode_cmb(Span<const byte_type> data, GameKind game)
 			: data.begin() + offEvents);
 
 	// Global variables
-	result.globalNames.resize(globalAmt);
-
-	for (unsigned i = 0; i < globalAmt; ++i)
-	{
-		result.globalNames[i] = [&] ()
-		{
-			// TODO: less hacky way of doing this
-			std::string r("gvar_");
-			r.append(std::to_string(i));
-
-			return r;
-		} ();
-	}
+	make_global_names(header.globalAmt, result.globalNames);
 
 	// 2. Read scene information
+	// Scenes that fail to decode are kept (with an empty script) so that scene indices stay meaningful
+
+	std::vector<unsigned> boundaries { offStrings, offEvents }; // sorted below, scripts end at the next one
+	std::vector<unsigned> scriptScenes; // scenes whose script is to be decoded
 
 	for (unsigned i = 0;; ++i)
 	{
 		if (offEvents + i*4 + 4 > data.size())
-			throw std::runtime_error("Event offset array unterminated by then end of the file"); // TODO: better error
+		{
+			diags.report(ErrorKind::EventTableUnterminated, offEvents + i*4);
+			break;
+		}
 
 		const auto offEvent = decode_int_le(data.subspan(offEvents + 4*i, 4));
 
 		if (offEvent == 0)
 			break; // We reached the end!
 
-		if (offEvent + 0x14 > data.size())
-			throw std::runtime_error("Scene information goes past the end of the file"); // TODO: better error
-
-		const auto offName   = decode_int_le(data.subspan(offEvent + 0x00, 4));
-		const auto offScript = decode_int_le(data.subspan(offEvent + 0x04, 4));
-		const auto kind      = decode_int_le(data.subspan(offEvent + 0x0C, 1));
-		const auto argAmt    = decode_int_le(data.subspan(offEvent + 0x0D, 1));
-		const auto paramAmt  = decode_int_le(data.subspan(offEvent + 0x0E, 1));
-		const auto idx       = decode_int_le(data.subspan(offEvent + 0x10, 2));
-		const auto varAmt    = decode_int_le(data.subspan(offEvent + 0x12, 2));
+		result.scenes.emplace_back();
+		auto& scene = result.scenes.back();
 
-		if (paramAmt > PARAMS_AMT_SUSPICION_LIMIT)
-			throw std::runtime_error("Scene parameter amount is past the suspicion limit!"); // TODO: better error
+		scene.idx = i;
+		scene.name = [&] () { std::string r("Unknown_"); r.append(std::to_string(i)); return r; } (); // TODO: better string formatting
 
-		if (varAmt > LOCALS_AMT_SUSPICION_LIMIT)
-			throw std::runtime_error("Scene variable amount is past the suspicion limit!"); // TODO: better error
+		if (offEvent + CMB_SCENE_RECORD_SIZE > data.size())
+		{
+			diags.report(ErrorKind::SceneOutOfBounds, offEvents + 4*i, i);
+			continue;
+		}
 
-		if (argAmt > varAmt)
-			throw std::runtime_error("Scene argument amount is past the variable amount!"); // TODO: better error
+		boundaries.push_back(offEvent);
 
-		if (offEvent + 0x14 + 2*paramAmt > data.size())
-			throw std::runtime_error("Scene information parameters goes past the end of the file"); // TODO: better error
+		const auto record = read_scene_record(data.subspan(offEvent, CMB_SCENE_RECORD_SIZE));
 
-		if (idx != i)
-			throw std::runtime_error("Scene information is invalid (index doesn't match)!"); // TODO: better error
+		if (!check_scene_record(record, offEvent, i, data.size(), diags))
+			continue;
 
-		result.scenes.emplace_back();
-		auto& scene = result.scenes.back();
+		boundaries.push_back(record.offScript);
 
-		scene.idx      = idx;
-		scene.kind     = kind;
-		scene.argCnt   = argAmt;
-		scene.isGlobal = (offName != 0);
+		scene.kind         = record.kind;
+		scene.argCnt       = record.argAmt;
+		scene.isGlobal     = (record.offName != 0);
+		scene.scriptOffset = record.offScript;
 
 		// Read name
-		scene.name = [&] ()
+		if (record.offName != 0)
 		{
-			if (offName == 0)
-				return [&] () { std::string r("Unknown_"); r.append(std::to_string(idx)); return r; } (); // TODO: better string formatting
-
-			std::string result;
+			const auto nameBegin = data.begin() + record.offName;
+			const auto nameEnd = std::find(nameBegin, data.end(), 0);
 
-			for (unsigned i = offName;; ++i)
+			if (nameEnd == data.end())
 			{
-				if (i > data.size())
-					throw std::runtime_error("Scene name string reaches past the end of the file");
-
-				if (data[i] == 0)
-					break;
-
-				result.push_back(data[i]);
+				diags.report(ErrorKind::SceneNameOutOfBounds, record.offName, i);
+				continue;
 			}
 
-			return result;
-		} ();
+			scene.name.assign(nameBegin, nameEnd);
+		}
 
 		// Read parameters
-		scene.parameters = [&] ()
-		{
-			std::vector<int> result(paramAmt, 0);
+		scene.parameters.resize(record.paramAmt);
 
-			for (unsigned i = 0; i < paramAmt; ++i)
-				result[i] = decode_int_le(data.subspan(offEvent + 0x14 + 2*i, 2));
-
-			return result;
-		} ();
+		for (unsigned j = 0; j < record.paramAmt; ++j)
+			scene.parameters[j] = decode_int_le(data.subspan(offEvent + CMB_SCENE_RECORD_SIZE + 2*j, 2));
 
 		// Name variables lazy names
-		scene.varnames = [&] ()
-		{
-			std::vector<std::string> result(varAmt);
+		make_varnames(record.argAmt, record.varAmt, scene.varnames);
 
-			for (unsigned i = 0; i < argAmt; ++i)
-				result[i] = [&] () { std::string r("arg_"); r.append(std::to_string(i)); return r; } (); // TODO: better string formatting
+		scriptScenes.push_back(i);
+	}
 
-			for (unsigned i = argAmt; i < varAmt; ++i)
-				result[i] = [&] () { std::string r("var_"); r.append(std::to_string(i)); return r; } (); // TODO: better string formatting
+	// 3. Decode scripts, each only up to the next structure in the file
 
-			return result;
-		} ();
+	std::sort(boundaries.begin(), boundaries.end());
+
+	for (auto i : scriptScenes)
+	{
+		auto& scene = result.scenes[i];
+
+		const auto it = std::upper_bound(boundaries.begin(), boundaries.end(), scene.scriptOffset);
+		const unsigned scriptEnd = (it != boundaries.end() && *it < data.size()) ? *it : data.size();
+
+		try_decode_script(data.subspan(scene.scriptOffset, scriptEnd - scene.scriptOffset), game, scene.scriptOffset, i,
+			scene.rawScript, scene.unreachable, diags);
+
+		SOREN_STATS_ADD(Instructions, scene.rawScript.size());
+	}
 
-		// Decode script
-		scene.rawScript = decode_script(data.subspan(offScript), game);
+	index_cmb_strings(result);
+
+	return diags.size() == diagCnt;
+}
+
+void index_cmb_strings(CmbInfo& cmb)
+{
+	static thread_local std::vector<std::uint32_t> referenced;
+	referenced.clear();
+
+	for (auto& scene : cmb.scenes)
+	{
+		for (auto& ins : scene.rawScript)
+		{
+			switch (ins.opcode)
+			{
+
+			case BC_OPCODE_STRING8:
+			case BC_OPCODE_STRING16:
+			case BC_OPCODE_STRING32:
+				referenced.push_back(static_cast<std::uint32_t>(ins.operand));
+				break;
+
+			case BC_OPCODE_CALLEXT:
+				referenced.push_back(static_cast<std::uint32_t>(ins.operand) >> 8);
+				break;
+
+			} // switch (ins.opcode)
+		}
 	}
 
+	cmb.stringIndex.build(cmb.stringPool, referenced);
+}
+
+CmbInfo decode_cmb(Span<const byte_type> data, GameKind game)
+{
+	CmbInfo result;
+	Diagnostics diags;
+
+	if (!try_decode_cmb(data, game, result, diags))
+		throw std::runtime_error(get_error_message(diags.list.front().kind)); // TODO: better error
+
 	return result;
 }
 
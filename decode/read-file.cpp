@@ -0,0 +1,31 @@
+#include "decode/decode.h"
+#include "decode/lz.h"
+
+#include "core/io.h"
+
+namespace soren {
+
+bool try_read_cmb_file(const char* filename, std::vector<byte_type>& result, Diagnostics& diags)
+{
+	if (!read_entire_file(filename, result))
+	{
+		diags.report(ErrorKind::FileUnreadable, 0);
+		return false;
+	}
+
+	return try_decompress_cmb_data(result, diags);
+}
+
+bool try_decompress_cmb_data(std::vector<byte_type>& data, Diagnostics& diags)
+{
+	if (detect_lz(data) == LzKind::None)
+		return true;
+
+	// the compressed data is only needed until it is decompressed into data
+	std::vector<byte_type> compressed;
+	compressed.swap(data);
+
+	return try_lz_decompress(compressed, data, diags);
+}
+
+} // namespace soren
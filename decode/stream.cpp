@@ -0,0 +1,367 @@
+#include "decode/stream.h"
+#include "decode/decode.h"
+#include "decode/decode-common.h"
+#include "decode/lz.h"
+
+#include "core/stats.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace soren {
+
+enum
+{
+	STREAM_STRING_CHUNK = 64,
+};
+
+// Reads the NUL terminated string at offset, which should end before end
+
+bool CmbStream::read_string(unsigned offset, unsigned end, std::string& result)
+{
+	result.clear();
+
+	char chunk[STREAM_STRING_CHUNK];
+
+	while (offset < end)
+	{
+		const unsigned size = std::min<unsigned>(STREAM_STRING_CHUNK, end - offset);
+
+		if (!mFile.read(offset, size, chunk))
+			return false;
+
+		if (const void* nul = std::memchr(chunk, 0, size))
+		{
+			result.append(chunk, static_cast<const char*>(nul) - chunk);
+			return true;
+		}
+
+		result.append(chunk, size);
+		offset += size;
+	}
+
+	return false;
+}
+
+bool CmbStream::open(const char* filename, bool autoGame, GameKind game, Diagnostics& diags)
+{
+	const auto diagCnt = diags.size();
+
+	mInfo = CmbInfo();
+	mLoaded = -1;
+	mSlots.clear();
+	mBoundaries.clear();
+	mGame = game;
+	mCompressed = false;
+
+	if (!mFile.open(filename))
+	{
+		diags.report(ErrorKind::FileUnreadable, 0);
+		return false;
+	}
+
+	const auto fileSize = mFile.size();
+
+	byte_type headerBytes[CMB_HEADER_SIZE];
+	const auto headerSize = std::min<std::size_t>(CMB_HEADER_SIZE, fileSize);
+
+	if (!mFile.read(0, headerSize, headerBytes))
+	{
+		diags.report(ErrorKind::FileUnreadable, 0);
+		return false;
+	}
+
+	if (detect_lz(Span<const byte_type>(headerBytes, headerSize)) != LzKind::None)
+	{
+		mCompressed = true;
+		return false;
+	}
+
+	if (headerSize < CMB_HEADER_SIZE)
+	{
+		diags.report(ErrorKind::FileTooSmall, 0);
+		return false;
+	}
+
+	const auto header = read_cmb_header(Span<const byte_type>(headerBytes, CMB_HEADER_SIZE));
+
+	if (!check_cmb_header(header, fileSize, diags))
+		return false;
+
+	mOffStrings = header.offStrings;
+	mPoolEnd = (header.offStrings > header.offEvents) ? fileSize : header.offEvents;
+
+	make_global_names(header.globalAmt, mInfo.globalNames);
+
+	mBoundaries.push_back(header.offStrings);
+	mBoundaries.push_back(header.offEvents);
+
+	// Scene records, same checks as try_decode_cmb
+
+	for (unsigned i = 0;; ++i)
+	{
+		byte_type word[4];
+
+		if (!mFile.read(header.offEvents + 4*i, 4, word))
+		{
+			diags.report(ErrorKind::EventTableUnterminated, header.offEvents + i*4);
+			break;
+		}
+
+		const auto offEvent = decode_int_le(Span<const byte_type>(word, 4));
+
+		if (offEvent == 0)
+			break; // We reached the end!
+
+		mInfo.scenes.emplace_back();
+		mSlots.push_back({ 0u, false });
+
+		auto& scene = mInfo.scenes.back();
+
+		scene.idx = i;
+		scene.name = [&] () { std::string r("Unknown_"); r.append(std::to_string(i)); return r; } (); // TODO: better string formatting
+
+		byte_type recordBytes[CMB_SCENE_RECORD_SIZE];
+
+		if (!mFile.read(offEvent, CMB_SCENE_RECORD_SIZE, recordBytes))
+		{
+			diags.report(ErrorKind::SceneOutOfBounds, header.offEvents + 4*i, i);
+			continue;
+		}
+
+		mBoundaries.push_back(offEvent);
+
+		const auto record = read_scene_record(Span<const byte_type>(recordBytes, CMB_SCENE_RECORD_SIZE));
+
+		if (!check_scene_record(record, offEvent, i, fileSize, diags))
+			continue;
+
+		scene.kind         = record.kind;
+		scene.argCnt       = record.argAmt;
+		scene.isGlobal     = (record.offName != 0);
+		scene.scriptOffset = record.offScript;
+
+		if (record.offName != 0)
+		{
+			if (!read_string(record.offName, fileSize, mString))
+			{
+				diags.report(ErrorKind::SceneNameOutOfBounds, record.offName, i);
+				continue;
+			}
+
+			scene.name = mString;
+		}
+
+		byte_type paramBytes[2 * PARAMS_AMT_SUSPICION_LIMIT];
+		mFile.read(offEvent + CMB_SCENE_RECORD_SIZE, 2 * record.paramAmt, paramBytes); // checked by check_scene_record
+
+		scene.parameters.resize(record.paramAmt);
+
+		for (unsigned j = 0; j < record.paramAmt; ++j)
+			scene.parameters[j] = decode_int_le(Span<const byte_type>(paramBytes + 2*j, 2));
+
+		mSlots.back() = { record.varAmt, true };
+		mBoundaries.push_back(record.offScript);
+	}
+
+	std::sort(mBoundaries.begin(), mBoundaries.end());
+	mBoundaries.erase(std::unique(mBoundaries.begin(), mBoundaries.end()), mBoundaries.end());
+
+	mMetadataBytes = mInfo.scenes.capacity() * sizeof(SceneInfo)
+		+ mSlots.capacity() * sizeof(SceneSlot)
+		+ mBoundaries.capacity() * sizeof(unsigned)
+		+ mInfo.globalNames.capacity() * sizeof(std::string);
+
+	for (auto& scene : mInfo.scenes)
+		mMetadataBytes += scene.name.capacity() + scene.parameters.capacity() * sizeof(int);
+
+	for (auto& name : mInfo.globalNames)
+		mMetadataBytes += name.capacity();
+
+	// Game detection, one script at a time
+
+	if (autoGame)
+	{
+		GameDetection detection;
+		detection.confidence = DetectConfidence::Low;
+
+		for (unsigned i = 0; i < mInfo.scenes.size(); ++i)
+		{
+			if (!mSlots[i].loadable)
+				continue;
+
+			const auto offScript = mInfo.scenes[i].scriptOffset;
+
+			mScript.resize(script_size(i));
+
+			if (!mFile.read(offScript, mScript.size(), mScript.data()))
+				continue;
+
+			if (detect_game_step(mScript, offScript, mInfo.scenes.size(), detection))
+				break;
+		}
+
+		mGame = detection.game;
+	}
+
+	if (mSymbols)
+		apply_symbols(*mSymbols, mGame, SYMBOL_ANY_FILE, mInfo);
+
+	return diags.size() == diagCnt;
+}
+
+unsigned CmbStream::get_script_end(unsigned offScript) const
+{
+	const auto it = std::upper_bound(mBoundaries.begin(), mBoundaries.end(), offScript);
+
+	return (it != mBoundaries.end() && *it < mFile.size())
+		? *it
+		: mFile.size();
+}
+
+std::size_t CmbStream::script_size(unsigned idx) const
+{
+	if (!mSlots[idx].loadable)
+		return 0;
+
+	const auto offScript = mInfo.scenes[idx].scriptOffset;
+	return get_script_end(offScript) - offScript;
+}
+
+bool CmbStream::load_scene(unsigned idx, Diagnostics& diags)
+{
+	if (!mSlots[idx].loadable)
+		return false;
+
+	auto& scene = mInfo.scenes[idx];
+	mLoaded = idx;
+
+	mScript.resize(script_size(idx));
+
+	if (!mFile.read(scene.scriptOffset, mScript.size(), mScript.data()))
+	{
+		diags.report(ErrorKind::ScriptOutOfBounds, scene.scriptOffset, idx);
+		return false;
+	}
+
+	scene.rawScript.swap(mInsBuffer);
+
+	if (!try_decode_script(mScript, mGame, scene.scriptOffset, idx, scene.rawScript, scene.unreachable, diags))
+	{
+		scene.rawScript.clear();
+		return false;
+	}
+
+	SOREN_STATS_ADD(Instructions, scene.rawScript.size());
+
+	make_varnames(scene.argCnt, mSlots[idx].varAmt, scene.varnames);
+
+	if (mSymbols)
+		apply_scene_symbols(*mSymbols, mGame, SYMBOL_ANY_FILE, scene);
+
+	// Build this scene's string pool and remap operands to it
+	// Offsets that don't point to a good string are remapped past the end of the pool, so that they are still reported
+
+	std::vector<std::pair<unsigned, unsigned>> remap; // original offset -> new offset
+
+	auto get_string_offset = [] (const BcIns& ins)
+	{
+		return (ins.opcode == BC_OPCODE_CALLEXT)
+			? static_cast<std::uint32_t>(ins.operand) >> 8
+			: static_cast<std::uint32_t>(ins.operand);
+	};
+
+	auto is_string_ins = [] (const BcIns& ins)
+	{
+		return ins.opcode == BC_OPCODE_STRING8 || ins.opcode == BC_OPCODE_STRING16 || ins.opcode == BC_OPCODE_STRING32 || ins.opcode == BC_OPCODE_CALLEXT;
+	};
+
+	for (auto& ins : scene.rawScript)
+	{
+		if (is_string_ins(ins))
+			remap.push_back({ get_string_offset(ins), 0u });
+	}
+
+	std::sort(remap.begin(), remap.end());
+	remap.erase(std::unique(remap.begin(), remap.end()), remap.end());
+
+	mInfo.stringPool.clear();
+
+	const unsigned badOffset = 0xFFFFFF; // fits callext operands too
+
+	for (auto& entry : remap)
+	{
+		const bool inPool = entry.first < mPoolEnd - mOffStrings;
+
+		if (!inPool || !read_string(mOffStrings + entry.first, mPoolEnd, mString))
+		{
+			entry.second = badOffset;
+			continue;
+		}
+
+		entry.second = mInfo.stringPool.size();
+		mInfo.stringPool.insert(mInfo.stringPool.end(), mString.begin(), mString.end());
+		mInfo.stringPool.push_back('\0');
+	}
+
+	for (auto& ins : scene.rawScript)
+	{
+		if (!is_string_ins(ins))
+			continue;
+
+		const auto it = std::lower_bound(remap.begin(), remap.end(), std::make_pair(get_string_offset(ins), 0u));
+
+		if (ins.opcode == BC_OPCODE_CALLEXT)
+			ins.operand = static_cast<std::int32_t>((it->second << 8) | (ins.operand & 0xFF));
+		else
+			ins.operand = static_cast<std::int32_t>(it->second);
+	}
+
+	// every string of this pool starts after a NUL
+	mInfo.stringIndex.build(mInfo.stringPool);
+
+	if (mConverter)
+		mInfo.stringIndex.convert(mInfo.stringPool.data(), mConverter);
+
+	return true;
+}
+
+void CmbStream::unload_scene(unsigned idx)
+{
+	auto& scene = mInfo.scenes[idx];
+
+	scene.rawScript.clear();
+	scene.rawScript.swap(mInsBuffer);
+
+	scene.unreachable.clear();
+	scene.unreachable.shrink_to_fit();
+
+	scene.varnames.clear();
+	scene.varnames.shrink_to_fit();
+
+	mInfo.stringPool.clear();
+	mInfo.stringIndex.clear();
+
+	mLoaded = -1;
+}
+
+std::size_t CmbStream::resident_bytes() const
+{
+	std::size_t result = mFile.window_size() + mMetadataBytes
+		+ mScript.capacity()
+		+ mInsBuffer.capacity() * sizeof(BcIns)
+		+ mInfo.stringPool.capacity()
+		+ mString.capacity();
+
+	if (mLoaded >= 0)
+	{
+		auto& scene = mInfo.scenes[mLoaded];
+
+		result += scene.rawScript.capacity() * sizeof(BcIns);
+		result += scene.varnames.capacity() * sizeof(std::string);
+	}
+
+	return result;
+}
+
+} // namespace soren
@@ -0,0 +1,86 @@
+#ifndef SOREN_DECODE_STREAM_INCLUDED
+#define SOREN_DECODE_STREAM_INCLUDED
+
+#include <vector>
+
+#include "core/io.h"
+#include "core/diagnostics.h"
+#include "core/soren-cmb.h"
+#include "decode/detect.h"
+#include "decode/symbols.h"
+
+namespace soren {
+
+// Bounded-memory reader for a CMB file (--stream)
+// Opening only reads the header, the event table and the scene records (names, parameters)
+// Scripts are read and decoded one scene at a time, each one bounded by the next structure in the file
+// While a scene is loaded, info().stringPool only holds the strings it references and its string operands are
+// remapped to those, so the string pool is never loaded as a whole
+
+class CmbStream
+{
+public:
+	explicit CmbStream(std::size_t windowSize)
+		: mFile(windowSize) {}
+
+	// When autoGame is set, the game is detected by scanning scripts one at a time (see detect_game_step)
+	// Compressed files can't be streamed: open then fails without reporting anything, and compressed() is set
+	bool open(const char* filename, bool autoGame, GameKind game, Diagnostics& diags);
+
+	bool compressed() const { return mCompressed; }
+
+	// Names are renamed from symbols (if any) as they are made, only with symbols for any file (files aren't hashed)
+	void set_symbols(const SymbolDb* symbols) { mSymbols = symbols; }
+
+	// Strings of each scene are converted as it is loaded (see StringPoolIndex::convert)
+	void set_string_converter(StringPoolIndex::Converter converter) { mConverter = converter; }
+
+	const CmbInfo& info() const { return mInfo; }
+	GameKind game() const { return mGame; }
+
+	// Size of the script of scene idx, as bounded by the next structure in the file
+	std::size_t script_size(unsigned idx) const;
+
+	// Returns false if the scene couldn't be loaded (its rawScript is then empty)
+	bool load_scene(unsigned idx, Diagnostics& diags);
+	void unload_scene(unsigned idx);
+
+	// Rough amount of memory held: window, metadata and loaded scene
+	std::size_t resident_bytes() const;
+
+private:
+	unsigned get_script_end(unsigned offScript) const;
+	bool read_string(unsigned offset, unsigned end, std::string& result);
+
+	FileWindow mFile;
+	GameKind mGame { GameKind::FE10 };
+	bool mCompressed { false };
+	const SymbolDb* mSymbols { nullptr };
+	StringPoolIndex::Converter mConverter { nullptr };
+
+	CmbInfo mInfo;
+
+	unsigned mOffStrings { 0u };
+	unsigned mPoolEnd { 0u };
+
+	struct SceneSlot
+	{
+		unsigned varAmt;
+		bool loadable; // the scene record was fine
+	};
+
+	std::vector<SceneSlot> mSlots; // per scene
+	std::vector<unsigned> mBoundaries; // sorted offsets of every structure in the file (scripts end at the next one)
+
+	std::size_t mMetadataBytes { 0u };
+	int mLoaded { -1 }; // index of the loaded scene
+
+	// kept between scenes so that their capacity is reused
+	std::vector<byte_type> mScript; // raw bytes of the loaded script
+	std::vector<BcIns> mInsBuffer;
+	std::string mString;
+};
+
+} // namespace soren
+
+#endif // SOREN_DECODE_STREAM_INCLUDED
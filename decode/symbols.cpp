@@ -0,0 +1,367 @@
+#include "decode/symbols.h"
+#include "decode/archive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+namespace soren {
+
+/*
+ * Database layout (all little endian):
+ *
+ * 0x00 header:  "SSDB", u32 version, u32 entryCnt, u32 bucketCnt, u32 slotCnt, u32 namesSize, u32 flags, u32 reserved (0)
+ * 0x20 buckets: bucketCnt u32 seeds (padded to 8 bytes)
+ *      slots:   slotCnt entries of 0x18 bytes:
+ *               u64 file, u32 scene, u32 slot, u32 nameOffset (within names), u16 nameLength, u8 game, u8 reserved
+ *               unused slots have game 0xFF
+ *      names:   NUL terminated names
+ *
+ * flags bit 0 is set if some entry has a file other than SYMBOL_ANY_FILE.
+ *
+ * The hash table is perfect (hash and displace): a key is in bucket hash(key, 0) % bucketCnt, and in slot
+ * hash(key, seed) % slotCnt, seed being the bucket's. Seeds are found when building, by placing buckets from the
+ * biggest down and trying seeds until every key of the bucket lands on a free slot. A lookup is then two hashes and
+ * one comparison (keys that aren't in the database land on some other key's slot).
+ */
+
+enum : std::uint32_t
+{
+	SYMBOL_DB_VERSION = 1,
+
+	SYMBOL_DB_HEADER_SIZE = 0x20,
+	SYMBOL_DB_SLOT_SIZE = 0x18,
+
+	SYMBOL_DB_FLAG_FILE_SYMBOLS = 1,
+
+	SYMBOL_BUCKET_LOAD = 4, // average keys per bucket
+	SYMBOL_SEED_ATTEMPTS = 1u << 16, // per bucket, before trying again with a bigger table
+};
+
+enum : std::uint8_t
+{
+	SYMBOL_SLOT_UNUSED = 0xFF,
+};
+
+static const char sSymbolDbMagic[4] { 'S', 'S', 'D', 'B' };
+
+static
+std::uint64_t read_le(const byte_type* data, unsigned size)
+{
+	std::uint64_t result = 0;
+
+	for (unsigned i = size; i > 0; --i)
+		result = (result << 8) | data[i - 1];
+
+	return result;
+}
+
+static
+void put_le(std::vector<byte_type>& out, std::size_t offset, std::uint64_t value, unsigned size)
+{
+	for (unsigned i = 0; i < size; ++i)
+		out[offset + i] = (value >> (8*i)) & 0xFF;
+}
+
+// splitmix64 finalizer
+static
+std::uint64_t mix(std::uint64_t x)
+{
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+
+	return x ^ (x >> 31);
+}
+
+static
+std::uint64_t hash_symbol_key(const SymbolKey& key, std::uint32_t seed)
+{
+	std::uint64_t result = mix(key.file ^ (0x9E3779B97F4A7C15ull * (seed + 1)));
+
+	result = mix(result ^ ((static_cast<std::uint64_t>(key.scene) << 32) | key.slot));
+	result = mix(result ^ static_cast<unsigned>(key.game));
+
+	return result;
+}
+
+static
+std::size_t get_slots_offset(std::uint32_t bucketCnt)
+{
+	return SYMBOL_DB_HEADER_SIZE + ((4*static_cast<std::size_t>(bucketCnt) + 7) & ~std::size_t(7));
+}
+
+bool SymbolDb::open(const char* filename)
+{
+	mEntryCnt = 0;
+
+	if (!mFile.open(filename))
+		return false;
+
+	const byte_type* data = mFile.data();
+	const std::uint64_t fileSize = mFile.size();
+
+	if (fileSize < SYMBOL_DB_HEADER_SIZE || std::memcmp(data, sSymbolDbMagic, 4) != 0 || read_le(data + 4, 4) != SYMBOL_DB_VERSION)
+		return false;
+
+	const auto entryCnt = read_le(data + 0x08, 4);
+	const auto bucketCnt = read_le(data + 0x0C, 4);
+	const auto slotCnt = read_le(data + 0x10, 4);
+	const auto namesSize = read_le(data + 0x14, 4);
+
+	const std::uint64_t slotsOffset = get_slots_offset(bucketCnt);
+	const std::uint64_t namesOffset = slotsOffset + slotCnt * SYMBOL_DB_SLOT_SIZE;
+
+	if (bucketCnt == 0 || slotCnt < entryCnt || namesOffset + namesSize > fileSize)
+		return false;
+
+	mBucketCnt = bucketCnt;
+	mSlotCnt = slotCnt;
+	mHasFileSymbols = (read_le(data + 0x18, 4) & SYMBOL_DB_FLAG_FILE_SYMBOLS) != 0;
+
+	mBuckets = data + SYMBOL_DB_HEADER_SIZE;
+	mSlots = data + slotsOffset;
+	mNames = reinterpret_cast<const char*>(data + namesOffset);
+	mNamesSize = namesSize;
+
+	mEntryCnt = entryCnt;
+	return true;
+}
+
+Span<const char> SymbolDb::find(const SymbolKey& key) const
+{
+	if (mEntryCnt == 0)
+		return Span<const char>();
+
+	const auto seed = read_le(mBuckets + 4*(hash_symbol_key(key, 0) % mBucketCnt), 4);
+	const byte_type* slot = mSlots + (hash_symbol_key(key, seed) % mSlotCnt) * SYMBOL_DB_SLOT_SIZE;
+
+	if (slot[0x16] != static_cast<unsigned>(key.game) || read_le(slot + 0x00, 8) != key.file
+		|| read_le(slot + 0x08, 4) != key.scene || read_le(slot + 0x0C, 4) != key.slot)
+		return Span<const char>();
+
+	const auto nameOffset = read_le(slot + 0x10, 4);
+	const auto nameLength = read_le(slot + 0x14, 2);
+
+	if (nameOffset + nameLength >= mNamesSize)
+		return Span<const char>(); // broken entry
+
+	return Span<const char>(mNames + nameOffset, nameLength);
+}
+
+Span<const char> SymbolDb::find_for_file(const SymbolKey& key) const
+{
+	if (mHasFileSymbols && key.file != SYMBOL_ANY_FILE)
+	{
+		const auto result = find(key);
+
+		if (result.size() != 0)
+			return result;
+	}
+
+	return find(SymbolKey { key.game, SYMBOL_ANY_FILE, key.scene, key.slot });
+}
+
+// Seeds for every bucket and the slot of every input, false if some bucket ran out of seeds
+static
+bool place_symbols(const std::vector<SymbolInput>& inputs, std::uint32_t bucketCnt, std::uint32_t slotCnt,
+	std::vector<std::uint32_t>& seeds, std::vector<std::uint32_t>& slots)
+{
+	std::vector<std::vector<std::uint32_t>> buckets(bucketCnt);
+
+	for (std::uint32_t i = 0; i < inputs.size(); ++i)
+		buckets[hash_symbol_key(inputs[i].key, 0) % bucketCnt].push_back(i);
+
+	std::vector<std::uint32_t> order(bucketCnt);
+
+	for (std::uint32_t i = 0; i < bucketCnt; ++i)
+		order[i] = i;
+
+	std::stable_sort(order.begin(), order.end(), [&] (std::uint32_t a, std::uint32_t b)
+	{
+		return buckets[a].size() > buckets[b].size();
+	});
+
+	seeds.assign(bucketCnt, 0);
+	slots.assign(inputs.size(), 0);
+
+	std::vector<bool> used(slotCnt, false);
+	std::vector<std::uint32_t> placed;
+
+	for (auto b : order)
+	{
+		auto& bucket = buckets[b];
+
+		if (bucket.empty())
+			break;
+
+		std::uint32_t seed = 1;
+
+		for (; seed <= SYMBOL_SEED_ATTEMPTS; ++seed)
+		{
+			placed.clear();
+
+			for (auto i : bucket)
+			{
+				const std::uint32_t slot = hash_symbol_key(inputs[i].key, seed) % slotCnt;
+
+				if (used[slot] || std::find(placed.begin(), placed.end(), slot) != placed.end())
+					break;
+
+				placed.push_back(slot);
+			}
+
+			if (placed.size() == bucket.size())
+				break;
+		}
+
+		if (seed > SYMBOL_SEED_ATTEMPTS)
+			return false;
+
+		seeds[b] = seed;
+
+		for (std::size_t j = 0; j < bucket.size(); ++j)
+		{
+			used[placed[j]] = true;
+			slots[bucket[j]] = placed[j];
+		}
+	}
+
+	return true;
+}
+
+bool write_symbol_db(std::ostream& out, const std::vector<SymbolInput>& inputs)
+{
+	if (inputs.size() >= 0x7FFFFFFFu)
+		return false;
+
+	std::vector<SymbolKey> keys;
+	keys.reserve(inputs.size());
+
+	for (auto& input : inputs)
+	{
+		if (input.name.size() > 0xFFFF)
+			return false;
+
+		keys.push_back(input.key);
+	}
+
+	// distinct keys (equal keys would never get a seed)
+	std::sort(keys.begin(), keys.end(), [] (const SymbolKey& a, const SymbolKey& b)
+	{
+		return std::make_tuple(static_cast<unsigned>(a.game), a.file, a.scene, a.slot)
+			< std::make_tuple(static_cast<unsigned>(b.game), b.file, b.scene, b.slot);
+	});
+
+	if (std::adjacent_find(keys.begin(), keys.end()) != keys.end())
+		return false;
+
+	// Hash table, made roomier until every bucket finds a seed
+
+	const std::uint32_t entryCnt = inputs.size();
+	const std::uint32_t bucketCnt = std::max<std::uint32_t>(1, (entryCnt + SYMBOL_BUCKET_LOAD - 1) / SYMBOL_BUCKET_LOAD);
+
+	std::uint32_t slotCnt = std::max<std::uint32_t>(1, entryCnt + entryCnt / 16);
+
+	std::vector<std::uint32_t> seeds, slots;
+
+	while (!place_symbols(inputs, bucketCnt, slotCnt, seeds, slots))
+		slotCnt += slotCnt / 8 + 1;
+
+	// Layout
+
+	std::uint64_t namesSize = 0;
+
+	for (auto& input : inputs)
+		namesSize += input.name.size() + 1;
+
+	if (namesSize > 0xFFFFFFFFu)
+		return false;
+
+	const std::size_t slotsOffset = get_slots_offset(bucketCnt);
+	const std::size_t namesOffset = slotsOffset + static_cast<std::size_t>(slotCnt) * SYMBOL_DB_SLOT_SIZE;
+
+	std::vector<byte_type> result(namesOffset + namesSize, 0);
+
+	bool hasFileSymbols = false;
+
+	for (auto& input : inputs)
+		hasFileSymbols = hasFileSymbols || input.key.file != SYMBOL_ANY_FILE;
+
+	std::memcpy(result.data(), sSymbolDbMagic, 4);
+	put_le(result, 0x04, SYMBOL_DB_VERSION, 4);
+	put_le(result, 0x08, entryCnt, 4);
+	put_le(result, 0x0C, bucketCnt, 4);
+	put_le(result, 0x10, slotCnt, 4);
+	put_le(result, 0x14, namesSize, 4);
+	put_le(result, 0x18, hasFileSymbols ? std::uint32_t(SYMBOL_DB_FLAG_FILE_SYMBOLS) : 0u, 4);
+
+	for (std::uint32_t i = 0; i < bucketCnt; ++i)
+		put_le(result, SYMBOL_DB_HEADER_SIZE + 4*i, seeds[i], 4);
+
+	for (std::uint32_t i = 0; i < slotCnt; ++i)
+		result[slotsOffset + i*SYMBOL_DB_SLOT_SIZE + 0x16] = SYMBOL_SLOT_UNUSED;
+
+	std::size_t nameOffset = 0;
+
+	for (std::uint32_t i = 0; i < entryCnt; ++i)
+	{
+		auto& input = inputs[i];
+		const std::size_t slot = slotsOffset + static_cast<std::size_t>(slots[i]) * SYMBOL_DB_SLOT_SIZE;
+
+		put_le(result, slot + 0x00, input.key.file, 8);
+		put_le(result, slot + 0x08, input.key.scene, 4);
+		put_le(result, slot + 0x0C, input.key.slot, 4);
+		put_le(result, slot + 0x10, nameOffset, 4);
+		put_le(result, slot + 0x14, input.name.size(), 2);
+		put_le(result, slot + 0x16, static_cast<unsigned>(input.key.game), 1);
+
+		std::memcpy(result.data() + namesOffset + nameOffset, input.name.c_str(), input.name.size() + 1);
+		nameOffset += input.name.size() + 1;
+	}
+
+	out.write(reinterpret_cast<const char*>(result.data()), result.size());
+
+	return bool(out);
+}
+
+// Applying
+
+static
+void apply_symbol(const SymbolDb& db, const SymbolKey& key, std::string& name)
+{
+	const auto symbol = db.find_for_file(key);
+
+	if (symbol.size() != 0)
+		name.assign(symbol.begin(), symbol.end());
+}
+
+void apply_scene_symbols(const SymbolDb& db, GameKind game, std::uint64_t fileHash, SceneInfo& scene)
+{
+	for (std::uint32_t i = 0; i < scene.varnames.size(); ++i)
+		apply_symbol(db, SymbolKey { game, fileHash, scene.idx, i }, scene.varnames[i]);
+}
+
+void apply_symbols(const SymbolDb& db, GameKind game, std::uint64_t fileHash, CmbInfo& cmb)
+{
+	if (db.size() == 0)
+		return;
+
+	for (std::uint32_t i = 0; i < cmb.globalNames.size(); ++i)
+		apply_symbol(db, SymbolKey { game, fileHash, SYMBOL_NONE, i }, cmb.globalNames[i]);
+
+	for (auto& scene : cmb.scenes)
+	{
+		// global scenes are called by their name, it isn't made up
+		if (!scene.isGlobal)
+			apply_symbol(db, SymbolKey { game, fileHash, scene.idx, SYMBOL_NONE }, scene.name);
+
+		apply_scene_symbols(db, game, fileHash, scene);
+	}
+}
+
+std::uint64_t hash_symbol_file(Span<const byte_type> data)
+{
+	return hash_archive_member(data);
+}
+
+} // namespace soren
@@ -0,0 +1,100 @@
+#ifndef SOREN_DECODE_SYMBOLS_INCLUDED
+#define SOREN_DECODE_SYMBOLS_INCLUDED
+
+#include <cstdint>
+
+#include <vector>
+#include <string>
+#include <ostream>
+
+#include "core/types.h"
+#include "core/io.h"
+#include "core/soren-bytecode.h"
+#include "core/soren-cmb.h"
+
+namespace soren {
+
+// Symbol databases (soren symbols build): names to use in place of the ones decoding makes up (gvar_N, Unknown_N,
+// arg_N/var_N), compiled into a perfect hash table that is mapped as it is (see symbols.cpp for the layout)
+
+// A symbol is keyed by game, file (FNV-1a 64 of the decompressed file, or SYMBOL_ANY_FILE), scene and slot:
+//   global variable N:   scene SYMBOL_NONE, slot N
+//   scene N (unnamed):   scene N, slot SYMBOL_NONE
+//   local variable N:    scene, slot N
+enum : std::uint32_t
+{
+	SYMBOL_NONE = 0xFFFFFFFFu,
+};
+
+enum : std::uint64_t
+{
+	SYMBOL_ANY_FILE = 0u,
+};
+
+struct SymbolKey
+{
+	GameKind game;
+	std::uint64_t file;
+	std::uint32_t scene;
+	std::uint32_t slot;
+};
+
+inline bool operator == (const SymbolKey& a, const SymbolKey& b)
+{
+	return a.game == b.game && a.file == b.file && a.scene == b.scene && a.slot == b.slot;
+}
+
+// Read-only view of a symbol database, lookups hash the key twice and compare one entry
+class SymbolDb
+{
+public:
+	// Returns false if the file can't be read or isn't a symbol database (entries are only checked when looked up)
+	bool open(const char* filename);
+
+	std::size_t size() const { return mEntryCnt; }
+
+	// True if some symbols are for specific files (only then is there any point hashing files)
+	bool has_file_symbols() const { return mHasFileSymbols; }
+
+	// The name for key, or an empty span if there is none
+	Span<const char> find(const SymbolKey& key) const;
+
+	// Same, falling back to the SYMBOL_ANY_FILE symbol
+	Span<const char> find_for_file(const SymbolKey& key) const;
+
+private:
+	MappedFile mFile;
+
+	std::uint32_t mEntryCnt { 0u };
+	std::uint32_t mBucketCnt { 0u };
+	std::uint32_t mSlotCnt { 0u };
+	bool mHasFileSymbols { false };
+
+	const byte_type* mBuckets { nullptr };
+	const byte_type* mSlots { nullptr };
+	const char* mNames { nullptr };
+	std::uint32_t mNamesSize { 0u };
+};
+
+struct SymbolInput
+{
+	SymbolKey key;
+	std::string name;
+};
+
+// Builds and writes a database of inputs (which must have distinct keys), returns false if they don't fit the format
+bool write_symbol_db(std::ostream& out, const std::vector<SymbolInput>& inputs);
+
+// Renames global variables, unnamed scenes and (decoded) local variables of cmb that db has symbols for
+// fileHash is hash_symbol_file of the decoded data, or SYMBOL_ANY_FILE to only apply symbols for any file
+void apply_symbols(const SymbolDb& db, GameKind game, std::uint64_t fileHash, CmbInfo& cmb);
+
+// Only local variables of one scene (for scenes decoded one at a time)
+void apply_scene_symbols(const SymbolDb& db, GameKind game, std::uint64_t fileHash, SceneInfo& scene);
+
+// FNV-1a 64 (same as archive member hashes)
+std::uint64_t hash_symbol_file(Span<const byte_type> data);
+
+} // namespace soren
+
+#endif // SOREN_DECODE_SYMBOLS_INCLUDED
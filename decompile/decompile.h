@@ -0,0 +1,246 @@
+#ifndef SOREN_DECOMPILE_INCLUDED
+#define SOREN_DECOMPILE_INCLUDED
+
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include "core/types.h"
+#include "core/diagnostics.h"
+#include "core/offset-map.h"
+#include "core/soren-bytecode.h"
+#include "core/soren-cmb.h"
+
+#include "ast/stmt.h"
+#include "ast/flat-ast.h"
+
+namespace soren {
+
+// A statement whose expression is still owned by the stack machine (see stack-machine.h)
+// Push statements double as the operand stack
+
+template<typename ExprRef>
+struct PendingStmt
+{
+	Stmt::Kind kind;
+	std::int32_t target; // Goto/GotoIf only
+	ExprRef expr; // everything but Goto/Yield
+
+	// of expr as a tree (subexpressions shared by dup/deref counted once per use), for the budget below
+	std::uint32_t depth { 0u };
+	std::uint64_t size { 0u };
+};
+
+struct SceneAst
+{
+	NameMap labels;
+	OffsetMap<Ast> slices;
+};
+
+// Limits on the work decompiling one scene (or file) may take, so that crafted input can't stall a run. 0 is no limit
+// Going over any of them fails the scene (it is reported and nothing of it is kept), the rest of the run goes on
+
+struct DecompileBudget
+{
+	std::uint32_t instructions { 0u }; // per scene, and as many moves of bk conversion (which is quadratic on chains)
+	std::uint32_t slices { 0u };       // per scene
+	std::uint64_t nodes { 0u };        // expression nodes per scene, counting what dup/deref copy every time
+	std::uint32_t depth { 0u };        // expression nesting
+	std::uint32_t sceneMs { 0u };      // wall clock per scene
+	std::uint32_t fileMs { 0u };       // wall clock per file, from BudgetMeter::start_file
+};
+
+// Where the scene being decompiled stands against the budget
+// Deadlines are checked cooperatively: hot loops tick for the work they do (an instruction run or moved, a node made or
+// copied), and the clock is read every 1024 ticks
+// A dropped tree scene still has to free what it built, deadlines leave time for that: as long as freeing nodes took in
+// the last dropped scenes, for every node built so far
+
+struct BudgetMeter
+{
+	using clock = std::chrono::steady_clock;
+
+	DecompileBudget budget;
+
+	clock::time_point fileDeadline { clock::time_point::max() };
+	clock::time_point deadline { clock::time_point::max() }; // the scene's, or the file's if sooner
+
+	std::uint64_t nodes { 0u };
+	std::uint64_t moves { 0u };
+	std::uint64_t ticks { 0u };
+	std::uint64_t nextCheck { 0u }; // ticks at which to read the clock next
+
+	ErrorKind exceeded { ErrorKind::None }; // the first limit gone over, for the scene
+	clock::time_point exceededAt {};
+
+	bool freesNodes { false };
+	clock::duration freeTimePerNode { std::chrono::nanoseconds(20) }; // learned from dropped scenes
+
+	void start_file();
+
+	// Returns false if the file is already past its deadline
+	// freesNodes is whether dropping the scene frees its nodes one by one (tree asts), deadlines only leave time for it then
+	bool start_scene(bool freesNodes);
+
+	bool tick(std::uint64_t work = 1)
+	{
+		ticks += work;
+		return ticks < nextCheck || check_deadline();
+	}
+
+	bool check_deadline();
+
+	bool check_instructions(std::size_t count);
+	bool check_slices(std::size_t count);
+
+	// bk conversion moving an instruction past another
+	bool move()
+	{
+		if (budget.instructions != 0 && ++moves > budget.instructions)
+			return fail(ErrorKind::MoveBudgetExceeded);
+
+		return tick();
+	}
+
+	// count more expression nodes, the one on top being depth deep
+	bool spend(std::uint64_t count, std::uint32_t depth);
+
+	bool fail(ErrorKind kind)
+	{
+		if (exceeded == ErrorKind::None)
+		{
+			exceeded = kind;
+			exceededAt = clock::now();
+		}
+
+		return false;
+	}
+
+	// Once the scene that went over budget is freed (learns how long that took)
+	void end_dropped_scene();
+};
+
+// Working buffers of the pipeline below, for decompiling scenes one after the other (one per thread)
+// They are cleared, never freed, between scenes: once they fit the largest scene seen, slicing, bk conversion and the
+// stack machine make no heap allocations, nor do flat asts (tree ast nodes, and their names past SSO length, still do)
+// So only flat asts (--flat-ast) decompile scenes without allocating, the default tree asts still allocate every node
+
+struct DecompileScratch
+{
+	std::vector<unsigned> sliceStarts;
+	OffsetMap<Span<const BcIns>> slices;
+	NameMap labels; // flat only, tree labels go to the SceneAst
+
+	std::vector<BcIns> fixedSlice;
+
+	std::vector<PendingStmt<std::unique_ptr<Expr>>> treePending;
+	std::vector<PendingStmt<FlatAst::index_type>> flatPending;
+
+	std::vector<Ast> spareAsts; // statement lists of recycled scenes, emptied
+
+	BudgetMeter meter; // set meter.budget (and call meter.start_file) to limit scenes decompiled through this
+
+	// Empties ast, keeping its statement lists (and label storage) for the next scene
+	void recycle(SceneAst& ast);
+};
+
+// Splits a script into slices of straight-line code, keyed by the offset of their first instruction
+template<bool IgnoreBranchAndKeeps = true>
+OffsetMap<Span<const BcIns>> slice_script(Span<const BcIns> script);
+
+// Same, into result (cleared first), sliceStarts is working storage
+template<bool IgnoreBranchAndKeeps = true>
+void slice_script(Span<const BcIns> script, OffsetMap<Span<const BcIns>>& result, std::vector<unsigned>& sliceStarts);
+
+// Same, checking slices against meter's budget as they are found and ticking it per instruction
+// Returns false once over budget, with stopLocation the instruction it got to
+bool slice_script(Span<const BcIns> script, OffsetMap<Span<const BcIns>>& result, std::vector<unsigned>& sliceStarts,
+	BudgetMeter& meter, unsigned& stopLocation);
+
+// Converts bky/bkn chains to fake land/lorr instructions (in place)
+Span<BcIns> convert_bks_to_fake_logic(Span<BcIns> slice);
+
+// Same, ticking meter once per instruction moved, returns false (leaving slice half converted) once past the deadline
+bool convert_bks_to_fake_logic(Span<BcIns> slice, BudgetMeter& meter);
+std::vector<BcIns> get_bks_as_fake_logic(Span<const BcIns> slice);
+
+// Runs the stack machine over a (bk-converted) slice, throws std::runtime_error on malformed input
+std::vector<Stmt> make_statements(const CmbInfo& script, const SceneInfo& scene, Span<const BcIns> slice);
+
+// Exception-free variant, reports to diags and returns false (leaving result empty) on malformed input
+bool try_make_statements(const CmbInfo& script, const SceneInfo& scene, Span<const BcIns> slice,
+	std::vector<Stmt>& result, Diagnostics& diags);
+
+// Same, appending to result (which should be empty) with the stack machine working in pending
+// Work is counted against meter if given, going over its budget fails the slice (with meter->exceeded set)
+bool try_make_statements(const CmbInfo& script, const SceneInfo& scene, Span<const BcIns> slice,
+	std::vector<Stmt>& result, std::vector<PendingStmt<std::unique_ptr<Expr>>>& pending, Diagnostics& diags,
+	BudgetMeter* meter = nullptr);
+
+// Names of every jump target within the given slices
+NameMap make_labels(const OffsetMap<Span<const BcIns>>& slices);
+
+// Same, into result (cleared first)
+void make_labels(const OffsetMap<Span<const BcIns>>& slices, NameMap& result);
+
+// Same, ticking meter per instruction and label, returns false once past the deadline
+bool make_labels(const OffsetMap<Span<const BcIns>>& slices, NameMap& result, BudgetMeter& meter);
+
+// Runs the entire pipeline above on one scene
+SceneAst decompile_scene(const CmbInfo& script, const SceneInfo& scene);
+
+// Exception-free variant, slices that fail to build are reported and left out
+bool try_decompile_scene(const CmbInfo& script, const SceneInfo& scene, SceneAst& result, Diagnostics& diags);
+
+// Same, with result recycled into scratch first (see DecompileScratch)
+// A scene going over scratch.meter.budget is reported and left empty
+bool try_decompile_scene(const CmbInfo& script, const SceneInfo& scene, SceneAst& result, DecompileScratch& scratch,
+	Diagnostics& diags);
+
+// Rewrites a (fully decompiled) scene into nested if/else/while statements (see Stmt::childAst)
+// Jumps that don't fit a single-entry region are left as gotos, labels still jumped to are moved to the statement they name
+// The result is a single slice at offset 0 and no slice labels. Returns false (leaving the scene untouched) if it can't be done
+bool structure_scene(SceneAst& ast);
+
+// Linearized scene ast: every slice, statement and expression of a scene in contiguous arrays
+
+struct FlatSlice
+{
+	unsigned offset;
+	SymbolTable::id_type label;
+	std::uint32_t firstStmt;
+	std::uint32_t stmtCnt;
+};
+
+struct FlatSceneAst
+{
+	std::vector<FlatSlice> slices;
+	FlatAst ast;
+
+	void clear()
+	{
+		slices.clear();
+		ast.clear();
+	}
+};
+
+// Same as try_make_statements, but appends to a flat ast
+bool make_flat_statements(const CmbInfo& script, const SceneInfo& scene, Span<const BcIns> slice,
+	FlatAst& ast, Diagnostics& diags);
+
+bool make_flat_statements(const CmbInfo& script, const SceneInfo& scene, Span<const BcIns> slice,
+	FlatAst& ast, std::vector<PendingStmt<FlatAst::index_type>>& pending, Diagnostics& diags,
+	BudgetMeter* meter = nullptr);
+
+// Same as try_decompile_scene, `result` is cleared first
+bool decompile_scene_flat(const CmbInfo& script, const SceneInfo& scene, FlatSceneAst& result, Diagnostics& diags);
+
+bool decompile_scene_flat(const CmbInfo& script, const SceneInfo& scene, FlatSceneAst& result, DecompileScratch& scratch,
+	Diagnostics& diags);
+
+FlatSceneAst make_flat_scene_ast(const SceneAst& sceneAst);
+SceneAst make_scene_ast(const FlatSceneAst& flatAst);
+
+} // namespace soren
+
+#endif // SOREN_DECOMPILE_INCLUDED
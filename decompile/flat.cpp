@@ -0,0 +1,149 @@
+#include "decompile/decompile.h"
+
+#include "core/stats.h"
+
+namespace soren {
+
+bool decompile_scene_flat(const CmbInfo& script, const SceneInfo& scene, FlatSceneAst& result, Diagnostics& diags)
+{
+	DecompileScratch scratch;
+
+	return decompile_scene_flat(script, scene, result, scratch, diags);
+}
+
+bool decompile_scene_flat(const CmbInfo& script, const SceneInfo& scene, FlatSceneAst& result, DecompileScratch& scratch,
+	Diagnostics& diags)
+{
+	result.clear();
+
+	auto& meter = scratch.meter;
+
+	// going over budget drops the whole scene
+	auto exceed = [&] (unsigned location)
+	{
+		diags.report(meter.exceeded, scene.scriptOffset + location, scene.idx);
+		result.clear();
+
+		meter.end_dropped_scene();
+		return false;
+	};
+
+	if (!meter.start_scene(false) || !meter.check_instructions(scene.rawScript.size()))
+		return exceed(0);
+
+	bool ok = true;
+
+	auto& slices = scratch.slices;
+	auto& labels = scratch.labels;
+
+	{
+		SOREN_STATS_PHASE(Slice);
+
+		unsigned stopLocation = 0;
+
+		if (!slice_script(scene.rawScript, slices, scratch.sliceStarts, meter, stopLocation))
+			return exceed(stopLocation);
+
+		if (!make_labels(slices, labels, meter))
+			return exceed(0);
+	}
+
+	SOREN_STATS_ADD(Slices, slices.size());
+
+	for (auto& slice : slices)
+	{
+		if (slice.second.empty())
+			continue;
+
+		auto& fixedSlice = scratch.fixedSlice;
+
+		{
+			SOREN_STATS_PHASE(BkConversion);
+
+			// TODO: check whether any bkn/bky jumps to another slice, because that would be bad
+			fixedSlice.assign(slice.second.begin(), slice.second.end());
+
+			if (!convert_bks_to_fake_logic(fixedSlice, meter))
+				return exceed(slice.first);
+		}
+
+		SOREN_STATS_PHASE(Statements);
+
+		const auto labelIt = labels.get(slice.first);
+
+		const auto label = (labelIt != labels.end())
+			? result.ast.symbols.intern(labelIt->second)
+			: SymbolTable::bad_id;
+
+		const std::uint32_t firstStmt = result.ast.statements.size();
+
+		if (!make_flat_statements(script, scene, fixedSlice, result.ast, scratch.flatPending, diags, &meter))
+		{
+			// reported by the stack machine already
+			if (meter.exceeded != ErrorKind::None)
+			{
+				result.clear();
+
+				meter.end_dropped_scene();
+				return false;
+			}
+
+			ok = false;
+			continue;
+		}
+
+		const std::uint32_t stmtCnt = result.ast.statements.size() - firstStmt;
+
+		SOREN_STATS_ADD(Statements, stmtCnt);
+
+		result.slices.push_back({ slice.first, label, firstStmt, stmtCnt });
+	}
+
+	return ok;
+}
+
+FlatSceneAst make_flat_scene_ast(const SceneAst& sceneAst)
+{
+	FlatSceneAst result;
+
+	for (auto& slice : sceneAst.slices)
+	{
+		const auto labelIt = sceneAst.labels.get(slice.first);
+
+		const auto label = (labelIt != sceneAst.labels.end())
+			? result.ast.symbols.intern(labelIt->second)
+			: SymbolTable::bad_id;
+
+		const std::uint32_t firstStmt = result.ast.statements.size();
+
+		for (auto& stmt : slice.second)
+			result.ast.append_stmt(stmt);
+
+		result.slices.push_back({ slice.first, label, firstStmt, static_cast<std::uint32_t>(slice.second.size()) });
+	}
+
+	return result;
+}
+
+SceneAst make_scene_ast(const FlatSceneAst& flatAst)
+{
+	SceneAst result;
+
+	for (auto& slice : flatAst.slices)
+	{
+		if (slice.label != SymbolTable::bad_id)
+			result.labels.set(slice.offset, std::string(flatAst.ast.symbols.c_str(slice.label), flatAst.ast.symbols.length(slice.label)));
+
+		Ast statements;
+		statements.reserve(slice.stmtCnt);
+
+		for (std::uint32_t i = 0; i < slice.stmtCnt; ++i)
+			statements.push_back(flatAst.ast.make_stmt(slice.firstStmt + i));
+
+		result.slices.set(slice.offset, std::move(statements));
+	}
+
+	return result;
+}
+
+} // namespace soren
@@ -0,0 +1,292 @@
+#include "decompile/decompile.h"
+#include "decompile/stack-machine.h"
+
+#include "core/stats.h"
+#include "ast/traverse.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace soren {
+
+// Builds the pointer-based ast
+
+struct TreeBuilder
+{
+	using ExprRef = std::unique_ptr<Expr>;
+
+	explicit TreeBuilder(std::vector<Stmt>& result)
+		: result(result) {}
+
+	ExprRef make_intlit(std::int32_t value)
+	{
+		SOREN_STATS_ONLY(nodeCnt++;)
+		return Expr::make_unique_intlit(value);
+	}
+
+	ExprRef make_strlit(const PoolString& value)
+	{
+		SOREN_STATS_ONLY(nodeCnt++;)
+		return Expr::make_unique_strlit(std::string(value.str, value.length));
+	}
+
+	ExprRef make_identifier(const std::string& name)
+	{
+		SOREN_STATS_ONLY(nodeCnt++;)
+		return Expr::make_unique_identifier(std::string(name));
+	}
+
+	ExprRef make_unop(Expr::Kind kind, ExprRef&& inner)
+	{
+		SOREN_STATS_ONLY(nodeCnt++;)
+		return Expr::make_unique_unop(kind, std::move(inner));
+	}
+
+	ExprRef make_binop(Expr::Kind kind, ExprRef&& lexpr, ExprRef&& rexpr)
+	{
+		SOREN_STATS_ONLY(nodeCnt++;)
+		return Expr::make_unique_binop(kind, std::move(lexpr), std::move(rexpr));
+	}
+
+	ExprRef make_call(const char* name, Span<PendingStmt<ExprRef>> args)
+	{
+		return make_call(name, std::strlen(name), args);
+	}
+
+	ExprRef make_call(const PoolString& name, Span<PendingStmt<ExprRef>> args)
+	{
+		return make_call(name.str, name.length, args);
+	}
+
+	ExprRef make_call(const char* name, std::size_t length, Span<PendingStmt<ExprRef>> args)
+	{
+		SOREN_STATS_ONLY(nodeCnt++;)
+
+		auto callexpr = std::make_unique<Expr>();
+
+		callexpr->kind = Expr::Kind::Func;
+		callexpr->named.assign(name, length);
+
+		for (auto& arg : args)
+			callexpr->children.push_back(std::move(arg.expr));
+
+		return callexpr;
+	}
+
+	ExprRef make_copy(const ExprRef& expr, BudgetMeter* meter)
+	{
+		SOREN_STATS_ONLY(nodeCnt++;)
+
+		if (meter == nullptr)
+			return Expr::make_unique_copy(*expr);
+
+		// copies can be as large as the node budget, the deadline is checked as they go
+		return copy_expr(*expr, [meter] () { return meter->tick(); });
+	}
+
+	void add_statement(Stmt::Kind kind, std::int32_t target, ExprRef&& expr)
+	{
+		switch (kind)
+		{
+
+		case Stmt::Kind::Goto:
+			result.push_back(Stmt::make_goto(target));
+			break;
+
+		case Stmt::Kind::GotoIf:
+			result.push_back(Stmt::make_goto_if(target, std::move(expr)));
+			break;
+
+		case Stmt::Kind::Yield:
+			result.push_back(Stmt::make_yield());
+			break;
+
+		default:
+			result.push_back(Stmt { kind, {}, {} });
+			result.back().children.push_back(std::move(expr));
+			break;
+
+		} // switch (kind)
+	}
+
+	std::vector<Stmt>& result;
+	SOREN_STATS_ONLY(std::uint64_t nodeCnt { 0u };)
+};
+
+// Builds the linearized ast, appending only
+
+struct FlatBuilder
+{
+	using ExprRef = FlatAst::index_type;
+
+	explicit FlatBuilder(FlatAst& ast)
+		: ast(ast) {}
+
+	ExprRef make_intlit(std::int32_t value)
+	{
+		return ast.add_leaf(Expr::Kind::IntLiteral, value, SymbolTable::bad_id);
+	}
+
+	ExprRef make_strlit(const PoolString& value)
+	{
+		return ast.add_leaf(Expr::Kind::StrLiteral, 0, ast.symbols.intern(value));
+	}
+
+	ExprRef make_identifier(const std::string& name)
+	{
+		return ast.add_leaf(Expr::Kind::Named, 0, ast.symbols.intern(name));
+	}
+
+	ExprRef make_unop(Expr::Kind kind, ExprRef inner)
+	{
+		return ast.add_node(kind, SymbolTable::bad_id, inner);
+	}
+
+	ExprRef make_binop(Expr::Kind kind, ExprRef lexpr, ExprRef rexpr)
+	{
+		return ast.add_node(kind, SymbolTable::bad_id, lexpr, rexpr);
+	}
+
+	ExprRef make_call(const char* name, Span<PendingStmt<ExprRef>> args)
+	{
+		return make_call(ast.symbols.intern(name), args);
+	}
+
+	ExprRef make_call(const PoolString& name, Span<PendingStmt<ExprRef>> args)
+	{
+		return make_call(ast.symbols.intern(name), args);
+	}
+
+	ExprRef make_call(SymbolTable::id_type name, Span<PendingStmt<ExprRef>> args)
+	{
+		const std::uint32_t firstChild = ast.links.size();
+
+		for (auto& arg : args)
+			ast.links.push_back(arg.expr);
+
+		return ast.add_node_linked(Expr::Kind::Func, name, firstChild, args.size());
+	}
+
+	ExprRef make_copy(ExprRef expr, BudgetMeter*)
+	{
+		// nodes are immutable, share instead of copying
+		return expr;
+	}
+
+	void add_statement(Stmt::Kind kind, std::int32_t target, ExprRef expr)
+	{
+		switch (kind)
+		{
+
+		case Stmt::Kind::Goto:
+			ast.add_statement(kind, SymbolTable::bad_id, ast.links.size(), 1);
+			ast.links.push_back(make_label(target));
+			break;
+
+		case Stmt::Kind::GotoIf:
+		{
+			const auto label = make_label(target);
+
+			ast.add_statement(kind, SymbolTable::bad_id, ast.links.size(), 2);
+			ast.links.push_back(label);
+			ast.links.push_back(expr);
+
+			break;
+		}
+
+		case Stmt::Kind::Yield:
+			ast.add_statement(kind, SymbolTable::bad_id, 0, 0);
+			break;
+
+		default:
+			ast.add_statement(kind, SymbolTable::bad_id, ast.links.size(), 1);
+			ast.links.push_back(expr);
+			break;
+
+		} // switch (kind)
+	}
+
+	ExprRef make_label(std::int32_t target)
+	{
+		// same as what Stmt::make_goto does
+
+		char buf[32];
+		const auto len = std::snprintf(buf, sizeof(buf), "label_%d", target);
+
+		return ast.add_leaf(Expr::Kind::Named, 0, ast.symbols.intern(buf, len));
+	}
+
+	FlatAst& ast;
+};
+
+bool try_make_statements(const CmbInfo& script, const SceneInfo& scene, Span<const BcIns> slice,
+	std::vector<Stmt>& result, Diagnostics& diags)
+{
+	std::vector<PendingStmt<TreeBuilder::ExprRef>> pending;
+
+	result.clear();
+
+	return try_make_statements(script, scene, slice, result, pending, diags);
+}
+
+bool try_make_statements(const CmbInfo& script, const SceneInfo& scene, Span<const BcIns> slice,
+	std::vector<Stmt>& result, std::vector<PendingStmt<std::unique_ptr<Expr>>>& pending, Diagnostics& diags,
+	BudgetMeter* meter)
+{
+	TreeBuilder builder(result);
+	result.reserve(slice.size());
+
+	pending.clear();
+	pending.reserve(slice.size());
+
+	if (!run_stack_machine(script, scene, slice, builder, pending, diags, meter))
+	{
+		result.clear();
+		return false;
+	}
+
+	SOREN_STATS_ADD(ExprNodes, builder.nodeCnt);
+
+	return true;
+}
+
+std::vector<Stmt> make_statements(const CmbInfo& script, const SceneInfo& scene, Span<const BcIns> slice)
+{
+	std::vector<Stmt> result;
+	Diagnostics diags;
+
+	if (!try_make_statements(script, scene, slice, result, diags))
+		throw std::runtime_error(get_error_message(diags.list.front().kind)); // TODO: better error
+
+	return result;
+}
+
+bool make_flat_statements(const CmbInfo& script, const SceneInfo& scene, Span<const BcIns> slice,
+	FlatAst& ast, Diagnostics& diags)
+{
+	std::vector<PendingStmt<FlatBuilder::ExprRef>> pending;
+
+	return make_flat_statements(script, scene, slice, ast, pending, diags);
+}
+
+bool make_flat_statements(const CmbInfo& script, const SceneInfo& scene, Span<const BcIns> slice,
+	FlatAst& ast, std::vector<PendingStmt<FlatAst::index_type>>& pending, Diagnostics& diags,
+	BudgetMeter* meter)
+{
+	FlatBuilder builder(ast);
+
+	pending.clear();
+	pending.reserve(slice.size());
+
+	SOREN_STATS_ONLY(const auto exprCnt = ast.exprs.size();)
+
+	if (!run_stack_machine(script, scene, slice, builder, pending, diags, meter))
+		return false;
+
+	SOREN_STATS_ADD(ExprNodes, ast.exprs.size() - exprCnt);
+
+	return true;
+}
+
+} // namespace soren
@@ -0,0 +1,472 @@
+#include "decompile/decompile.h"
+
+#include "core/stats.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+namespace soren {
+
+// Stands in for a BudgetMeter when there is none
+struct NoBudget
+{
+	bool tick() { return true; }
+	bool check_slices(std::size_t) { return true; }
+};
+
+template<bool IgnoreBranchAndKeeps, typename Budget>
+static
+bool slice(Span<const BcIns> script, OffsetMap<Span<const BcIns>>& result, std::vector<unsigned>& sliceStarts,
+	Budget& budget, unsigned& stopLocation)
+{
+	result.clear();
+
+	if (script.empty())
+		return true;
+
+	// Step 1: Find slice starts (instructions, counted as they are found)
+
+	sliceStarts.assign(script.size(), 0u);
+	sliceStarts[0] = 1u;
+
+	std::size_t sliceCnt = 1;
+
+	// a slice starts at the first instruction at or past offset
+	auto start_slice = [&] (unsigned offset)
+	{
+		const auto it = std::lower_bound(script.begin(), script.end(), offset,
+			[] (const BcIns& ins, unsigned offset) { return ins.location < offset; });
+
+		if (it == script.end() || sliceStarts[it - script.begin()] != 0)
+			return true;
+
+		sliceStarts[it - script.begin()] = 1u;
+		return budget.check_slices(++sliceCnt);
+	};
+
+	for (auto& ins : script)
+	{
+		stopLocation = ins.location;
+
+		if (!budget.tick())
+			return false;
+
+		if (IgnoreBranchAndKeeps && ins.is_jump_keep())
+			continue;
+
+		if (ins.is_jump())
+		{
+			// jumps generate:
+			// a slice after themselves
+			// a slice before the jump target
+			// a label before the jump target
+
+			if (!start_slice(ins.location + 1 + ins.info().operandSize) || !start_slice(ins.operand))
+				return false;
+		}
+
+		if (ins.is_end())
+		{
+			// ends generate slices after themselves
+			if (!start_slice(ins.location + 1))
+				return false;
+		}
+	}
+
+	// Step 2: Slice
+
+	std::size_t begin = 0;
+
+	for (std::size_t i = 1; i <= script.size(); ++i)
+	{
+		if (i != script.size() && sliceStarts[i] == 0)
+			continue;
+
+		stopLocation = script[begin].location;
+
+		if (!budget.tick())
+			return false;
+
+		result.set(script[begin].location, { script.begin() + begin, script.begin() + i });
+		begin = i;
+	}
+
+	return true;
+}
+
+template<bool IgnoreBranchAndKeeps>
+OffsetMap<Span<const BcIns>> slice_script(Span<const BcIns> script)
+{
+	OffsetMap<Span<const BcIns>> result;
+	std::vector<unsigned> sliceStarts;
+
+	slice_script<IgnoreBranchAndKeeps>(script, result, sliceStarts);
+
+	return result;
+}
+
+template<bool IgnoreBranchAndKeeps>
+void slice_script(Span<const BcIns> script, OffsetMap<Span<const BcIns>>& result, std::vector<unsigned>& sliceStarts)
+{
+	NoBudget budget;
+	unsigned stopLocation;
+
+	slice<IgnoreBranchAndKeeps>(script, result, sliceStarts, budget, stopLocation);
+}
+
+bool slice_script(Span<const BcIns> script, OffsetMap<Span<const BcIns>>& result, std::vector<unsigned>& sliceStarts,
+	BudgetMeter& meter, unsigned& stopLocation)
+{
+	return slice<true>(script, result, sliceStarts, meter, stopLocation);
+}
+
+template<typename Tick>
+static
+bool convert_bks(Span<BcIns> slice, Tick tick)
+{
+	// Converts bky/bkn chains to fake land/lorr instructions and reorder accordingly
+	// ex:
+	/*
+	 * 0 val 0
+	 * 2 bkn 7
+	 * 5 val 1
+	 * 7 bn ...
+	 */
+	// becomes
+	/*
+	 * 0 val 0
+	 * 5 val 1
+	 * 2 fake!land
+	 * 7 bn ...
+	 */
+
+	for (unsigned i = 0; i < slice.size(); ++i)
+	{
+		unsigned op = slice[i].opcode;
+
+		switch (op)
+		{
+
+		case BC_OPCODE_BKN:
+		case BC_OPCODE_BKY:
+		{
+			// Move the bkn/bky to just before the jump target, and replace it with a fake and/or
+
+			unsigned target = slice[i++].operand;
+			unsigned j = i;
+
+			while (j < slice.size() && slice[j].location != target)
+			{
+				// long chains (or far targets) make this quadratic
+				if (!tick())
+					return false;
+
+				std::swap(slice[j-1], slice[j]);
+				j++;
+			}
+
+			slice[j-1].opcode = (op == BC_OPCODE_BKN) ? BC_FAKEOP_LAND : BC_FAKEOP_LORR;
+			slice[j-1].operand = 0;
+		}
+
+		default:
+			continue;
+
+		} // switch (op)
+	}
+
+	return true;
+}
+
+Span<BcIns> convert_bks_to_fake_logic(Span<BcIns> slice)
+{
+	convert_bks(slice, [] () { return true; });
+	return slice;
+}
+
+bool convert_bks_to_fake_logic(Span<BcIns> slice, BudgetMeter& meter)
+{
+	return convert_bks(slice, [&] () { return meter.move(); });
+}
+
+std::vector<BcIns> get_bks_as_fake_logic(Span<const BcIns> slice)
+{
+	std::vector<BcIns> result(slice.begin(), slice.end());
+	convert_bks_to_fake_logic(result);
+
+	return result;
+}
+
+NameMap make_labels(const OffsetMap<Span<const BcIns>>& slices)
+{
+	NameMap result;
+	make_labels(slices, result);
+
+	return result;
+}
+
+template<typename Budget>
+static
+bool make_labels(const OffsetMap<Span<const BcIns>>& slices, NameMap& result, Budget& budget)
+{
+	result.clear();
+
+	// targets are sorted first, setting them in jump order would insert in the middle of result (quadratic)
+	static thread_local std::vector<unsigned> targets;
+	targets.clear();
+
+	for (auto& slice : slices)
+	{
+		for (auto& ins : slice.second)
+		{
+			if (!budget.tick())
+				return false;
+
+			if (ins.is_jump() && !ins.is_jump_keep())
+				targets.push_back(ins.operand);
+		}
+	}
+
+	std::sort(targets.begin(), targets.end());
+	targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+	for (auto target : targets)
+	{
+		if (!budget.tick())
+			return false;
+
+		result.set(target, [&] () { std::string r("label_"); r.append(std::to_string(target)); return r; } ());
+	}
+
+	return true;
+}
+
+void make_labels(const OffsetMap<Span<const BcIns>>& slices, NameMap& result)
+{
+	NoBudget budget;
+	make_labels(slices, result, budget);
+}
+
+bool make_labels(const OffsetMap<Span<const BcIns>>& slices, NameMap& result, BudgetMeter& meter)
+{
+	return make_labels<BudgetMeter>(slices, result, meter);
+}
+
+void BudgetMeter::start_file()
+{
+	fileDeadline = (budget.fileMs != 0)
+		? clock::now() + std::chrono::milliseconds(budget.fileMs)
+		: clock::time_point::max();
+}
+
+bool BudgetMeter::start_scene(bool freesNodes)
+{
+	this->freesNodes = freesNodes;
+
+	nodes = 0;
+	moves = 0;
+	ticks = 0;
+	nextCheck = std::numeric_limits<std::uint64_t>::max();
+	exceeded = ErrorKind::None;
+
+	deadline = fileDeadline;
+
+	if (budget.sceneMs != 0)
+		deadline = std::min(deadline, clock::now() + std::chrono::milliseconds(budget.sceneMs));
+
+	return deadline == clock::time_point::max() || check_deadline();
+}
+
+bool BudgetMeter::check_deadline()
+{
+	const auto now = clock::now();
+
+	// nodes is at most the node budget (if any), don't overflow past it
+	const auto freeTime = freesNodes
+		? freeTimePerNode * static_cast<clock::rep>(std::min<std::uint64_t>(nodes, 1ull << 32))
+		: clock::duration::zero();
+
+	if (now + freeTime < deadline)
+	{
+		nextCheck = ticks + 1024;
+		return true;
+	}
+
+	return fail((deadline == fileDeadline) ? ErrorKind::FileDeadlineExceeded : ErrorKind::SceneDeadlineExceeded);
+}
+
+bool BudgetMeter::check_instructions(std::size_t count)
+{
+	if (budget.instructions != 0 && count > budget.instructions)
+		return fail(ErrorKind::InstructionBudgetExceeded);
+
+	return true;
+}
+
+bool BudgetMeter::check_slices(std::size_t count)
+{
+	if (budget.slices != 0 && count > budget.slices)
+		return fail(ErrorKind::SliceBudgetExceeded);
+
+	return true;
+}
+
+bool BudgetMeter::spend(std::uint64_t count, std::uint32_t depth)
+{
+	// nodes over the budget aren't made, so aren't counted
+	if (budget.nodes != 0 && (nodes > budget.nodes || count > budget.nodes - nodes))
+		return fail(ErrorKind::NodeBudgetExceeded);
+
+	nodes = (nodes > std::numeric_limits<std::uint64_t>::max() - count) ? std::numeric_limits<std::uint64_t>::max() : nodes + count;
+
+	if (budget.depth != 0 && depth > budget.depth)
+		return fail(ErrorKind::DepthBudgetExceeded);
+
+	return tick(count);
+}
+
+void BudgetMeter::end_dropped_scene()
+{
+	// nothing freed node by node, too few nodes to time, or more than were made (no node budget to stop dup chains)
+	if (!freesNodes || nodes < 4096 || nodes > (1ull << 32))
+		return;
+
+	const auto freeTime = (clock::now() - exceededAt) / static_cast<clock::rep>(nodes);
+
+	// rather too long than too short
+	freeTimePerNode = std::max(freeTime + freeTime / 4, freeTimePerNode - freeTimePerNode / 16);
+}
+
+void DecompileScratch::recycle(SceneAst& ast)
+{
+	for (auto& slice : ast.slices)
+	{
+		if (slice.second.capacity() == 0)
+			continue;
+
+		slice.second.clear();
+		spareAsts.push_back(std::move(slice.second));
+	}
+
+	ast.slices.clear();
+	ast.labels.clear();
+}
+
+bool try_decompile_scene(const CmbInfo& script, const SceneInfo& scene, SceneAst& result, Diagnostics& diags)
+{
+	DecompileScratch scratch;
+
+	result = SceneAst();
+
+	return try_decompile_scene(script, scene, result, scratch, diags);
+}
+
+bool try_decompile_scene(const CmbInfo& script, const SceneInfo& scene, SceneAst& result, DecompileScratch& scratch,
+	Diagnostics& diags)
+{
+	scratch.recycle(result);
+
+	auto& meter = scratch.meter;
+
+	// going over budget drops the whole scene
+	auto exceed = [&] (unsigned location)
+	{
+		diags.report(meter.exceeded, scene.scriptOffset + location, scene.idx);
+		scratch.recycle(result);
+
+		meter.end_dropped_scene();
+		return false;
+	};
+
+	if (!meter.start_scene(true) || !meter.check_instructions(scene.rawScript.size()))
+		return exceed(0);
+
+	bool ok = true;
+
+	auto& slices = scratch.slices;
+
+	{
+		SOREN_STATS_PHASE(Slice);
+
+		unsigned stopLocation = 0;
+
+		if (!slice_script(scene.rawScript, slices, scratch.sliceStarts, meter, stopLocation))
+			return exceed(stopLocation);
+
+		if (!make_labels(slices, result.labels, meter))
+			return exceed(0);
+	}
+
+	SOREN_STATS_ADD(Slices, slices.size());
+
+	for (auto& slice : slices)
+	{
+		if (slice.second.empty())
+			continue;
+
+		auto& fixedSlice = scratch.fixedSlice;
+
+		{
+			SOREN_STATS_PHASE(BkConversion);
+
+			// TODO: check whether any bkn/bky jumps to another slice, because that would be bad
+			fixedSlice.assign(slice.second.begin(), slice.second.end());
+
+			if (!convert_bks_to_fake_logic(fixedSlice, meter))
+				return exceed(slice.first);
+		}
+
+		SOREN_STATS_PHASE(Statements);
+
+		Ast statements;
+
+		if (!scratch.spareAsts.empty())
+		{
+			statements = std::move(scratch.spareAsts.back());
+			scratch.spareAsts.pop_back();
+		}
+
+		if (!try_make_statements(script, scene, fixedSlice, statements, scratch.treePending, diags, &meter))
+		{
+			scratch.spareAsts.push_back(std::move(statements));
+
+			// reported by the stack machine already
+			if (meter.exceeded != ErrorKind::None)
+			{
+				scratch.recycle(result);
+
+				meter.end_dropped_scene();
+				return false;
+			}
+
+			ok = false;
+			continue;
+		}
+
+		SOREN_STATS_ADD(Statements, statements.size());
+
+		result.slices.set(slice.first, std::move(statements));
+	}
+
+	return ok;
+}
+
+SceneAst decompile_scene(const CmbInfo& script, const SceneInfo& scene)
+{
+	SceneAst result;
+	Diagnostics diags;
+
+	if (!try_decompile_scene(script, scene, result, diags))
+		throw std::runtime_error(get_error_message(diags.list.front().kind)); // TODO: better error
+
+	return result;
+}
+
+template OffsetMap<Span<const BcIns>> slice_script<true>(Span<const BcIns> script);
+template OffsetMap<Span<const BcIns>> slice_script<false>(Span<const BcIns> script);
+
+template void slice_script<true>(Span<const BcIns> script, OffsetMap<Span<const BcIns>>& result, std::vector<unsigned>& sliceStarts);
+template void slice_script<false>(Span<const BcIns> script, OffsetMap<Span<const BcIns>>& result, std::vector<unsigned>& sliceStarts);
+
+} // namespace soren
@@ -0,0 +1,710 @@
+#ifndef SOREN_DECOMPILE_STACK_MACHINE_INCLUDED
+#define SOREN_DECOMPILE_STACK_MACHINE_INCLUDED
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <limits>
+
+#include "core/types.h"
+#include "core/diagnostics.h"
+#include "core/soren-bytecode.h"
+#include "core/soren-cmb.h"
+
+#include "ast/expr.h"
+#include "ast/stmt.h"
+
+#include "decompile/decompile.h"
+
+namespace soren {
+
+// Runs the stack machine over a (bk-converted) slice, creating nodes through the given builder
+// This is the one place where instruction semantics live, builders only decide how nodes are stored
+//
+// Builder interface:
+//   using ExprRef = ...;
+//   ExprRef make_intlit(std::int32_t value);
+//   ExprRef make_strlit(const PoolString& value);
+//   ExprRef make_identifier(const std::string& name);
+//   ExprRef make_unop(Expr::Kind kind, ExprRef&& inner);
+//   ExprRef make_binop(Expr::Kind kind, ExprRef&& lexpr, ExprRef&& rexpr);
+//   ExprRef make_call(const char* name, Span<PendingStmt<ExprRef>> args); // args are pushes, take their expr
+//   ExprRef make_call(const PoolString& name, Span<PendingStmt<ExprRef>> args);
+//   ExprRef make_copy(const ExprRef& expr, BudgetMeter* meter); // may tick meter, returns null once it runs out
+//   void add_statement(Stmt::Kind kind, std::int32_t target, ExprRef&& expr);
+//
+// `result` is working storage, it is left empty on return
+// Nothing here throws: on malformed input, the issue is reported to diags, no statement is added and false is returned
+// The same goes for going over the budget of meter (if any), which is checked before any node is made or copied (and
+// its deadline while copying)
+
+template<typename Builder>
+bool run_stack_machine(const CmbInfo& script, const SceneInfo& scene, Span<const BcIns> slice,
+	Builder& builder, std::vector<PendingStmt<typename Builder::ExprRef>>& result, Diagnostics& diags,
+	BudgetMeter* meter)
+{
+	using ExprRef = typename Builder::ExprRef;
+
+	result.clear();
+
+	// set by the helpers below, checked after each instruction
+	ErrorKind error = ErrorKind::None;
+
+	const auto fail = [&] (ErrorKind kind)
+	{
+		if (error == ErrorKind::None)
+			error = kind;
+	};
+
+	const auto abort = [&] (const BcIns& ins)
+	{
+		diags.report(error, scene.scriptOffset + ins.location, scene.idx);
+		result.clear();
+
+		return false;
+	};
+
+	const auto push = [&] (ExprRef&& expr, std::uint32_t depth, std::uint64_t size)
+	{
+		result.push_back({ Stmt::Kind::Push, 0, std::move(expr), depth, size });
+	};
+
+	// sizes saturate, nothing else stops dup chains from doubling them without a node budget
+	const auto add_size = [] (std::uint64_t a, std::uint64_t b) -> std::uint64_t
+	{
+		return (a > std::numeric_limits<std::uint64_t>::max() - b) ? std::numeric_limits<std::uint64_t>::max() : a + b;
+	};
+
+	// accounts for making count nodes, the top one depth deep
+	const auto spend = [&] (std::uint64_t count, std::uint32_t depth)
+	{
+		if (meter == nullptr || meter->spend(count, depth))
+			return true;
+
+		fail(meter->exceeded);
+		return false;
+	};
+
+	const auto expect_push = [&] (const char*, auto func)
+	{
+		if (result.size() < 1 || result.back().kind != Stmt::Kind::Push)
+			return fail(ErrorKind::ExpectedPush); // TODO: say which instruction ("name" only expected after push)
+
+		func(result.back());
+	};
+
+	const auto expect_push_push = [&] (const char*, auto func)
+	{
+		if (result.size() < 2)
+			return fail(ErrorKind::ExpectedPush); // TODO: say which instruction ("name" as first instruction)
+
+		if (result.back().kind != Stmt::Kind::Push)
+			return fail(ErrorKind::ExpectedPush); // TODO: say which instruction ("name" only expected after 2 pushes)
+
+		auto& rop = result.back();
+
+		if (result[result.size()-2].kind != Stmt::Kind::Push)
+			return fail(ErrorKind::ExpectedPush); // TODO: say which instruction ("name" only expected after 2 pushes)
+
+		auto& lop = result[result.size()-2];
+
+		func(lop, rop);
+	};
+
+	const auto unop = [&] (const char* name, Expr::Kind kind)
+	{
+		expect_push(name, [&] (auto& back)
+		{
+			if (!spend(1, back.depth + 1))
+				return;
+
+			back.expr = builder.make_unop(kind, std::move(back.expr));
+			back.depth += 1;
+			back.size = add_size(back.size, 1);
+		});
+	};
+
+	const auto binop = [&] (const char* name, Expr::Kind kind)
+	{
+		expect_push_push(name, [&] (auto& l, auto& r)
+		{
+			const auto depth = std::max(l.depth, r.depth) + 1;
+			const auto size = add_size(add_size(l.size, r.size), 1);
+
+			if (!spend(1, depth))
+				return;
+
+			auto lexpr = std::move(l.expr);
+			auto rexpr = std::move(r.expr);
+
+			result.pop_back();
+			result.pop_back();
+
+			push(builder.make_binop(kind, std::move(lexpr), std::move(rexpr)), depth, size);
+		});
+	};
+
+	const auto call = [&] (const auto& funcname, unsigned argCnt)
+	{
+		if (result.size() < argCnt)
+			return fail(ErrorKind::ExpectedPush); // TODO: say which instruction (call expected after x pushes)
+
+		for (unsigned i = result.size() - argCnt; i < result.size(); ++i)
+			if (result[i].kind != Stmt::Kind::Push)
+				return fail(ErrorKind::ExpectedPush); // TODO: say which instruction (call expexted after x pushes)
+
+		std::uint32_t depth = 1;
+		std::uint64_t size = 1;
+
+		for (unsigned i = result.size() - argCnt; i < result.size(); ++i)
+		{
+			depth = std::max(depth, result[i].depth + 1);
+			size = add_size(size, result[i].size);
+		}
+
+		if (!spend(1, depth))
+			return;
+
+		auto callexpr = builder.make_call(funcname,
+			Span<PendingStmt<ExprRef>>(result.data() + result.size() - argCnt, argCnt));
+
+		result.resize(result.size() - argCnt);
+		push(std::move(callexpr), depth, size);
+	};
+
+	const auto variable = [&] (const std::string& name)
+	{
+		return builder.make_identifier(name);
+	};
+
+	const auto variable_ref = [&] (const std::string& name)
+	{
+		return builder.make_unop(Expr::Kind::Addrof, builder.make_identifier(name));
+	};
+
+	const auto push_variable = [&] (const std::string& name)
+	{
+		if (spend(1, 1))
+			push(variable(name), 1, 1);
+	};
+
+	const auto push_variable_ref = [&] (const std::string& name)
+	{
+		if (spend(2, 2))
+			push(variable_ref(name), 2, 2);
+	};
+
+	// push a => push [&name + a]
+	const auto index_variable = [&] (auto& back, const std::string& name)
+	{
+		const auto depth = std::max<std::uint32_t>(back.depth, 2) + 2;
+
+		if (!spend(4, depth))
+			return;
+
+		back.expr = builder.make_unop(Expr::Kind::Deref,
+			builder.make_binop(Expr::Kind::Add,
+				variable_ref(name),
+				std::move(back.expr)));
+
+		back.depth = depth;
+		back.size = add_size(back.size, 4);
+	};
+
+	// push a => push &name + a
+	const auto offset_variable_ref = [&] (auto& back, const std::string& name)
+	{
+		const auto depth = std::max<std::uint32_t>(back.depth, 2) + 1;
+
+		if (!spend(3, depth))
+			return;
+
+		back.expr = builder.make_binop(Expr::Kind::Add,
+			variable_ref(name),
+			std::move(back.expr));
+
+		back.depth = depth;
+		back.size = add_size(back.size, 3);
+	};
+
+	for (auto& ins : slice)
+	{
+		if (meter != nullptr && !meter->tick())
+			fail(meter->exceeded);
+
+		// operand checks, so that nothing below indexes out of bounds
+		// pool strings are looked up once, here (they were measured and hashed when decoding, see StringPoolIndex)
+
+		PoolString str { nullptr, 0u, 0u, 0u };
+
+		switch (ins.opcode)
+		{
+
+		case BC_OPCODE_VAL8: case BC_OPCODE_VAL16:
+		case BC_OPCODE_VALX8: case BC_OPCODE_VALX16:
+		case BC_OPCODE_REF8: case BC_OPCODE_REF16:
+		case BC_OPCODE_REFX8: case BC_OPCODE_REFX16:
+			if (static_cast<std::uint32_t>(ins.operand) >= scene.varnames.size())
+				fail(ErrorKind::BadVariableIndex);
+
+			break;
+
+		case BC_OPCODE_GVAL8: case BC_OPCODE_GVAL16:
+		case BC_OPCODE_GVALX8: case BC_OPCODE_GVALX16:
+		case BC_OPCODE_GREF8: case BC_OPCODE_GREF16:
+		case BC_OPCODE_GREFX8: case BC_OPCODE_GREFX16:
+			if (static_cast<std::uint32_t>(ins.operand) >= script.globalNames.size())
+				fail(ErrorKind::BadGlobalIndex);
+
+			break;
+
+		case BC_OPCODE_STRING8:
+		case BC_OPCODE_STRING16:
+		case BC_OPCODE_STRING32:
+			str = script.find_string(ins.operand);
+
+			if (str.str == nullptr)
+				fail(ErrorKind::BadStringOffset);
+
+			break;
+
+		case BC_OPCODE_CALL:
+			if (static_cast<std::uint32_t>(ins.operand) >= script.scenes.size())
+				fail(ErrorKind::BadSceneIndex);
+
+			break;
+
+		case BC_OPCODE_CALLEXT:
+			str = script.find_string(static_cast<std::uint32_t>(ins.operand) >> 8);
+
+			if (str.str == nullptr)
+				fail(ErrorKind::BadStringOffset);
+
+			break;
+
+		} // switch (ins.opcode)
+
+		if (error != ErrorKind::None)
+			return abort(ins);
+
+		switch (ins.opcode)
+		{
+
+		case BC_OPCODE_NOP:
+			// nothing
+
+			break;
+
+		case BC_OPCODE_VAL8:
+		case BC_OPCODE_VAL16:
+			// push varname
+
+			push_variable(scene.varnames[ins.operand]);
+			break;
+
+		case BC_OPCODE_VALX8:
+		case BC_OPCODE_VALX16:
+			// push a => push [&varname + a]
+
+			expect_push("valx", [&] (auto& back)
+			{
+				index_variable(back, scene.varnames[ins.operand]);
+			});
+
+			break;
+
+		case BC_OPCODE_REF8:
+		case BC_OPCODE_REF16:
+			// push &varname
+
+			push_variable_ref(scene.varnames[ins.operand]);
+			break;
+
+		case BC_OPCODE_REFX8:
+		case BC_OPCODE_REFX16:
+			// push a => push &varname + a
+
+			expect_push("refx", [&] (auto& back)
+			{
+				offset_variable_ref(back, scene.varnames[ins.operand]);
+			});
+
+			break;
+
+		case BC_OPCODE_GVAL8:
+		case BC_OPCODE_GVAL16:
+			// push varname
+
+			push_variable(script.globalNames[ins.operand]);
+			break;
+
+		case BC_OPCODE_GVALX8:
+		case BC_OPCODE_GVALX16:
+			// push a => push [&varname + a]
+
+			expect_push("valx", [&] (auto& back)
+			{
+				index_variable(back, script.globalNames[ins.operand]);
+			});
+
+			break;
+
+		case BC_OPCODE_GREF8:
+		case BC_OPCODE_GREF16:
+			// push &varname
+
+			push_variable_ref(script.globalNames[ins.operand]);
+			break;
+
+		case BC_OPCODE_GREFX8:
+		case BC_OPCODE_GREFX16:
+			// push a => push &varname + a
+
+			expect_push("refx", [&] (auto& back)
+			{
+				offset_variable_ref(back, script.globalNames[ins.operand]);
+			});
+
+			break;
+
+		case BC_OPCODE_NUMBER8:
+		case BC_OPCODE_NUMBER16:
+		case BC_OPCODE_NUMBER32:
+			// push imm
+
+			if (spend(1, 1))
+				push(builder.make_intlit(ins.operand), 1, 1);
+
+			break;
+
+		case BC_OPCODE_STRING8:
+		case BC_OPCODE_STRING16:
+		case BC_OPCODE_STRING32:
+			// push <string at imm>
+
+			if (spend(1, 1))
+				push(builder.make_strlit(str), 1, 1);
+
+			break;
+
+		case BC_OPCODE_DEREF:
+			// push a => push a, [a]
+
+			expect_push("deref", [&] (auto& back)
+			{
+				const auto depth = back.depth + 1;
+				const auto size = add_size(back.size, 1);
+
+				// before copying, which is what would blow up
+				if (!spend(size, depth))
+					return;
+
+				auto copy = builder.make_copy(back.expr, meter);
+
+				if (meter != nullptr && meter->exceeded != ErrorKind::None)
+					return fail(meter->exceeded);
+
+				push(builder.make_unop(Expr::Kind::Deref, std::move(copy)), depth, size);
+			});
+
+			break;
+
+		case BC_OPCODE_DISC:
+			// push a => a
+
+			expect_push("disc", [&] (auto& back)
+			{
+				back.kind = Stmt::Kind::Expr;
+			});
+
+			break;
+
+		case BC_OPCODE_STORE:
+			// push a, b => push [a] = b
+
+			binop("store", Expr::Kind::Assign);
+			break;
+
+		case BC_OPCODE_ADD:
+			// push a, b => push a + b
+
+			binop("add", Expr::Kind::Add);
+			break;
+
+		case BC_OPCODE_SUB:
+			// push a, b => push a - b
+
+			binop("sub", Expr::Kind::Sub);
+			break;
+
+		case BC_OPCODE_MUL:
+			// push a, b => push a * b
+
+			binop("mul", Expr::Kind::Mul);
+			break;
+
+		case BC_OPCODE_DIV:
+			// push a, b => push a / b
+
+			binop("div", Expr::Kind::Div);
+			break;
+
+		case BC_OPCODE_MOD:
+			// push a, b => push a % b
+
+			binop("mod", Expr::Kind::Mod);
+			break;
+
+		case BC_OPCODE_ORR:
+			// push a, b => push a | b
+
+			binop("orr", Expr::Kind::Or);
+			break;
+
+		case BC_OPCODE_AND:
+			// push a, b => push a & b
+
+			binop("and", Expr::Kind::And);
+			break;
+
+		case BC_OPCODE_XOR:
+			// push a, b => push a ^ b
+
+			binop("xor", Expr::Kind::Xor);
+			break;
+
+		case BC_OPCODE_LSL:
+			// push a, b => push a << b
+
+			binop("lsl", Expr::Kind::Lsl);
+			break;
+
+		case BC_OPCODE_LSR:
+			// push a, b => push a >> b
+
+			binop("lsr", Expr::Kind::Lsr);
+			break;
+
+		case BC_OPCODE_EQ:
+			// push a, b => push a == b
+
+			binop("eq", Expr::Kind::Eq);
+			break;
+
+		case BC_OPCODE_NE:
+			// push a, b => push a != b
+
+			binop("ne", Expr::Kind::Ne);
+			break;
+
+		case BC_OPCODE_LT:
+			// push a, b => push a < b
+
+			binop("lt", Expr::Kind::Lt);
+			break;
+
+		case BC_OPCODE_LE:
+			// push a, b => push a <= b
+
+			binop("le", Expr::Kind::Le);
+			break;
+
+		case BC_OPCODE_GT:
+			// push a, b => push a > b
+
+			binop("gt", Expr::Kind::Gt);
+			break;
+
+		case BC_OPCODE_GE:
+			// push a, b => push a >= b
+
+			binop("ge", Expr::Kind::Ge);
+			break;
+
+		case BC_OPCODE_EQSTR:
+			// push a, b => push a <=> b
+
+			binop("eqstr", Expr::Kind::EqStr);
+			break;
+
+		case BC_OPCODE_NESTR:
+			// push a, b => push a <!> b
+
+			binop("nestr", Expr::Kind::NeStr);
+			break;
+
+		case BC_OPCODE_NEG:
+			// push a => push -a
+
+			unop("neg", Expr::Kind::Neg);
+			break;
+
+		case BC_OPCODE_NOT:
+			// push a => push !a
+
+			unop("not", Expr::Kind::Not);
+			break;
+
+		case BC_OPCODE_MVN:
+			// push a => push ~a
+
+			unop("mvn", Expr::Kind::BitwiseNot);
+			break;
+
+		case BC_OPCODE_CALL:
+			// push ... => push func(...)
+
+			call(script.scenes[ins.operand].name.c_str(), script.scenes[ins.operand].argCnt);
+			break;
+
+		case BC_OPCODE_CALLEXT:
+			// push ... => push func(...)
+
+			call(str, ins.operand & 0xFF);
+			break;
+
+		case BC_OPCODE_RETURN:
+			// push a => return a
+
+			expect_push("ret", [&] (auto& back)
+			{
+				back.kind = Stmt::Kind::Return;
+			});
+
+			break;
+
+		case BC_OPCODE_B:
+			// goto off
+
+			result.push_back({ Stmt::Kind::Goto, ins.operand, ExprRef() });
+			break;
+
+		case BC_OPCODE_BN:
+			// push a => goto off if !a
+
+			expect_push("bn", [&] (auto& back)
+			{
+				if (!spend(1, back.depth + 1))
+					return;
+
+				back.kind = Stmt::Kind::GotoIf;
+				back.target = ins.operand;
+				back.expr = builder.make_unop(Expr::Kind::Not, std::move(back.expr));
+				back.depth += 1;
+				back.size = add_size(back.size, 1);
+			});
+
+			break;
+
+		case BC_OPCODE_BY:
+			// push a => goto off if a
+
+			expect_push("by", [&] (auto& back)
+			{
+				back.kind = Stmt::Kind::GotoIf;
+				back.target = ins.operand;
+			});
+
+			break;
+
+		case BC_OPCODE_YIELD:
+			// yield
+
+			result.push_back({ Stmt::Kind::Yield, 0, ExprRef() });
+			break;
+
+		case BC_OPCODE_40:
+			// nothing
+
+			break;
+
+		case BC_OPCODE_PRINTF:
+			// push ... => __printf(...)
+
+			call("__printf", ins.operand);
+
+			if (error == ErrorKind::None)
+				result.back().kind = Stmt::Kind::Expr;
+
+			break;
+
+		case BC_OPCODE_DUP:
+			// push a => push a, a
+
+			expect_push("dup", [&] (auto& back)
+			{
+				const auto depth = back.depth;
+				const auto size = back.size;
+
+				if (!spend(size, depth))
+					return;
+
+				auto copy = builder.make_copy(back.expr, meter);
+
+				if (meter != nullptr && meter->exceeded != ErrorKind::None)
+					return fail(meter->exceeded);
+
+				push(std::move(copy), depth, size);
+			});
+
+			break;
+
+		case BC_OPCODE_RETN:
+			// return 0
+
+			if (spend(1, 1))
+				result.push_back({ Stmt::Kind::Return, 0, builder.make_intlit(0), 1, 1 });
+
+			break;
+
+		case BC_OPCODE_RETY:
+			// return 1
+
+			if (spend(1, 1))
+				result.push_back({ Stmt::Kind::Return, 0, builder.make_intlit(1), 1, 1 });
+
+			break;
+
+		case BC_OPCODE_ASSIGN:
+			// push a, b => [a] = b
+
+			binop("assign", Expr::Kind::Assign);
+
+			if (error == ErrorKind::None)
+				result.back().kind = Stmt::Kind::Expr;
+
+			break;
+
+		case BC_FAKEOP_LAND:
+			// push a, b => push a && b
+
+			binop("fake!land", Expr::Kind::LogicalAnd);
+			break;
+
+		case BC_FAKEOP_LORR:
+			// push a, b => push a || b
+
+			binop("fake!lorr", Expr::Kind::LogicalOr);
+			break;
+
+		default:
+			fail(ErrorKind::UnsupportedOpcode);
+			break;
+
+		} // switch (ins.opcode)
+
+		if (error != ErrorKind::None)
+			return abort(ins);
+	}
+
+	for (auto& pending : result)
+		builder.add_statement(pending.kind, pending.target, std::move(pending.expr));
+
+	result.clear();
+
+	return true;
+}
+
+} // namespace soren
+
+#endif // SOREN_DECOMPILE_STACK_MACHINE_INCLUDED
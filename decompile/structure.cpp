@@ -0,0 +1,648 @@
+#include "decompile/decompile.h"
+
+#include "core/stats.h"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <limits>
+#include <iterator>
+
+namespace soren {
+
+/*
+ * Control flow structuring, over the slices of a scene (one basic block per slice, in offset order):
+ *
+ * - dominators are computed with the Cooper-Harvey-Kennedy iterative scheme (over reverse post-order),
+ *   then numbered along the dominator tree so that dominance is an O(1) interval check
+ * - a block that dominates all of its retreating predecessors heads a natural loop, spanning up to its last back edge
+ *   (a retreating edge to a block that doesn't dominate its source is irreducible, and stays a goto)
+ * - a region (contiguous range of blocks) only becomes a body if it is only entered from its head,
+ *   which is an O(1) range min/max query over each block's lowest and highest predecessor
+ *
+ * Every block is visited once per nesting level, and nesting is capped, so this stays near-linear.
+ */
+
+enum : unsigned
+{
+	NO_BLOCK = std::numeric_limits<unsigned>::max(),
+
+	// past this, regions are written as they are (this keeps the recursion here and in writers bounded)
+	STRUCTURE_DEPTH_LIMIT = 64,
+};
+
+// Compressed adjacency lists
+struct EdgeLists
+{
+	std::vector<unsigned> first; // size is blockCnt + 1
+	std::vector<unsigned> edges;
+
+	const unsigned* begin(unsigned block) const { return edges.data() + first[block]; }
+	const unsigned* end(unsigned block) const { return edges.data() + first[block + 1]; }
+};
+
+// O(1) min/max over ranges of a fixed array
+struct RangeTable
+{
+	void build(const std::vector<int>& values, bool isMax)
+	{
+		mIsMax = isMax;
+		mLevels.assign(1, values);
+
+		for (std::size_t width = 2; width <= values.size(); width *= 2)
+		{
+			auto& prev = mLevels.back();
+			std::vector<int> level(values.size() - width + 1);
+
+			for (std::size_t i = 0; i < level.size(); ++i)
+				level[i] = combine(prev[i], prev[i + width/2]);
+
+			mLevels.push_back(std::move(level));
+		}
+	}
+
+	// over [first, end), end > first
+	int query(unsigned first, unsigned end) const
+	{
+		unsigned level = 0;
+
+		while ((2u << level) <= end - first)
+			++level;
+
+		return combine(mLevels[level][first], mLevels[level][end - (1u << level)]);
+	}
+
+private:
+	int combine(int a, int b) const
+	{
+		return mIsMax ? std::max(a, b) : std::min(a, b);
+	}
+
+	std::vector<std::vector<int>> mLevels;
+	bool mIsMax { false };
+};
+
+static
+std::unique_ptr<Expr> negate(std::unique_ptr<Expr>&& expr)
+{
+	if (expr->kind == Expr::Kind::Not)
+		return std::move(expr->children[0]);
+
+	return Expr::make_unique_unop(Expr::Kind::Not, std::move(expr));
+}
+
+static
+bool is_jump(const Stmt& stmt)
+{
+	return stmt.kind == Stmt::Kind::Goto || stmt.kind == Stmt::Kind::GotoIf;
+}
+
+struct Structurer
+{
+	bool build(SceneAst& ast)
+	{
+		const unsigned blockCnt = ast.slices.size();
+
+		if (blockCnt == 0)
+			return false;
+
+		mLabels.assign(blockCnt, nullptr);
+		mRefs.assign(blockCnt, 0);
+
+		for (unsigned i = 0; i < blockCnt; ++i)
+		{
+			// an empty block would have nothing to hold its label
+			if (ast.slices[i].second.empty())
+				return false;
+
+			ast.labels.for_at(ast.slices[i].first, [&] (const std::string& name)
+			{
+				mLabels[i] = &name;
+				mBlockOfLabel.emplace(name, i);
+			});
+		}
+
+		// Successors, from every jump in the block (slices normally only end with one)
+
+		mTargets.assign(blockCnt, NO_BLOCK);
+
+		std::vector<std::pair<unsigned, unsigned>> edges;
+
+		for (unsigned i = 0; i < blockCnt; ++i)
+		{
+			auto& stmts = ast.slices[i].second;
+
+			for (auto& stmt : stmts)
+			{
+				if (!is_jump(stmt))
+					continue;
+
+				auto it = mBlockOfLabel.find(stmt.children[0]->named);
+
+				// slices that failed to build are missing
+				if (it == mBlockOfLabel.end())
+					return false;
+
+				edges.emplace_back(i, it->second);
+				mRefs[it->second]++;
+			}
+
+			auto& last = stmts.back();
+
+			if (is_jump(last))
+				mTargets[i] = edges.back().second;
+
+			const bool fallsThrough = last.kind != Stmt::Kind::Goto && last.kind != Stmt::Kind::Return;
+
+			if (fallsThrough && i + 1 < blockCnt)
+				edges.emplace_back(i, i + 1);
+		}
+
+		make_lists(mSuccs, edges, blockCnt, false);
+		make_lists(mPreds, edges, blockCnt, true);
+
+		// Lowest and highest predecessor of each block, the entry block is entered from "before" the script
+
+		std::vector<int> minPreds(blockCnt, std::numeric_limits<int>::max());
+		std::vector<int> maxPreds(blockCnt, -1);
+
+		minPreds[0] = -1;
+
+		for (auto& edge : edges)
+		{
+			minPreds[edge.second] = std::min<int>(minPreds[edge.second], edge.first);
+			maxPreds[edge.second] = std::max<int>(maxPreds[edge.second], edge.first);
+		}
+
+		mMinPred.build(minPreds, false);
+		mMaxPred.build(maxPreds, true);
+
+		compute_dominators(blockCnt);
+		find_loops(blockCnt);
+
+		mBlocks.resize(blockCnt);
+
+		for (unsigned i = 0; i < blockCnt; ++i)
+			mBlocks[i] = std::move(ast.slices[i].second);
+
+		return true;
+	}
+
+	static
+	void make_lists(EdgeLists& lists, const std::vector<std::pair<unsigned, unsigned>>& edges, unsigned blockCnt, bool reverse)
+	{
+		lists.first.assign(blockCnt + 1, 0);
+		lists.edges.resize(edges.size());
+
+		for (auto& edge : edges)
+			lists.first[(reverse ? edge.second : edge.first) + 1]++;
+
+		for (unsigned i = 0; i < blockCnt; ++i)
+			lists.first[i + 1] += lists.first[i];
+
+		std::vector<unsigned> fill(lists.first.begin(), lists.first.end() - 1);
+
+		for (auto& edge : edges)
+		{
+			if (reverse)
+				lists.edges[fill[edge.second]++] = edge.first;
+			else
+				lists.edges[fill[edge.first]++] = edge.second;
+		}
+	}
+
+	void compute_dominators(unsigned blockCnt)
+	{
+		// Reverse post-order (iterative dfs from the entry block)
+
+		std::vector<unsigned> order;
+		std::vector<unsigned> rpoIndex(blockCnt, NO_BLOCK);
+
+		{
+			std::vector<std::pair<unsigned, const unsigned*>> stack;
+			std::vector<bool> visited(blockCnt, false);
+
+			stack.emplace_back(0, mSuccs.begin(0));
+			visited[0] = true;
+
+			while (!stack.empty())
+			{
+				auto& top = stack.back();
+
+				if (top.second != mSuccs.end(top.first))
+				{
+					const unsigned next = *top.second++;
+
+					if (!visited[next])
+					{
+						visited[next] = true;
+						stack.emplace_back(next, mSuccs.begin(next));
+					}
+
+					continue;
+				}
+
+				order.push_back(top.first);
+				stack.pop_back();
+			}
+
+			std::reverse(order.begin(), order.end());
+
+			for (unsigned i = 0; i < order.size(); ++i)
+				rpoIndex[order[i]] = i;
+		}
+
+		// Cooper, Harvey & Kennedy, "A Simple, Fast Dominance Algorithm"
+
+		std::vector<unsigned> idom(blockCnt, NO_BLOCK);
+		idom[0] = 0;
+
+		auto intersect = [&] (unsigned a, unsigned b)
+		{
+			while (a != b)
+			{
+				while (rpoIndex[a] > rpoIndex[b])
+					a = idom[a];
+
+				while (rpoIndex[b] > rpoIndex[a])
+					b = idom[b];
+			}
+
+			return a;
+		};
+
+		for (bool changed = true; changed;)
+		{
+			changed = false;
+
+			for (unsigned i = 1; i < order.size(); ++i)
+			{
+				const unsigned block = order[i];
+				unsigned newIdom = NO_BLOCK;
+
+				for (auto it = mPreds.begin(block); it != mPreds.end(block); ++it)
+				{
+					if (idom[*it] == NO_BLOCK)
+						continue;
+
+					newIdom = (newIdom == NO_BLOCK) ? *it : intersect(*it, newIdom);
+				}
+
+				if (idom[block] != newIdom)
+				{
+					idom[block] = newIdom;
+					changed = true;
+				}
+			}
+		}
+
+		// Dominator tree intervals
+
+		std::vector<std::pair<unsigned, unsigned>> treeEdges;
+
+		for (unsigned i = 1; i < order.size(); ++i)
+			treeEdges.emplace_back(idom[order[i]], order[i]);
+
+		EdgeLists children;
+		make_lists(children, treeEdges, blockCnt, false);
+
+		mDomEnter.assign(blockCnt, NO_BLOCK);
+		mDomLeave.assign(blockCnt, NO_BLOCK);
+
+		unsigned counter = 0;
+
+		std::vector<std::pair<unsigned, const unsigned*>> stack;
+		stack.emplace_back(0, children.begin(0));
+		mDomEnter[0] = counter++;
+
+		while (!stack.empty())
+		{
+			auto& top = stack.back();
+
+			if (top.second != children.end(top.first))
+			{
+				const unsigned next = *top.second++;
+
+				mDomEnter[next] = counter++;
+				stack.emplace_back(next, children.begin(next));
+
+				continue;
+			}
+
+			mDomLeave[top.first] = counter++;
+			stack.pop_back();
+		}
+	}
+
+	bool dominates(unsigned a, unsigned b) const
+	{
+		if (mDomEnter[a] == NO_BLOCK || mDomEnter[b] == NO_BLOCK)
+			return false;
+
+		return mDomEnter[a] <= mDomEnter[b] && mDomLeave[b] <= mDomLeave[a];
+	}
+
+	void find_loops(unsigned blockCnt)
+	{
+		mLoopEnd.assign(blockCnt, NO_BLOCK);
+
+		for (unsigned header = 0; header < blockCnt; ++header)
+		{
+			unsigned loopEnd = NO_BLOCK;
+			bool reducible = true;
+
+			for (auto it = mPreds.begin(header); it != mPreds.end(header); ++it)
+			{
+				if (*it < header)
+					continue;
+
+				if (!dominates(header, *it))
+				{
+					reducible = false;
+					break;
+				}
+
+				loopEnd = (loopEnd == NO_BLOCK) ? *it : std::max(loopEnd, *it);
+			}
+
+			if (reducible)
+				mLoopEnd[header] = loopEnd;
+		}
+	}
+
+	// true if the blocks in [first, end) are only entered from blocks in [from, end)
+	bool only_entered_from(unsigned first, unsigned end, unsigned from) const
+	{
+		if (first >= end)
+			return true;
+
+		return mMinPred.query(first, end) >= int(from) && mMaxPred.query(first, end) < int(end);
+	}
+
+	void push(Ast& out, Stmt&& stmt, const std::string*& label)
+	{
+		if (label != nullptr)
+		{
+			stmt.label = *label;
+			label = nullptr;
+		}
+
+		out.push_back(std::move(stmt));
+	}
+
+	// Writes block statements [0, count), jumps to the exit of the innermost enclosing loop become breaks
+	void emit_statements(Ast& out, unsigned block, std::size_t count, unsigned loopExit, const std::string*& label)
+	{
+		auto& stmts = mBlocks[block];
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			auto& stmt = stmts[i];
+
+			if (loopExit != NO_BLOCK && i + 1 == stmts.size() && mTargets[block] == loopExit)
+			{
+				mRefs[loopExit]--;
+
+				if (stmt.kind == Stmt::Kind::Goto)
+				{
+					push(out, Stmt { Stmt::Kind::Break, {}, {} }, label);
+					continue;
+				}
+
+				Stmt cond { Stmt::Kind::If, {}, {} };
+				cond.children.push_back(std::move(stmt.children[1]));
+				cond.childAst = std::make_unique<Ast>();
+				cond.childAst->push_back(Stmt { Stmt::Kind::Break, {}, {} });
+
+				push(out, std::move(cond), label);
+				continue;
+			}
+
+			push(out, std::move(stmt), label);
+		}
+	}
+
+	// true if the last statement of ast is a jump to block that can be removed (nothing jumps to it)
+	bool is_jump_to(const Ast& ast, Stmt::Kind kind, unsigned block) const
+	{
+		if (ast.empty() || ast.back().kind != kind || mLabels[block] == nullptr)
+			return false;
+
+		auto& stmt = ast.back();
+
+		if (!stmt.label.empty() && mRefs[mBlockOfLabel.at(stmt.label)] != 0)
+			return false;
+
+		return stmt.children[0]->named == *mLabels[block];
+	}
+
+	// Writes the blocks [first, end) to out
+	// If inLoop, first is the header of the loop being written, whose label is already taken
+	void emit_range(Ast& out, unsigned first, unsigned end, unsigned depth, unsigned loopExit, bool inLoop)
+	{
+		for (unsigned block = first; block < end;)
+		{
+			const std::string* label = (inLoop && block == first) ? nullptr : mLabels[block];
+			auto& stmts = mBlocks[block];
+
+			if (depth >= STRUCTURE_DEPTH_LIMIT)
+			{
+				emit_statements(out, block, stmts.size(), loopExit, label);
+				++block;
+
+				continue;
+			}
+
+			// Loops
+
+			const unsigned loopEnd = mLoopEnd[block];
+
+			if (!(inLoop && block == first) && loopEnd != NO_BLOCK && loopEnd < end
+				&& only_entered_from(block + 1, loopEnd + 1, block) && mMaxPred.query(block, block + 1) <= int(loopEnd))
+			{
+				const unsigned exit = loopEnd + 1;
+
+				Stmt loop { Stmt::Kind::While, {}, {} };
+				loop.childAst = std::make_unique<Ast>();
+
+				auto& body = *loop.childAst;
+
+				if (stmts.size() == 1 && stmts[0].kind == Stmt::Kind::GotoIf && mTargets[block] == exit && loopEnd > block)
+				{
+					// while (!c) { ... }
+					mRefs[exit]--;
+					loop.children.push_back(negate(std::move(stmts[0].children[1])));
+					emit_range(body, block + 1, exit, depth + 1, exit, false);
+				}
+				else
+				{
+					// while (1) { ... }
+					loop.children.push_back(Expr::make_unique_intlit(1));
+					emit_range(body, block, exit, depth + 1, exit, true);
+				}
+
+				if (is_jump_to(body, Stmt::Kind::Goto, block))
+				{
+					// continuing is implicit
+					body.pop_back();
+					mRefs[block]--;
+				}
+				else if (is_jump_to(body, Stmt::Kind::GotoIf, block))
+				{
+					auto truth = std::move(body.back().children[1]);
+					body.pop_back();
+					mRefs[block]--;
+
+					Stmt cond { Stmt::Kind::If, {}, {} };
+					cond.children.push_back(negate(std::move(truth)));
+					cond.childAst = std::make_unique<Ast>();
+					cond.childAst->push_back(Stmt { Stmt::Kind::Break, {}, {} });
+
+					body.push_back(std::move(cond));
+				}
+				else if (body.empty() || (body.back().kind != Stmt::Kind::Goto && body.back().kind != Stmt::Kind::Return
+					&& body.back().kind != Stmt::Kind::Break))
+				{
+					// falls out of the loop
+					body.push_back(Stmt { Stmt::Kind::Break, {}, {} });
+				}
+
+				push(out, std::move(loop), label);
+
+				block = exit;
+				continue;
+			}
+
+			// Conditionals: "goto t if c" over [block + 1, t) becomes "if (!c) { ... }"
+
+			const unsigned target = mTargets[block];
+
+			if (stmts.back().kind == Stmt::Kind::GotoIf && target > block + 1 && target <= end && target != loopExit
+				&& only_entered_from(block + 1, target, block))
+			{
+				emit_statements(out, block, stmts.size() - 1, loopExit, label);
+				mRefs[target]--;
+
+				Stmt cond { Stmt::Kind::If, {}, {} };
+				cond.children.push_back(negate(std::move(stmts.back().children[1])));
+				cond.childAst = std::make_unique<Ast>();
+
+				emit_range(*cond.childAst, block + 1, target, depth + 1, loopExit, false);
+
+				// "goto f" ending the then part, with [target, f) only entered from here, is an else part
+
+				const unsigned elseEnd = mTargets[target - 1];
+				const bool hasElse = mBlocks[target - 1].back().kind == Stmt::Kind::Goto
+					&& elseEnd > target && elseEnd <= end && elseEnd != loopExit
+					&& std::all_of(mPreds.begin(target), mPreds.end(target), [&] (unsigned pred)
+						{ return pred == block || (pred >= target && pred < elseEnd); })
+					&& only_entered_from(target + 1, elseEnd, target)
+					&& is_jump_to(*cond.childAst, Stmt::Kind::Goto, elseEnd);
+
+				push(out, std::move(cond), label);
+
+				if (!hasElse)
+				{
+					block = target;
+					continue;
+				}
+
+				out.back().childAst->pop_back();
+				mRefs[elseEnd]--;
+
+				Stmt otherwise { Stmt::Kind::Else, {}, {} };
+				otherwise.childAst = std::make_unique<Ast>();
+
+				emit_range(*otherwise.childAst, target, elseEnd, depth + 1, loopExit, false);
+
+				out.push_back(std::move(otherwise));
+
+				block = elseEnd;
+				continue;
+			}
+
+			emit_statements(out, block, stmts.size(), loopExit, label);
+			++block;
+		}
+	}
+
+	EdgeLists mSuccs;
+	EdgeLists mPreds;
+	RangeTable mMinPred;
+	RangeTable mMaxPred;
+
+	std::vector<unsigned> mDomEnter;
+	std::vector<unsigned> mDomLeave;
+
+	std::vector<unsigned> mTargets; // target of each block's ending jump (if any)
+	std::vector<unsigned> mLoopEnd; // last block of the natural loop headed by each block (if any)
+	std::vector<const std::string*> mLabels;
+	std::vector<unsigned> mRefs; // how many jumps to each block are still to be written as gotos
+	std::unordered_map<std::string, unsigned> mBlockOfLabel;
+	std::vector<Ast> mBlocks;
+};
+
+static
+void collect_targets(const Ast& ast, std::unordered_set<std::string>& targets)
+{
+	for (auto& stmt : ast)
+	{
+		if (is_jump(stmt))
+			targets.insert(stmt.children[0]->named);
+
+		if (stmt.childAst)
+			collect_targets(*stmt.childAst, targets);
+	}
+}
+
+static
+void remove_unused_labels(Ast& ast, const std::unordered_set<std::string>& targets)
+{
+	for (auto& stmt : ast)
+	{
+		if (!stmt.label.empty() && targets.count(stmt.label) == 0)
+			stmt.label.clear();
+
+		if (stmt.childAst)
+			remove_unused_labels(*stmt.childAst, targets);
+	}
+}
+
+bool structure_scene(SceneAst& ast)
+{
+	SOREN_STATS_PHASE(Structure);
+
+	// no jumps (the common case), nothing to do but merging slices
+	if (ast.labels.empty() && !ast.slices.empty())
+	{
+		auto& first = ast.slices.front().second;
+
+		for (std::size_t i = 1; i < ast.slices.size(); ++i)
+			std::move(ast.slices[i].second.begin(), ast.slices[i].second.end(), std::back_inserter(first));
+
+		ast.slices.front().first = 0;
+		ast.slices.resize(1);
+
+		return true;
+	}
+
+	Structurer structurer;
+
+	if (!structurer.build(ast))
+		return false;
+
+	Ast result;
+	structurer.emit_range(result, 0, structurer.mBlocks.size(), 0, NO_BLOCK, false);
+
+	std::unordered_set<std::string> targets;
+	collect_targets(result, targets);
+	remove_unused_labels(result, targets);
+
+	ast.slices.clear();
+	ast.slices.set(0, std::move(result));
+	ast.labels.clear();
+
+	return true;
+}
+
+} // namespace soren
@@ -1,869 +1,614 @@
 #include <iostream>
 #include <vector>
-#include <fstream>
-#include <set>
-#include <algorithm>
-#include <stdexcept>
+#include <cstring>
 #include <memory>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <thread>
 
-#include "core/offset-map.h"
+#include <sys/resource.h>
 
+#include "core/stats.h"
+#include "core/diagnostics.h"
 #include "core/soren-bytecode.h"
 #include "core/soren-cmb.h"
-
-#include "ast/expr.h"
-#include "ast/stmt.h"
+#include "core/bulk-read.h"
+#include "core/sjis.h"
 
 #include "decode/decode.h"
+#include "decode/detect.h"
+#include "decode/stream.h"
+#include "decode/archive.h"
+#include "decode/symbols.h"
+#include "decompile/decompile.h"
+#include "output/output.h"
+#include "output/scene-cache.h"
+#include "cli/commands.h"
 
 namespace soren {
 
-static
-std::vector<byte_type> read_entire_file(const char* filename)
+struct DumpOptions
 {
-	std::ifstream in(filename, std::ios::binary | std::ios::ate);
-
-	if (!in.is_open())
-		throw "couldn't open file for binary read"; // FIXME
-
-	const auto size = in.tellg();
-	std::vector<byte_type> result(size);
-
-	in.seekg(0, std::ios::beg);
-	in.read(reinterpret_cast<std::ifstream::char_type*>(result.data()), size);
+	OutputFormat format { OutputFormat::Text };
+	bool flatAst { false };
+	bool structured { false };
+	bool validate { false };
+	bool check { false };
+	unsigned jobs { 0u }; // --check only, 0 is one per hardware thread
+	bool detectOnly { false };
+	bool dedup { true };
+	std::size_t dedupCap { 0x4000000u }; // bytes of rendered bodies kept for reuse
+	bool stats { false };
+	OutputFormat statsFormat { OutputFormat::Text };
+	bool autoGame { true };
+	GameKind game { GameKind::FE10 };
+	bool stream { false };
+	std::size_t window { 0x10000u };
+	std::size_t memoryCap { 0u }; // 0 is no cap
+	std::size_t inFlight { 32u }; // files read ahead in multi-file runs, 0 reads each file when its turn comes
+	bool ioUring { true };
+	const SymbolDb* symbols { nullptr };
+	DecompileBudget budget; // no limits by default
+	bool sjis { false }; // pool strings are Shift-JIS, printed as UTF-8
+};
+
+struct StreamReport
+{
+	std::size_t peakHeld { 0u };
+};
 
-	return result;
+static
+void report_diagnostics(const char* filename, const Diagnostics& diags)
+{
+	for (auto& diag : diags.list)
+		std::cerr << filename << ": error: " << diag << std::endl;
 }
 
-template<bool IgnoreBranchAndKeeps = true>
-OffsetMap<Span<const BcIns>> slice_script(Span<const BcIns> script)
+// Only runs the game detection pre-scan, printing its result
+static
+bool detect_file(const char* filename)
 {
-	OffsetMap<Span<const BcIns>> result;
-	std::set<std::size_t> slicePoints;
-
-	// Step 1: Find slice points
+	CmbInput input;
+	Diagnostics diags;
 
-	for (auto& ins : script)
+	if (!try_load_cmb_input(filename, input, diags))
 	{
-		if (IgnoreBranchAndKeeps && ins.is_jump_keep())
-			continue;
+		report_diagnostics(filename, diags);
+		return false;
+	}
 
-		if (ins.is_jump())
-		{
-			// jumps generate:
-			// a slice after themselves
-			// a slice before the jump target
-			// a label before the jump target
+	const auto detection = get_input_game(input);
 
-			slicePoints.insert(ins.location + 1 + ins.info().operandSize);
-			slicePoints.insert(ins.operand);
-		}
+	std::cout << filename << "\t" << get_game_name(detection.game) << "\t" << get_confidence_name(detection.confidence) << std::endl;
 
-		if (ins.is_end())
-		{
-			// ends generate slices after themselves
-			slicePoints.insert(ins.location + 1);
-		}
-	}
+	return detection.confidence != DetectConfidence::None;
+}
 
-	// Step 2: Slice
+// State reused between scenes (of every file): one ast of each kind, each scene's ast only lives for as long as it is
+// being written, and the pipeline's working buffers
+struct SceneWork
+{
+	FlatSceneAst flatAst;
+	SceneAst ast;
+	DecompileScratch scratch;
+	std::string key;
+};
 
-	auto scrIt   = script.begin();
-	auto sliceIt = slicePoints.begin();
+// Decompiles and writes one scene, or reuses its rendered body from cache (if any)
+static
+void process_scene(const CmbInfo& cmb, const SceneInfo& scene, ModelWriter* writer, SceneCache* cache, const DumpOptions& options,
+	SceneWork& work, Diagnostics& diags)
+{
+	auto decompile = [&] ()
+	{
+		if (options.flatAst)
+			decompile_scene_flat(cmb, scene, work.flatAst, work.scratch, diags);
+		else if (try_decompile_scene(cmb, scene, work.ast, work.scratch, diags) && options.structured)
+			structure_scene(work.ast);
+	};
 
-	while (scrIt != script.end())
+	if (cache && writer && writer->has_scene_body())
 	{
-		auto itStart = scrIt;
+		make_scene_content_key(cmb, scene, work.key);
 
-		if (sliceIt != slicePoints.end())
+		if (auto body = cache->find(work.key))
 		{
-			auto sliceOffset = *sliceIt++;
+			SOREN_STATS_PHASE(Print);
 
-			scrIt = std::find_if(itStart, script.end(), [sliceOffset] (auto& ins)
-			{
-				return ins.location >= sliceOffset;
-			});
-		}
-		else
-		{
-			scrIt = script.end();
+			writer->write_scene_head(cmb, scene);
+			writer->write_raw(*body);
+
+			return;
 		}
 
-		result.set(itStart->location, { itStart, scrIt });
-	}
+		const auto start = std::chrono::steady_clock::now();
+		const auto diagCnt = diags.size();
 
-	return result;
-}
+		decompile();
 
-Span<BcIns> convert_bks_to_fake_logic(Span<BcIns> slice)
-{
-	// Converts bky/bkn chains to fake land/lorr instructions and reorder accordingly
-	// ex:
-	/*
-	 * 0 val 0
-	 * 2 bkn 7
-	 * 5 val 1
-	 * 7 bn ...
-	 */
-	// becomes
-	/*
-	 * 0 val 0
-	 * 5 val 1
-	 * 2 fake!land
-	 * 7 bn ...
-	 */
-
-	for (unsigned i = 0; i < slice.size(); ++i)
-	{
-		unsigned op = slice[i].opcode;
+		std::ostringstream body;
+		std::uint64_t renderNs = 0;
 
-		switch (op)
 		{
+			SOREN_STATS_PHASE(Print);
 
-		case BC_OPCODE_BKN:
-		case BC_OPCODE_BKY:
-		{
-			// Move the bkn/bky to just before the jump target, and replace it with a fake and/or
+			if (options.flatAst)
+				writer->write_flat_scene_body(body, cmb, scene, work.flatAst);
+			else
+				writer->write_scene_body(body, cmb, scene, work.ast);
 
-			unsigned target = slice[i++].operand;
-			unsigned j = i;
+			// writing it out isn't saved by reusing it
+			renderNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
 
-			while (j < slice.size() && slice[j].location != target)
-			{
-				std::swap(slice[j-1], slice[j]);
-				j++;
-			}
-
-			slice[j-1].opcode = (op == BC_OPCODE_BKN) ? BC_FAKEOP_LAND : BC_FAKEOP_LORR;
-			slice[j-1].operand = 0;
+			writer->write_scene_head(cmb, scene);
+			writer->write_raw(body.str());
 		}
 
-		default:
-			continue;
+		// scenes with issues are not reused, so that their issues are reported for every copy
+		if (diags.size() == diagCnt)
+			cache->insert(work.key, body.str(), renderNs);
 
-		} // switch (op)
+		return;
 	}
 
-	return slice;
-}
+	decompile();
 
-std::vector<BcIns> get_bks_as_fake_logic(Span<const BcIns> slice)
-{
-	std::vector<BcIns> result(slice.begin(), slice.end());
-	convert_bks_to_fake_logic(result);
+	if (writer)
+	{
+		SOREN_STATS_PHASE(Print);
 
-	return result;
+		if (options.flatAst)
+			writer->write_flat_scene(cmb, scene, work.flatAst);
+		else
+			writer->write_scene(cmb, scene, work.ast);
+	}
 }
 
-std::vector<Stmt> make_statements(const CmbInfo& script, const SceneInfo& scene, Span<const BcIns> slice)
+// Reads (and decompresses) one file or archive member, taking it from reader if any (which then must be handing out
+// that file next)
+static
+bool read_input(const char* filename, BulkReader* reader, CmbInput& input, Diagnostics& diags)
 {
-	std::vector<Stmt> result;
-	result.reserve(slice.size());
+	SOREN_STATS_PHASE(Read);
 
-	const auto expect_push = [&] (const char*, auto func)
-	{
-		if (result.size() < 1)
-			throw std::runtime_error("expected after push"); // TODO: better error ("name" only expected after push)
-
-		if (result.back().kind != Stmt::Kind::Push)
-			throw std::runtime_error("expected after push"); // TODO: better error ("name" only expected after push)
+	if (reader == nullptr)
+		return try_load_cmb_input(filename, input, diags);
 
-		func(result.back());
-	};
+	BulkFile file;
 
-	const auto expect_push_push = [&] (const char*, auto func)
+	if (!reader->next(file) || !file.ok)
 	{
-		if (result.size() < 2)
-			throw false; // FIXME: error ("name" as first instruction)
-
-		if (result.back().kind != Stmt::Kind::Push)
-			throw false; // FIXME: error ("name" only expected after 2 pushes)
-
-		auto& rop = result.back();
-
-		if (result[result.size()-2].kind != Stmt::Kind::Push)
-			throw false; // FIXME: error ("name" only expected after 2 pushes)
-
-		auto& lop = result[result.size()-2];
-
-		func(lop, rop);
-	};
-
-	const auto unop = [&] (const char* name, Expr::Kind kind)
-	{
-		expect_push(name, [&] (auto& back)
-		{
-			back.children[0] = Expr::make_unique_unop(kind, std::move(back.children[0]));
-		});
-	};
-
-	const auto binop = [&] (const char* name, Expr::Kind kind)
-	{
-		expect_push_push(name, [&] (auto& l, auto& r)
-		{
-			auto lexpr = std::move(l.children[0]);
-			auto rexpr = std::move(r.children[0]);
+		diags.report(ErrorKind::FileUnreadable, 0);
+		return false;
+	}
 
-			result.pop_back();
-			result.pop_back();
+	input.owned.swap(file.data);
+	input.hasDetection = false;
 
-			result.push_back(Stmt::make_push(
-				Expr::make_unique_binop(kind, std::move(lexpr), std::move(rexpr))));
-		});
-	};
+	const bool ok = try_decompress_cmb_data(input.owned, diags);
+	input.data = input.owned;
 
-	const auto call = [&] (const char* funcname, unsigned argCnt)
-	{
-		if (result.size() < argCnt)
-			throw false; // FIXME: error (call expected after x pushes)
-
-		for (unsigned i = result.size() - argCnt; i < result.size(); ++i)
-			if (result[i].kind != Stmt::Kind::Push)
-				throw false; // FIXME: error (call expexted after x pushes)
+	return ok;
+}
 
-		auto callexpr = std::make_unique<Expr>();
+// Decodes one file and writes it through writer (if any)
+// Never throws on malformed input: every issue is reported and whatever could be decoded is still written
+// Scenes already rendered in an earlier file (or scene) are reused from cache (if any)
+// Returns false if there was any issue
 
-		callexpr->kind = Expr::Kind::Func;
-		callexpr->named = funcname;
+static
+bool process_file(const char* filename, BulkReader* reader, ModelWriter* writer, SceneCache* cache, const DumpOptions& options,
+	SceneWork& work)
+{
+	Diagnostics diags;
 
-		for (unsigned i = result.size() - argCnt; i < result.size(); ++i)
-			callexpr->children.push_back(std::move(result[i].children[0]));
+	work.scratch.meter.start_file();
 
-		result.resize(result.size() - argCnt);
-		result.push_back(Stmt::make_push(std::move(callexpr)));
-	};
+	CmbInput input;
 
-	for (auto& ins : slice)
 	{
-		switch (ins.opcode)
+		if (!read_input(filename, reader, input, diags))
 		{
+			report_diagnostics(filename, diags);
 
-		case BC_OPCODE_NOP:
-			// nothing
-
-			break;
-
-		case BC_OPCODE_VAL8:
-		case BC_OPCODE_VAL16:
-			// push varname
-
-			result.push_back(Stmt::make_push(
-				Expr::make_unique_identifier(std::string(scene.varnames[ins.operand]))));
-
-			break;
-
-		case BC_OPCODE_VALX8:
-		case BC_OPCODE_VALX16:
-			// push a => push [&varname + a]
-
-			expect_push("valx", [&] (auto& back)
-			{
-				back.children[0] = Expr::make_unique_unop(Expr::Kind::Deref,
-					Expr::make_unique_binop(Expr::Kind::Add,
-						Expr::make_unique_unop(Expr::Kind::Addrof,
-							Expr::make_unique_identifier(std::string(scene.varnames[ins.operand]))),
-						std::move(back.children[0])));
-			});
-
-			break;
-
-		case BC_OPCODE_REF8:
-		case BC_OPCODE_REF16:
-			// push &varname
-
-			result.push_back(Stmt::make_push(
-				Expr::make_unique_unop(Expr::Kind::Addrof,
-					Expr::make_unique_identifier(std::string(scene.varnames[ins.operand])))));
-
-			break;
-
-		case BC_OPCODE_REFX8:
-		case BC_OPCODE_REFX16:
-			// push a => push &varname + a
-
-			expect_push("refx", [&] (auto& back)
-			{
-				back.children[0] = Expr::make_unique_binop(Expr::Kind::Add,
-					Expr::make_unique_unop(Expr::Kind::Addrof,
-						Expr::make_unique_identifier(std::string(scene.varnames[ins.operand]))),
-					std::move(back.children[0]));
-			});
-
-			break;
-
-		case BC_OPCODE_GVAL8:
-		case BC_OPCODE_GVAL16:
-			// push varname
-
-			result.push_back(Stmt::make_push(
-				Expr::make_unique_identifier(std::string(script.globalNames[ins.operand]))));
-
-			break;
-
-		case BC_OPCODE_GVALX8:
-		case BC_OPCODE_GVALX16:
-			// push a => push [&varname + a]
-
-			expect_push("valx", [&] (auto& back)
-			{
-				back.children[0] = Expr::make_unique_unop(Expr::Kind::Deref,
-					Expr::make_unique_binop(Expr::Kind::Add,
-						Expr::make_unique_unop(Expr::Kind::Addrof,
-							Expr::make_unique_identifier(std::string(script.globalNames[ins.operand]))),
-						std::move(back.children[0])));
-			});
-
-			break;
-
-		case BC_OPCODE_GREF8:
-		case BC_OPCODE_GREF16:
-			// push &varname
-
-			result.push_back(Stmt::make_push(
-				Expr::make_unique_unop(Expr::Kind::Addrof,
-					Expr::make_unique_identifier(std::string(script.globalNames[ins.operand])))));
-
-			break;
-
-		case BC_OPCODE_GREFX8:
-		case BC_OPCODE_GREFX16:
-			// push a => push &varname + a
-
-			expect_push("refx", [&] (auto& back)
-			{
-				back.children[0] = Expr::make_unique_binop(Expr::Kind::Add,
-					Expr::make_unique_unop(Expr::Kind::Addrof,
-						Expr::make_unique_identifier(std::string(script.globalNames[ins.operand]))),
-					std::move(back.children[0]));
-			});
-
-			break;
-
-		case BC_OPCODE_NUMBER8:
-		case BC_OPCODE_NUMBER16:
-		case BC_OPCODE_NUMBER32:
-			// push imm
-
-			result.push_back(Stmt::make_push(
-				Expr::make_unique_intlit(ins.operand)));
-
-			break;
-
-		case BC_OPCODE_STRING8:
-		case BC_OPCODE_STRING16:
-		case BC_OPCODE_STRING32:
-			// push <string at imm>
-
-			result.push_back(Stmt::make_push(
-				Expr::make_unique_strlit({ script.get_cstr(ins.operand) })));
-
-			break;
-
-		case BC_OPCODE_DEREF:
-			// push a => push a, [a]
-
-			expect_push("deref", [&] (auto& back)
-			{
-				result.push_back(Stmt::make_push(
-					Expr::make_unique_unop(Expr::Kind::Deref,
-						Expr::make_unique_copy(*back.children[0]))));
-			});
-
-			break;
-
-		case BC_OPCODE_DISC:
-			// push a => a
-
-			expect_push("disc", [&] (auto& back)
-			{
-				back.kind = Stmt::Kind::Expr;
-			});
-
-			break;
-
-		case BC_OPCODE_STORE:
-			// push a, b => push [a] = b
-
-			binop("store", Expr::Kind::Assign);
-			break;
-
-		case BC_OPCODE_ADD:
-			// push a, b => push a + b
-
-			binop("add", Expr::Kind::Add);
-			break;
-
-		case BC_OPCODE_SUB:
-			// push a, b => push a - b
-
-			binop("sub", Expr::Kind::Sub);
-			break;
-
-		case BC_OPCODE_MUL:
-			// push a, b => push a * b
-
-			binop("mul", Expr::Kind::Mul);
-			break;
-
-		case BC_OPCODE_DIV:
-			// push a, b => push a / b
-
-			binop("div", Expr::Kind::Div);
-			break;
-
-		case BC_OPCODE_MOD:
-			// push a, b => push a % b
-
-			binop("mod", Expr::Kind::Mod);
-			break;
-
-		case BC_OPCODE_ORR:
-			// push a, b => push a | b
-
-			binop("orr", Expr::Kind::Or);
-			break;
-
-		case BC_OPCODE_AND:
-			// push a, b => push a & b
-
-			binop("and", Expr::Kind::And);
-			break;
-
-		case BC_OPCODE_XOR:
-			// push a, b => push a ^ b
-
-			binop("xor", Expr::Kind::Xor);
-			break;
-
-		case BC_OPCODE_LSL:
-			// push a, b => push a << b
-
-			binop("lsl", Expr::Kind::Lsl);
-			break;
-
-		case BC_OPCODE_LSR:
-			// push a, b => push a >> b
-
-			binop("lsr", Expr::Kind::Lsr);
-			break;
-
-		case BC_OPCODE_EQ:
-			// push a, b => push a == b
-
-			binop("eq", Expr::Kind::Eq);
-			break;
-
-		case BC_OPCODE_NE:
-			// push a, b => push a != b
-
-			binop("ne", Expr::Kind::Ne);
-			break;
-
-		case BC_OPCODE_LT:
-			// push a, b => push a < b
-
-			binop("lt", Expr::Kind::Lt);
-			break;
-
-		case BC_OPCODE_LE:
-			// push a, b => push a <= b
-
-			binop("le", Expr::Kind::Le);
-			break;
-
-		case BC_OPCODE_GT:
-			// push a, b => push a > b
-
-			binop("gt", Expr::Kind::Gt);
-			break;
-
-		case BC_OPCODE_GE:
-			// push a, b => push a >= b
-
-			binop("ge", Expr::Kind::Ge);
-			break;
-
-		case BC_OPCODE_EQSTR:
-			// push a, b => push a <=> b
-
-			binop("eqstr", Expr::Kind::EqStr);
-			break;
-
-		case BC_OPCODE_NESTR:
-			// push a, b => push a <!> b
-
-			binop("nestr", Expr::Kind::NeStr);
-			break;
-
-		case BC_OPCODE_NEG:
-			// push a => push -a
-
-			unop("neg", Expr::Kind::Neg);
-			break;
-
-		case BC_OPCODE_NOT:
-			// push a => push !a
-
-			unop("not", Expr::Kind::Not);
-			break;
-
-		case BC_OPCODE_MVN:
-			// push a => push ~a
-
-			unop("mvn", Expr::Kind::BitwiseNot);
-			break;
-
-		case BC_OPCODE_CALL:
-			// push ... => push func(...)
-
-			call(script.scenes[ins.operand].name.c_str(), script.scenes[ins.operand].argCnt);
-			break;
-
-		case BC_OPCODE_CALLEXT:
-			// push ... => push func(...)
-
-			call(script.get_cstr(ins.operand >> 8), ins.operand & 0xFF);
-			break;
+			return false;
+		}
+	}
 
-		case BC_OPCODE_RETURN:
-			// push a => return a
+	SOREN_STATS_ADD(Bytes, input.data.size());
 
-			expect_push("ret", [&] (auto& back)
-			{
-				back.kind = Stmt::Kind::Return;
-			});
+	CmbInfo cmb;
 
-			break;
+	{
+		SOREN_STATS_PHASE(Decode);
 
-		case BC_OPCODE_B:
-			// goto off
+		const auto game = options.autoGame
+			? get_input_game(input).game
+			: options.game;
 
-			result.push_back(Stmt::make_goto(ins.operand));
-			break;
+		if (!try_decode_cmb(input.data, game, cmb, diags) && cmb.scenes.empty())
+		{
+			report_diagnostics(filename, diags);
+			return false;
+		}
 
-		case BC_OPCODE_BN:
-			// push a => goto off if !a
+		if (options.symbols)
+		{
+			const auto fileHash = options.symbols->has_file_symbols()
+				? hash_symbol_file(input.data)
+				: SYMBOL_ANY_FILE;
 
-			expect_push("bn", [&] (auto& back)
-			{
-				auto expr = std::move(back.children[0]);
-				result.pop_back();
+			apply_symbols(*options.symbols, game, fileHash, cmb);
+		}
 
-				result.push_back(Stmt::make_goto_if(ins.operand,
-					Expr::make_unique_unop(Expr::Kind::Not, std::move(expr))));
-			});
+		if (options.sjis)
+			cmb.stringIndex.convert(cmb.stringPool.data(), sjis_to_utf8);
+	}
 
-			break;
+	if (writer)
+	{
+		SOREN_STATS_PHASE(Print);
+		writer->write_header(cmb);
+	}
 
-		case BC_OPCODE_BY:
-			// push a => goto off if a
+	for (auto& scene : cmb.scenes)
+	{
+		if (scene.rawScript.empty())
+			continue; // failed to decode
 
-			expect_push("by", [&] (auto& back)
-			{
-				auto expr = std::move(back.children[0]);
-				result.pop_back();
+		process_scene(cmb, scene, writer, cache, options, work, diags);
+	}
 
-				result.push_back(Stmt::make_goto_if(ins.operand, std::move(expr)));
-			});
+	if (writer)
+	{
+		SOREN_STATS_PHASE(Print);
+		writer->write_footer(cmb);
+	}
 
-			break;
+	report_diagnostics(filename, diags);
 
-		case BC_OPCODE_YIELD:
-			// yield
+	return diags.empty();
+}
 
-			result.push_back(Stmt::make_yield());
-			break;
 
-		case BC_OPCODE_40:
-			// nothing
+// Same as process_file, but only ever holds one scene (see decode/stream.h)
+// Scenes that would take the held memory past options.memoryCap are skipped and reported
+// Nothing is deduplicated, the cache would outgrow the memory cap
 
-			break;
+static
+bool process_file_streamed(const char* filename, ModelWriter* writer, const DumpOptions& options,
+	SceneWork& work, StreamReport& report)
+{
+	Diagnostics diags;
 
-		case BC_OPCODE_PRINTF:
-			// push ... => __printf(...)
+	work.scratch.meter.start_file();
 
-			call("__printf", ins.operand);
-			result.back().kind = Stmt::Kind::Expr;
+	CmbStream stream(options.window);
+	stream.set_symbols(options.symbols);
 
-			break;
+	if (options.sjis)
+		stream.set_string_converter(sjis_to_utf8);
 
-		case BC_OPCODE_DUP:
-			// push a => push a, a
+	{
+		SOREN_STATS_PHASE(Decode);
 
-			expect_push("dup", [&] (auto& back)
+		if (!stream.open(filename, options.autoGame, options.game, diags) && stream.info().scenes.empty())
+		{
+			if (stream.compressed())
 			{
-				result.push_back(Stmt::make_push(
-					Expr::make_unique_copy(*back.children[0])));
-			});
-
-			break;
-
-		case BC_OPCODE_RETN:
-			// return 0
-
-			result.push_back(Stmt::make_return(
-				Expr::make_unique_intlit(0)));
-
-			break;
-
-		case BC_OPCODE_RETY:
-			// return 1
-
-			result.push_back(Stmt::make_return(
-				Expr::make_unique_intlit(1)));
-
-			break;
-
-		case BC_OPCODE_ASSIGN:
-			// push a, b => [a] = b
-
-			binop("assign", Expr::Kind::Assign);
-			result.back().kind = Stmt::Kind::Expr;
-
-			break;
-
-		case BC_FAKEOP_LAND:
-			// push a, b => push a && b
-
-			binop("fake!land", Expr::Kind::LogicalAnd);
-			break;
-
-		case BC_FAKEOP_LORR:
-			// push a, b => push a || b
-
-			binop("fake!lorr", Expr::Kind::LogicalOr);
-			break;
-
-		default:
-			throw false; // FIXME: unsupported opcode
+				// the whole decompressed file would be in memory anyway
+				std::cerr << filename << ": note: compressed, not streamed" << std::endl;
+				return process_file(filename, nullptr, writer, nullptr, options, work);
+			}
 
-		} // switch (ins.opcode)
+			report_diagnostics(filename, diags);
+			return false;
+		}
 	}
 
-	return result;
-}
+	auto& cmb = stream.info();
 
-std::ostream& operator << (std::ostream& os, const Expr& expr)
-{
-	switch (expr.kind)
+	auto exceeds_cap = [&] (std::size_t bytes)
 	{
+		return options.memoryCap != 0 && bytes > options.memoryCap;
+	};
 
-	case Expr::Kind::IntLiteral:
-		return os << std::dec << expr.literal;
-
-	case Expr::Kind::StrLiteral:
-		return os << "\"" << expr.named << "\"";
-
-	case Expr::Kind::Named:
-		return os << expr.named;
-
-	case Expr::Kind::Deref:
-		return os << "[" << *expr.children[0] << "]";
+	if (exceeds_cap(stream.resident_bytes()))
+	{
+		diags.report(ErrorKind::MemoryCapExceeded, 0);
+		report_diagnostics(filename, diags);
 
-	case Expr::Kind::Addrof:
-		return os << "&" << *expr.children[0];
+		return false;
+	}
 
-	case Expr::Kind::Assign:
-		return os << "[" << *expr.children[0] << "] = " << *expr.children[1];
+	if (writer)
+	{
+		SOREN_STATS_PHASE(Print);
+		writer->write_header(cmb);
+	}
 
-	case Expr::Kind::Add:
-		return os << *expr.children[0] << " + " << *expr.children[1];
+	for (unsigned i = 0; i < cmb.scenes.size(); ++i)
+	{
+		// at most one instruction per byte
+		const auto estimate = stream.resident_bytes() + stream.script_size(i) * (1 + sizeof(BcIns));
 
-	case Expr::Kind::Sub:
-		return os << *expr.children[0] << " - " << *expr.children[1];
+		if (exceeds_cap(estimate))
+		{
+			diags.report(ErrorKind::MemoryCapExceeded, cmb.scenes[i].scriptOffset, i);
+			continue;
+		}
 
-	case Expr::Kind::Mul:
-		return os << *expr.children[0] << " * " << *expr.children[1];
+		{
+			SOREN_STATS_PHASE(Decode);
 
-	case Expr::Kind::Div:
-		return os << *expr.children[0] << " / " << *expr.children[1];
+			if (!stream.load_scene(i, diags))
+				continue;
+		}
 
-	case Expr::Kind::Mod:
-		return os << *expr.children[0] << " % " << *expr.children[1];
+		report.peakHeld = std::max(report.peakHeld, stream.resident_bytes());
 
-	case Expr::Kind::And:
-		return os << *expr.children[0] << " & " << *expr.children[1];
+		process_scene(cmb, cmb.scenes[i], writer, nullptr, options, work, diags);
 
-	case Expr::Kind::Or:
-		return os << *expr.children[0] << " | " << *expr.children[1];
+		stream.unload_scene(i);
+	}
 
-	case Expr::Kind::Xor:
-		return os << *expr.children[0] << " ^ " << *expr.children[1];
+	if (writer)
+	{
+		SOREN_STATS_PHASE(Print);
+		writer->write_footer(cmb);
+	}
 
-	case Expr::Kind::Lsl:
-		return os << *expr.children[0] << " << " << *expr.children[1];
+	report_diagnostics(filename, diags);
 
-	case Expr::Kind::Lsr:
-		return os << *expr.children[0] << " >> " << *expr.children[1];
+	return diags.empty();
+}
 
-	case Expr::Kind::Not:
-		return os << "!" << *expr.children[0];
+} // namespace soren
 
-	case Expr::Kind::Neg:
-		return os << "-" << *expr.children[0];
+int main(int argc, char** argv)
+{
+	if (argc > 1 && std::strcmp(argv[1], "stats-corpus") == 0)
+		return soren::run_stats_corpus(argc - 2, argv + 2);
 
-	case Expr::Kind::BitwiseNot:
-		return os << "~" << *expr.children[0];
+	if (argc > 1 && std::strcmp(argv[1], "bench") == 0)
+		return soren::run_bench(argc - 2, argv + 2);
 
-	case Expr::Kind::Eq:
-		return os << *expr.children[0] << " == " << *expr.children[1];
+	if (argc > 1 && std::strcmp(argv[1], "diff") == 0)
+		return soren::run_diff(argc - 2, argv + 2);
 
-	case Expr::Kind::Ne:
-		return os << *expr.children[0] << " != " << *expr.children[1];
+	if (argc > 1 && std::strcmp(argv[1], "daemon") == 0)
+		return soren::run_daemon(argc - 2, argv + 2);
 
-	case Expr::Kind::Lt:
-		return os << *expr.children[0] << " <? " << *expr.children[1];
+	if (argc > 1 && std::strcmp(argv[1], "compile") == 0)
+		return soren::run_compile(argc - 2, argv + 2);
 
-	case Expr::Kind::Le:
-		return os << *expr.children[0] << " <= " << *expr.children[1];
+	if (argc > 1 && std::strcmp(argv[1], "pack") == 0)
+		return soren::run_pack(argc - 2, argv + 2);
 
-	case Expr::Kind::Gt:
-		return os << *expr.children[0] << " >? " << *expr.children[1];
+	if (argc > 1 && std::strcmp(argv[1], "strings") == 0)
+		return soren::run_strings(argc - 2, argv + 2);
 
-	case Expr::Kind::Ge:
-		return os << *expr.children[0] << " >=? " << *expr.children[1];
+	if (argc > 1 && std::strcmp(argv[1], "symbols") == 0)
+		return soren::run_symbols(argc - 2, argv + 2);
 
-	case Expr::Kind::EqStr:
-		return os << *expr.children[0] << " <=> " << *expr.children[1];
+	soren::DumpOptions options;
+	const char* symbolsPath = nullptr;
+	std::size_t maxNodes = 0;
 
-	case Expr::Kind::NeStr:
-		return os << *expr.children[0] << " <!> " << *expr.children[1];
+	std::vector<const char*> filenames;
 
-	case Expr::Kind::LogicalAnd:
-		return os << *expr.children[0] << " && " << *expr.children[1];
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--format=text") == 0)
+			options.format = soren::OutputFormat::Text;
+		else if (std::strcmp(argv[i], "--format=json") == 0)
+			options.format = soren::OutputFormat::Json;
+		else if (std::strcmp(argv[i], "--format=binary") == 0)
+			options.format = soren::OutputFormat::Binary;
+		else if (std::strcmp(argv[i], "--flat-ast") == 0)
+			options.flatAst = true;
+		else if (std::strcmp(argv[i], "--structured") == 0)
+			options.structured = true;
+		else if (std::strcmp(argv[i], "--validate") == 0)
+			options.validate = true;
+		else if (std::strcmp(argv[i], "--check") == 0)
+			options.check = true;
+		else if (soren::parse_unsigned_option(argv[i], "--jobs=", options.jobs))
+			continue;
+		else if (std::strcmp(argv[i], "--no-dedup") == 0)
+			options.dedup = false;
+		else if (std::strcmp(argv[i], "--stats") == 0)
+			options.stats = true, options.statsFormat = soren::OutputFormat::Text;
+		else if (std::strcmp(argv[i], "--stats=json") == 0)
+			options.stats = true, options.statsFormat = soren::OutputFormat::Json;
+		else if (std::strcmp(argv[i], "--stream") == 0)
+			options.stream = true;
+		else if (soren::parse_size_option(argv[i], "--window=", options.window))
+			continue;
+		else if (soren::parse_size_option(argv[i], "--memory-cap=", options.memoryCap))
+			continue;
+		else if (soren::parse_size_option(argv[i], "--dedup-cap=", options.dedupCap))
+			continue;
+		else if (soren::parse_size_option(argv[i], "--in-flight=", options.inFlight))
+			continue;
+		else if (std::strcmp(argv[i], "--no-io-uring") == 0)
+			options.ioUring = false;
+		else if (soren::parse_unsigned_option(argv[i], "--max-instructions=", options.budget.instructions))
+			continue;
+		else if (soren::parse_unsigned_option(argv[i], "--max-slices=", options.budget.slices))
+			continue;
+		else if (soren::parse_size_option(argv[i], "--max-nodes=", maxNodes))
+			options.budget.nodes = maxNodes;
+		else if (soren::parse_unsigned_option(argv[i], "--max-depth=", options.budget.depth))
+			continue;
+		else if (soren::parse_unsigned_option(argv[i], "--scene-timeout=", options.budget.sceneMs))
+			continue;
+		else if (soren::parse_unsigned_option(argv[i], "--file-timeout=", options.budget.fileMs))
+			continue;
+		else if (std::strcmp(argv[i], "--sjis") == 0)
+			options.sjis = true;
+		else if (std::strncmp(argv[i], "--symbols=", 10) == 0)
+			symbolsPath = argv[i] + 10;
+		else if (std::strcmp(argv[i], "--detect") == 0)
+			options.detectOnly = true;
+		else if (std::strcmp(argv[i], "--game=auto") == 0)
+			options.autoGame = true;
+		else if (std::strcmp(argv[i], "--game=fe9") == 0)
+			options.autoGame = false, options.game = soren::GameKind::FE9;
+		else if (std::strcmp(argv[i], "--game=fe10") == 0)
+			options.autoGame = false, options.game = soren::GameKind::FE10;
+		else if (argv[i][0] == '-')
+			return 1;
+		else
+			filenames.push_back(argv[i]);
+	}
 
-	case Expr::Kind::LogicalOr:
-		return os << *expr.children[0] << " || " << *expr.children[1];
+	if (filenames.empty())
+		return 1;
 
-	case Expr::Kind::Func:
-		os << expr.named << "(";
+	soren::SymbolDb symbols;
 
-		for (unsigned i = 0; i < expr.children.size(); ++i)
+	if (symbolsPath != nullptr)
+	{
+		if (!symbols.open(symbolsPath))
 		{
-			if (i != 0)
-				os << ", ";
-
-			os << *expr.children[i];
+			std::cerr << symbolsPath << ": error: couldn't open symbol database" << std::endl;
+			return 2;
 		}
 
-		return os << ")";
-
-	default:
-		return os << "<expr>";
+		options.symbols = &symbols;
+	}
 
-	} // switch (expr.kind)
-}
+	// archives stand for all their members
+	std::vector<std::string> inputNames;
+	unsigned failedArchiveCnt = 0;
 
-std::ostream& operator << (std::ostream& os, const Stmt& stmt)
-{
-	switch (stmt.kind)
+	for (auto filename : filenames)
 	{
+		if (!soren::is_archive_path(filename))
+		{
+			inputNames.emplace_back(filename);
+			continue;
+		}
 
-	case Stmt::Kind::Invalid:
-		return os << "<invalid statement>" << std::endl;
-
-	case Stmt::Kind::Push:
-		return os << "push " << *stmt.children[0] << ";";
-
-	case Stmt::Kind::Expr:
-		return os << *stmt.children[0] << ";";
-
-	case Stmt::Kind::Return:
-		return os << "return " << *stmt.children[0] << ";";
-
-	case Stmt::Kind::Goto:
-		return os << "goto " << *stmt.children[0] << ";";
+		if (!soren::list_archive_members(filename, inputNames))
+		{
+			std::cerr << filename << ": error: couldn't open archive" << std::endl;
+			failedArchiveCnt++;
+		}
+	}
 
-	case Stmt::Kind::GotoIf:
-		return os << "goto " << *stmt.children[0] << " if " << *stmt.children[1] << ";";
+	filenames.clear();
 
-	case Stmt::Kind::Yield:
-		return os << "yield;";
+	for (auto& name : inputNames)
+		filenames.push_back(name.c_str());
 
-	} // switch (stmt.kind)
-}
+	if (options.check)
+	{
+		const unsigned jobs = options.jobs ? options.jobs : std::thread::hardware_concurrency();
+		const int result = soren::run_check(filenames, jobs, options.autoGame, options.game);
 
-} // namespace soren
+		return (failedArchiveCnt == 0) ? result : 2;
+	}
 
-#include <iomanip>
+	if (options.stream && (options.format != soren::OutputFormat::Text || options.window == 0))
+	{
+		// the other formats write string pool offsets, which streaming remaps
+		std::cerr << "--stream only supports text output" << std::endl;
+		return 1;
+	}
 
-int main(int argc, char** argv)
-{
-	if (argc < 2)
+	if (options.structured && (options.format == soren::OutputFormat::Binary || options.flatAst))
+	{
+		// neither the binary layout nor the flat ast have nested statements
+		std::cerr << "--structured only supports text and json output, without --flat-ast" << std::endl;
 		return 1;
+	}
 
-	std::string filename = argv[1];
+#if SOREN_ENABLE_STATS
+	if (options.stats)
+		soren::enable_stats();
+#endif
 
-	const auto data = soren::read_entire_file(filename.c_str());
-	const auto span = soren::Span<const soren::byte_type>(data);
-	const auto cmb = soren::decode_cmb(span, soren::GameKind::FE10);
+	auto writer = (options.validate || options.detectOnly)
+		? nullptr
+		: soren::make_model_writer(options.format, std::cout);
 
-	for (auto& gvar : cmb.globalNames)
-		std::cout << "VARIABLE " << gvar << ";" << std::endl;
+	// identical scenes across files are only rendered twice (see output/scene-cache.h)
+	// not when streaming, rendered bodies would be held for the whole run
+	const bool dedup = options.dedup && !options.stream && filenames.size() > 1 && writer && writer->has_scene_body();
+	soren::SceneCache cache(options.dedupCap);
 
-	if (cmb.globalNames.size() > 0)
-		std::cout << std::endl;
+	soren::StreamReport streamReport;
 
-	for (auto& scene : cmb.scenes)
-	{
-		std::cout << "EVENT " << scene.name << "(";
+	// files are read ahead of their turn (and in parallel) when there are several to dump
+	// archive members aren't read at all, they are views into the archive's mapping
+	std::vector<std::string> paths;
+	std::unique_ptr<soren::BulkReader> reader;
 
-		for (unsigned i = 0; i < scene.argCnt; ++i)
+	if (!options.detectOnly && !options.stream && filenames.size() > 1 && options.inFlight > 0)
+	{
+		for (auto filename : filenames)
 		{
-			if (i != 0)
-				std::cout << ", ";
-
-			std::cout << scene.varnames[i];
+			if (!soren::is_archive_member(filename))
+				paths.emplace_back(filename);
 		}
 
-		std::cout << ")";
+		if (!paths.empty())
+			reader = std::make_unique<soren::BulkReader>(paths, static_cast<unsigned>(std::min<std::size_t>(options.inFlight, 4096u)), options.ioUring);
+	}
 
-		if (scene.isGlobal)
-			std::cout << " global";
+	soren::SceneWork work;
+	unsigned failedCnt = 0;
 
-		std::cout << std::endl;
-		std::cout << "{" << std::endl;
+	work.scratch.meter.budget = options.budget;
 
-		const auto slices = soren::slice_script(scene.rawScript);
+	for (auto filename : filenames)
+	{
+		const bool member = soren::is_archive_member(filename);
 
-		const auto labels = [&] ()
-		{
-			soren::NameMap result;
+		// members are mapped whole already, streaming them would save nothing
+		const bool ok = options.detectOnly
+			? soren::detect_file(filename)
+			: (options.stream && !member)
+				? soren::process_file_streamed(filename, writer.get(), options, work, streamReport)
+				: soren::process_file(filename, member ? nullptr : reader.get(), writer.get(), dedup ? &cache : nullptr, options, work);
 
-			for (auto& slice : slices)
-			{
-				for (auto& ins : slice.second)
-				{
-					if (ins.is_jump() && !ins.is_jump_keep())
-						result.set(ins.operand, [&] () { std::string r("label_"); r.append(std::to_string(ins.operand)); return r; } ());
-				}
-			}
+		if (!ok)
+			failedCnt++;
+	}
 
-			return result;
-		} ();
+	if (options.validate)
+		std::cerr << (filenames.size() - failedCnt) << "/" << filenames.size() << " files valid" << std::endl;
 
-		for (auto& slice : slices)
-		{
-			if (slice.second.empty())
-				continue;
+	if (dedup)
+	{
+		std::cerr << "dedup: " << cache.hit_count() << "/" << cache.lookup_count() << " scenes reused ("
+			<< (cache.lookup_count() ? 100.0 * cache.hit_count() / cache.lookup_count() : 0.0) << "%), "
+			<< cache.size() << " unique (" << cache.bytes() << " bytes), ~" << (cache.saved_ns() / 1000000.0) << " ms saved";
 
-			if (slice.first != 0)
-				std::cout << std::endl;
+		if (cache.full_count() != 0)
+			std::cerr << ", " << cache.full_count() << " not kept past the cap";
 
-			labels.for_at(slice.first, [&] (auto& name)
-			{
-				std::cout << name << ":" << std::endl;
-			});
+		std::cerr << std::endl;
+	}
 
-			// TODO: check whether any bkn/bky jumps to another slice, because that would be bad
-			const auto fixedSlice = soren::get_bks_as_fake_logic(slice.second);
+	if (options.stream)
+	{
+		rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
 
-			for (auto& stmt : soren::make_statements(cmb, scene, fixedSlice))
-				std::cout << "  " << stmt << std::endl;
-		}
+		std::cerr << "stream: peak " << streamReport.peakHeld << " bytes held";
 
-		std::cout << "}" << std::endl << std::endl;
+		if (options.memoryCap != 0)
+			std::cerr << " (cap " << options.memoryCap << ")";
+
+		std::cerr << ", peak RSS " << usage.ru_maxrss << " KiB" << std::endl;
 	}
 
-	return 0;
+	if (options.stats)
+		soren::write_stats(std::cerr, options.statsFormat);
+
+	return (failedCnt == 0 && failedArchiveCnt == 0) ? 0 : 2;
 }
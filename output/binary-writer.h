@@ -0,0 +1,71 @@
+#ifndef SOREN_OUTPUT_BINARY_WRITER_INCLUDED
+#define SOREN_OUTPUT_BINARY_WRITER_INCLUDED
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "core/types.h"
+
+namespace soren {
+
+// Length-prefixed binary records: u8 tag, u32 payload length, payload
+// All integers are little endian, strings are u32 length followed by the raw bytes (no terminator)
+
+class BinaryWriter
+{
+public:
+	explicit BinaryWriter(std::ostream& os)
+		: mOs(os) {}
+
+	void u8(std::uint8_t value) { mBuffer.push_back(value); }
+
+	void u32(std::uint32_t value)
+	{
+		for (unsigned i = 0; i < 4; ++i)
+			mBuffer.push_back((value >> (8*i)) & 0xFF);
+	}
+
+	void i32(std::int32_t value) { u32(static_cast<std::uint32_t>(value)); }
+
+	void str(const char* data, std::size_t len)
+	{
+		u32(len);
+		mBuffer.insert(mBuffer.end(), data, data + len);
+	}
+
+	void str(const std::string& value) { str(value.data(), value.size()); }
+
+	void raw(const void* data, std::size_t len)
+	{
+		auto bytes = static_cast<const byte_type*>(data);
+		mBuffer.insert(mBuffer.end(), bytes, bytes + len);
+	}
+
+	// writes the buffered payload as a record and resets the buffer (keeping its storage)
+	void flush_record(std::uint8_t tag)
+	{
+		const std::uint32_t len = mBuffer.size();
+		const byte_type head[5] { tag, byte_type(len), byte_type(len >> 8), byte_type(len >> 16), byte_type(len >> 24) };
+
+		mOs.write(reinterpret_cast<const char*>(head), sizeof(head));
+		mOs.write(reinterpret_cast<const char*>(mBuffer.data()), mBuffer.size());
+
+		mBuffer.clear();
+	}
+
+	// writes bytes directly, bypassing the record buffer (for file magic)
+	void write_direct(const void* data, std::size_t len)
+	{
+		mOs.write(static_cast<const char*>(data), len);
+	}
+
+private:
+	std::ostream& mOs;
+	std::vector<byte_type> mBuffer;
+};
+
+} // namespace soren
+
+#endif // SOREN_OUTPUT_BINARY_WRITER_INCLUDED
@@ -0,0 +1,117 @@
+#ifndef SOREN_OUTPUT_JSON_WRITER_INCLUDED
+#define SOREN_OUTPUT_JSON_WRITER_INCLUDED
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace soren {
+
+// Streaming JSON writer: values go straight to the stream, only the nesting state is kept
+// Strings are written as raw bytes (escaping only what JSON requires), they are not transcoded
+
+class JsonWriter
+{
+public:
+	explicit JsonWriter(std::ostream& os)
+		: mOs(os) {}
+
+	void begin_object() { prefix(); mOs << '{'; mFirst.push_back(true); }
+	void end_object() { mFirst.pop_back(); mOs << '}'; }
+
+	void begin_array() { prefix(); mOs << '['; mFirst.push_back(true); }
+	void end_array() { mFirst.pop_back(); mOs << ']'; }
+
+	void key(const char* name)
+	{
+		prefix();
+		write_escaped(name, std::char_traits<char>::length(name));
+		mOs << ':';
+		mAfterKey = true;
+	}
+
+	void value(std::int64_t number) { prefix(); mOs << std::dec << number; }
+	void value(std::int32_t number) { value(static_cast<std::int64_t>(number)); }
+	void value(std::uint32_t number) { value(static_cast<std::int64_t>(number)); }
+	void value(std::uint64_t number) { prefix(); mOs << std::dec << number; }
+	void value(double number) { prefix(); mOs << number; }
+	void value(bool boolean) { prefix(); mOs << (boolean ? "true" : "false"); }
+
+	void value(const char* str) { value(str, std::char_traits<char>::length(str)); }
+	void value(const std::string& str) { value(str.data(), str.size()); }
+	void value(const char* str, std::size_t len) { prefix(); write_escaped(str, len); }
+
+	void null() { prefix(); mOs << "null"; }
+
+	template<typename Type>
+	void field(const char* name, Type&& val) { key(name); value(std::forward<Type>(val)); }
+
+	// to be called between top-level documents (ndjson)
+	void newline() { mOs << '\n'; }
+
+private:
+	void prefix()
+	{
+		if (mAfterKey)
+		{
+			mAfterKey = false;
+			return;
+		}
+
+		if (mFirst.empty())
+			return;
+
+		if (!mFirst.back())
+			mOs << ',';
+
+		mFirst.back() = false;
+	}
+
+	void write_escaped(const char* str, std::size_t len)
+	{
+		static const char hex[] = "0123456789abcdef";
+
+		mOs << '"';
+
+		const char* run = str;
+
+		for (std::size_t i = 0; i < len; ++i)
+		{
+			const unsigned char chr = str[i];
+
+			if (chr >= 0x20 && chr != '"' && chr != '\\')
+				continue;
+
+			mOs.write(run, (str + i) - run);
+			run = str + i + 1;
+
+			switch (chr)
+			{
+
+			case '"':  mOs << "\\\""; break;
+			case '\\': mOs << "\\\\"; break;
+			case '\n': mOs << "\\n"; break;
+			case '\r': mOs << "\\r"; break;
+			case '\t': mOs << "\\t"; break;
+
+			default:
+				mOs << "\\u00" << hex[chr >> 4] << hex[chr & 0xF];
+				break;
+
+			} // switch (chr)
+		}
+
+		mOs.write(run, (str + len) - run);
+		mOs << '"';
+	}
+
+private:
+	std::ostream& mOs;
+	std::vector<bool> mFirst;
+	bool mAfterKey { false };
+};
+
+} // namespace soren
+
+#endif // SOREN_OUTPUT_JSON_WRITER_INCLUDED
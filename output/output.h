@@ -0,0 +1,61 @@
+#ifndef SOREN_OUTPUT_INCLUDED
+#define SOREN_OUTPUT_INCLUDED
+
+#include <ostream>
+#include <memory>
+
+#include "core/soren-cmb.h"
+#include "decompile/decompile.h"
+
+namespace soren {
+
+enum class OutputFormat
+{
+	Text,   // the human-oriented dump
+	Json,   // one JSON document, streamed scene by scene
+	Binary, // length-prefixed records, see write-binary.cpp for the layout
+};
+
+// Model writers are fed one scene at a time, so that nothing but the current scene needs to be kept around
+
+struct ModelWriter
+{
+	virtual ~ModelWriter() = default;
+
+	virtual void write_header(const CmbInfo& cmb) = 0;
+	virtual void write_scene(const CmbInfo& cmb, const SceneInfo& scene, const SceneAst& ast) = 0;
+
+	// writers that can work off the linearized ast directly override this
+	virtual void write_flat_scene(const CmbInfo& cmb, const SceneInfo& scene, const FlatSceneAst& ast)
+	{
+		write_scene(cmb, scene, make_scene_ast(ast));
+	}
+
+	virtual void write_footer(const CmbInfo& cmb) = 0;
+
+	// Writers whose scene output is a head naming the scene, followed by a body that only depends on the scene's content,
+	// implement these so that identical scenes can share one rendered body (see output/scene-cache.h)
+	// write_scene must then be the same as write_scene_head followed by write_scene_body
+
+	virtual bool has_scene_body() const { return false; }
+
+	virtual void write_scene_head(const CmbInfo&, const SceneInfo&) {}
+	virtual void write_scene_body(std::ostream&, const CmbInfo&, const SceneInfo&, const SceneAst&) {}
+	virtual void write_flat_scene_body(std::ostream&, const CmbInfo&, const SceneInfo&, const FlatSceneAst&) {}
+
+	// writes an already rendered body
+	virtual void write_raw(const std::string&) {}
+};
+
+std::unique_ptr<ModelWriter> make_text_writer(std::ostream& os);
+std::unique_ptr<ModelWriter> make_json_writer(std::ostream& os);
+std::unique_ptr<ModelWriter> make_binary_writer(std::ostream& os);
+
+std::unique_ptr<ModelWriter> make_model_writer(OutputFormat format, std::ostream& os);
+
+// Writes the --stats report (see core/stats.h), as a table unless format is Json
+void write_stats(std::ostream& os, OutputFormat format);
+
+} // namespace soren
+
+#endif // SOREN_OUTPUT_INCLUDED
@@ -0,0 +1,137 @@
+#include "output/scene-cache.h"
+
+namespace soren {
+
+static inline
+void append_u32(std::string& result, std::uint32_t value)
+{
+	result.push_back(static_cast<char>(value));
+	result.push_back(static_cast<char>(value >> 8));
+	result.push_back(static_cast<char>(value >> 16));
+	result.push_back(static_cast<char>(value >> 24));
+}
+
+static inline
+void append_str(std::string& result, const char* str, std::uint32_t offset)
+{
+	// bad offsets are kept as is, so that they never share a key with a good scene
+	if (str == nullptr)
+	{
+		result.push_back('\1');
+		append_u32(result, offset);
+		return;
+	}
+
+	result.push_back('\0');
+	result.append(str);
+	result.push_back('\0');
+}
+
+void make_scene_content_key(const CmbInfo& cmb, const SceneInfo& scene, std::string& result)
+{
+	result.clear();
+
+	append_u32(result, scene.argCnt);
+	append_u32(result, scene.varnames.size());
+	append_u32(result, cmb.globalNames.size());
+	append_u32(result, scene.rawScript.size());
+
+	// names may come from a symbol database, they aren't always made from indices
+	for (auto& name : scene.varnames)
+		append_str(result, name.c_str(), 0);
+
+	for (auto& ins : scene.rawScript)
+	{
+		// locations end up in labels
+		result.push_back(static_cast<char>(ins.opcode));
+		append_u32(result, ins.location);
+
+		switch (ins.opcode)
+		{
+
+		case BC_OPCODE_STRING8:
+		case BC_OPCODE_STRING16:
+		case BC_OPCODE_STRING32:
+			append_str(result, cmb.try_get_cstr(ins.operand), ins.operand);
+			break;
+
+		case BC_OPCODE_CALLEXT:
+			append_str(result, cmb.try_get_cstr(static_cast<std::uint32_t>(ins.operand) >> 8), ins.operand);
+			append_u32(result, ins.operand & 0xFF);
+			break;
+
+		case BC_OPCODE_CALL:
+			if (static_cast<std::uint32_t>(ins.operand) < cmb.scenes.size())
+			{
+				auto& callee = cmb.scenes[ins.operand];
+
+				append_str(result, callee.name.c_str(), ins.operand);
+				append_u32(result, callee.argCnt);
+			}
+			else
+			{
+				append_u32(result, ins.operand);
+			}
+
+			break;
+
+		case BC_OPCODE_GVAL8: case BC_OPCODE_GVAL16:
+		case BC_OPCODE_GVALX8: case BC_OPCODE_GVALX16:
+		case BC_OPCODE_GVALY8: case BC_OPCODE_GVALY16:
+		case BC_OPCODE_GREF8: case BC_OPCODE_GREF16:
+		case BC_OPCODE_GREFX8: case BC_OPCODE_GREFX16:
+		case BC_OPCODE_GREFY8: case BC_OPCODE_GREFY16:
+			append_u32(result, ins.operand);
+
+			if (static_cast<std::uint32_t>(ins.operand) < cmb.globalNames.size())
+				append_str(result, cmb.globalNames[ins.operand].c_str(), ins.operand);
+
+			break;
+
+		default:
+			append_u32(result, ins.operand);
+			break;
+
+		} // switch (ins.opcode)
+	}
+}
+
+const std::string* SceneCache::find(const std::string& key)
+{
+	mLookupCnt++;
+
+	auto it = mEntries.find(key);
+
+	if (it == mEntries.end() || !it->second.timed)
+		return nullptr;
+
+	mHitCnt++;
+	mSavedNs += it->second.renderNs;
+
+	return &it->second.body;
+}
+
+void SceneCache::insert(const std::string& key, std::string&& body, std::uint64_t renderNs)
+{
+	auto it = mEntries.find(key);
+
+	if (it != mEntries.end())
+	{
+		it->second.renderNs = renderNs;
+		it->second.timed = true;
+		return;
+	}
+
+	const std::size_t bytes = key.size() + body.size();
+
+	if (mBytes + bytes > mCapacity)
+	{
+		mFullCnt++;
+		return;
+	}
+
+	mEntries.emplace(key, Entry { std::move(body), renderNs, false });
+	mBytes += bytes;
+}
+
+} // namespace soren
@@ -0,0 +1,64 @@
+#ifndef SOREN_OUTPUT_SCENE_CACHE_INCLUDED
+#define SOREN_OUTPUT_SCENE_CACHE_INCLUDED
+
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+
+#include "core/soren-cmb.h"
+
+namespace soren {
+
+// Rendered scene bodies shared between identical scenes of a batch run
+// Scenes are keyed by everything their rendered body depends on: instructions (with string operands replaced
+// by the strings themselves), called scene names, the variable layout and the names of variables and globals used;
+// but not their own name or index
+
+void make_scene_content_key(const CmbInfo& cmb, const SceneInfo& scene, std::string& result);
+
+// A body is rendered twice before it is reused, its first render time is mostly the cold start of the scene's kind
+// Once the bodies (and keys) held reach capacity bytes, further ones aren't kept
+
+class SceneCache
+{
+public:
+	explicit SceneCache(std::size_t capacity)
+		: mCapacity(capacity) {}
+
+	// nullptr if not cached, or not rendered twice yet
+	const std::string* find(const std::string& key);
+
+	// renderNs is how long decompiling and rendering body took, what reusing it saves (the second time)
+	void insert(const std::string& key, std::string&& body, std::uint64_t renderNs);
+
+	std::uint64_t lookup_count() const { return mLookupCnt; }
+	std::uint64_t hit_count() const { return mHitCnt; }
+	std::uint64_t full_count() const { return mFullCnt; } // bodies not kept for lack of room
+
+	std::uint64_t saved_ns() const { return mSavedNs; } // second render time of every reused body, summed
+
+	std::size_t size() const { return mEntries.size(); }
+	std::size_t bytes() const { return mBytes; }
+
+private:
+	struct Entry
+	{
+		std::string body;
+		std::uint64_t renderNs;
+		bool timed; // rendered twice
+	};
+
+	std::unordered_map<std::string, Entry> mEntries;
+
+	std::size_t mCapacity;
+	std::size_t mBytes { 0u };
+
+	std::uint64_t mLookupCnt { 0u };
+	std::uint64_t mHitCnt { 0u };
+	std::uint64_t mFullCnt { 0u };
+	std::uint64_t mSavedNs { 0u };
+};
+
+} // namespace soren
+
+#endif // SOREN_OUTPUT_SCENE_CACHE_INCLUDED
@@ -0,0 +1,152 @@
+#include "output/output.h"
+#include "output/binary-writer.h"
+
+#include "ast/traverse.h"
+
+namespace soren {
+
+/*
+ * Stream layout:
+ *
+ * "SORB" u32 version
+ * record...
+ *
+ * record := u8 tag, u32 len, payload[len]
+ *
+ * 'C' (cmb):   u32 stringPoolSize, u32 globalCnt, str globalNames[globalCnt]
+ * 'S' (scene): u32 idx, u32 kind, str name, u32 argCnt, u8 isGlobal,
+ *              u32 paramCnt, i32 parameters[paramCnt],
+ *              u32 varCnt, str varnames[varCnt],
+ *              u32 insCnt, { u32 location, u8 opcode, i32 operand }[insCnt],
+ *              u32 sliceCnt, slice[sliceCnt]
+ * 'E' (end):   empty
+ *
+ * slice := u32 offset, str label (empty if none), u32 stmtCnt, stmt[stmtCnt]
+ * stmt  := u8 kind, u32 childCnt, expr[childCnt]
+ * expr  := u8 kind, i32 literal, str named, u32 childCnt, expr[childCnt]
+ *
+ * kinds are the numeric values of Stmt::Kind and Expr::Kind
+ */
+
+enum : std::uint32_t
+{
+	BINARY_FORMAT_VERSION = 1,
+};
+
+enum : std::uint8_t
+{
+	BINARY_TAG_CMB   = 'C',
+	BINARY_TAG_SCENE = 'S',
+	BINARY_TAG_END   = 'E',
+};
+
+static
+void write_expr(BinaryWriter& bin, const Expr& expr)
+{
+	// children follow their parent, as a preorder walk has it
+	for_each_preorder(TreeNodes {}, expr, [&] (const Expr& node)
+	{
+		bin.u8(static_cast<std::uint8_t>(node.kind));
+		bin.i32(node.literal);
+		bin.str(node.named);
+		bin.u32(node.children.size());
+	});
+}
+
+static
+void write_stmt(BinaryWriter& bin, const Stmt& stmt)
+{
+	bin.u8(static_cast<std::uint8_t>(stmt.kind));
+	bin.u32(stmt.children.size());
+
+	for (auto& child : stmt.children)
+		write_expr(bin, *child);
+}
+
+struct BinaryModelWriter : public ModelWriter
+{
+	explicit BinaryModelWriter(std::ostream& os)
+		: os(os), bin(os) {}
+
+	void write_header(const CmbInfo& cmb) override
+	{
+		const byte_type magic[8] { 'S', 'O', 'R', 'B',
+			byte_type(BINARY_FORMAT_VERSION), byte_type(BINARY_FORMAT_VERSION >> 8),
+			byte_type(BINARY_FORMAT_VERSION >> 16), byte_type(BINARY_FORMAT_VERSION >> 24) };
+
+		bin.write_direct(magic, sizeof(magic));
+
+		bin.u32(cmb.stringPool.size());
+		bin.u32(cmb.globalNames.size());
+
+		for (auto& gvar : cmb.globalNames)
+			bin.str(gvar);
+
+		bin.flush_record(BINARY_TAG_CMB);
+	}
+
+	void write_scene(const CmbInfo&, const SceneInfo& scene, const SceneAst& ast) override
+	{
+		bin.u32(scene.idx);
+		bin.u32(scene.kind);
+		bin.str(scene.name);
+		bin.u32(scene.argCnt);
+		bin.u8(scene.isGlobal ? 1 : 0);
+
+		bin.u32(scene.parameters.size());
+
+		for (auto param : scene.parameters)
+			bin.i32(param);
+
+		bin.u32(scene.varnames.size());
+
+		for (auto& varname : scene.varnames)
+			bin.str(varname);
+
+		bin.u32(scene.rawScript.size());
+
+		for (auto& ins : scene.rawScript)
+		{
+			bin.u32(ins.location);
+			bin.u8(ins.opcode);
+			bin.i32(ins.operand);
+		}
+
+		bin.u32(ast.slices.size());
+
+		for (auto& slice : ast.slices)
+		{
+			bin.u32(slice.first);
+
+			auto labelIt = ast.labels.get(slice.first);
+
+			if (labelIt != ast.labels.end())
+				bin.str(labelIt->second);
+			else
+				bin.str(nullptr, 0);
+
+			bin.u32(slice.second.size());
+
+			for (auto& stmt : slice.second)
+				write_stmt(bin, stmt);
+		}
+
+		bin.flush_record(BINARY_TAG_SCENE);
+		os.flush();
+	}
+
+	void write_footer(const CmbInfo&) override
+	{
+		bin.flush_record(BINARY_TAG_END);
+	}
+
+	std::ostream& os;
+	BinaryWriter bin;
+};
+
+std::unique_ptr<ModelWriter> make_binary_writer(std::ostream& os)
+{
+	return std::make_unique<BinaryModelWriter>(os);
+}
+
+} // namespace soren
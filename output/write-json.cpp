@@ -0,0 +1,249 @@
+#include "output/output.h"
+#include "output/json-writer.h"
+
+#include "ast/print.h"
+#include "ast/traverse.h"
+
+namespace soren {
+
+/*
+ * Document layout:
+ *
+ * {
+ *   "format": "soren", "version": 1,
+ *   "globals": [ "gvar_0", ... ],
+ *   "stringPoolSize": n,
+ *   "scenes": [
+ *     {
+ *       "idx": 0, "kind": 0, "name": "...", "argCnt": 0, "isGlobal": false,
+ *       "parameters": [ ... ], "varnames": [ ... ],
+ *       "script": [ { "loc": 0, "opcode": 7, "op": "ref", "operand": 0 }, ... ],
+ *       "unreachable": [ [ begin, end ], ... ], (script-relative byte ranges no path decodes)
+ *       "slices": [ { "offset": 0, "label": "label_0" | null, "statements": [ stmt, ... ] }, ... ]
+ *     }, ...
+ *   ]
+ * }
+ *
+ * stmt := { "kind": "push", "label": "..." (if any), "children": [ expr, ... ], "body": [ stmt, ... ] (if/else/while only) }
+ * expr := { "kind": "add", "value": 1 (int only), "name": "..." (str/named/func only), "children": [ expr, ... ] }
+ */
+
+// Writes expressions as a walk_expr visitor (see ast/traverse.h)
+struct JsonExprWriter
+{
+	bool enter(const Expr& expr, const Expr*, unsigned)
+	{
+		json.begin_object();
+		json.field("kind", get_kind_name(expr.kind));
+
+		switch (expr.kind)
+		{
+
+		case Expr::Kind::IntLiteral:
+			json.field("value", expr.literal);
+			break;
+
+		case Expr::Kind::StrLiteral:
+		case Expr::Kind::Named:
+		case Expr::Kind::Func:
+			json.field("name", expr.named);
+			break;
+
+		default:
+			break;
+
+		} // switch (expr.kind)
+
+		if (!expr.children.empty())
+		{
+			json.key("children");
+			json.begin_array();
+		}
+
+		return true;
+	}
+
+	void between(const Expr&, unsigned) {}
+
+	void leave(const Expr& expr, const Expr*, unsigned)
+	{
+		if (!expr.children.empty())
+			json.end_array();
+
+		json.end_object();
+	}
+
+	JsonWriter& json;
+};
+
+static
+void write_expr(JsonWriter& json, const Expr& expr)
+{
+	JsonExprWriter writer { json };
+	walk_expr(expr, writer);
+}
+
+static
+void write_stmt(JsonWriter& json, const Stmt& stmt)
+{
+	json.begin_object();
+	json.field("kind", get_kind_name(stmt.kind));
+
+	if (!stmt.label.empty())
+		json.field("label", stmt.label);
+
+	json.key("children");
+	json.begin_array();
+
+	for (auto& child : stmt.children)
+		write_expr(json, *child);
+
+	json.end_array();
+
+	if (stmt.childAst)
+	{
+		json.key("body");
+		json.begin_array();
+
+		for (auto& inner : *stmt.childAst)
+			write_stmt(json, inner);
+
+		json.end_array();
+	}
+
+	json.end_object();
+}
+
+struct JsonModelWriter : public ModelWriter
+{
+	explicit JsonModelWriter(std::ostream& os)
+		: os(os), json(os) {}
+
+	void write_header(const CmbInfo& cmb) override
+	{
+		json.begin_object();
+
+		json.field("format", "soren");
+		json.field("version", 1);
+
+		json.key("globals");
+		json.begin_array();
+
+		for (auto& gvar : cmb.globalNames)
+			json.value(gvar);
+
+		json.end_array();
+
+		json.field("stringPoolSize", static_cast<std::uint64_t>(cmb.stringPool.size()));
+
+		json.key("scenes");
+		json.begin_array();
+	}
+
+	void write_scene(const CmbInfo&, const SceneInfo& scene, const SceneAst& ast) override
+	{
+		json.begin_object();
+
+		json.field("idx", scene.idx);
+		json.field("kind", scene.kind);
+		json.field("name", scene.name);
+		json.field("argCnt", scene.argCnt);
+		json.field("isGlobal", scene.isGlobal);
+
+		json.key("parameters");
+		json.begin_array();
+
+		for (auto param : scene.parameters)
+			json.value(param);
+
+		json.end_array();
+
+		json.key("varnames");
+		json.begin_array();
+
+		for (auto& varname : scene.varnames)
+			json.value(varname);
+
+		json.end_array();
+
+		json.key("script");
+		json.begin_array();
+
+		for (auto& ins : scene.rawScript)
+		{
+			json.begin_object();
+			json.field("loc", ins.location);
+			json.field("opcode", static_cast<std::uint32_t>(ins.opcode));
+			json.field("op", ins.info().mnemonic);
+			json.field("operand", ins.operand);
+			json.end_object();
+		}
+
+		json.end_array();
+
+		json.key("unreachable");
+		json.begin_array();
+
+		for (auto& range : scene.unreachable)
+		{
+			json.begin_array();
+			json.value(range.begin);
+			json.value(range.end);
+			json.end_array();
+		}
+
+		json.end_array();
+
+		json.key("slices");
+		json.begin_array();
+
+		for (auto& slice : ast.slices)
+		{
+			json.begin_object();
+			json.field("offset", slice.first);
+
+			json.key("label");
+
+			auto labelIt = ast.labels.get(slice.first);
+
+			if (labelIt != ast.labels.end())
+				json.value(labelIt->second);
+			else
+				json.null();
+
+			json.key("statements");
+			json.begin_array();
+
+			for (auto& stmt : slice.second)
+				write_stmt(json, stmt);
+
+			json.end_array();
+
+			json.end_object();
+		}
+
+		json.end_array();
+
+		json.end_object();
+
+		// keep downstream readers fed while we work on the next scene
+		os.flush();
+	}
+
+	void write_footer(const CmbInfo&) override
+	{
+		json.end_array(); // scenes
+		json.end_object();
+		json.newline();
+	}
+
+	std::ostream& os;
+	JsonWriter json;
+};
+
+std::unique_ptr<ModelWriter> make_json_writer(std::ostream& os)
+{
+	return std::make_unique<JsonModelWriter>(os);
+}
+
+} // namespace soren
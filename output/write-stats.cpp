@@ -0,0 +1,110 @@
+#include "output/output.h"
+#include "output/json-writer.h"
+
+#include "core/stats.h"
+
+#include <iomanip>
+
+namespace soren {
+
+#if SOREN_ENABLE_STATS
+
+static
+double to_ms(std::uint64_t ns)
+{
+	return ns / 1000000.0;
+}
+
+void write_stats(std::ostream& os, OutputFormat format)
+{
+	if (format == OutputFormat::Json)
+	{
+		JsonWriter json(os);
+
+		json.begin_object();
+
+		json.key("phases");
+		json.begin_array();
+
+		for (int i = 0; i < static_cast<int>(StatsPhase::Count); ++i)
+		{
+			const auto phase = static_cast<StatsPhase>(i);
+			const auto totals = get_phase_totals(phase);
+
+			json.begin_object();
+			json.field("phase", get_phase_name(phase));
+			json.field("calls", totals.calls);
+			json.field("wallNs", totals.wallNs);
+			json.field("cpuNs", totals.cpuNs);
+			json.field("allocations", totals.allocations);
+			json.field("allocatedBytes", totals.allocatedBytes);
+			json.end_object();
+		}
+
+		json.end_array();
+
+		json.key("counters");
+		json.begin_object();
+
+		for (int i = 0; i < static_cast<int>(StatsCounter::Count); ++i)
+		{
+			const auto counter = static_cast<StatsCounter>(i);
+			json.field(get_counter_name(counter), get_counter_total(counter));
+		}
+
+		json.end_object();
+
+		json.end_object();
+		json.newline();
+
+		return;
+	}
+
+	// human-oriented table
+
+	const auto flags = os.flags();
+
+	os << std::left << std::setw(12) << "phase"
+		<< std::right << std::setw(10) << "calls"
+		<< std::setw(12) << "wall (ms)"
+		<< std::setw(12) << "cpu (ms)"
+		<< std::setw(10) << "allocs"
+		<< std::setw(14) << "alloc bytes" << std::endl;
+
+	os << std::fixed << std::setprecision(3);
+
+	for (int i = 0; i < static_cast<int>(StatsPhase::Count); ++i)
+	{
+		const auto phase = static_cast<StatsPhase>(i);
+		const auto totals = get_phase_totals(phase);
+
+		os << std::left << std::setw(12) << get_phase_name(phase)
+			<< std::right << std::setw(10) << totals.calls
+			<< std::setw(12) << to_ms(totals.wallNs)
+			<< std::setw(12) << to_ms(totals.cpuNs)
+			<< std::setw(10) << totals.allocations
+			<< std::setw(14) << totals.allocatedBytes << std::endl;
+	}
+
+	os << std::endl;
+
+	for (int i = 0; i < static_cast<int>(StatsCounter::Count); ++i)
+	{
+		const auto counter = static_cast<StatsCounter>(i);
+		os << std::left << std::setw(12) << get_counter_name(counter) << std::right << std::setw(10) << get_counter_total(counter) << std::endl;
+	}
+
+	os.flags(flags);
+}
+
+#else // SOREN_ENABLE_STATS
+
+void write_stats(std::ostream& os, OutputFormat format)
+{
+	(void) format;
+	os << "stats were disabled at build time (SOREN_STATS=OFF)" << std::endl;
+}
+
+#endif // SOREN_ENABLE_STATS
+
+} // namespace soren
@@ -0,0 +1,128 @@
+#include "output/output.h"
+
+#include "ast/print.h"
+
+namespace soren {
+
+struct TextWriter : public ModelWriter
+{
+	explicit TextWriter(std::ostream& os)
+		: os(os) {}
+
+	void write_header(const CmbInfo& cmb) override
+	{
+		for (auto& gvar : cmb.globalNames)
+			os << "VARIABLE " << gvar << ";" << std::endl;
+
+		if (cmb.globalNames.size() > 0)
+			os << std::endl;
+	}
+
+	bool has_scene_body() const override { return true; }
+
+	void write_scene_head(const CmbInfo&, const SceneInfo& scene) override
+	{
+		os << "EVENT " << scene.name << "(";
+
+		for (unsigned i = 0; i < scene.argCnt; ++i)
+		{
+			if (i != 0)
+				os << ", ";
+
+			os << scene.varnames[i];
+		}
+
+		os << ")";
+
+		if (scene.isGlobal)
+			os << " global";
+
+		os << std::endl;
+		os << "{" << std::endl;
+	}
+
+	void write_scene_body(std::ostream& os, const CmbInfo&, const SceneInfo&, const SceneAst& ast) override
+	{
+		for (auto& slice : ast.slices)
+		{
+			if (slice.first != 0)
+				os << std::endl;
+
+			ast.labels.for_at(slice.first, [&] (auto& name)
+			{
+				os << name << ":" << std::endl;
+			});
+
+			print_block(os, slice.second, 1);
+		}
+
+		os << "}" << std::endl << std::endl;
+	}
+
+	void write_flat_scene_body(std::ostream& os, const CmbInfo&, const SceneInfo&, const FlatSceneAst& ast) override
+	{
+		for (auto& slice : ast.slices)
+		{
+			if (slice.offset != 0)
+				os << std::endl;
+
+			if (slice.label != SymbolTable::bad_id)
+				os << ast.ast.symbols.c_str(slice.label) << ":" << std::endl;
+
+			for (std::uint32_t i = 0; i < slice.stmtCnt; ++i)
+			{
+				os << "  ";
+				print_flat_stmt(os, ast.ast, slice.firstStmt + i) << std::endl;
+			}
+		}
+
+		os << "}" << std::endl << std::endl;
+	}
+
+	void write_scene(const CmbInfo& cmb, const SceneInfo& scene, const SceneAst& ast) override
+	{
+		write_scene_head(cmb, scene);
+		write_scene_body(os, cmb, scene, ast);
+	}
+
+	void write_flat_scene(const CmbInfo& cmb, const SceneInfo& scene, const FlatSceneAst& ast) override
+	{
+		write_scene_head(cmb, scene);
+		write_flat_scene_body(os, cmb, scene, ast);
+	}
+
+	void write_raw(const std::string& str) override
+	{
+		os.write(str.data(), str.size());
+	}
+
+	void write_footer(const CmbInfo&) override {}
+
+	std::ostream& os;
+};
+
+std::unique_ptr<ModelWriter> make_text_writer(std::ostream& os)
+{
+	return std::make_unique<TextWriter>(os);
+}
+
+std::unique_ptr<ModelWriter> make_model_writer(OutputFormat format, std::ostream& os)
+{
+	switch (format)
+	{
+
+	case OutputFormat::Text:
+		return make_text_writer(os);
+
+	case OutputFormat::Json:
+		return make_json_writer(os);
+
+	case OutputFormat::Binary:
+		return make_binary_writer(os);
+
+	} // switch (format)
+
+	return nullptr;
+}
+
+} // namespace soren